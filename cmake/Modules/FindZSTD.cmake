@@ -0,0 +1,38 @@
+# - Find zstd
+# Find the native zstd includes and library
+# This module defines
+#  ZSTD_INCLUDE_DIR, where to find zstd.h
+#  ZSTD_LIBRARIES, the libraries needed to use zstd
+#  ZSTD_FOUND, If false, do not try to use zstd
+
+find_library(ZSTD_LIBRARY
+  NAMES zstd
+  PATHS /lib /usr/lib /usr/local/lib
+  )
+
+find_path(ZSTD_INCLUDE_DIR zstd.h
+  /usr/local/include
+  /usr/include
+  )
+
+if (ZSTD_LIBRARY AND ZSTD_INCLUDE_DIR)
+  set(ZSTD_LIBRARIES ${ZSTD_LIBRARY})
+  set(ZSTD_FOUND "YES")
+else ()
+  set(ZSTD_FOUND "NO")
+endif ()
+
+if (ZSTD_FOUND)
+  if (NOT ZSTD_FIND_QUIETLY)
+    message(STATUS "Found zstd: ${ZSTD_LIBRARIES}")
+  endif ()
+else ()
+  if (ZSTD_FIND_REQUIRED)
+    message(FATAL_ERROR "Could not find zstd library")
+  endif ()
+endif ()
+
+mark_as_advanced(
+  ZSTD_LIBRARY
+  ZSTD_INCLUDE_DIR
+  )
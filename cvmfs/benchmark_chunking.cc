@@ -0,0 +1,188 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * Measures the throughput of the chunk detectors in GB/s and the fraction of
+ * data that is deduplicated after a few small insertions and deletions.  The
+ * input is the same as in T_ChunkDetectors.ChunkDetectorDedupSlow: random
+ * data in 1 MB buffers, 512 kB minimal, 1 MB average and 2 MB maximal chunk
+ * size, and 20 edits.
+ *
+ * Usage: benchmark_chunking [size in MB]
+ */
+
+#include "cvmfs_config.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <vector>
+
+#include "file_processing/char_buffer.h"
+#include "file_processing/chunk_detector.h"
+#include "prng.h"
+#include "util.h"
+
+using namespace std;  // NOLINT
+
+namespace {
+
+const size_t kBufferSize = 1024 * 1024;
+const size_t kBase = 512000;
+const unsigned kNumEdits = 20;
+
+upload::ChunkDetector *CreateDetector(const unsigned type) {
+  if (type == 0)
+    return new upload::Xor32Detector(kBase, kBase * 2, kBase * 4);
+  return new upload::GearDetector(kBase, kBase * 2, kBase * 4);
+}
+
+
+vector<upload::CharBuffer *> MakeBuffers(const vector<unsigned char> &data) {
+  vector<upload::CharBuffer *> buffers;
+  size_t i = 0;
+  while (i < data.size()) {
+    upload::CharBuffer *buffer = new upload::CharBuffer(kBufferSize);
+    buffer->SetUsedBytes(std::min(data.size() - i, kBufferSize));
+    buffer->SetBaseOffset(i);
+    memcpy(buffer->ptr(), &data[i], buffer->used_bytes());
+    buffers.push_back(buffer);
+    i += buffer->used_bytes();
+  }
+  return buffers;
+}
+
+
+void FreeBuffers(vector<upload::CharBuffer *> *buffers) {
+  for (unsigned i = 0; i < buffers->size(); ++i)
+    delete (*buffers)[i];
+  buffers->clear();
+}
+
+
+/**
+ * Runs a new detector of the given type over the data and returns the cut
+ * marks.  seconds, if not NULL, receives the time spent in the detector.
+ */
+vector<off_t> FindCutMarks(const unsigned type,
+                           const vector<unsigned char> &data,
+                           double *seconds)
+{
+  vector<upload::CharBuffer *> buffers = MakeBuffers(data);
+  upload::ChunkDetector *detector = CreateDetector(type);
+  vector<off_t> cut_marks;
+  off_t next_cut;
+  StopWatch stop_watch;
+  stop_watch.Start();
+  for (unsigned i = 0; i < buffers.size(); ++i) {
+    while ((next_cut = detector->FindNextCutMark(buffers[i])) != 0)
+      cut_marks.push_back(next_cut);
+  }
+  stop_watch.Stop();
+  if (seconds != NULL)
+    *seconds = stop_watch.GetTime();
+  delete detector;
+  FreeBuffers(&buffers);
+  return cut_marks;
+}
+
+
+/**
+ * 64bit FNV-1a hashes of the chunk contents defined by the cut marks
+ */
+vector<uint64_t> HashChunks(const vector<unsigned char> &data,
+                            const vector<off_t> &cut_marks,
+                            vector<size_t> *sizes)
+{
+  vector<uint64_t> hashes;
+  sizes->clear();
+  size_t begin = 0;
+  for (unsigned i = 0; i <= cut_marks.size(); ++i) {
+    const size_t end = (i < cut_marks.size()) ? cut_marks[i] : data.size();
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t j = begin; j < end; ++j) {
+      hash ^= data[j];
+      hash *= 1099511628211ULL;
+    }
+    hashes.push_back(hash);
+    sizes->push_back(end - begin);
+    begin = end;
+  }
+  return hashes;
+}
+
+
+/**
+ * Fraction of the bytes in modified that are found in unchanged chunks of
+ * original.
+ */
+double DedupRatio(const vector<unsigned char> &original,
+                  const vector<off_t> &original_cuts,
+                  const vector<unsigned char> &modified,
+                  const vector<off_t> &modified_cuts)
+{
+  vector<size_t> sizes;
+  const vector<uint64_t> original_hashes =
+    HashChunks(original, original_cuts, &sizes);
+  const set<uint64_t> known(original_hashes.begin(), original_hashes.end());
+  const vector<uint64_t> modified_hashes =
+    HashChunks(modified, modified_cuts, &sizes);
+  size_t deduplicated = 0;
+  for (unsigned i = 0; i < modified_hashes.size(); ++i) {
+    if (known.find(modified_hashes[i]) != known.end())
+      deduplicated += sizes[i];
+  }
+  return static_cast<double>(deduplicated) / modified.size();
+}
+
+}  // anonymous namespace
+
+
+int main(int argc, char **argv) {
+  const unsigned size_mb = (argc > 1) ? atoi(argv[1]) : 100;
+  if (size_mb == 0) {
+    fprintf(stderr, "Usage: %s [size in MB]\n", argv[0]);
+    return 1;
+  }
+
+  Prng prng;
+  prng.InitSeed(42);
+  vector<unsigned char> original(size_mb * 1024 * 1024);
+  for (size_t i = 0; i < original.size(); ++i)
+    original[i] = static_cast<unsigned char>(prng.Next(256));
+
+  // Insert or delete a few bytes at random positions
+  vector<unsigned char> modified(original);
+  prng.InitSeed(7);
+  for (unsigned i = 0; i < kNumEdits; ++i) {
+    const size_t pos = prng.Next(modified.size() - 100);
+    const size_t len = 1 + prng.Next(100);
+    if (i % 2) {
+      modified.erase(modified.begin() + pos, modified.begin() + pos + len);
+    } else {
+      vector<unsigned char> insert(len);
+      for (unsigned j = 0; j < len; ++j)
+        insert[j] = static_cast<unsigned char>(prng.Next(256));
+      modified.insert(modified.begin() + pos, insert.begin(), insert.end());
+    }
+  }
+
+  // Same names as for CVMFS_CHUNKING_ALGORITHM
+  const char *names[] = {"xor32", "gear"};
+  for (unsigned d = 0; d < 2; ++d) {
+    double seconds;
+    const vector<off_t> original_cuts = FindCutMarks(d, original, &seconds);
+    const vector<off_t> modified_cuts = FindCutMarks(d, modified, NULL);
+    const double ratio =
+      DedupRatio(original, original_cuts, modified, modified_cuts);
+    printf("%-5s: %.2f GB/s, %u chunks, average size %.0f kB, "
+           "%.1f%% deduplicated after %u edits\n",
+           names[d], original.size() / seconds / 1e9,
+           static_cast<unsigned>(original_cuts.size() + 1),
+           original.size() / 1024.0 / (original_cuts.size() + 1),
+           ratio * 100.0, kNumEdits);
+  }
+
+  return 0;
+}
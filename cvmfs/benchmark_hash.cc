@@ -0,0 +1,114 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * Measures the throughput of the content hash algorithms in MB/s, for a
+ * single stream (shash::HashMem) and for many independent streams hashed at
+ * once (shash::HashMemMulti).  SHA-1 is measured with every subset of the
+ * detected CPU features, so that the scalar, the multi-buffer SIMD, and the
+ * SHA extension code paths can be compared on the same machine.
+ *
+ * Usage: benchmark_hash [size in MB] [number of streams]
+ */
+
+#include "cvmfs_config.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "hash.h"
+#include "hash_accel.h"
+#include "prng.h"
+#include "util.h"
+
+using namespace std;  // NOLINT
+
+static vector<unsigned> FeatureSets(const unsigned detected) {
+  vector<unsigned> result;
+  result.push_back(0);
+  const unsigned candidates[] = {shash::accel::kCpuSse2,
+                                 shash::accel::kCpuAvx2,
+                                 shash::accel::kCpuSha, detected};
+  for (unsigned i = 0; i < 4; ++i) {
+    if (((candidates[i] & detected) == candidates[i]) &&
+        (candidates[i] != result.back()))
+    {
+      result.push_back(candidates[i]);
+    }
+  }
+  return result;
+}
+
+
+static double MegabytesPerSecond(const uint64_t bytes, const double seconds) {
+  return static_cast<double>(bytes) / seconds / (1024 * 1024);
+}
+
+
+int main(int argc, char **argv) {
+  const unsigned size_mb = (argc > 1) ? atoi(argv[1]) : 256;
+  const unsigned num_streams = (argc > 2) ? atoi(argv[2]) : 16;
+  if ((size_mb == 0) || (num_streams == 0)) {
+    fprintf(stderr, "Usage: %s [size in MB] [number of streams]\n", argv[0]);
+    return 1;
+  }
+  const unsigned size = size_mb * 1024 * 1024;
+  const unsigned stream_size = size / num_streams;
+
+  Prng prng;
+  prng.InitSeed(42);
+  vector<unsigned char> buffer(size);
+  for (unsigned i = 0; i < size; ++i)
+    buffer[i] = prng.Next(256);
+
+  vector<const unsigned char *> stream_buffers;
+  vector<unsigned> stream_sizes;
+  for (unsigned i = 0; i < num_streams; ++i) {
+    stream_buffers.push_back(&buffer[i * stream_size]);
+    stream_sizes.push_back(stream_size);
+  }
+
+  const unsigned detected = shash::accel::DetectCpuFeatures();
+  printf("CPU features: %s\n",
+         shash::accel::DescribeCpuFeatures(detected).c_str());
+  printf("%u MB, %u streams of %u kB\n",
+         size_mb, num_streams, stream_size / 1024);
+
+  // Same names as for CVMFS_HASH_ALGORITHM
+  const char *names[] = {"md5", "sha1", "rmd160"};
+  const vector<unsigned> feature_sets = FeatureSets(detected);
+  for (unsigned a = 0; a < shash::kAny; ++a) {
+    const shash::Algorithms algorithm = static_cast<shash::Algorithms>(a);
+    for (unsigned f = 0; f < feature_sets.size(); ++f) {
+      // Only SHA-1 has accelerated code paths
+      if ((algorithm != shash::kSha1) && (feature_sets[f] != detected))
+        continue;
+      shash::accel::SetCpuFeatures(feature_sets[f]);
+
+      StopWatch stop_watch;
+      stop_watch.Start();
+      shash::Any digest(algorithm);
+      shash::HashMem(&buffer[0], size, &digest);
+      stop_watch.Stop();
+      const double single = MegabytesPerSecond(size, stop_watch.GetTime());
+
+      vector<shash::Any> digests(num_streams, shash::Any(algorithm));
+      stop_watch.Reset();
+      stop_watch.Start();
+      shash::HashMemMulti(&stream_buffers[0], &stream_sizes[0], num_streams,
+                          &digests[0]);
+      stop_watch.Stop();
+      const double multi = MegabytesPerSecond(
+        static_cast<uint64_t>(stream_size) * num_streams,
+        stop_watch.GetTime());
+
+      printf("%-6s [%-12s]: %7.0f MB/s single stream, %7.0f MB/s multi\n",
+             names[a],
+             shash::accel::DescribeCpuFeatures(feature_sets[f]).c_str(),
+             single, multi);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,61 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "bloom_filter.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#include "smalloc.h"
+
+using namespace std;  // NOLINT
+
+
+BloomFilter::BloomFilter(
+  const uint64_t expected_size,
+  const unsigned bits_per_element,
+  const unsigned num_probes)
+  : num_probes_(num_probes)
+  , num_elements_(0)
+{
+  assert(num_probes_ > 0);
+  // Round up to full words, at least one word
+  const uint64_t num_words =
+    (expected_size * bits_per_element + 63) / 64 + 1;
+  num_bits_ = num_words * 64;
+  bitmap_ = static_cast<uint64_t *>(smalloc(num_words * sizeof(uint64_t)));
+  memset(bitmap_, 0, num_words * sizeof(uint64_t));
+}
+
+
+BloomFilter::~BloomFilter() {
+  free(bitmap_);
+}
+
+
+void BloomFilter::Add(const uint64_t h1, const uint64_t h2) {
+  // An odd step avoids collapsing all probes onto the same bit
+  const uint64_t delta = h2 | 1;
+  uint64_t h = h1;
+  for (unsigned i = 0; i < num_probes_; ++i) {
+    const uint64_t bit = h % num_bits_;
+    bitmap_[bit / 64] |= (uint64_t(1) << (bit % 64));
+    h += delta;
+  }
+  num_elements_++;
+}
+
+
+bool BloomFilter::MayContain(const uint64_t h1, const uint64_t h2) const {
+  const uint64_t delta = h2 | 1;
+  uint64_t h = h1;
+  for (unsigned i = 0; i < num_probes_; ++i) {
+    const uint64_t bit = h % num_bits_;
+    if ((bitmap_[bit / 64] & (uint64_t(1) << (bit % 64))) == 0)
+      return false;
+    h += delta;
+  }
+  return true;
+}
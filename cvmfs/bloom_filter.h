@@ -0,0 +1,46 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_BLOOM_FILTER_H_
+#define CVMFS_BLOOM_FILTER_H_
+
+#include <stdint.h>
+
+#include "util.h"
+
+/**
+ * Fixed-size Bloom filter for keys that are already uniformly distributed,
+ * such as MD5 path hashes.  The k probe positions are derived from two 64bit
+ * halves of the key by double hashing (h1 + i*h2), so no further hashing is
+ * required.  With 10 bits per element and 7 probes, the false positive rate
+ * is below 1%.
+ *
+ * The filter is not thread-safe for insertion; once filled, concurrent
+ * lookups are fine.
+ */
+class BloomFilter : SingleCopy {
+ public:
+  static const unsigned kDefaultBitsPerElement = 10;
+  static const unsigned kDefaultNumProbes = 7;
+
+  BloomFilter(const uint64_t expected_size,
+              const unsigned bits_per_element = kDefaultBitsPerElement,
+              const unsigned num_probes = kDefaultNumProbes);
+  ~BloomFilter();
+
+  void Add(const uint64_t h1, const uint64_t h2);
+  bool MayContain(const uint64_t h1, const uint64_t h2) const;
+
+  uint64_t num_bits() const { return num_bits_; }
+  uint64_t num_elements() const { return num_elements_; }
+  uint64_t bytes_allocated() const { return num_bits_ / 8; }
+
+ private:
+  uint64_t *bitmap_;
+  uint64_t num_bits_;
+  unsigned num_probes_;
+  uint64_t num_elements_;
+};
+
+#endif  // CVMFS_BLOOM_FILTER_H_
@@ -61,6 +61,7 @@
 #include "signature.h"
 #include "smalloc.h"
 #include "util.h"
+#include "util_concurrency.h"
 
 #ifndef NFS_SUPER_MAGIC
 #define NFS_SUPER_MAGIC 0x6969
@@ -469,6 +470,127 @@ static bool CommitFromMem(const shash::Any &id, const unsigned char *buffer,
 }
 
 
+/**
+ * Makes room for a download of size bytes.
+ * \return Zero if the file fits into the cache, -ENOSPC otherwise
+ */
+static int PrepareSpace(const uint64_t size) {
+  if (size > quota::GetMaxFileSize()) {
+    LogCvmfs(kLogCache, kLogDebug, "file too big for lru cache (%"PRIu64" "
+                                   "requested but only %"PRIu64" bytes free)",
+             size, quota::GetMaxFileSize());
+    return -ENOSPC;
+  }
+
+  // Opportunitically clean up cache for large files
+  if ((size >= kBigFile) && (quota::GetCapacity() > 0)) {
+    assert(quota::GetCapacity() >= size);
+    quota::Cleanup(quota::GetCapacity() - size);
+  }
+  return 0;
+}
+
+
+/**
+ * Checks and commits a finished download into the file f of a transaction
+ * started with StartTransaction().  Closes f and aborts the transaction on
+ * failure.
+ *
+ * \return Read-only file descriptor for the committed file or a negative error
+ *         code
+ */
+static int CommitDownload(const shash::Any &checksum,
+                          const uint64_t size,
+                          const string &cvmfs_path,
+                          const bool volatile_content,
+                          const string &url,
+                          const download::Failures error_code,
+                          const string &final_path,
+                          const string &temp_path,
+                          FILE *f)
+{
+  int fd_return;
+  int result = -EIO;
+
+  if (error_code == download::kFailOk) {
+    LogCvmfs(kLogCache, kLogDebug, "finished downloading of %s", url.c_str());
+
+    // Check decompressed size (a cross check just in case)
+    platform_stat64 stat_info;
+    stat_info.st_size = -1;
+    // allow size to be zero if alien cache, because hadoop-fuse-dfs
+    //   returns size zero for a while
+    if ((platform_fstat(fileno(f), &stat_info) != 0) ||
+         ((stat_info.st_size != (int64_t)size) &&
+         (!alien_cache_ || (stat_info.st_size != 0))))
+    {
+      LogCvmfs(kLogCache, kLogDebug | kLogSyslogErr,
+               "size check failure for %s, expected %lu, got %ld",
+               url.c_str(), size, stat_info.st_size);
+      if (!CopyPath2Path(temp_path, *cache_path_ + "/quarantaine/" +
+                         checksum.ToString()))
+      {
+        LogCvmfs(kLogCache, kLogDebug | kLogSyslogErr,
+                 "failed to move %s to quarantaine", temp_path.c_str());
+      }
+      goto commit_abort;
+    }
+
+    LogCvmfs(kLogCache, kLogDebug, "trying to commit %s", final_path.c_str());
+    fclose(f);
+    f = NULL;
+    fd_return = ::open(temp_path.c_str(), O_RDONLY);
+    if (fd_return < 0) {
+      result = -errno;
+      goto commit_abort;
+    }
+    result = cache::CommitTransaction(final_path, temp_path, cvmfs_path,
+                                      checksum, volatile_content, size);
+    if (result == 0) {
+      platform_disable_kcache(fd_return);
+      return fd_return;
+    }
+    close(fd_return);
+    return result;
+  }
+
+ commit_abort:
+  if (f)
+    fclose(f);
+  AbortTransaction(temp_path);
+  return result;
+}
+
+
+/**
+ * Hands the result of a download to the threads that waited for it and
+ * removes the download queue of checksum.
+ */
+static void NotifyWaiting(const shash::Any &checksum,
+                          const string &cvmfs_path,
+                          const int result,
+                          const download::Failures error_code,
+                          vector<int> *pipes_waiting)
+{
+  LogCvmfs(kLogCache, kLogDebug, "finalizing download of %s",
+           cvmfs_path.c_str());
+  if (result < 0) {
+    LogCvmfs(kLogCache, kLogDebug | kLogSyslogErr,
+             "failed to fetch %s (hash: %s, error %d)", cvmfs_path.c_str(),
+             checksum.ToString().c_str(), error_code);
+  }
+
+  pthread_mutex_lock(&lock_queues_download_);
+  for (unsigned i = 0, s = pipes_waiting->size(); i < s; ++i) {
+    int fd_dup = (result >= 0) ? dup(result) : result;
+    WritePipe((*pipes_waiting)[i], &fd_dup, sizeof(int));
+  }
+  pipes_waiting->clear();
+  queues_download_->erase(checksum);
+  pthread_mutex_unlock(&lock_queues_download_);
+}
+
+
 /**
  * Returns a read-only file descriptor for a specific catalog entry, which could
  * be a complete file in the CAS as well as a chunk of a file.
@@ -508,18 +630,9 @@ static int Fetch(const shash::Any &checksum,
   if (cache_mode_ == kCacheReadOnly)
     return -EROFS;
 
-  if (size > quota::GetMaxFileSize()) {
-    LogCvmfs(kLogCache, kLogDebug, "file too big for lru cache (%"PRIu64" "
-                                   "requested but only %"PRIu64" bytes free)",
-             size, quota::GetMaxFileSize());
-    return -ENOSPC;
-  }
-
-  // Opportunitically clean up cache for large files
-  if ((size >= kBigFile) && (quota::GetCapacity() > 0)) {
-    assert(quota::GetCapacity() >= size);
-    quota::Cleanup(quota::GetCapacity() - size);
-  }
+  retval = PrepareSpace(size);
+  if (retval != 0)
+    return retval;
 
   // Initialize TLS
   ThreadLocalStorage *tls = static_cast<ThreadLocalStorage *>(
@@ -573,105 +686,37 @@ static int Fetch(const shash::Any &checksum,
   const string url = "/data" + checksum.MakePathWithSuffix(1, 2, hash_suffix);
   string final_path;
   string temp_path;
-  int fd;  // Used to write the downloaded file
-  FILE *f = NULL;
-  int result = -EIO;
+  FILE *f;
+  int result;
+  tls->download_job.error_code = download::kFailOther;
 
-  fd = StartTransaction(checksum, &final_path, &temp_path);
+  const int fd = StartTransaction(checksum, &final_path, &temp_path);
   if (fd < 0) {
     LogCvmfs(kLogCache, kLogDebug, "could not start transaction on %s",
              final_path.c_str());
     result = fd;
-    goto fetch_finalize;
-  }
-
-  f = fdopen(fd, "w");
-  if (!f) {
+  } else if ((f = fdopen(fd, "w")) == NULL) {
     result = -errno;
     LogCvmfs(kLogCache, kLogDebug, "could not fdopen %s", final_path.c_str());
-    goto fetch_finalize;
-  }
-
-  LogCvmfs(kLogCache, kLogDebug, "miss: %s %s",
-           cvmfs_path.c_str(), url.c_str());
-
-  tls->download_job.url = &url;
-  tls->download_job.destination_file = f;
-  tls->download_job.expected_hash = &checksum;
-  tls->download_job.extra_info = &cvmfs_path;
-  download_manager->Fetch(&tls->download_job);
-
-  if (tls->download_job.error_code == download::kFailOk) {
-    LogCvmfs(kLogCache, kLogDebug, "finished downloading of %s", url.c_str());
-
-    // Check decompressed size (a cross check just in case)
-    platform_stat64 stat_info;
-    stat_info.st_size = -1;
-    // allow size to be zero if alien cache, because hadoop-fuse-dfs
-    //   returns size zero for a while
-    if ((platform_fstat(fileno(f), &stat_info) != 0) ||
-         ((stat_info.st_size != (int64_t)size) &&
-         (!alien_cache_ || (stat_info.st_size != 0))))
-    {
-      LogCvmfs(kLogCache, kLogDebug | kLogSyslogErr,
-               "size check failure for %s, expected %lu, got %ld",
-               url.c_str(), size, stat_info.st_size);
-      if (!CopyPath2Path(temp_path, *cache_path_ + "/quarantaine/" +
-                         checksum.ToString()))
-      {
-        LogCvmfs(kLogCache, kLogDebug | kLogSyslogErr,
-                 "failed to move %s to quarantaine", temp_path.c_str());
-      }
-      result = -EIO;
-      goto fetch_finalize;
-    }
-
-    LogCvmfs(kLogCache, kLogDebug, "trying to commit %s", final_path.c_str());
-    fclose(f);
-    fd = -1;
-    fd_return = ::open(temp_path.c_str(), O_RDONLY);
-    if (fd_return < 0) {
-      result = -errno;
-      goto fetch_finalize;
-    }
-    result = cache::CommitTransaction(final_path, temp_path, cvmfs_path,
-                                      checksum, volatile_content, size);
-    if (result == 0) {
-      platform_disable_kcache(fd_return);
-      result = fd_return;
-    } else {
-      close(fd_return);
-    }
-  }
-
- fetch_finalize:
-  // Cleanup
-  LogCvmfs(kLogCache, kLogDebug, "finalizing download of %s",
-           cvmfs_path.c_str());
-  if (result < 0) {
-    LogCvmfs(kLogCache, kLogDebug | kLogSyslogErr,
-             "failed to fetch %s (hash: %s, error %d)", cvmfs_path.c_str(),
-             checksum.ToString().c_str(), tls->download_job.error_code);
-  }
-  if (fd >= 0) {
-    if (f) {
-      fclose(f);
-    } else {
-      close(fd);
-    }
+    close(fd);
     AbortTransaction(temp_path);
+  } else {
+    LogCvmfs(kLogCache, kLogDebug, "miss: %s %s",
+             cvmfs_path.c_str(), url.c_str());
+
+    tls->download_job.url = &url;
+    tls->download_job.destination_file = f;
+    tls->download_job.expected_hash = &checksum;
+    tls->download_job.extra_info = &cvmfs_path;
+    download_manager->Fetch(&tls->download_job);
+    result = CommitDownload(checksum, size, cvmfs_path, volatile_content, url,
+                            tls->download_job.error_code, final_path,
+                            temp_path, f);
   }
 
   // Signal the waiting threads and remove the queue
-  pthread_mutex_lock(&lock_queues_download_);
-  for (unsigned i = 0, s = tls->other_pipes_waiting.size(); i < s; ++i) {
-    int fd_dup = (result >= 0) ? dup(result) : result;
-    WritePipe(tls->other_pipes_waiting[i], &fd_dup, sizeof(int));
-  }
-  tls->other_pipes_waiting.clear();
-  queues_download_->erase(checksum);
-  pthread_mutex_unlock(&lock_queues_download_);
-
+  NotifyWaiting(checksum, cvmfs_path, result, tls->download_job.error_code,
+                &tls->other_pipes_waiting);
   return result;
 }
 
@@ -722,6 +767,320 @@ int FetchChunk(const FileChunk &chunk,
 }
 
 
+/**
+ * A chunk download submitted by FetchChunks() or PrefetchChunks().  Other
+ * threads that request the same chunk meanwhile wait on pipes_waiting, as they
+ * do for Fetch().
+ */
+struct ChunkDownload {
+  explicit ChunkDownload(const FileChunk &c) : chunk(c), idx(0), file(NULL) { }
+  FileChunk chunk;
+  unsigned idx;
+  string url;
+  string final_path;
+  string temp_path;
+  FILE *file;
+  vector<int> pipes_waiting;
+  download::JobInfo job;
+};
+
+
+/**
+ * Registers the download of a chunk that is not in the cache in the download
+ * queues and opens its transaction.
+ *
+ * @param[out] in_flight  Set if another thread already downloads the chunk
+ * @param[out] fd         File descriptor of a cache hit or a negative error
+ *                        code, if no download is started
+ * \return The prepared download or NULL
+ */
+static ChunkDownload *StartChunkDownload(const FileChunk &chunk,
+                                         const string *cvmfs_path,
+                                         bool *in_flight,
+                                         int *fd)
+{
+  const shash::Any &checksum = chunk.content_hash();
+  *in_flight = false;
+  *fd = cache::Open(checksum);
+  if (*fd >= 0) {
+    LogCvmfs(kLogCache, kLogDebug, "hit: %s", cvmfs_path->c_str());
+    if (cache_mode_ == kCacheReadWrite)
+      quota::Touch(checksum);
+    return NULL;
+  }
+  if (cache_mode_ == kCacheReadOnly) {
+    *fd = -EROFS;
+    return NULL;
+  }
+  *fd = PrepareSpace(chunk.size());
+  if (*fd != 0)
+    return NULL;
+
+  pthread_mutex_lock(&lock_queues_download_);
+  if (queues_download_->find(checksum) != queues_download_->end()) {
+    pthread_mutex_unlock(&lock_queues_download_);
+    *in_flight = true;
+    *fd = -EIO;
+    return NULL;
+  }
+  // Check again in the cache (race condition)
+  *fd = cache::Open(checksum);
+  if (*fd >= 0) {
+    pthread_mutex_unlock(&lock_queues_download_);
+    quota::Touch(checksum);
+    return NULL;
+  }
+  ChunkDownload *download = new ChunkDownload(chunk);
+  (*queues_download_)[checksum] = &download->pipes_waiting;
+  pthread_mutex_unlock(&lock_queues_download_);
+
+  atomic_inc64(&num_download_);
+  download->url =
+    "/data" + checksum.MakePathWithSuffix(1, 2, shash::kSuffixPartial);
+  *fd = StartTransaction(checksum, &download->final_path,
+                         &download->temp_path);
+  if (*fd >= 0) {
+    download->file = fdopen(*fd, "w");
+    if (download->file == NULL) {
+      const int save_errno = errno;
+      close(*fd);
+      AbortTransaction(download->temp_path);
+      *fd = -save_errno;
+    }
+  }
+  if (*fd < 0) {
+    LogCvmfs(kLogCache, kLogDebug, "could not start transaction on %s",
+             download->final_path.c_str());
+    NotifyWaiting(checksum, *cvmfs_path, *fd, download::kFailOther,
+                  &download->pipes_waiting);
+    delete download;
+    return NULL;
+  }
+
+  LogCvmfs(kLogCache, kLogDebug, "miss: %s %s",
+           cvmfs_path->c_str(), download->url.c_str());
+  download::JobInfo *job = &download->job;
+  job->url = &download->url;
+  job->compressed = true;
+  job->probe_hosts = true;
+  job->destination = download::kDestinationFile;
+  job->destination_file = download->file;
+  job->expected_hash = &download->chunk.content_hash();
+  job->extra_info = cvmfs_path;
+  return download;
+}
+
+
+/**
+ * Commits a finished chunk download and wakes up the threads waiting for it.
+ * \return Read-only file descriptor for the chunk or a negative error code
+ */
+static int FinishChunkDownload(ChunkDownload *download,
+                               const string &cvmfs_path,
+                               const bool volatile_content)
+{
+  const shash::Any &checksum = download->chunk.content_hash();
+  const int result =
+    CommitDownload(checksum, download->chunk.size(), cvmfs_path,
+                   volatile_content, download->url, download->job.error_code,
+                   download->final_path, download->temp_path, download->file);
+  NotifyWaiting(checksum, cvmfs_path, result, download->job.error_code,
+                &download->pipes_waiting);
+  return result;
+}
+
+
+/**
+ * Counts the outstanding downloads of a FetchChunks() call.  Runs in the I/O
+ * threads of the download manager.
+ */
+class ChunkDownloadCounter {
+ public:
+  void OnFetched(download::JobInfo * const &info) { pending.Decrement(); }
+  SynchronizingCounter<int32_t> pending;
+};
+
+
+/**
+ * Fetches a list of file chunks at once.  Cache hits are served directly.  The
+ * missing chunks are submitted as a single batch to the download manager, so
+ * that they are in flight at the same time without extra threads.  Concurrent
+ * requests for the same chunk are still de-duplicated by the download queues;
+ * chunks that are downloaded by another thread are waited for at the end.
+ *
+ * @param[in] chunks      Demanded file chunks
+ * @param[in] cvmfs_path  Path of the full file as seen in cvmfs
+ * @param[out] fds        Read-only file descriptor for every chunk or a
+ *                        negative error code
+ * \return Number of chunks that could not be fetched
+ */
+unsigned FetchChunks(const FileChunkList &chunks,
+                     const string &cvmfs_path,
+                     const bool volatile_content,
+                     download::DownloadManager *download_manager,
+                     vector<int> *fds)
+{
+  CallGuard call_guard;
+  const unsigned num_chunks = chunks.size();
+  fds->assign(num_chunks, -EIO);
+
+  vector<ChunkDownload *> downloads;
+  vector<unsigned> other_downloads;
+  for (unsigned i = 0; i < num_chunks; ++i) {
+    bool in_flight;
+    ChunkDownload *download =
+      StartChunkDownload(*chunks.AtPtr(i), &cvmfs_path, &in_flight,
+                         &(*fds)[i]);
+    if (in_flight)
+      other_downloads.push_back(i);
+    if (download == NULL)
+      continue;
+    download->idx = i;
+    downloads.push_back(download);
+  }
+
+  if (!downloads.empty()) {
+    LogCvmfs(kLogCache, kLogDebug, "fetching %u out of %u chunks of %s",
+             static_cast<unsigned>(downloads.size()), num_chunks,
+             cvmfs_path.c_str());
+    ChunkDownloadCounter counter;
+    vector<download::JobInfo *> jobs;
+    for (unsigned i = 0; i < downloads.size(); ++i) {
+      jobs.push_back(&downloads[i]->job);
+      counter.pending.Increment();
+    }
+    download_manager->FetchAsync(jobs, download_manager->MakeCallback(
+      &ChunkDownloadCounter::OnFetched, &counter));
+    counter.pending.WaitForZero();
+
+    for (unsigned i = 0; i < downloads.size(); ++i) {
+      ChunkDownload *download = downloads[i];
+      (*fds)[download->idx] =
+        FinishChunkDownload(download, cvmfs_path, volatile_content);
+      delete download;
+    }
+  }
+
+  // Chunks that another thread downloads, or that appear twice in the list,
+  // can be waited for now that our own downloads are finished
+  for (unsigned i = 0; i < other_downloads.size(); ++i) {
+    const unsigned idx = other_downloads[i];
+    (*fds)[idx] = FetchChunk(*chunks.AtPtr(idx), cvmfs_path, volatile_content,
+                             download_manager);
+  }
+
+  unsigned num_failed = 0;
+  for (unsigned i = 0; i < num_chunks; ++i) {
+    if ((*fds)[i] < 0)
+      num_failed++;
+  }
+  return num_failed;
+}
+
+
+/**
+ * The downloads of a PrefetchChunks() call.  Every download is committed by
+ * the I/O thread that finished it; the last one deletes the batch.  The call
+ * guard keeps TearDown2ReadOnly() waiting until all of them are committed.
+ */
+class ChunkPrefetch {
+ public:
+  ChunkPrefetch(const string &p, const bool v,
+                SynchronizingCounter<int32_t> *c)
+    : cvmfs_path(p), volatile_content(v), num_pending(c)
+  {
+    atomic_init32(&num_remaining);
+  }
+
+  void OnFetched(download::JobInfo * const &info) {
+    ChunkDownload *download = NULL;
+    for (unsigned i = 0; i < downloads.size(); ++i) {
+      if (&downloads[i]->job == info) {
+        download = downloads[i];
+        break;
+      }
+    }
+    assert(download != NULL);
+    const int fd = FinishChunkDownload(download, cvmfs_path, volatile_content);
+    if (fd >= 0)
+      close(fd);
+    if (num_pending != NULL)
+      num_pending->Decrement();
+    if (atomic_xadd32(&num_remaining, -1) == 1)
+      delete this;
+  }
+
+  ~ChunkPrefetch() {
+    for (unsigned i = 0; i < downloads.size(); ++i)
+      delete downloads[i];
+  }
+
+  CallGuard call_guard;
+  const string cvmfs_path;
+  const bool volatile_content;
+  SynchronizingCounter<int32_t> *num_pending;
+  vector<ChunkDownload *> downloads;
+  atomic_int32 num_remaining;
+};
+
+
+/**
+ * Stages a list of file chunks in the cache without waiting for them.  Chunks
+ * that are cached or that another thread downloads are skipped, the others are
+ * submitted as a single FetchAsync() batch.  Every chunk is committed by the
+ * I/O thread of the download manager as soon as it arrives, which also wakes
+ * up readers that requested the chunk in the meantime.
+ *
+ * @param[in] chunks       File chunks to stage, can be freed after the call
+ * @param[in] cvmfs_path   Path of the full file as seen in cvmfs
+ * @param[in] num_pending  If not NULL, incremented for every submitted download
+ *                         and decremented once the download is committed
+ * \return Number of submitted downloads
+ */
+unsigned PrefetchChunks(const FileChunkList &chunks,
+                        const string &cvmfs_path,
+                        const bool volatile_content,
+                        download::DownloadManager *download_manager,
+                        SynchronizingCounter<int32_t> *num_pending)
+{
+  ChunkPrefetch *prefetch =
+    new ChunkPrefetch(cvmfs_path, volatile_content, num_pending);
+  for (unsigned i = 0; i < chunks.size(); ++i) {
+    bool in_flight;
+    int fd;
+    ChunkDownload *download =
+      StartChunkDownload(*chunks.AtPtr(i), &prefetch->cvmfs_path, &in_flight,
+                         &fd);
+    if (download == NULL) {
+      if (fd >= 0)
+        close(fd);
+      continue;
+    }
+    prefetch->downloads.push_back(download);
+  }
+
+  const unsigned num_downloads = prefetch->downloads.size();
+  if (num_downloads == 0) {
+    delete prefetch;
+    return 0;
+  }
+
+  LogCvmfs(kLogCache, kLogDebug, "prefetching %u out of %u chunks of %s",
+           num_downloads, static_cast<unsigned>(chunks.size()),
+           cvmfs_path.c_str());
+  vector<download::JobInfo *> jobs;
+  for (unsigned i = 0; i < num_downloads; ++i) {
+    jobs.push_back(&prefetch->downloads[i]->job);
+    if (num_pending != NULL)
+      num_pending->Increment();
+  }
+  atomic_xadd32(&prefetch->num_remaining, num_downloads);
+  download_manager->FetchAsync(jobs, download_manager->MakeCallback(
+    &ChunkPrefetch::OnFetched, prefetch));
+  return num_downloads;
+}
+
+
 int64_t GetNumDownloads() {
   return atomic_read64(&num_download_);
 }
@@ -765,8 +1124,7 @@ catalog::Catalog *CatalogManager::CreateCatalog(
   const shash::Any  &catalog_hash,
   catalog::Catalog  *parent_catalog
 ) {
-  mounted_catalogs_[mountpoint] = loaded_catalogs_[mountpoint];
-  loaded_catalogs_.erase(mountpoint);
+  mounted_catalogs_[mountpoint] = catalog_hash;
   return new catalog::Catalog(mountpoint, catalog_hash, parent_catalog);
 }
 
@@ -911,10 +1269,10 @@ catalog::LoadError CatalogManager::LoadCatalog(const PathString  &mountpoint,
   // Load a particular catalog
   if (!hash.IsNull()) {
     cvmfs_path += " (" + hash.ToString() + ")";
+    // Runs without the catalog manager lock for nested catalogs, the mounted
+    // catalogs are recorded in CreateCatalog()
     catalog::LoadError load_error = LoadCatalogCas(hash, cvmfs_path,
                                                    catalog_path);
-    if (load_error == catalog::kLoadNew)
-      loaded_catalogs_[mountpoint] = hash;
     *catalog_hash = hash;
     return load_error;
   }
@@ -982,7 +1340,6 @@ catalog::LoadError CatalogManager::LoadCatalog(const PathString  &mountpoint,
             return catalog::kLoadFail;
           }
         }
-        loaded_catalogs_[mountpoint] = cache_hash;
         *catalog_hash = cache_hash;
         offline_mode_ = true;
 
@@ -1012,11 +1369,9 @@ catalog::LoadError CatalogManager::LoadCatalog(const PathString  &mountpoint,
           return catalog::kLoadNoSpace;
         }
       }
-      loaded_catalogs_[mountpoint] = cache_hash;
       *catalog_hash = cache_hash;
       return catalog::kLoadUp2Date;
     } else {
-      loaded_catalogs_[mountpoint] = cache_hash;
       *catalog_hash = cache_hash;
       return catalog::kLoadUp2Date;
     }
@@ -1032,7 +1387,6 @@ catalog::LoadError CatalogManager::LoadCatalog(const PathString  &mountpoint,
     LoadCatalogCas(ensemble.manifest->catalog_hash(), cvmfs_path, catalog_path);
   if (load_retval != catalog::kLoadNew)
     return load_retval;
-  loaded_catalogs_[mountpoint] = ensemble.manifest->catalog_hash();
   *catalog_hash = ensemble.manifest->catalog_hash();
 
   // Store new manifest and certificate
@@ -1065,6 +1419,26 @@ void CatalogManager::UnloadCatalog(const catalog::Catalog *catalog) {
 }
 
 
+/**
+ * The pin taken by LoadCatalogCas() stays if the same catalog is mounted
+ * elsewhere, e.g. by the thread that changed the tree.
+ */
+void CatalogManager::DiscardCatalog(const shash::Any &catalog_hash) {
+  LogCvmfs(kLogCache, kLogDebug, "discarding catalog %s",
+           catalog_hash.ToString().c_str());
+  if (cache_mode_ != kCacheReadWrite)
+    return;
+  for (map<PathString, shash::Any>::const_iterator i =
+       mounted_catalogs_.begin(), iEnd = mounted_catalogs_.end();
+       i != iEnd; ++i)
+  {
+    if (i->second == catalog_hash)
+      return;
+  }
+  quota::Unpin(catalog_hash);
+}
+
+
 CatalogManager::~CatalogManager() {
   LogCvmfs(kLogCache, kLogDebug, "unpinning / unloading all catalogs");
 
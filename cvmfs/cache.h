@@ -33,6 +33,8 @@ namespace download {
 class DownloadManager;
 }
 
+template <typename T> class SynchronizingCounter;
+
 namespace cache {
 
 enum CacheModes {
@@ -52,6 +54,16 @@ int FetchChunk(const FileChunk &chunk,
                const std::string &cvmfs_path,
                const bool volatile_content,
                download::DownloadManager *download_manager);
+unsigned FetchChunks(const FileChunkList &chunks,
+                     const std::string &cvmfs_path,
+                     const bool volatile_content,
+                     download::DownloadManager *download_manager,
+                     std::vector<int> *fds);
+unsigned PrefetchChunks(const FileChunkList &chunks,
+                        const std::string &cvmfs_path,
+                        const bool volatile_content,
+                        download::DownloadManager *download_manager,
+                        SynchronizingCounter<int32_t> *num_pending);
 int64_t GetNumDownloads();
 
 CacheModes GetCacheMode();
@@ -93,6 +105,7 @@ class CatalogManager : public catalog::AbstractCatalogManager {
                                  std::string       *catalog_path,
                                  shash::Any        *catalog_hash);
   void UnloadCatalog(const catalog::Catalog *catalog);
+  void DiscardCatalog(const shash::Any &catalog_hash);
   catalog::Catalog* CreateCatalog(const PathString &mountpoint,
                                   const shash::Any  &catalog_hash,
                                   catalog::Catalog *parent_catalog);
@@ -106,7 +119,6 @@ class CatalogManager : public catalog::AbstractCatalogManager {
   /**
    * required for unpinning
    */
-  std::map<PathString, shash::Any> loaded_catalogs_;
   std::map<PathString, shash::Any> mounted_catalogs_;
 
   std::string repo_name_;
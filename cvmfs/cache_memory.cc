@@ -0,0 +1,172 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#define __STDC_FORMAT_MACROS
+
+#include "cvmfs_config.h"
+#include "cache_memory.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdlib>
+
+#include "logging.h"
+#include "smalloc.h"
+
+using namespace std;  // NOLINT
+
+namespace cache {
+
+MemoryCache::MemoryCache(
+  const uint64_t max_bytes,
+  const uint64_t max_object_size,
+  perf::Statistics *statistics)
+  : max_bytes_(max_bytes)
+  , max_object_size_(max_object_size)
+  , bytes_(0)
+{
+  assert(max_object_size_ <= max_bytes_);
+  // Number of cache entries must be a multiple of 64 and at least 128
+  const uint64_t mask_64 = ~((1 << 6) - 1);
+  uint64_t num_entries = (max_bytes_ / kAvgObjectSize) & mask_64;
+  if (num_entries < 128)
+    num_entries = 128;
+  lru_ = new lru::LruCache<shash::Any, MemoryObject *>(
+    num_entries, shash::Any(), hasher_any);
+
+  int retval = pthread_mutex_init(&lock_, NULL);
+  assert(retval == 0);
+
+  n_hit_ = statistics->Register("memcache.n_hit",
+    "number of opens served from the in-memory object cache");
+  n_miss_ = statistics->Register("memcache.n_miss",
+    "number of opens of small files not found in the in-memory object cache");
+  n_insert_ = statistics->Register("memcache.n_insert",
+    "number of objects copied into the in-memory object cache");
+  n_evict_ = statistics->Register("memcache.n_evict",
+    "number of objects evicted from the in-memory object cache");
+  sz_bytes_ = statistics->Register("memcache.sz_bytes",
+    "number of bytes occupied by the in-memory object cache");
+  LogCvmfs(kLogCache, kLogDebug, "in-memory object cache of %"PRIu64" bytes "
+           "for objects up to %"PRIu64" bytes (%"PRIu64" entries)",
+           max_bytes_, max_object_size_, num_entries);
+}
+
+
+/**
+ * Drops the references of the cache.  Objects still referenced by open file
+ * handles stay valid until they are released.
+ */
+MemoryCache::~MemoryCache() {
+  while (EvictOldest()) { }
+  delete lru_;
+  pthread_mutex_destroy(&lock_);
+}
+
+
+/**
+ * Needs to be called with lock_ held.
+ */
+bool MemoryCache::EvictOldest() {
+  shash::Any id;
+  MemoryObject *object;
+  if (!lru_->PopOldest(&id, &object))
+    return false;
+  bytes_ -= object->size;
+  sz_bytes_->Set(bytes_);
+  perf::Inc(n_evict_);
+  Release(object);
+  return true;
+}
+
+
+/**
+ * Returns the object with an additional reference or NULL.
+ */
+MemoryObject *MemoryCache::Lookup(const shash::Any &id) {
+  MemoryObject *object;
+  pthread_mutex_lock(&lock_);
+  if (!lru_->Lookup(id, &object)) {
+    pthread_mutex_unlock(&lock_);
+    perf::Inc(n_miss_);
+    return NULL;
+  }
+  atomic_inc32(&object->refcount);
+  pthread_mutex_unlock(&lock_);
+  perf::Inc(n_hit_);
+  return object;
+}
+
+
+/**
+ * Copies size bytes of the file descriptor fd into the cache.  Returns the
+ * object with an additional reference or NULL if the object is too large or
+ * cannot be read.
+ */
+MemoryObject *MemoryCache::Insert(
+  const shash::Any &id,
+  const int fd,
+  const uint64_t size)
+{
+  if (size > max_object_size_)
+    return NULL;
+
+  MemoryObject *object = reinterpret_cast<MemoryObject *>(
+    smalloc(sizeof(MemoryObject) + size));
+  object->size = size;
+  object->data = reinterpret_cast<unsigned char *>(object + 1);
+  // One reference for the cache, one for the caller
+  atomic_init32(&object->refcount);
+  atomic_xadd32(&object->refcount, 2);
+  uint64_t nbytes = 0;
+  while (nbytes < size) {
+    const ssize_t retval =
+      pread(fd, object->data + nbytes, size - nbytes, nbytes);
+    if (retval < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (retval == 0)
+      break;
+    nbytes += retval;
+  }
+  if (nbytes != size) {
+    LogCvmfs(kLogCache, kLogDebug, "failed to copy %s into memory cache",
+             id.ToString().c_str());
+    free(object);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&lock_);
+  MemoryObject *existing;
+  if (lru_->Lookup(id, &existing)) {
+    // Raced with another thread
+    atomic_inc32(&existing->refcount);
+    pthread_mutex_unlock(&lock_);
+    free(object);
+    return existing;
+  }
+  while ((bytes_ + size > max_bytes_) || lru_->IsFull()) {
+    if (!EvictOldest())
+      break;
+  }
+  lru_->Insert(id, object);
+  bytes_ += size;
+  sz_bytes_->Set(bytes_);
+  pthread_mutex_unlock(&lock_);
+  perf::Inc(n_insert_);
+  return object;
+}
+
+
+void MemoryCache::Release(MemoryObject *object) {
+  if (atomic_xadd32(&object->refcount, -1) == 1)
+    free(object);
+}
+
+}  // namespace cache
@@ -0,0 +1,94 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_CACHE_MEMORY_H_
+#define CVMFS_CACHE_MEMORY_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "atomic.h"
+#include "hash.h"
+#include "lru.h"
+#include "statistics.h"
+#include "util.h"
+
+namespace cache {
+
+/**
+ * A small object kept in memory.  The memory cache holds one reference, every
+ * open file handle pointing to the object holds another one.  Open handles
+ * survive a reload of the cvmfs library, so the layout must not change.
+ */
+struct MemoryObject {
+  atomic_int32 refcount;
+  uint32_t size;
+  unsigned char *data;
+};
+
+
+/**
+ * An optional, size-bounded in-memory tier in front of the on-disk cache for
+ * small objects.  Hits are served without touching the cache directory; open
+ * files refer to the object by a file handle with kMemoryHandleFlag set
+ * instead of a file descriptor.
+ *
+ * The LRU order is kept by an lru::LruCache.  Its number of entries is derived
+ * from the memory limit, the memory limit itself is enforced by evicting the
+ * oldest objects on insert.
+ */
+class MemoryCache : SingleCopy {
+ public:
+  static const uint64_t kMemoryHandleFlag = uint64_t(1) << 62;
+  static const unsigned kAvgObjectSize = 4096;
+
+  MemoryCache(const uint64_t max_bytes,
+              const uint64_t max_object_size,
+              perf::Statistics *statistics);
+  ~MemoryCache();
+
+  MemoryObject *Lookup(const shash::Any &id);
+  MemoryObject *Insert(const shash::Any &id, const int fd,
+                       const uint64_t size);
+  static void Release(MemoryObject *object);
+
+  static inline bool IsMemoryHandle(const uint64_t handle) {
+    return (static_cast<int64_t>(handle) > 0) && (handle & kMemoryHandleFlag);
+  }
+  static inline uint64_t Object2Handle(const MemoryObject *object) {
+    const uint64_t address = reinterpret_cast<uintptr_t>(object);
+    assert((address & kMemoryHandleFlag) == 0);
+    return address | kMemoryHandleFlag;
+  }
+  static inline MemoryObject *Handle2Object(const uint64_t handle) {
+    return reinterpret_cast<MemoryObject *>(handle & ~kMemoryHandleFlag);
+  }
+
+  uint64_t max_object_size() const { return max_object_size_; }
+  lru::Statistics lru_statistics() { return lru_->statistics(); }
+
+ private:
+  static uint32_t hasher_any(const shash::Any &key) {
+    // Don't start with the first bytes, because == is using them as well
+    return (uint32_t) *(reinterpret_cast<const uint32_t *>(key.digest) + 1);
+  }
+
+  bool EvictOldest();
+
+  uint64_t max_bytes_;
+  uint64_t max_object_size_;
+  uint64_t bytes_;
+  lru::LruCache<shash::Any, MemoryObject *> *lru_;
+  pthread_mutex_t lock_;
+
+  perf::Counter *n_hit_;
+  perf::Counter *n_miss_;
+  perf::Counter *n_insert_;
+  perf::Counter *n_evict_;
+  perf::Counter *sz_bytes_;
+};
+
+}  // namespace cache
+
+#endif  // CVMFS_CACHE_MEMORY_H_
@@ -0,0 +1,153 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "cache_prefetch.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "logging.h"
+
+using namespace std;  // NOLINT
+
+namespace cache {
+
+ChunkPrefetcher::ChunkPrefetcher(
+  const unsigned window,
+  PrefetchFunction prefetch,
+  download::DownloadManager *download_manager,
+  perf::Statistics *statistics)
+  : window_(window)
+  , max_pending_(window * 16)
+  , prefetch_(prefetch)
+  , download_manager_(download_manager)
+{
+  assert(window_ > 0);
+  int retval = pthread_mutex_init(&lock_, NULL);
+  assert(retval == 0);
+
+  n_issued_ = statistics->Register("prefetch.n_issued",
+    "overall number of chunks scheduled for read-ahead");
+  n_dropped_ = statistics->Register("prefetch.n_dropped",
+    "number of read-ahead requests dropped due to too many downloads");
+  n_hit_ = statistics->Register("prefetch.n_hit",
+    "number of prefetched chunks that were read afterwards");
+  n_waste_ = statistics->Register("prefetch.n_waste",
+    "number of prefetched chunks that were never read");
+}
+
+
+/**
+ * Waits for the scheduled downloads.  Has to be called before the download
+ * manager is stopped.
+ */
+ChunkPrefetcher::~ChunkPrefetcher() {
+  num_pending_.WaitForZero();
+  pthread_mutex_destroy(&lock_);
+}
+
+
+/**
+ * Updates the hit and waste counters when a chunk is read.  Every hit doubles
+ * the read-ahead distance.  Needs to be called with lock_ held.
+ */
+void ChunkPrefetcher::Account(StreamState *state, const unsigned chunk_idx) {
+  if ((state->window_begin >= state->window_end) ||
+      (chunk_idx < state->window_begin))
+  {
+    return;
+  }
+
+  if (chunk_idx < state->window_end) {
+    perf::Inc(n_hit_);
+    state->distance = std::min(2 * state->distance, window_);
+    perf::Xadd(n_waste_, chunk_idx - state->window_begin);
+    state->window_begin = chunk_idx + 1;
+  } else {
+    // Jumped over the read-ahead window
+    perf::Xadd(n_waste_, state->window_end - state->window_begin);
+    state->window_begin = state->window_end = chunk_idx + 1;
+  }
+}
+
+
+/**
+ * Called by the Fuse module for every read() on a chunked file.  Must not be
+ * called with the chunk handle locked, scheduling opens the cached chunks of
+ * the window.
+ */
+void ChunkPrefetcher::OnRead(
+  const uint64_t chunk_handle,
+  const FileChunkReflist &chunks,
+  const unsigned chunk_idx_first,
+  const unsigned chunk_idx_last,
+  const off_t offset,
+  const size_t size,
+  const bool volatile_content)
+{
+  LockMutex(&lock_);
+  StreamState *state = &streams_[chunk_handle];
+  if (offset == state->next_offset) {
+    ++state->streak;
+  } else {
+    state->streak = 0;
+    state->distance = 1;
+  }
+  state->next_offset = offset + size;
+
+  for (unsigned i = chunk_idx_first; i <= chunk_idx_last; ++i)
+    Account(state, i);
+
+  if (state->streak < kSequentialThreshold) {
+    UnlockMutex(&lock_);
+    return;
+  }
+
+  const unsigned num_chunks = chunks.list->size();
+  const unsigned begin = std::max(state->window_end, chunk_idx_last + 1);
+  unsigned end = std::min(chunk_idx_last + 1 + state->distance, num_chunks);
+  const int32_t num_pending = num_pending_;
+  if ((begin < end) &&
+      (num_pending + static_cast<int32_t>(end - begin) > max_pending_))
+  {
+    perf::Inc(n_dropped_);
+    end = (num_pending < max_pending_) ? begin + max_pending_ - num_pending
+                                       : begin;
+  }
+  if (begin >= end) {
+    UnlockMutex(&lock_);
+    return;
+  }
+
+  FileChunkList window;
+  for (unsigned i = begin; i < end; ++i)
+    window.PushBack(*chunks.list->AtPtr(i));
+  if (state->window_begin >= state->window_end)
+    state->window_begin = begin;
+  state->window_end = end;
+  perf::Xadd(n_issued_, end - begin);
+  UnlockMutex(&lock_);
+
+  const string path = chunks.path.ToString();
+  LogCvmfs(kLogCache, kLogDebug, "prefetching chunks [%u, %u) of %s",
+           begin, end, path.c_str());
+  prefetch_(window, "Prefetch of " + path, volatile_content,
+            download_manager_, &num_pending_);
+}
+
+
+void ChunkPrefetcher::OnRelease(const uint64_t chunk_handle) {
+  LockMutex(&lock_);
+  map<uint64_t, StreamState>::iterator i = streams_.find(chunk_handle);
+  if (i != streams_.end()) {
+    if (i->second.window_end > i->second.window_begin) {
+      perf::Xadd(n_waste_, i->second.window_end - i->second.window_begin);
+    }
+    streams_.erase(i);
+  }
+  UnlockMutex(&lock_);
+}
+
+}  // namespace cache
@@ -0,0 +1,121 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_CACHE_PREFETCH_H_
+#define CVMFS_CACHE_PREFETCH_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+
+#include "file_chunk.h"
+#include "gtest/gtest_prod.h"
+#include "statistics.h"
+#include "util.h"
+#include "util_concurrency.h"
+
+namespace download {
+class DownloadManager;
+}
+
+namespace cache {
+
+/**
+ * Detects sequential reads on open chunked files and stages the following
+ * chunks of the file into the cache before the reader reaches them.  The
+ * chunks of a read-ahead window are handed to cache::PrefetchChunks() as a
+ * single batch, so that they are downloaded by the I/O threads of the download
+ * manager without blocking the reader.  Concurrent requests for the same chunk
+ * are still de-duplicated by the download queues of the cache module.
+ *
+ * The access pattern is tracked per chunk handle.  Once a handle has been read
+ * sequentially for kSequentialThreshold consecutive calls, the following chunks
+ * are scheduled.  The read-ahead distance starts at a single chunk and doubles
+ * with every hit up to window_ chunks; a seek resets it.  Scheduled chunks that
+ * are read later on count as hits, scheduled chunks that are skipped or never
+ * read count as waste.
+ */
+class ChunkPrefetcher : SingleCopy {
+ public:
+  static const unsigned kSequentialThreshold = 2;
+
+  /**
+   * Stages chunks in the cache without waiting, see cache::PrefetchChunks()
+   */
+  typedef unsigned (*PrefetchFunction)(
+    const FileChunkList &chunks,
+    const std::string &cvmfs_path,
+    const bool volatile_content,
+    download::DownloadManager *download_manager,
+    SynchronizingCounter<int32_t> *num_pending);
+
+  ChunkPrefetcher(const unsigned window,
+                  PrefetchFunction prefetch,
+                  download::DownloadManager *download_manager,
+                  perf::Statistics *statistics);
+  ~ChunkPrefetcher();
+
+  void OnRead(const uint64_t chunk_handle,
+              const FileChunkReflist &chunks,
+              const unsigned chunk_idx_first,
+              const unsigned chunk_idx_last,
+              const off_t offset,
+              const size_t size,
+              const bool volatile_content);
+  void OnRelease(const uint64_t chunk_handle);
+
+  unsigned window() const { return window_; }
+
+ private:
+  FRIEND_TEST(T_ChunkPrefetcher, Sequential);
+  FRIEND_TEST(T_ChunkPrefetcher, Seek);
+  FRIEND_TEST(T_ChunkPrefetcher, Pending);
+
+  /**
+   * Sequential access state of a single chunk handle.  Chunks in
+   * [window_begin, window_end) are scheduled but not yet read.
+   */
+  struct StreamState {
+    StreamState()
+      : next_offset(0)
+      , streak(0)
+      , distance(1)
+      , window_begin(0)
+      , window_end(0)
+    { }
+    off_t next_offset;
+    unsigned streak;
+    /**
+     * Number of chunks to read ahead of the current read
+     */
+    unsigned distance;
+    unsigned window_begin;
+    unsigned window_end;
+  };
+
+  void Account(StreamState *state, const unsigned chunk_idx);
+
+  unsigned window_;
+  /**
+   * Read-ahead is dropped while that many downloads are in flight
+   */
+  int32_t max_pending_;
+  PrefetchFunction prefetch_;
+  download::DownloadManager *download_manager_;
+  std::map<uint64_t, StreamState> streams_;
+  SynchronizingCounter<int32_t> num_pending_;
+  pthread_mutex_t lock_;
+
+  perf::Counter *n_issued_;
+  perf::Counter *n_dropped_;
+  perf::Counter *n_hit_;
+  perf::Counter *n_waste_;
+};
+
+}  // namespace cache
+
+#endif  // CVMFS_CACHE_PREFETCH_H_
@@ -2,17 +2,22 @@
  * This file is part of the CernVM File System.
  */
 
+#define __STDC_FORMAT_MACROS
+
 #include "catalog.h"
 
 #include <errno.h>
+#include <inttypes.h>
 
 #include <algorithm>
 #include <cassert>
 
+#include "bloom_filter.h"
 #include "catalog_mgr.h"
 #include "logging.h"
 #include "platform.h"
 #include "smalloc.h"
+#include "statistics.h"
 #include "util.h"
 
 using namespace std;  // NOLINT
@@ -73,10 +78,19 @@ Catalog::Catalog(const PathString &path,
   sql_all_chunks_ = NULL;
   sql_chunks_listing_ = NULL;
   sql_lookup_xattrs_ = NULL;
+  lookup_filter_ = NULL;
+  atomic_init32(&lookup_filter_ready_);
+  lookup_filter_failed_ = false;
+  lookup_filter_counters_ = NULL;
 }
 
 
 Catalog::~Catalog() {
+  if (lookup_filter_ != NULL) {
+    perf::Xadd(lookup_filter_counters_->sz_bytes,
+               -static_cast<int64_t>(lookup_filter_->bytes_allocated()));
+    delete lookup_filter_;
+  }
   pthread_mutex_destroy(lock_);
   free(lock_);
   FinalizePreparedStatements();
@@ -254,7 +268,24 @@ bool Catalog::LookupEntry(const shash::Md5 &md5path, const bool expand_symlink,
 {
   assert(IsInitialized());
 
+  uint64_t lo, hi;
+  md5path.ToIntPair(&lo, &hi);
+  // The filter is immutable once built and can be read without the lock
+  bool filtered = atomic_read32(&lookup_filter_ready_);
+  if (filtered && !lookup_filter_->MayContain(lo, hi)) {
+    perf::Inc(lookup_filter_counters_->n_skip);
+    return false;
+  }
+
   pthread_mutex_lock(lock_);
+  if (!filtered && (lookup_filter_counters_ != NULL)) {
+    filtered = BuildLookupFilter();
+    if (filtered && !lookup_filter_->MayContain(lo, hi)) {
+      pthread_mutex_unlock(lock_);
+      perf::Inc(lookup_filter_counters_->n_skip);
+      return false;
+    }
+  }
   sql_lookup_md5path_->BindPathHash(md5path);
   bool found = sql_lookup_md5path_->FetchRow();
   if (found && (dirent != NULL)) {
@@ -264,6 +295,8 @@ bool Catalog::LookupEntry(const shash::Md5 &md5path, const bool expand_symlink,
   sql_lookup_md5path_->Reset();
   pthread_mutex_unlock(lock_);
 
+  if (!found && filtered)
+    perf::Inc(lookup_filter_counters_->n_false_positive);
   return found;
 }
 
@@ -625,6 +658,75 @@ void Catalog::SetOwnerMaps(const OwnerMap *uid_map, const OwnerMap *gid_map) {
 }
 
 
+/**
+ * Reads up to size bytes of the catalog database through a memory map.  Pages
+ * in the map are not copied into the SQlite page cache.
+ */
+void Catalog::SetMmapSize(const uint64_t size) {
+  assert(database_ != NULL);
+  pthread_mutex_lock(lock_);
+  const bool retval = database_->SetMmapSize(size);
+  pthread_mutex_unlock(lock_);
+  if (!retval) {
+    LogCvmfs(kLogCatalog, kLogDebug, "failed to set mmap size of catalog %s",
+             database_path().c_str());
+  }
+}
+
+
+/**
+ * Path lookups consult a Bloom filter of the path hashes of all entries, so
+ * that lookups of paths that are not in the catalog are answered without a
+ * database query.  The catalog must not change afterwards.
+ */
+void Catalog::EnableLookupFilter(const LookupFilterCounters *counters) {
+  lookup_filter_counters_ = counters;
+}
+
+
+/**
+ * Loads the path hashes of all entries into the lookup filter.  Called by the
+ * first path lookup with lock_ held instead of on attach, which happens under
+ * the catalog manager's write lock.
+ * @return true if the filter is ready, false if it cannot be built
+ */
+bool Catalog::BuildLookupFilter() const {
+  assert(database_ != NULL);
+  if (lookup_filter_ != NULL)
+    return true;
+  if (lookup_filter_failed_)
+    return false;
+
+  BloomFilter *filter = new BloomFilter(max_row_id_);
+  SqlAllPathHashes sql_all_path_hashes(database());
+  shash::Md5 md5path;
+  uint64_t lo, hi;
+  while (sql_all_path_hashes.Next(&md5path)) {
+    md5path.ToIntPair(&lo, &hi);
+    filter->Add(lo, hi);
+  }
+  const bool retval = sql_all_path_hashes.Reset();
+  if (!retval || (filter->num_elements() > max_row_id_)) {
+    LogCvmfs(kLogCatalog, kLogDebug,
+             "failed to build lookup filter for catalog %s",
+             database_path().c_str());
+    delete filter;
+    lookup_filter_failed_ = true;
+    return false;
+  }
+
+  lookup_filter_ = filter;
+  atomic_write32(&lookup_filter_ready_, 1);
+  perf::Xadd(lookup_filter_counters_->sz_bytes,
+             lookup_filter_->bytes_allocated());
+  LogCvmfs(kLogCatalog, kLogDebug,
+           "built lookup filter for catalog %s (%"PRIu64" entries, %"PRIu64
+           " bytes)", database_path().c_str(), filter->num_elements(),
+           filter->bytes_allocated());
+  return true;
+}
+
+
 /**
  * Add a Catalog as child to this Catalog.
  * @param child the Catalog to define as child
@@ -733,9 +835,11 @@ Catalog* Catalog::FindChild(const PathString &mountpoint) const {
 void Catalog::FixTransitionPoint(const shash::Md5 &md5path,
                                  DirectoryEntry *dirent) const
 {
-  if (dirent->IsNestedCatalogRoot() && HasParent()) {
+  // Lookups run concurrently to detaching, read the parent pointer only once
+  const Catalog *parent = parent_;
+  if (dirent->IsNestedCatalogRoot() && (parent != NULL)) {
     DirectoryEntry parent_dirent;
-    const bool retval = parent_->LookupMd5Path(md5path, &parent_dirent);
+    const bool retval = parent->LookupMd5Path(md5path, &parent_dirent);
     assert(retval);
 
     dirent->set_inode(parent_dirent.inode());
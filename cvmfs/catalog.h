@@ -13,6 +13,7 @@
 #include <string>
 #include <vector>
 
+#include "atomic.h"
 #include "catalog_counters.h"
 #include "catalog_sql.h"
 #include "directory_entry.h"
@@ -23,6 +24,12 @@
 #include "util.h"
 #include "xattr.h"
 
+class BloomFilter;
+
+namespace perf {
+class Counter;
+}
+
 namespace swissknife {
 class CommandMigrate;
 }
@@ -60,6 +67,19 @@ struct InodeRange {
 };
 
 
+/**
+ * Counters shared by the negative lookup filters of all catalogs of a
+ * catalog manager.
+ */
+struct LookupFilterCounters {
+  LookupFilterCounters() : n_skip(NULL), n_false_positive(NULL), sz_bytes(NULL)
+  { }
+  perf::Counter *n_skip;  /**< lookups answered by the filter */
+  perf::Counter *n_false_positive;  /**< filter hits not found in SQL */
+  perf::Counter *sz_bytes;  /**< memory used by all filters */
+};
+
+
 /**
  * Allows to define a class that transforms the inode in order to ensure
  * that inodes are not reused after reloads (catalog or fuse module).
@@ -204,6 +224,8 @@ class Catalog : public SingleCopy {
 
   void SetInodeAnnotation(InodeAnnotation *new_annotation);
   void SetOwnerMaps(const OwnerMap *uid_map, const OwnerMap *gid_map);
+  void SetMmapSize(const uint64_t size);
+  void EnableLookupFilter(const LookupFilterCounters *counters);
 
  protected:
   typedef std::map<uint64_t, inode_t> HardlinkGroupMap;
@@ -280,6 +302,17 @@ class Catalog : public SingleCopy {
   SqlChunksListing         *sql_chunks_listing_;
   SqlLookupXattrs          *sql_lookup_xattrs_;
 
+  bool BuildLookupFilter() const;
+
+  /**
+   * Path hashes of all entries, lets negative lookups bypass SQLite.  Built
+   * by the first lookup under lock_, so that attaching the catalog is cheap.
+   */
+  mutable BloomFilter *lookup_filter_;
+  mutable atomic_int32 lookup_filter_ready_;
+  mutable bool lookup_filter_failed_;
+  const LookupFilterCounters *lookup_filter_counters_;
+
   mutable HashVector        referenced_hashes_;
 };  // class Catalog
 
@@ -14,6 +14,7 @@
 #include "logging.h"
 #include "shortstring.h"
 #include "smalloc.h"
+#include "statistics.h"
 #include "xattr.h"
 
 using namespace std;  // NOLINT
@@ -21,16 +22,22 @@ using namespace std;  // NOLINT
 namespace catalog {
 
 
-AbstractCatalogManager::AbstractCatalogManager() {
+AbstractCatalogManager::AbstractCatalogManager() : tree_(new CatalogTree()) {
   inode_watermark_status_ = 0;
   inode_gauge_ = AbstractCatalogManager::kInodeOffset;
   revision_cache_ = 0;
   inode_annotation_ = NULL;
   incarnation_ = 0;
+  catalog_mmap_size_ = 0;
+  lookup_filter_ = false;
   rwlock_ =
     reinterpret_cast<pthread_rwlock_t *>(smalloc(sizeof(pthread_rwlock_t)));
   int retval = pthread_rwlock_init(rwlock_, NULL);
   assert(retval == 0);
+  lock_inflight_loads_ =
+    reinterpret_cast<pthread_mutex_t *>(smalloc(sizeof(pthread_mutex_t)));
+  retval = pthread_mutex_init(lock_inflight_loads_, NULL);
+  assert(retval == 0);
   retval = pthread_key_create(&pkey_sqlitemem_, NULL);
   assert(retval == 0);
   remount_listener_ = NULL;
@@ -39,7 +46,13 @@ AbstractCatalogManager::AbstractCatalogManager() {
 
 AbstractCatalogManager::~AbstractCatalogManager() {
   DetachAll();
+  PublishTree();
+  tree_.Drain();
+  delete tree_.Peek();
   pthread_key_delete(pkey_sqlitemem_);
+  assert(inflight_loads_.empty());
+  pthread_mutex_destroy(lock_inflight_loads_);
+  free(lock_inflight_loads_);
   pthread_rwlock_destroy(rwlock_);
   free(rwlock_);
 }
@@ -60,6 +73,34 @@ void AbstractCatalogManager::SetOwnerMaps(const OwnerMap &uid_map,
 }
 
 
+/**
+ * Catalogs attached from now on read up to size bytes of their database files
+ * through a memory map.
+ */
+void AbstractCatalogManager::SetCatalogMmapSize(const uint64_t size) {
+  catalog_mmap_size_ = size;
+}
+
+
+/**
+ * Catalogs attached from now on keep a Bloom filter of their path hashes in
+ * memory, so that lookups of non-existing paths don't hit SQLite.  Only for
+ * read-only catalogs.
+ */
+void AbstractCatalogManager::EnableLookupFilter(perf::Statistics *statistics) {
+  assert(catalogs_.empty());
+  lookup_filter_counters_.n_skip = statistics->Register(
+    "catalog_mgr.n_filter_skip",
+    "overall number of path lookups answered by the lookup filter");
+  lookup_filter_counters_.n_false_positive = statistics->Register(
+    "catalog_mgr.n_filter_false_positive",
+    "overall number of lookup filter false positives");
+  lookup_filter_counters_.sz_bytes = statistics->Register(
+    "catalog_mgr.sz_filter", "memory used by lookup filters");
+  lookup_filter_ = true;
+}
+
+
 void AbstractCatalogManager::CheckInodeWatermark() {
   if (inode_watermark_status_ > 0)
     return;
@@ -120,6 +161,8 @@ LoadError AbstractCatalogManager::Remount(const bool dry_run) {
     DetachAll();
     inode_gauge_ = AbstractCatalogManager::kInodeOffset;
 
+    // Lookups keep using the old tree until the new root is attached.  The
+    // caller has to fence lookups against the change of the inode generation.
     Catalog *new_root = CreateCatalog(PathString("", 0), catalog_hash, NULL);
     assert(new_root);
     bool retval = AttachCatalog(catalog_path, new_root);
@@ -154,6 +197,7 @@ void AbstractCatalogManager::DetachNested() {
   {
     DetachSubtree(*i);
   }
+  PublishTree();
 
   Unlock();
 }
@@ -180,9 +224,10 @@ bool AbstractCatalogManager::LookupPath(const PathString &path,
     DirectoryEntry(catalog::kDirentNegative);
 
   EnforceSqliteMemLimit();
-  ReadLock();
+  unsigned ticket;
+  const CatalogTree *tree = tree_.Acquire(&ticket);
 
-  Catalog *best_fit = FindCatalog(path);
+  Catalog *best_fit = tree->FindCatalog(path);
   assert(best_fit != NULL);
 
   atomic_inc64(&statistics_.num_lookup_path);
@@ -194,47 +239,27 @@ bool AbstractCatalogManager::LookupPath(const PathString &path,
   if (!found && MountSubtree(path, best_fit, NULL)) {
     LogCvmfs(kLogCatalog, kLogDebug, "looking up '%s' in a nested catalog",
              path.c_str());
-    Unlock();
-    WriteLock();
-    // Check again to avoid race
-    best_fit = FindCatalog(path);
+    // Other lookups continue on the current snapshot while we mount
+    tree_.Release(ticket);
+    found = MountSubtreeUnlocked(path);
+    tree = tree_.Acquire(&ticket);
+    if (!found) {
+      LogCvmfs(kLogCatalog, kLogDebug,
+               "failed to load nested catalog for '%s'", path.c_str());
+      goto lookup_path_notfound;
+    }
+
+    best_fit = tree->FindCatalog(path);
     assert(best_fit != NULL);
     atomic_inc64(&statistics_.num_lookup_path);
     found = best_fit->LookupPath(path, dirent);
-
     if (!found) {
       LogCvmfs(kLogCatalog, kLogDebug,
-               "entry not found, we may have to load nested catalogs");
-
-      Catalog *nested_catalog;
-      found = MountSubtree(path, best_fit, &nested_catalog);
-      // DowngradeLock(); TODO
-
-      if (!found) {
-        LogCvmfs(kLogCatalog, kLogDebug,
-                 "failed to load nested catalog for '%s'", path.c_str());
-        goto lookup_path_notfound;
-      }
-
-      if (nested_catalog != best_fit) {
-        atomic_inc64(&statistics_.num_lookup_path);
-        found = nested_catalog->LookupPath(path, dirent);
-        if (!found) {
-          LogCvmfs(kLogCatalog, kLogDebug,
-                   "nested catalogs loaded but entry '%s' was still not found",
-                   path.c_str());
-          if (dirent != NULL) *dirent = dirent_negative;
-          goto lookup_path_notfound;
-        } else {
-          best_fit = nested_catalog;
-        }
-      } else {
-        LogCvmfs(kLogCatalog, kLogDebug, "no nested catalog fits");
-        if (dirent != NULL) *dirent = dirent_negative;
-        goto lookup_path_notfound;
-      }
+               "nested catalogs loaded but entry '%s' was still not found",
+               path.c_str());
+      if (dirent != NULL) *dirent = dirent_negative;
+      goto lookup_path_notfound;
     }
-    assert(found);
   }
   // Not in a nested catalog (because no nested cataog fits), ENOENT
   if (!found) {
@@ -253,8 +278,10 @@ bool AbstractCatalogManager::LookupPath(const PathString &path,
     DirectoryEntry parent;
     PathString parent_path = GetParentPath(path);
     if (dirent->IsNestedCatalogRoot()) {
-      if (best_fit->parent())
-        found = best_fit->parent()->LookupPath(parent_path, &parent);
+      // The parent catalog serves the parent path
+      if (best_fit != tree->root)
+        found = tree->FindCatalog(parent_path)->LookupPath(parent_path,
+                                                           &parent);
       else
         found = false;
     } else {
@@ -276,11 +303,11 @@ bool AbstractCatalogManager::LookupPath(const PathString &path,
     dirent->set_symlink(raw_symlink);
   }
 
-  Unlock();
+  tree_.Release(ticket);
   return true;
 
  lookup_path_notfound:
-  Unlock();
+  tree_.Release(ticket);
   // Includes both: ENOENT and not found due to I/O error
   atomic_inc64(&statistics_.num_lookup_path_negative);
   return false;
@@ -293,28 +320,23 @@ bool AbstractCatalogManager::LookupXattrs(
 {
   EnforceSqliteMemLimit();
   bool result;
-  ReadLock();
+  unsigned ticket;
+  const CatalogTree *tree = tree_.Acquire(&ticket);
 
   // Find catalog, possibly load nested
-  Catalog *best_fit = FindCatalog(path);
-  Catalog *catalog = best_fit;
-  if (MountSubtree(path, best_fit, NULL)) {
-    Unlock();
-    WriteLock();
-    // Check again to avoid race
-    best_fit = FindCatalog(path);
-    result = MountSubtree(path, best_fit, &catalog);
-    // DowngradeLock(); TODO
-    if (!result) {
-      Unlock();
+  Catalog *catalog = tree->FindCatalog(path);
+  if (MountSubtree(path, catalog, NULL)) {
+    tree_.Release(ticket);
+    if (!MountSubtreeUnlocked(path))
       return false;
-    }
+    tree = tree_.Acquire(&ticket);
+    catalog = tree->FindCatalog(path);
   }
 
   atomic_inc64(&statistics_.num_lookup_xattrs);
   result = catalog->LookupXattrsPath(path, xattrs);
 
-  Unlock();
+  tree_.Release(ticket);
   return result;
 }
 
@@ -330,28 +352,23 @@ bool AbstractCatalogManager::Listing(const PathString &path,
 {
   EnforceSqliteMemLimit();
   bool result;
-  ReadLock();
+  unsigned ticket;
+  const CatalogTree *tree = tree_.Acquire(&ticket);
 
   // Find catalog, possibly load nested
-  Catalog *best_fit = FindCatalog(path);
-  Catalog *catalog = best_fit;
-  if (MountSubtree(path, best_fit, NULL)) {
-    Unlock();
-    WriteLock();
-    // Check again to avoid race
-    best_fit = FindCatalog(path);
-    result = MountSubtree(path, best_fit, &catalog);
-    // DowngradeLock(); TODO
-    if (!result) {
-      Unlock();
+  Catalog *catalog = tree->FindCatalog(path);
+  if (MountSubtree(path, catalog, NULL)) {
+    tree_.Release(ticket);
+    if (!MountSubtreeUnlocked(path))
       return false;
-    }
+    tree = tree_.Acquire(&ticket);
+    catalog = tree->FindCatalog(path);
   }
 
   atomic_inc64(&statistics_.num_listing);
   result = catalog->ListingPath(path, listing);
 
-  Unlock();
+  tree_.Release(ticket);
   return result;
 }
 
@@ -367,28 +384,23 @@ bool AbstractCatalogManager::ListingStat(const PathString &path,
 {
   EnforceSqliteMemLimit();
   bool result;
-  ReadLock();
+  unsigned ticket;
+  const CatalogTree *tree = tree_.Acquire(&ticket);
 
   // Find catalog, possibly load nested
-  Catalog *best_fit = FindCatalog(path);
-  Catalog *catalog = best_fit;
-  if (MountSubtree(path, best_fit, NULL)) {
-    Unlock();
-    WriteLock();
-    // Check again to avoid race
-    best_fit = FindCatalog(path);
-    result = MountSubtree(path, best_fit, &catalog);
-    // DowngradeLock(); TODO
-    if (!result) {
-      Unlock();
+  Catalog *catalog = tree->FindCatalog(path);
+  if (MountSubtree(path, catalog, NULL)) {
+    tree_.Release(ticket);
+    if (!MountSubtreeUnlocked(path))
       return false;
-    }
+    tree = tree_.Acquire(&ticket);
+    catalog = tree->FindCatalog(path);
   }
 
   atomic_inc64(&statistics_.num_listing);
   result = catalog->ListingPathStat(path, listing);
 
-  Unlock();
+  tree_.Release(ticket);
   return result;
 }
 
@@ -407,59 +419,147 @@ bool AbstractCatalogManager::ListFileChunks(
 {
   EnforceSqliteMemLimit();
   bool result;
-  ReadLock();
+  unsigned ticket;
+  const CatalogTree *tree = tree_.Acquire(&ticket);
 
   // Find catalog, possibly load nested
-  Catalog *best_fit = FindCatalog(path);
-  Catalog *catalog = best_fit;
-  if (MountSubtree(path, best_fit, NULL)) {
-    Unlock();
-    WriteLock();
-    // Check again to avoid race
-    best_fit = FindCatalog(path);
-    result = MountSubtree(path, best_fit, &catalog);
-    if (!result) {
-      Unlock();
+  Catalog *catalog = tree->FindCatalog(path);
+  if (MountSubtree(path, catalog, NULL)) {
+    tree_.Release(ticket);
+    if (!MountSubtreeUnlocked(path))
       return false;
-    }
+    tree = tree_.Acquire(&ticket);
+    catalog = tree->FindCatalog(path);
   }
 
   result = catalog->ListPathChunks(path, interpret_hashes_as, chunks);
 
-  Unlock();
+  tree_.Release(ticket);
   return result;
 }
 
 
+/**
+ * Mounts the nested catalogs required to serve path.  Runs outside any
+ * read-side section; lookups on other paths continue meanwhile.  The catalogs
+ * are downloaded without the write lock, one nesting level at a time.
+ */
+bool AbstractCatalogManager::MountSubtreeUnlocked(const PathString &path) {
+  while (true) {
+    Catalog::NestedCatalog nested;
+    unsigned ticket;
+    const CatalogTree *tree = tree_.Acquire(&ticket);
+    const bool missing = FindNextNested(path, tree->FindCatalog(path), &nested);
+    tree_.Release(ticket);
+    if (!missing)
+      return true;
+
+    // prevent endless recursion with corrupted catalogs
+    if (nested.hash.IsNull())
+      return false;
+    if (!LoadNested(path, nested))
+      return false;
+  }
+}
+
+
+/**
+ * Downloads and attaches the nested catalog on the way to path.  If another
+ * thread already downloads the same catalog, waits for its result instead.
+ * Only attaching the catalog requires the write lock.
+ * @return false if the catalog could not be loaded or attached.  True also
+ * if the catalog tree changed in the meantime, the caller has to look again.
+ */
+bool AbstractCatalogManager::LoadNested(const PathString &path,
+                                        const Catalog::NestedCatalog &nested)
+{
+  pthread_mutex_lock(lock_inflight_loads_);
+  InflightLoad *load;
+  InflightLoads::iterator iter = inflight_loads_.find(nested.hash);
+  const bool is_owner = (iter == inflight_loads_.end());
+  if (is_owner) {
+    load = new InflightLoad();
+    inflight_loads_[nested.hash] = load;
+  } else {
+    load = iter->second;
+    load->refcount++;
+  }
+  pthread_mutex_unlock(lock_inflight_loads_);
+
+  if (is_owner) {
+    LogCvmfs(kLogCatalog, kLogDebug, "load nested catalog at %s",
+             nested.path.c_str());
+    string catalog_path;
+    shash::Any catalog_hash;
+    const LoadError retval =
+      LoadCatalog(nested.path, nested.hash, &catalog_path, &catalog_hash);
+    bool result = false;
+    if ((retval == kLoadFail) || (retval == kLoadNoSpace)) {
+      LogCvmfs(kLogCatalog, kLogDebug, "failed to load catalog '%s' (%d - %s)",
+               nested.path.c_str(), retval, Code2Ascii(retval));
+    } else {
+      WriteLock();
+      // The parent might have been detached or the nested catalog mounted by
+      // a writer while we were downloading
+      Catalog *parent = FindCatalog(path);
+      Catalog::NestedCatalog current;
+      if (FindNextNested(path, parent, &current) &&
+          (current.path == nested.path) && (current.hash == nested.hash))
+      {
+        // On failure, the catalog is unloaded again
+        result = AttachNewCatalog(nested.path, catalog_path, catalog_hash,
+                                  parent) != NULL;
+      } else {
+        DiscardCatalog(catalog_hash);
+        result = true;
+      }
+      Unlock();
+    }
+    load->result.Set(result);
+  } else {
+    LogCvmfs(kLogCatalog, kLogDebug, "waiting for nested catalog at %s",
+             nested.path.c_str());
+  }
+  const bool result = load->result.Get();
+
+  pthread_mutex_lock(lock_inflight_loads_);
+  if (is_owner)
+    inflight_loads_.erase(nested.hash);
+  if (--load->refcount == 0)
+    delete load;
+  pthread_mutex_unlock(lock_inflight_loads_);
+  return result;
+}
+
 
 uint64_t AbstractCatalogManager::GetRevision() const {
-  ReadLock();
-  const uint64_t revision = revision_cache_;
-  Unlock();
+  unsigned ticket;
+  const uint64_t revision = tree_.Acquire(&ticket)->revision;
+  tree_.Release(ticket);
   return revision;
 }
 
 
 bool AbstractCatalogManager::GetVolatileFlag() const {
-  ReadLock();
-  const bool volatile_flag = GetRootCatalog()->volatile_flag();
-  Unlock();
+  unsigned ticket;
+  const bool volatile_flag = tree_.Acquire(&ticket)->root->volatile_flag();
+  tree_.Release(ticket);
   return volatile_flag;
 }
 
 
 uint64_t AbstractCatalogManager::GetTTL() const {
-  ReadLock();
-  const uint64_t revision = GetRootCatalog()->GetTTL();
-  Unlock();
+  unsigned ticket;
+  const uint64_t revision = tree_.Acquire(&ticket)->root->GetTTL();
+  tree_.Release(ticket);
   return revision;
 }
 
 
 int AbstractCatalogManager::GetNumCatalogs() const {
-  ReadLock();
-  int result = catalogs_.size();
-  Unlock();
+  unsigned ticket;
+  int result = tree_.Acquire(&ticket)->catalogs.size();
+  tree_.Release(ticket);
   return result;
 }
 
@@ -525,6 +625,63 @@ Catalog* AbstractCatalogManager::FindCatalog(const PathString &path) const {
 }
 
 
+/**
+ * Like AbstractCatalogManager::FindCatalog() but on the snapshot: the best
+ * fit is the attached catalog with the longest mount point that is a prefix
+ * of path.
+ */
+Catalog *CatalogTree::FindCatalog(const PathString &path) const {
+  Catalog *best_fit = root;
+  if (catalogs.size() == 1)
+    return best_fit;
+
+  // Mount points are directories; try every prefix that ends at a '/'
+  const char *chars = path.GetChars();
+  const unsigned length = path.GetLength();
+  PathString prefix;
+  for (unsigned i = 1; i <= length; ++i) {
+    if ((i < length) && (chars[i] != '/'))
+      continue;
+    prefix.Assign(chars, i);
+    std::map<PathString, Catalog *>::const_iterator iter =
+      catalogs.find(prefix);
+    if (iter != catalogs.end())
+      best_fit = iter->second;
+  }
+  return best_fit;
+}
+
+
+/**
+ * Makes the current set of attached catalogs visible to lookups.  Doesn't wait
+ * for lookups on the previous snapshot: it is retired together with the
+ * catalogs that have been detached in the meantime and freed by a later
+ * PublishTree() once no lookup uses it anymore.  Must be called with the write
+ * lock held.
+ */
+void AbstractCatalogManager::PublishTree() {
+  CatalogTree *tree = new CatalogTree();
+  for (CatalogList::const_iterator i = catalogs_.begin(),
+       iEnd = catalogs_.end(); i != iEnd; ++i)
+  {
+    tree->catalogs[(*i)->path()] = *i;
+  }
+  tree->root = catalogs_.empty() ? NULL : GetRootCatalog();
+  tree->revision = revision_cache_;
+  tree_.Peek()->retired.swap(retired_catalogs_);
+  tree_.Replace(tree);
+}
+
+
+CatalogTree::~CatalogTree() {
+  for (CatalogList::const_iterator i = retired.begin(), iEnd = retired.end();
+       i != iEnd; ++i)
+  {
+    delete *i;
+  }
+}
+
+
 /**
  * Checks if a searched catalog is already mounted to this CatalogManager
  * @param root_path the root path of the searched catalog
@@ -547,18 +704,13 @@ bool AbstractCatalogManager::IsAttached(const PathString &root_path,
 
 
 /**
- * Recursively mounts all nested catalogs required to serve a path.
- * If leaf_catalog is NULL, just indicate if it is necessary to load a
- * nested catalog for the given path.
- * The final leaf nested catalog is returned.
+ * Finds the nested catalog of parent that is next on the way to path.
+ * @return false if path is served by parent itself
  */
-bool AbstractCatalogManager::MountSubtree(const PathString &path,
-                                          const Catalog *entry_point,
-                                          Catalog **leaf_catalog)
+bool AbstractCatalogManager::FindNextNested(const PathString &path,
+                                            const Catalog *parent,
+                                            Catalog::NestedCatalog *nested)
 {
-  bool result = true;
-  Catalog *parent = (entry_point == NULL) ?
-                    GetRootCatalog() : const_cast<Catalog *>(entry_point);
   assert(path.StartsWith(parent->path()));
 
   // Try to find path as a super string of nested catalog mount points
@@ -574,28 +726,45 @@ bool AbstractCatalogManager::MountSubtree(const PathString &path,
     PathString nested_path_slash(i->path);
     nested_path_slash.Append("/", 1);
     if (path_slash.StartsWith(nested_path_slash)) {
-      if (leaf_catalog == NULL)
-        return true;
-      Catalog *new_nested;
-      LogCvmfs(kLogCatalog, kLogDebug, "load nested catalog at %s",
-               i->path.c_str());
-      // prevent endless recursion with corrupted catalogs
-      // (due to reloading root)
-      if (i->hash.IsNull())
-        return false;
-      new_nested = MountCatalog(i->path, i->hash, parent);
-      if (!new_nested)
-        return false;
-
-      result = MountSubtree(path, new_nested, &parent);
-      break;
+      *nested = *i;
+      return true;
     }
   }
+  return false;
+}
+
+
+/**
+ * Recursively mounts all nested catalogs required to serve a path.
+ * If leaf_catalog is NULL, just indicate if it is necessary to load a
+ * nested catalog for the given path.
+ * The final leaf nested catalog is returned.
+ */
+bool AbstractCatalogManager::MountSubtree(const PathString &path,
+                                          const Catalog *entry_point,
+                                          Catalog **leaf_catalog)
+{
+  Catalog *parent = (entry_point == NULL) ?
+                    GetRootCatalog() : const_cast<Catalog *>(entry_point);
+  Catalog::NestedCatalog nested;
+  while (FindNextNested(path, parent, &nested)) {
+    if (leaf_catalog == NULL)
+      return true;
+    LogCvmfs(kLogCatalog, kLogDebug, "load nested catalog at %s",
+             nested.path.c_str());
+    // prevent endless recursion with corrupted catalogs
+    // (due to reloading root)
+    if (nested.hash.IsNull())
+      return false;
+    parent = MountCatalog(nested.path, nested.hash, parent);
+    if (!parent)
+      return false;
+  }
 
   if (leaf_catalog == NULL)
     return false;
   *leaf_catalog = parent;
-  return result;
+  return true;
 }
 
 
@@ -621,7 +790,23 @@ Catalog *AbstractCatalogManager::MountCatalog(const PathString &mountpoint,
     return NULL;
   }
 
-  attached_catalog = CreateCatalog(mountpoint, catalog_hash, parent_catalog);
+  return AttachNewCatalog(mountpoint, catalog_path, catalog_hash,
+                          parent_catalog);
+}
+
+
+/**
+ * Creates the Catalog object for a loaded catalog file and attaches it.
+ * Requires the write lock.
+ */
+Catalog *AbstractCatalogManager::AttachNewCatalog(
+  const PathString &mountpoint,
+  const string &catalog_path,
+  const shash::Any &catalog_hash,
+  Catalog *parent_catalog)
+{
+  Catalog *attached_catalog =
+    CreateCatalog(mountpoint, catalog_hash, parent_catalog);
 
   // Attach loaded catalog
   if (!AttachCatalog(catalog_path, attached_catalog)) {
@@ -660,6 +845,10 @@ bool AbstractCatalogManager::AttachCatalog(const string &db_path,
   new_catalog->set_inode_range(range);
   new_catalog->SetInodeAnnotation(inode_annotation_);
   new_catalog->SetOwnerMaps(&uid_map_, &gid_map_);
+  if (catalog_mmap_size_ > 0)
+    new_catalog->SetMmapSize(catalog_mmap_size_);
+  if (lookup_filter_)
+    new_catalog->EnableLookupFilter(&lookup_filter_counters_);
 
   // Add catalog to the manager
   if (!new_catalog->IsInitialized()) {
@@ -676,13 +865,14 @@ bool AbstractCatalogManager::AttachCatalog(const string &db_path,
 
   catalogs_.push_back(new_catalog);
   ActivateCatalog(new_catalog);
+  PublishTree();
   return true;
 }
 
 
 /**
  * Removes a catalog from this CatalogManager, the catalog pointer is
- * freed if the call succeeds.
+ * freed by the next PublishTree().
  * This method can create dangling children if a catalog in the middle of
  * a tree is removed.
  * @param catalog the catalog to detach
@@ -701,7 +891,8 @@ void AbstractCatalogManager::DetachCatalog(Catalog *catalog) {
   for (i = catalogs_.begin(), iend = catalogs_.end(); i != iend; ++i) {
     if (*i == catalog) {
       catalogs_.erase(i);
-      delete catalog;
+      // Lookups might still use the catalog
+      retired_catalogs_.push_back(catalog);
       return;
     }
   }
@@ -712,7 +903,7 @@ void AbstractCatalogManager::DetachCatalog(Catalog *catalog) {
 
 /**
  * Removes a catalog (and all of it's children) from this CatalogManager.
- * The given catalog and all children are freed, if this call succeeds.
+ * The given catalog and all children are freed by the next PublishTree().
  * @param catalog the catalog to detach
  * @return true on success, false otherwise
  */
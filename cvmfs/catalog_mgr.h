@@ -23,10 +23,16 @@
 #include "file_chunk.h"
 #include "hash.h"
 #include "logging.h"
+#include "shortstring.h"
 #include "util.h"
+#include "util_concurrency.h"
 
 class XattrList;
 
+namespace perf {
+class Statistics;
+}
+
 namespace catalog {
 
 const unsigned kSqliteMemPerThread = 1*1024*1024;
@@ -128,6 +134,28 @@ class InodeGenerationAnnotation : public InodeAnnotation {
 };
 
 
+/**
+ * Immutable snapshot of the attached catalogs.  Lookups find their catalog in
+ * the snapshot without taking the catalog manager lock.  Every change to the
+ * set of attached catalogs publishes a new snapshot; catalogs are only deleted
+ * once no reader can see them anymore.
+ */
+struct CatalogTree {
+  CatalogTree() : root(NULL), revision(0) { }
+  ~CatalogTree();
+  Catalog *FindCatalog(const PathString &path) const;
+
+  std::map<PathString, Catalog *> catalogs;  /**< by mount point */
+  Catalog *root;
+  uint64_t revision;
+  /**
+   * Catalogs that were detached after this snapshot had been published.  They
+   * are deleted together with the snapshot.
+   */
+  CatalogList retired;
+};
+
+
 class AbstractCatalogManager;
 /**
  * Here, the Cwd Buffer is registered in order to save the inodes of
@@ -149,6 +177,12 @@ class RemountListener {
  *
  * The loading / creating of catalogs is up to derived classes.
  *
+ * Lookups don't take locks.  They work on a published snapshot of the
+ * attached catalogs (CatalogTree).  Only mounting and detaching catalogs is
+ * serialized by the write lock.  Nested catalogs required by a lookup are
+ * downloaded before the write lock is taken; concurrent lookups that need the
+ * same nested catalog wait for the same download.
+ *
  * Usage:
  *   DerivedCatalogManager *catalog_manager = new DerivedCatalogManager();
  *   catalog_manager->Init();
@@ -197,6 +231,8 @@ class AbstractCatalogManager : public SingleCopy {
     Unlock();
   }
   void SetOwnerMaps(const OwnerMap &uid_map, const OwnerMap &gid_map);
+  void SetCatalogMmapSize(const uint64_t size);
+  void EnableLookupFilter(perf::Statistics *statistics);
 
   Statistics statistics() const { return statistics_; }
   uint64_t inode_gauge() {
@@ -232,12 +268,21 @@ class AbstractCatalogManager : public SingleCopy {
    * Load the catalog and return a file name and the catalog hash. Derived
    * class can decide if it wants to use the hash or the path.
    * Both the input as well as the output hash can be 0.
+   * Nested catalogs (non-zero input hash) are also loaded without the write
+   * lock held, so that part has to be thread-safe.  The same hash is never
+   * loaded concurrently, though.
    */
   virtual LoadError LoadCatalog(const PathString &mountpoint,
                                 const shash::Any &hash,
                                 std::string  *catalog_path,
                                 shash::Any   *catalog_hash) = 0;
   virtual void UnloadCatalog(const Catalog *catalog) { }
+  /**
+   * Called with the write lock held for a nested catalog that was loaded but
+   * is not attached because the tree changed during the download.  Releases
+   * what LoadCatalog() acquired for it.
+   */
+  virtual void DiscardCatalog(const shash::Any &catalog_hash) { }
   virtual void ActivateCatalog(Catalog *catalog) { }
 
   /**
@@ -267,6 +312,7 @@ class AbstractCatalogManager : public SingleCopy {
 
   inline Catalog* GetRootCatalog() const { return catalogs_.front(); }
   Catalog *FindCatalog(const PathString &path) const;
+  void PublishTree();
 
   inline void ReadLock() const {
     int retval = pthread_rwlock_rdlock(rwlock_);
@@ -283,7 +329,27 @@ class AbstractCatalogManager : public SingleCopy {
   virtual void EnforceSqliteMemLimit();
 
  private:
+  /**
+   * A nested catalog download that concurrent lookups can wait for.  The
+   * result tells if the download and the attach succeeded.
+   */
+  struct InflightLoad {
+    InflightLoad() : refcount(1) { }
+    Future<bool> result;
+    unsigned refcount;
+  };
+  typedef std::map<shash::Any, InflightLoad *> InflightLoads;
+
   void CheckInodeWatermark();
+  bool FindNextNested(const PathString &path, const Catalog *parent,
+                      Catalog::NestedCatalog *nested);
+  Catalog *AttachNewCatalog(const PathString &mountpoint,
+                            const std::string &catalog_path,
+                            const shash::Any &catalog_hash,
+                            Catalog *parent_catalog);
+  bool MountSubtreeUnlocked(const PathString &path);
+  bool LoadNested(const PathString &path,
+                  const Catalog::NestedCatalog &nested);
 
   /**
    * This list is only needed to find a catalog given an inode.
@@ -299,12 +365,30 @@ class AbstractCatalogManager : public SingleCopy {
    */
   uint64_t incarnation_;
   InodeAnnotation *inode_annotation_;  /**< applied to all catalogs */
+  /**
+   * Serializes changes to the catalog tree.  Lookups don't take it, they use
+   * the published snapshot.
+   */
   pthread_rwlock_t *rwlock_;
+  mutable RcuPtr<CatalogTree> tree_;
+  /**
+   * Detached catalogs, handed to the current snapshot by the next
+   * PublishTree()
+   */
+  CatalogList retired_catalogs_;
+  /**
+   * Nested catalog downloads in progress, by catalog hash
+   */
+  InflightLoads inflight_loads_;
+  pthread_mutex_t *lock_inflight_loads_;
   Statistics statistics_;
   pthread_key_t pkey_sqlitemem_;
   RemountListener *remount_listener_;
   OwnerMap uid_map_;
   OwnerMap gid_map_;
+  uint64_t catalog_mmap_size_;  /**< applied to all catalogs */
+  bool lookup_filter_;  /**< build negative lookup filters for all catalogs */
+  LookupFilterCounters lookup_filter_counters_;
 
   // Not needed anymore since there are the glue buffers
   // Catalog *Inode2Catalog(const inode_t inode);
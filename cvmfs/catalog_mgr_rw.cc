@@ -13,6 +13,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <string>
+#include <vector>
 
 #include "catalog_rw.h"
 #include "logging.h"
@@ -20,6 +21,7 @@
 #include "smalloc.h"
 #include "upload.h"
 #include "util.h"
+#include "util_concurrency.h"
 
 using namespace std;  // NOLINT
 
@@ -332,7 +334,9 @@ void WritableCatalogManager::AddFile(
     assert(false);
   }
 
-  assert(!entry.IsRegular() || !entry.checksum().IsNull());
+  // chunked files above the bulk chunk threshold have no content hash
+  assert(!entry.IsRegular() || entry.IsChunkedFile() ||
+         !entry.checksum().IsNull());
   catalog->AddEntry(entry, xattrs, file_path, parent_path);
   SyncUnlock();
 }
@@ -632,6 +636,7 @@ void WritableCatalogManager::RemoveNestedCatalog(const string &mountpoint) {
 
   // Remove the catalog from internal data structures
   DetachCatalog(nested_catalog);
+  PublishTree();
   SyncUnlock();
 }
 
@@ -671,63 +676,46 @@ manifest::Manifest *WritableCatalogManager::Commit(
   reinterpret_cast<WritableCatalog *>(GetRootCatalog())->SetDirty();
   WritableCatalogList catalogs_to_snapshot;
   GetModifiedCatalogs(&catalogs_to_snapshot);
+  WritableCatalog *root_catalog = catalogs_to_snapshot.back();
+  assert(root_catalog->IsRoot());
 
   spooler_->RegisterListener(
     &WritableCatalogManager::CatalogUploadCallback, this);
 
-  manifest::Manifest *result = NULL;
-  for (WritableCatalogList::iterator i = catalogs_to_snapshot.begin(),
-       iEnd = catalogs_to_snapshot.end(); i != iEnd; ++i)
-  {
-    (*i)->Commit();
-    if (stop_for_tweaks) {
-      LogCvmfs(kLogCatalog, kLogStdout, "Allowing for tweaks in %s at %s "
-               "(hit return to continue)",
-               (*i)->database_path().c_str(), (*i)->path().c_str());
-      int read_char = getchar();
-      assert(read_char != EOF);
-    }
-
-    if ((*i)->IsRoot() && manual_revision > 0) {
-      const uint64_t revision = (*i)->GetRevision();
-      if (revision >= manual_revision) {
-        LogCvmfs(kLogCatalog, kLogStderr, "Manual revision (%d) must not be "
-                                          "smaller than the current root "
-                                          "catalog's (%d). Skipped!",
-                                          manual_revision, revision);
-      } else {
-        // Gets incremented by SnapshotCatalog() afterwards!
-        (*i)->SetRevision(manual_revision - 1);
-      }
-    }
-    shash::Any hash = SnapshotCatalog(*i);
-
-    if ((*i)->GetCounters().GetSelfEntries() > catalog_entry_warn_threshold_) {
-      LogCvmfs(kLogCatalog, kLogStdout,
-               "WARNING: catalog at %s has more than %d entries (%d). "
-               "Please consider to split it into nested catalogs.",
-               ((*i)->IsRoot()) ? "/" : (*i)->path().c_str(),
-               catalog_entry_warn_threshold_,
-               (*i)->GetCounters().GetSelfEntries());
-    }
+  StopWatch stopwatch;
+  stopwatch.Start();
+  SnapshotTimings timings;
+  const shash::Any hash = SnapshotCatalogs(catalogs_to_snapshot,
+                                           stop_for_tweaks, manual_revision,
+                                           &timings);
+  set_base_hash(hash);
+
+  LogCvmfs(kLogCatalog, kLogVerboseMsg, "waiting for upload of catalogs");
+  StopWatch stopwatch_wait;
+  stopwatch_wait.Start();
+  spooler_->WaitForUpload();
+  stopwatch_wait.Stop();
+  stopwatch.Stop();
+  LogCvmfs(kLogCatalog, kLogStdout,
+           "Snapshotted %u catalogs in %.2f seconds (summed up over all "
+           "threads: database %.2fs, compression %.2fs, upload %.2fs; "
+           "waiting for uploads %.2fs)",
+           static_cast<unsigned>(catalogs_to_snapshot.size()),
+           stopwatch.GetTime(),
+           timings.commit, timings.compress, timings.upload,
+           stopwatch_wait.GetTime());
 
-    if ((*i)->IsRoot()) {
-      set_base_hash(hash);
-      LogCvmfs(kLogCatalog, kLogVerboseMsg, "waiting for upload of catalogs");
-      spooler_->WaitForUpload();
-      if (spooler_->GetNumberOfErrors() > 0) {
-        LogCvmfs(kLogCatalog, kLogStderr, "failed to commit catalogs");
-        return NULL;
-      }
-
-      // .cvmfspublished
-      int64_t catalog_size = GetFileSize((*i)->database_path());
-      if (catalog_size < 0)
-        return NULL;
+  manifest::Manifest *result = NULL;
+  if (spooler_->GetNumberOfErrors() > 0) {
+    LogCvmfs(kLogCatalog, kLogStderr, "failed to commit catalogs");
+  } else {
+    // .cvmfspublished
+    const int64_t catalog_size = GetFileSize(root_catalog->database_path());
+    if (catalog_size >= 0) {
       LogCvmfs(kLogCatalog, kLogVerboseMsg, "Committing repository manifest");
       result = new manifest::Manifest(hash, catalog_size, "");
-      result->set_ttl((*i)->GetTTL());
-      result->set_revision((*i)->GetRevision());
+      result->set_ttl(root_catalog->GetTTL());
+      result->set_revision(root_catalog->GetRevision());
     }
   }
 
@@ -737,6 +725,139 @@ manifest::Manifest *WritableCatalogManager::Commit(
 }
 
 
+/**
+ * State shared by the snapshot threads.  A catalog is ready once all its
+ * modified children are done because the new hashes of the children are
+ * written into the parent.
+ */
+struct WritableCatalogManager::SnapshotScheduler {
+  WritableCatalogManager *catalog_mgr;
+  bool stop_for_tweaks;
+  uint64_t manual_revision;
+
+  BottomUpScheduler<WritableCatalog> catalogs;
+  /**
+   * Protects root_hash and timings
+   */
+  pthread_mutex_t lock;
+  shash::Any root_hash;
+  SnapshotTimings timings;
+};
+
+
+/**
+ * Snapshots the modified catalogs, children before their parents.
+ * @return the content hash of the new root catalog
+ */
+shash::Any WritableCatalogManager::SnapshotCatalogs(
+  const WritableCatalogList &catalogs,
+  const bool stop_for_tweaks,
+  const uint64_t manual_revision,
+  SnapshotTimings *timings)
+{
+  SnapshotScheduler scheduler;
+  scheduler.catalog_mgr = this;
+  scheduler.stop_for_tweaks = stop_for_tweaks;
+  scheduler.manual_revision = manual_revision;
+  int retval = pthread_mutex_init(&scheduler.lock, NULL);
+  assert(retval == 0);
+
+  // Modified catalogs have modified parents, up to the root catalog
+  for (WritableCatalogList::const_iterator i = catalogs.begin(),
+       iEnd = catalogs.end(); i != iEnd; ++i)
+  {
+    scheduler.catalogs.Add(*i,
+      (*i)->HasParent() ? (*i)->GetWritableParent() : NULL);
+  }
+  const unsigned num_leafs = scheduler.catalogs.Start();
+
+  // Tweaks are interactive, one catalog after the other
+  unsigned num_threads = stop_for_tweaks ? 1 : GetNumberOfCpuCores();
+  if (num_threads > catalogs.size())
+    num_threads = catalogs.size();
+  LogCvmfs(kLogCatalog, kLogVerboseMsg,
+           "snapshotting %u catalogs (%u leafs) with %u threads",
+           static_cast<unsigned>(catalogs.size()), num_leafs, num_threads);
+  std::vector<pthread_t> threads(num_threads);
+  for (unsigned i = 0; i < num_threads; ++i) {
+    retval = pthread_create(&threads[i], NULL, MainSnapshot, &scheduler);
+    assert(retval == 0);
+  }
+  for (unsigned i = 0; i < num_threads; ++i)
+    pthread_join(threads[i], NULL);
+
+  pthread_mutex_destroy(&scheduler.lock);
+  timings->Add(scheduler.timings);
+  return scheduler.root_hash;
+}
+
+
+void *WritableCatalogManager::MainSnapshot(void *data) {
+  SnapshotScheduler *scheduler = reinterpret_cast<SnapshotScheduler *>(data);
+
+  WritableCatalog *catalog;
+  while ((catalog = scheduler->catalogs.Next()) != NULL) {
+    SnapshotTimings timings;
+    const shash::Any hash = scheduler->catalog_mgr->ProcessCatalog(
+      catalog, scheduler->stop_for_tweaks, scheduler->manual_revision,
+      &timings);
+
+    pthread_mutex_lock(&scheduler->lock);
+    scheduler->timings.Add(timings);
+    if (catalog->IsRoot())
+      scheduler->root_hash = hash;
+    pthread_mutex_unlock(&scheduler->lock);
+    scheduler->catalogs.Done(catalog);
+  }
+  return NULL;
+}
+
+
+/**
+ * Commits, snapshots and uploads a single modified catalog.  Runs
+ * concurrently for catalogs that don't depend on each other.
+ */
+shash::Any WritableCatalogManager::ProcessCatalog(
+  WritableCatalog *catalog,
+  const bool stop_for_tweaks,
+  const uint64_t manual_revision,
+  SnapshotTimings *timings)
+{
+  catalog->Commit();
+  if (stop_for_tweaks) {
+    LogCvmfs(kLogCatalog, kLogStdout, "Allowing for tweaks in %s at %s "
+             "(hit return to continue)",
+             catalog->database_path().c_str(), catalog->path().c_str());
+    int read_char = getchar();
+    assert(read_char != EOF);
+  }
+
+  if (catalog->IsRoot() && manual_revision > 0) {
+    const uint64_t revision = catalog->GetRevision();
+    if (revision >= manual_revision) {
+      LogCvmfs(kLogCatalog, kLogStderr, "Manual revision (%d) must not be "
+                                        "smaller than the current root "
+                                        "catalog's (%d). Skipped!",
+                                        manual_revision, revision);
+    } else {
+      // Gets incremented by SnapshotCatalog() afterwards!
+      catalog->SetRevision(manual_revision - 1);
+    }
+  }
+  const shash::Any hash = SnapshotCatalog(catalog, timings);
+
+  if (catalog->GetCounters().GetSelfEntries() > catalog_entry_warn_threshold_) {
+    LogCvmfs(kLogCatalog, kLogStdout,
+             "WARNING: catalog at %s has more than %d entries (%d). "
+             "Please consider to split it into nested catalogs.",
+             (catalog->IsRoot()) ? "/" : catalog->path().c_str(),
+             catalog_entry_warn_threshold_,
+             catalog->GetCounters().GetSelfEntries());
+  }
+  return hash;
+}
+
+
 int WritableCatalogManager::GetModifiedCatalogsRecursively(
   const Catalog *catalog,
   WritableCatalogList *result) const
@@ -771,19 +892,24 @@ int WritableCatalogManager::GetModifiedCatalogsRecursively(
 
 /**
  * Makes a new catalog revision.  Compresses and uploads catalog.  Returns
- * content hash.
+ * content hash.  Siblings can be snapshotted concurrently, access to the
+ * parent catalog is serialized.
  */
-shash::Any WritableCatalogManager::SnapshotCatalog(WritableCatalog *catalog)
-  const
+shash::Any WritableCatalogManager::SnapshotCatalog(WritableCatalog *catalog,
+                                                   SnapshotTimings *timings)
 {
   LogCvmfs(kLogCatalog, kLogVerboseMsg, "creating snapshot of catalog '%s'",
            catalog->path().c_str());
 
+  StopWatch stopwatch;
+  stopwatch.Start();
   catalog->Transaction();
   catalog->UpdateCounters();
   if (catalog->parent()) {
+    SyncLock();
     catalog->delta_counters_.PopulateToParent(
       &catalog->GetWritableParent()->delta_counters_);
+    SyncUnlock();
   }
   catalog->delta_counters_.SetZero();
 
@@ -796,20 +922,26 @@ shash::Any WritableCatalogManager::SnapshotCatalog(WritableCatalog *catalog)
   } else {
     shash::Any hash_previous;
     uint64_t size_previous;
+    SyncLock();
     const bool retval =
       catalog->parent()->FindNested(catalog->path(),
                                     &hash_previous, &size_previous);
+    SyncUnlock();
     assert(retval);
     catalog->SetPreviousRevision(hash_previous);
   }
   catalog->Commit();
 
   catalog->VacuumDatabaseIfNecessary();
+  stopwatch.Stop();
+  timings->commit += stopwatch.GetTime();
+  stopwatch.Reset();
 
   uint64_t catalog_size = GetFileSize(catalog->database_path());
   assert(catalog_size > 0);
 
   // Compress catalog
+  stopwatch.Start();
   shash::Any hash_catalog(spooler_->GetHashAlgorithm(), shash::kSuffixCatalog);
   if (!zlib::CompressPath2Path(catalog->database_path(),
                                catalog->database_path() + ".compressed",
@@ -818,17 +950,25 @@ shash::Any WritableCatalogManager::SnapshotCatalog(WritableCatalog *catalog)
     PrintError("could not compress catalog " + catalog->path().ToString());
     assert(false);
   }
+  stopwatch.Stop();
+  timings->compress += stopwatch.GetTime();
+  stopwatch.Reset();
 
   // Upload catalog
+  stopwatch.Start();
   spooler_->Upload(catalog->database_path() + ".compressed",
                    "data" + hash_catalog.MakePathExplicit(1, 2) + "C");
+  stopwatch.Stop();
+  timings->upload += stopwatch.GetTime();
 
   // Update registered catalog hash in nested catalog
   if (catalog->HasParent()) {
     LogCvmfs(kLogCatalog, kLogVerboseMsg, "updating nested catalog link");
     WritableCatalog *parent = static_cast<WritableCatalog *>(catalog->parent());
+    SyncLock();
     parent->UpdateNestedCatalog(catalog->path().ToString(), hash_catalog,
                                 catalog_size);
+    SyncUnlock();
   }
 
   return hash_catalog;
@@ -135,7 +135,34 @@ class WritableCatalogManager : public SimpleCatalogManager {
   int GetModifiedCatalogsRecursively(const Catalog *catalog,
                                      WritableCatalogList *result) const;
 
-  shash::Any SnapshotCatalog(WritableCatalog *catalog) const;
+  /**
+   * Wall clock time spent in the stages of catalog snapshots, summed up over
+   * all snapshot threads
+   */
+  struct SnapshotTimings {
+    SnapshotTimings() : commit(0.0), compress(0.0), upload(0.0) { }
+    void Add(const SnapshotTimings &other) {
+      commit += other.commit;
+      compress += other.compress;
+      upload += other.upload;
+    }
+    double commit;
+    double compress;
+    double upload;
+  };
+  struct SnapshotScheduler;
+
+  shash::Any SnapshotCatalogs(const WritableCatalogList &catalogs,
+                              const bool stop_for_tweaks,
+                              const uint64_t manual_revision,
+                              SnapshotTimings *timings);
+  static void *MainSnapshot(void *data);
+  shash::Any ProcessCatalog(WritableCatalog *catalog,
+                            const bool stop_for_tweaks,
+                            const uint64_t manual_revision,
+                            SnapshotTimings *timings);
+  shash::Any SnapshotCatalog(WritableCatalog *catalog,
+                             SnapshotTimings *timings);
   void CatalogUploadCallback(const upload::SpoolerResult &result);
 
  private:
@@ -145,7 +172,8 @@ class WritableCatalogManager : public SimpleCatalogManager {
   // defined in catalog_mgr_rw.cc
   static const std::string kCatalogFilename;
 
-  // private lock of WritableCatalogManager
+  // private lock of WritableCatalogManager, during Commit() it protects the
+  // parent catalogs that are updated by concurrent snapshots of their children
   pthread_mutex_t *sync_lock_;
   upload::Spooler *spooler_;
 
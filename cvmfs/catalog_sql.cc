@@ -422,10 +422,9 @@ SqlListContentHashes::SqlListContentHashes(const CatalogDatabase &database) {
       "UNION "
       "SELECT chunks.hash, catalog.flags, 1 "
       "  FROM catalog "
-      "  LEFT JOIN chunks "
+      "  JOIN chunks "
       "  ON catalog.md5path_1 = chunks.md5path_1 AND "
-      "     catalog.md5path_2 = chunks.md5path_2 "
-      "  WHERE length(catalog.hash) > 0;";
+      "     catalog.md5path_2 = chunks.md5path_2;";
 
   const bool successful_init = Init(database.sqlite_db(), statement);
   assert(successful_init);
@@ -1057,6 +1056,24 @@ bool SqlAllChunks::Close() {
 //------------------------------------------------------------------------------
 
 
+SqlAllPathHashes::SqlAllPathHashes(const CatalogDatabase &database) {
+  const string statement = "SELECT md5path_1, md5path_2 FROM catalog;";
+  Init(database.sqlite_db(), statement);
+}
+
+
+bool SqlAllPathHashes::Next(shash::Md5 *md5path) {
+  if (FetchRow()) {
+    *md5path = RetrieveMd5(0, 1);
+    return true;
+  }
+  return false;
+}
+
+
+//------------------------------------------------------------------------------
+
+
 SqlLookupXattrs::SqlLookupXattrs(const CatalogDatabase &database) {
   const string statement =
     "SELECT xattr FROM catalog "
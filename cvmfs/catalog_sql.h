@@ -527,6 +527,19 @@ class SqlAllChunks : public Sql {
 //------------------------------------------------------------------------------
 
 
+/**
+ * Enumerates the path hashes of all directory entries of a catalog.
+ */
+class SqlAllPathHashes : public Sql {
+ public:
+  explicit SqlAllPathHashes(const CatalogDatabase &database);
+  bool Next(shash::Md5 *md5path);
+};
+
+
+//------------------------------------------------------------------------------
+
+
 class SqlLookupXattrs : public Sql {
  public:
   explicit SqlLookupXattrs(const CatalogDatabase &database);
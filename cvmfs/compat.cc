@@ -165,8 +165,25 @@ ChunkTables::~ChunkTables() {
 
 void Migrate(ChunkTables *old_tables, ::ChunkTables *new_tables) {
   new_tables->next_handle = old_tables->next_handle;
-  new_tables->handle2fd = old_tables->handle2fd;
-  new_tables->inode2references = old_tables->inode2references;
+
+  SmallHashDynamic<uint64_t, ::ChunkFd> *old_handle2fd =
+    &old_tables->handle2fd;
+  for (unsigned keyno = 0; keyno < old_handle2fd->capacity(); ++keyno) {
+    const uint64_t handle = old_handle2fd->keys()[keyno];
+    if (handle == 0) continue;
+    new_tables->Handle2Shard(handle)->handle2fd.Insert(
+      handle, old_handle2fd->values()[keyno]);
+  }
+
+  SmallHashDynamic<uint64_t, uint32_t> *old_inode2references =
+    &old_tables->inode2references;
+  for (unsigned keyno = 0; keyno < old_inode2references->capacity(); ++keyno)
+  {
+    const uint64_t inode = old_inode2references->keys()[keyno];
+    if (inode == 0) continue;
+    new_tables->Inode2Shard(inode)->inode2references.Insert(
+      inode, old_inode2references->values()[keyno]);
+  }
 
   SmallHashDynamic<uint64_t, FileChunkReflist> *old_inode2chunks =
     &old_tables->inode2chunks;
@@ -187,10 +204,62 @@ void Migrate(ChunkTables *old_tables, ::ChunkTables *new_tables) {
     }
     delete old_list;
     ::FileChunkReflist new_reflist(new_list, old_reflist->path);
-    new_tables->inode2chunks.Insert(inode, new_reflist);
+    new_tables->Inode2Shard(inode)->inode2chunks.Insert(inode, new_reflist);
   }
 }
 
 }  // namespace chunk_tables
 
+
+//------------------------------------------------------------------------------
+
+
+namespace chunk_tables_v2 {
+
+ChunkTables::~ChunkTables() {
+  pthread_mutex_destroy(lock);
+  free(lock);
+  for (unsigned i = 0; i < kNumHandleLocks; ++i) {
+    pthread_mutex_destroy(handle_locks.At(i));
+    free(handle_locks.At(i));
+  }
+}
+
+/**
+ * The file chunk lists are handed over to the new tables as they are.
+ */
+void Migrate(ChunkTables *old_tables, ::ChunkTables *new_tables) {
+  new_tables->next_handle = old_tables->next_handle;
+
+  SmallHashDynamic<uint64_t, ::ChunkFd> *old_handle2fd =
+    &old_tables->handle2fd;
+  for (unsigned keyno = 0; keyno < old_handle2fd->capacity(); ++keyno) {
+    const uint64_t handle = old_handle2fd->keys()[keyno];
+    if (handle == 0) continue;
+    new_tables->Handle2Shard(handle)->handle2fd.Insert(
+      handle, old_handle2fd->values()[keyno]);
+  }
+
+  SmallHashDynamic<uint64_t, uint32_t> *old_inode2references =
+    &old_tables->inode2references;
+  for (unsigned keyno = 0; keyno < old_inode2references->capacity(); ++keyno)
+  {
+    const uint64_t inode = old_inode2references->keys()[keyno];
+    if (inode == 0) continue;
+    new_tables->Inode2Shard(inode)->inode2references.Insert(
+      inode, old_inode2references->values()[keyno]);
+  }
+
+  SmallHashDynamic<uint64_t, ::FileChunkReflist> *old_inode2chunks =
+    &old_tables->inode2chunks;
+  for (unsigned keyno = 0; keyno < old_inode2chunks->capacity(); ++keyno) {
+    const uint64_t inode = old_inode2chunks->keys()[keyno];
+    if (inode == 0) continue;
+    new_tables->Inode2Shard(inode)->inode2chunks.Insert(
+      inode, old_inode2chunks->values()[keyno]);
+  }
+}
+
+}  // namespace chunk_tables_v2
+
 }  // namespace compat
@@ -5,6 +5,9 @@
  * a set of functions to conveniently compress and decompress stuff.
  * Allmost all of the functions return true on success, otherwise false.
  *
+ * File contents can alternatively be compressed with zstd (if built with
+ * CVMFS_ZSTD), see the Compressor and Decompressor plugins at the end.
+ *
  * TODO: think about code deduplication
  */
 
@@ -19,6 +22,10 @@
 #include <cassert>
 #include <cstring>
 
+#ifdef CVMFS_ZSTD
+#include <zstd.h>
+#endif
+
 #include "hash.h"
 #include "logging.h"
 #include "platform.h"
@@ -495,29 +502,22 @@ bool CompressFile2File(FILE *fsrc, FILE *fdest, shash::Any *compressed_hash) {
 
 
 bool DecompressFile2File(FILE *fsrc, FILE *fdest) {
-  bool result = false;
   StreamStates stream_state = kStreamIOError;
-  z_stream strm;
+  StreamDecompressor decompressor;
   size_t have;
   unsigned char buf[kBufferSize];
 
-  DecompressInit(&strm);
-
   while ((have = fread(buf, 1, kBufferSize, fsrc)) > 0) {
-    stream_state = DecompressZStream2File(&strm, fdest, buf, have);
+    stream_state = decompressor.Inflate2File(buf, have, fdest);
     if ((stream_state == kStreamDataError) || (stream_state == kStreamIOError))
-      goto decompress_file2file_final;
+      return false;
   }
   LogCvmfs(kLogCompress, kLogDebug, "end of decompression, state=%d, error=%d",
            stream_state, ferror(fsrc));
   if ((stream_state != kStreamEnd) || ferror(fsrc))
-    goto decompress_file2file_final;
-
-  result = true;
+    return false;
 
- decompress_file2file_final:
-  DecompressFini(&strm);
-  return result;
+  return true;
 }
 
 
@@ -647,12 +647,19 @@ bool CompressMem2Mem(const void *buf, const int64_t size,
 }
 
 
+static bool ZstdDecompressMem2Mem(const void *buf, const int64_t size,
+                                  void **out_buf, uint64_t *out_size);
+
 /**
- * User of this function has to free out_buf.
+ * User of this function has to free out_buf.  Zstd compressed buffers are
+ * detected and decompressed as well.
  */
 bool DecompressMem2Mem(const void *buf, const int64_t size,
                        void **out_buf, uint64_t *out_size)
 {
+  if (DetectAlgorithm(buf, size) == kZstd)
+    return ZstdDecompressMem2Mem(buf, size, out_buf, out_size);
+
   unsigned char out[kZChunk];
   int z_ret;
   z_stream strm;
@@ -707,4 +714,391 @@ bool DecompressMem2Mem(const void *buf, const int64_t size,
   return true;
 }
 
+
+//-----------------------------------------------------------------------------
+
+
+// Every zstd frame starts with this magic number (little endian 0xFD2FB528).
+// The first byte of a zlib stream is 0x78 for the default window size.
+static const unsigned char kZstdMagic[4] = {0x28, 0xb5, 0x2f, 0xfd};
+
+
+bool ParseAlgorithm(const string &name, Algorithms *algorithm) {
+  if ((name == "zlib") || (name == "default")) {
+    *algorithm = kZlibDefault;
+    return true;
+  }
+  if (name == "zstd") {
+    *algorithm = kZstd;
+    return true;
+  }
+  return false;
+}
+
+
+string AlgorithmName(const Algorithms algorithm) {
+  switch (algorithm) {
+    case kZlibDefault:
+      return "zlib";
+    case kZstd:
+      return "zstd";
+    default:
+      return "unknown";
+  }
+}
+
+
+bool IsAlgorithmSupported(const Algorithms algorithm) {
+  switch (algorithm) {
+    case kZlibDefault:
+      return true;
+#ifdef CVMFS_ZSTD
+    case kZstd:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+
+Algorithms DetectAlgorithm(const void *buf, const size_t size) {
+  if ((size >= sizeof(kZstdMagic)) &&
+      (memcmp(buf, kZstdMagic, sizeof(kZstdMagic)) == 0))
+  {
+    return kZstd;
+  }
+  return kZlibDefault;
+}
+
+
+/**
+ * Wraps deflate(), the default for file contents
+ */
+class ZlibCompressor : public Compressor {
+ public:
+  explicit ZlibCompressor(const Algorithms &algorithm)
+    : Compressor(algorithm)
+  {
+    CompressInit(&stream_);
+  }
+
+  virtual ~ZlibCompressor() { CompressFini(&stream_); }
+
+  static bool WillHandle(const Algorithms &algorithm) {
+    return algorithm == kZlibDefault;
+  }
+
+  virtual bool Deflate(const bool flush,
+                       unsigned char **inbuf, size_t *inbufsize,
+                       unsigned char **outbuf, size_t *outbufsize)
+  {
+    stream_.avail_in = *inbufsize;
+    stream_.next_in = *inbuf;
+    stream_.avail_out = *outbufsize;
+    stream_.next_out = *outbuf;
+
+    const int retcode = deflate(&stream_, flush ? Z_FINISH : Z_NO_FLUSH);
+    assert(retcode == Z_OK || retcode == Z_STREAM_END);
+
+    *outbuf += *outbufsize - stream_.avail_out;
+    *outbufsize = stream_.avail_out;
+    *inbuf += *inbufsize - stream_.avail_in;
+    *inbufsize = stream_.avail_in;
+
+    if (flush)
+      return retcode == Z_STREAM_END;
+    return stream_.avail_in == 0;
+  }
+
+  virtual size_t DeflateBound(const size_t bytes) {
+    return deflateBound(&stream_, bytes);
+  }
+
+  virtual Compressor *Clone() {
+    ZlibCompressor *other = new ZlibCompressor(kZlibDefault);
+    CompressFini(&other->stream_);
+    const int retval = deflateCopy(&other->stream_, &stream_);
+    assert(retval == Z_OK);
+    return other;
+  }
+
+  virtual Algorithms algorithm() const { return kZlibDefault; }
+
+ private:
+  z_stream stream_;
+};
+
+
+class ZlibDecompressor : public Decompressor {
+ public:
+  explicit ZlibDecompressor(const Algorithms &algorithm)
+    : Decompressor(algorithm)
+  {
+    DecompressInit(&stream_);
+  }
+
+  virtual ~ZlibDecompressor() { DecompressFini(&stream_); }
+
+  static bool WillHandle(const Algorithms &algorithm) {
+    return algorithm == kZlibDefault;
+  }
+
+  virtual StreamStates Inflate2File(const void *buf, const int64_t size,
+                                    FILE *f)
+  {
+    return DecompressZStream2File(&stream_, f, buf, size);
+  }
+
+  virtual void Reset() {
+    const int retval = inflateReset(&stream_);
+    assert(retval == Z_OK);
+  }
+
+ private:
+  z_stream stream_;
+};
+
+
+#ifdef CVMFS_ZSTD
+
+/**
+ * Zstd decompresses several times faster than zlib at a similar compression
+ * ratio.  The content size is not stored in the frame header, so that the
+ * output only depends on the input bytes and not on how they are handed to
+ * Deflate(); Clone() relies on that.
+ *
+ * The zstd stream state cannot be copied.  Instead, after PrepareClone() the
+ * compressor keeps its input and Clone() replays it into a fresh stream.  The
+ * input is dropped after cloning, so it is kept at most until the first cut
+ * mark of a chunked file.
+ */
+class ZstdCompressor : public Compressor {
+ public:
+  explicit ZstdCompressor(const Algorithms &algorithm)
+    : Compressor(algorithm)
+    , stream_(ZSTD_createCCtx())
+    , keep_history_(false)
+  {
+    assert(stream_ != NULL);
+    ZSTD_CCtx_setParameter(stream_, ZSTD_c_compressionLevel,
+                           ZSTD_CLEVEL_DEFAULT);
+    ZSTD_CCtx_setParameter(stream_, ZSTD_c_contentSizeFlag, 0);
+  }
+
+  virtual ~ZstdCompressor() { ZSTD_freeCCtx(stream_); }
+
+  static bool WillHandle(const Algorithms &algorithm) {
+    return algorithm == kZstd;
+  }
+
+  virtual bool Deflate(const bool flush,
+                       unsigned char **inbuf, size_t *inbufsize,
+                       unsigned char **outbuf, size_t *outbufsize)
+  {
+    ZSTD_inBuffer input = { *inbuf, *inbufsize, 0 };
+    ZSTD_outBuffer output = { *outbuf, *outbufsize, 0 };
+    const size_t retval = ZSTD_compressStream2(
+      stream_, &output, &input, flush ? ZSTD_e_end : ZSTD_e_continue);
+    assert(!ZSTD_isError(retval));
+
+    if (keep_history_)
+      history_.insert(history_.end(), *inbuf, *inbuf + input.pos);
+    *inbuf += input.pos;
+    *inbufsize -= input.pos;
+    *outbuf += output.pos;
+    *outbufsize -= output.pos;
+
+    if (flush)
+      return retval == 0;
+    // A full output buffer might leave compressed data behind in the stream
+    return (*inbufsize == 0) && (*outbufsize > 0);
+  }
+
+  virtual size_t DeflateBound(const size_t bytes) {
+    return ZSTD_compressBound(bytes);
+  }
+
+  virtual void PrepareClone() { keep_history_ = true; }
+
+  virtual Compressor *Clone() {
+    assert(keep_history_);
+    ZstdCompressor *other = new ZstdCompressor(kZstd);
+    const size_t scratch_size = ZSTD_CStreamOutSize();
+    unsigned char *scratch =
+      static_cast<unsigned char *>(smalloc(scratch_size));
+    unsigned char *inbuf = history_.empty() ? NULL : &history_[0];
+    size_t inbufsize = history_.size();
+    bool done;
+    do {
+      unsigned char *outbuf = scratch;
+      size_t outbufsize = scratch_size;
+      done = other->Deflate(false, &inbuf, &inbufsize, &outbuf, &outbufsize);
+    } while (!done);
+    free(scratch);
+
+    keep_history_ = false;
+    std::vector<unsigned char>().swap(history_);
+    return other;
+  }
+
+  virtual Algorithms algorithm() const { return kZstd; }
+
+ private:
+  ZSTD_CCtx *stream_;
+  bool keep_history_;
+  std::vector<unsigned char> history_;
+};
+
+
+class ZstdDecompressor : public Decompressor {
+ public:
+  explicit ZstdDecompressor(const Algorithms &algorithm)
+    : Decompressor(algorithm)
+    , stream_(ZSTD_createDCtx())
+  {
+    assert(stream_ != NULL);
+  }
+
+  virtual ~ZstdDecompressor() { ZSTD_freeDCtx(stream_); }
+
+  static bool WillHandle(const Algorithms &algorithm) {
+    return algorithm == kZstd;
+  }
+
+  virtual StreamStates Inflate2File(const void *buf, const int64_t size,
+                                    FILE *f)
+  {
+    unsigned char out[kZChunk];
+    ZSTD_inBuffer input = { buf, static_cast<size_t>(size), 0 };
+    size_t retval;
+    do {
+      ZSTD_outBuffer output = { out, kZChunk, 0 };
+      retval = ZSTD_decompressStream(stream_, &output, &input);
+      if (ZSTD_isError(retval))
+        return kStreamDataError;
+      if (fwrite(out, 1, output.pos, f) != output.pos || ferror(f))
+        return kStreamIOError;
+      // A return value of 0 marks the end of a fully flushed frame.  Another
+      // call would already return the header size hint of the next frame.
+      if (retval == 0)
+        return kStreamEnd;
+      if ((input.pos == input.size) && (output.pos < output.size))
+        break;
+    } while (true);
+    return kStreamContinue;
+  }
+
+  virtual void Reset() {
+    ZSTD_DCtx_reset(stream_, ZSTD_reset_session_only);
+  }
+
+ private:
+  ZSTD_DCtx *stream_;
+};
+
+#endif  // CVMFS_ZSTD
+
+
+void Compressor::RegisterPlugins() {
+  RegisterPlugin<ZlibCompressor>();
+#ifdef CVMFS_ZSTD
+  RegisterPlugin<ZstdCompressor>();
+#endif
+}
+
+
+void Decompressor::RegisterPlugins() {
+  RegisterPlugin<ZlibDecompressor>();
+#ifdef CVMFS_ZSTD
+  RegisterPlugin<ZstdDecompressor>();
+#endif
+}
+
+
+StreamStates StreamDecompressor::Inflate2File(
+  const void *buf,
+  const int64_t size,
+  FILE *f)
+{
+  if (size <= 0)
+    return kStreamContinue;
+  if (decompressor_ != NULL)
+    return decompressor_->Inflate2File(buf, size, f);
+
+  // Collect the first bytes of the stream to detect the algorithm
+  const int64_t nbytes =
+    std::min(static_cast<int64_t>(kPrefixSize - prefix_size_), size);
+  memcpy(prefix_ + prefix_size_, buf, nbytes);
+  prefix_size_ += nbytes;
+  if ((prefix_size_ < kPrefixSize) && (prefix_[0] == kZstdMagic[0]))
+    return kStreamContinue;
+
+  decompressor_ =
+    Decompressor::Construct(DetectAlgorithm(prefix_, prefix_size_));
+  if (decompressor_ == NULL) {
+    LogCvmfs(kLogCompress, kLogDebug, "unsupported compression algorithm");
+    return kStreamDataError;
+  }
+  const StreamStates retval =
+    decompressor_->Inflate2File(prefix_, prefix_size_, f);
+  if ((retval == kStreamDataError) || (retval == kStreamIOError) ||
+      (nbytes == size))
+  {
+    return retval;
+  }
+  return decompressor_->Inflate2File(static_cast<const unsigned char *>(buf) +
+                                     nbytes, size - nbytes, f);
+}
+
+
+void StreamDecompressor::Reset() {
+  delete decompressor_;
+  decompressor_ = NULL;
+  prefix_size_ = 0;
+}
+
+
+static bool ZstdDecompressMem2Mem(const void *buf, const int64_t size,
+                                  void **out_buf, uint64_t *out_size)
+{
+#ifdef CVMFS_ZSTD
+  unsigned char out[kZChunk];
+  uint64_t alloc_size = kZChunk;
+  ZSTD_DCtx *stream = ZSTD_createDCtx();
+  assert(stream != NULL);
+  *out_buf = smalloc(alloc_size);
+  *out_size = 0;
+
+  ZSTD_inBuffer input = { buf, static_cast<size_t>(size), 0 };
+  size_t retval;
+  do {
+    ZSTD_outBuffer output = { out, kZChunk, 0 };
+    retval = ZSTD_decompressStream(stream, &output, &input);
+    if (ZSTD_isError(retval))
+      break;
+    if (*out_size + output.pos > alloc_size) {
+      alloc_size *= 2;
+      *out_buf = srealloc(*out_buf, alloc_size);
+    }
+    memcpy(static_cast<unsigned char *>(*out_buf) + *out_size, out,
+           output.pos);
+    *out_size += output.pos;
+    if ((retval == 0) ||
+        ((input.pos == input.size) && (output.pos < output.size)))
+    {
+      break;
+    }
+  } while (true);
+  ZSTD_freeDCtx(stream);
+
+  if (retval == 0)
+    return true;
+  free(*out_buf);
+  *out_buf = NULL;
+  *out_size = 0;
+#endif
+  return false;
+}
+
 }  // namespace zlib
@@ -10,8 +10,10 @@
 #include <stdio.h>
 
 #include <string>
+#include <vector>
 
 #include "duplex_zlib.h"
+#include "util.h"
 
 namespace shash {
 struct Any;
@@ -65,6 +67,112 @@ bool CompressMem2Mem(const void *buf, const int64_t size,
 bool DecompressMem2Mem(const void *buf, const int64_t size,
                        void **out_buf, uint64_t *out_size);
 
+
+
+/**
+ * Compression algorithms for file contents.  Catalogs, manifests, and other
+ * repository meta-data are always zlib compressed.  A zstd compressed object
+ * starts with the zstd frame magic number, so that the algorithm can be
+ * detected from the object itself (see DetectAlgorithm()).  Clients that do
+ * not support zstd fail to decompress such objects; zstd should only be
+ * enabled for repositories whose clients all support it.
+ */
+enum Algorithms {
+  kZlibDefault = 0,
+  kZstd
+};
+
+bool ParseAlgorithm(const std::string &name, Algorithms *algorithm);
+std::string AlgorithmName(const Algorithms algorithm);
+bool IsAlgorithmSupported(const Algorithms algorithm);
+Algorithms DetectAlgorithm(const void *buf, const size_t size);
+
+
+/**
+ * Streaming compression of file contents (see Chunk in file_processing).
+ */
+class Compressor : public PolymorphicConstruction<Compressor, Algorithms> {
+ public:
+  explicit Compressor(const Algorithms &algorithm) { }
+  virtual ~Compressor() { }
+
+  /**
+   * Compresses data from *inbuf to *outbuf.  Both pointers are advanced and
+   * both sizes are decreased by the number of consumed and produced bytes.
+   * With flush set, the compressed stream is terminated once all the input
+   * is consumed.
+   *
+   * @return  true if all the input is consumed (and, in case of flush, the
+   *          stream is terminated), false if more output space is required
+   */
+  virtual bool Deflate(const bool flush,
+                       unsigned char **inbuf, size_t *inbufsize,
+                       unsigned char **outbuf, size_t *outbufsize) = 0;
+
+  /**
+   * Upper bound of the compressed size of the given number of input bytes
+   */
+  virtual size_t DeflateBound(const size_t bytes) = 0;
+
+  /**
+   * Announces that Clone() might be called later on.  Must be called before
+   * any data is compressed.
+   */
+  virtual void PrepareClone() { }
+
+  /**
+   * Creates a copy of the compressor including its current stream state.  The
+   * copy produces the same output as the original for the same input.
+   */
+  virtual Compressor *Clone() = 0;
+
+  virtual Algorithms algorithm() const = 0;
+
+  static void RegisterPlugins();
+};
+
+
+/**
+ * Streaming decompression into a file
+ */
+class Decompressor : public PolymorphicConstruction<Decompressor, Algorithms>
+{
+ public:
+  explicit Decompressor(const Algorithms &algorithm) { }
+  virtual ~Decompressor() { }
+
+  virtual StreamStates Inflate2File(const void *buf, const int64_t size,
+                                    FILE *f) = 0;
+  /**
+   * Restarts the decompression of a new stream
+   */
+  virtual void Reset() = 0;
+
+  static void RegisterPlugins();
+};
+
+
+/**
+ * Decompresses a zlib or zstd stream into a file.  The algorithm is detected
+ * from the first bytes of the stream.  Used by the download manager, so that
+ * zlib and zstd compressed objects can be fetched with the same job.
+ */
+class StreamDecompressor : SingleCopy {
+ public:
+  StreamDecompressor() : decompressor_(NULL), prefix_size_(0) { }
+  ~StreamDecompressor() { Reset(); }
+
+  StreamStates Inflate2File(const void *buf, const int64_t size, FILE *f);
+  void Reset();
+
+ private:
+  static const unsigned kPrefixSize = 4;
+
+  Decompressor *decompressor_;
+  unsigned char prefix_[kPrefixSize];
+  unsigned prefix_size_;
+};
+
 }  // namespace zlib
 
 #endif  // CVMFS_COMPRESSION_H_
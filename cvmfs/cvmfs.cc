@@ -69,6 +69,8 @@
 #include "auto_umount.h"
 #include "backoff.h"
 #include "cache.h"
+#include "cache_memory.h"
+#include "cache_prefetch.h"
 #include "compat.h"
 #include "compression.h"
 #include "directory_entry.h"
@@ -108,6 +110,11 @@
 #warning "No NFS support, Fuse too old"
 #endif
 
+// fuse_reply_data() and splicing into the fuse device appeared in libfuse 2.9
+#ifdef FUSE_CAP_SPLICE_WRITE
+#define CVMFS_ZERO_COPY_READ
+#endif
+
 using namespace std;  // NOLINT
 
 namespace cvmfs {
@@ -201,6 +208,12 @@ bool volatile_repository_ = false;
  * synthetic attributes should not be copied up.
  */
 bool hide_magic_xattrs_ = false;
+/**
+ * If true, read() replies point to the cache file descriptors and libfuse
+ * splices the data into the kernel instead of copying through a user space
+ * buffer.  Requires libfuse >= 2.9.
+ */
+bool zero_copy_read_ = false;
 
 /**
  * in maintenance mode, cache timeout is 0 and catalogs are not reloaded
@@ -221,6 +234,15 @@ uint64_t next_directory_handle_ = 0;
 
 // contains inode to chunklist and handle to fd maps
 ChunkTables *chunk_tables_;
+/**
+ * Read-ahead of chunks on sequential access, NULL if CVMFS_CHUNK_PREFETCH is
+ * not set.
+ */
+cache::ChunkPrefetcher *chunk_prefetcher_ = NULL;
+/**
+ * Small objects kept in memory, NULL if CVMFS_OBJECT_MEMCACHE_SIZE is not set.
+ */
+cache::MemoryCache *memory_cache_ = NULL;
 
 perf::Statistics *statistics_;
 atomic_int64 num_fs_open_;
@@ -1089,9 +1111,10 @@ static void cvmfs_open(fuse_req_t req, fuse_ino_t ino,
       return;
     }
 
-    chunk_tables_->Lock();
-    if (!chunk_tables_->inode2chunks.Contains(ino)) {
-      chunk_tables_->Unlock();
+    ChunkTables::Shard *inode_shard = chunk_tables_->Inode2Shard(ino);
+    inode_shard->Lock();
+    if (!inode_shard->inode2chunks.Contains(ino)) {
+      inode_shard->Unlock();
 
       // Retrieve File chunks from the catalog
       FileChunkList *chunks = new FileChunkList();
@@ -1107,40 +1130,75 @@ static void cvmfs_open(fuse_req_t req, fuse_ino_t ino,
       }
       remount_fence_->Leave();
 
-      chunk_tables_->Lock();
+      inode_shard->Lock();
       // Check again to avoid race
-      if (!chunk_tables_->inode2chunks.Contains(ino)) {
-        chunk_tables_->inode2chunks.Insert(ino, FileChunkReflist(chunks, path));
-        chunk_tables_->inode2references.Insert(ino, 1);
+      if (!inode_shard->inode2chunks.Contains(ino)) {
+        inode_shard->inode2chunks.Insert(ino, FileChunkReflist(chunks, path));
+        inode_shard->inode2references.Insert(ino, 1);
       } else {
+        delete chunks;
         uint32_t refctr;
-        bool retval = chunk_tables_->inode2references.Lookup(ino, &refctr);
+        bool retval = inode_shard->inode2references.Lookup(ino, &refctr);
         assert(retval);
-        chunk_tables_->inode2references.Insert(ino, refctr+1);
+        inode_shard->inode2references.Insert(ino, refctr+1);
       }
     } else {
       remount_fence_->Leave();
       uint32_t refctr;
-      bool retval = chunk_tables_->inode2references.Lookup(ino, &refctr);
+      bool retval = inode_shard->inode2references.Lookup(ino, &refctr);
       assert(retval);
-      chunk_tables_->inode2references.Insert(ino, refctr+1);
+      inode_shard->inode2references.Insert(ino, refctr+1);
     }
+    inode_shard->Unlock();
 
     // Update the chunk handle list
+    const uint64_t chunk_handle = chunk_tables_->NextHandle();
     LogCvmfs(kLogCvmfs, kLogDebug,
-             "linking chunk handle %d to inode: %"PRIu64,
-             chunk_tables_->next_handle, uint64_t(ino));
-    chunk_tables_->handle2fd.Insert(chunk_tables_->next_handle, ChunkFd());
-    fi->fh = static_cast<uint64_t>(-chunk_tables_->next_handle);
-    ++chunk_tables_->next_handle;
-    chunk_tables_->Unlock();
+             "linking chunk handle %"PRIu64" to inode: %"PRIu64,
+             chunk_handle, uint64_t(ino));
+    ChunkTables::Shard *handle_shard =
+      chunk_tables_->Handle2Shard(chunk_handle);
+    handle_shard->Lock();
+    handle_shard->handle2fd.Insert(chunk_handle, ChunkFd());
+    handle_shard->Unlock();
+    fi->fh = static_cast<uint64_t>(-static_cast<int64_t>(chunk_handle));
 
     fuse_reply_open(req, fi);
     return;
   }
 
-  fd = cache::FetchDirent(dirent, string(path.GetChars(), path.GetLength()),
-                          volatile_repository_, download_manager_);
+  // Small files are served from memory if possible
+  bool fetched = false;
+  if (memory_cache_ && (dirent.size() <= memory_cache_->max_object_size())) {
+    cache::MemoryObject *object = memory_cache_->Lookup(dirent.checksum());
+    if (object == NULL) {
+      fd = cache::FetchDirent(dirent,
+                              string(path.GetChars(), path.GetLength()),
+                              volatile_repository_, download_manager_);
+      fetched = true;
+      if (fd >= 0) {
+        object = memory_cache_->Insert(dirent.checksum(), fd, dirent.size());
+        if (object != NULL)
+          close(fd);
+      }
+    } else if (cache::GetCacheMode() == cache::kCacheReadWrite) {
+      // Memory hits count for the LRU order of the copy on disk
+      quota::Touch(dirent.checksum());
+    }
+    if (object != NULL) {
+      LogCvmfs(kLogCvmfs, kLogDebug, "file %s opened from memory",
+               path.c_str());
+      fi->keep_cache = 0;
+      fi->fh = cache::MemoryCache::Object2Handle(object);
+      fuse_reply_open(req, fi);
+      return;
+    }
+  }
+
+  if (!fetched) {
+    fd = cache::FetchDirent(dirent, string(path.GetChars(), path.GetLength()),
+                            volatile_repository_, download_manager_);
+  }
 
   if (fd >= 0) {
     if (atomic_xadd32(&open_files_, 1) <
@@ -1185,8 +1243,42 @@ static void cvmfs_open(fuse_req_t req, fuse_ino_t ino,
 }
 
 
+#ifdef CVMFS_ZERO_COPY_READ
+/**
+ * Sends a read reply that refers to cache file descriptors.  The pages are
+ * spliced without SPLICE_MOVE, so they stay in the page cache of the cache
+ * files.  libfuse copies the data itself if splicing fails and replies with
+ * an error if the descriptors cannot be read.  A non-zero return value means
+ * that the reply could not be written to the fuse device; the request is
+ * finished nevertheless and must not be answered again.
+ */
+static void ReplyData(fuse_req_t req, struct fuse_bufvec *bufv) {
+  const int retval = fuse_reply_data(req, bufv, FUSE_BUF_SPLICE_NONBLOCK);
+  if (retval != 0) {
+    LogCvmfs(kLogCvmfs, kLogDebug | kLogSyslogErr,
+             "failed to send spliced read reply (%d)", retval);
+  }
+}
+#endif
+
+
 /**
- * Redirected to pread into cache.
+ * Closes the valid file descriptors of a cache::FetchChunks() result.
+ */
+static void CloseChunkFds(const vector<int> &fds) {
+  for (unsigned i = 0; i < fds.size(); ++i) {
+    if (fds[i] >= 0)
+      close(fds[i]);
+  }
+}
+
+
+/**
+ * Redirected to pread into cache.  With zero-copy reads enabled, the reply
+ * refers to the cache file descriptors instead so that libfuse can splice the
+ * data from the page cache into the fuse device.  If the fuse device cannot
+ * splice, zero-copy reads are disabled in cvmfs_init() and the data is read
+ * into a buffer.
  */
 static void cvmfs_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
                        struct fuse_file_info *fi)
@@ -1196,8 +1288,27 @@ static void cvmfs_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
            uint64_t(catalog_manager_->MangleInode(ino)), size, off, fi->fh);
   atomic_inc64(&num_fs_read_);
 
+  if (cache::MemoryCache::IsMemoryHandle(fi->fh)) {
+    cache::MemoryObject *object = cache::MemoryCache::Handle2Object(fi->fh);
+    const uint64_t begin =
+      std::min(static_cast<uint64_t>(off), static_cast<uint64_t>(object->size));
+    const size_t nbytes =
+      std::min(size, static_cast<size_t>(object->size - begin));
+    fuse_reply_buf(req, reinterpret_cast<char *>(object->data) + begin,
+                   nbytes);
+    LogCvmfs(kLogCvmfs, kLogDebug, "pushed %d bytes from memory to user",
+             nbytes);
+    return;
+  }
+
+#ifdef CVMFS_ZERO_COPY_READ
+  const bool zero_copy = zero_copy_read_;
+#else
+  const bool zero_copy = false;
+#endif
+
   // Get data chunk (<=128k guaranteed by Fuse)
-  char *data = static_cast<char *>(alloca(size));
+  char *data = zero_copy ? NULL : static_cast<char *>(alloca(size));
   unsigned int overall_bytes_fetched = 0;
 
   // Do we have a a chunked file?
@@ -1209,10 +1320,11 @@ static void cvmfs_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
     bool retval;
 
     // Fetch chunk list and file descriptor
-    chunk_tables_->Lock();
-    retval = chunk_tables_->inode2chunks.Lookup(ino, &chunks);
+    ChunkTables::Shard *inode_shard = chunk_tables_->Inode2Shard(ino);
+    inode_shard->Lock();
+    retval = inode_shard->inode2chunks.Lookup(ino, &chunks);
     assert(retval);
-    chunk_tables_->Unlock();
+    inode_shard->Unlock();
 
     // Find the chunk that holds the beginning of the requested data
     assert(chunks.list->size() > 0);
@@ -1232,32 +1344,117 @@ static void cvmfs_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
       }
       chunk_idx = idx_low + (idx_high-idx_low)/2;
     }
+    // The chunk that holds the end of the requested data
+    unsigned chunk_idx_last = chunk_idx;
+    while ((chunk_idx_last < chunks.list->size()-1) &&
+           (chunks.list->AtPtr(chunk_idx_last+1)->offset() <
+            static_cast<off_t>(off + size)))
+    {
+      ++chunk_idx_last;
+    }
+
+    // For zero-copy reads, one buffer segment per chunk.  File descriptors of
+    // all but the last chunk are closed after the reply has been sent.
+    const unsigned max_segments = chunk_idx_last - chunk_idx + 1;
+    struct fuse_bufvec *bufv = NULL;
+    int *spliced_fds = NULL;
+    unsigned num_spliced_fds = 0;
+    if (zero_copy) {
+      bufv = static_cast<struct fuse_bufvec *>(alloca(
+        sizeof(struct fuse_bufvec) + max_segments * sizeof(struct fuse_buf)));
+      memset(bufv, 0, sizeof(struct fuse_bufvec));
+      spliced_fds = static_cast<int *>(alloca(max_segments * sizeof(int)));
+    }
+
+    // Start downloading the following chunks before fetching the current
+    // ones.  The prefetcher keeps its own state, so this does not need to
+    // block other reads on the handle.
+    if (chunk_prefetcher_) {
+      chunk_prefetcher_->OnRead(chunk_handle, chunks, chunk_idx,
+                                chunk_idx_last, off, size,
+                                volatile_repository_);
+    }
 
     // Lock chunk handle
     pthread_mutex_t *handle_lock = chunk_tables_->Handle2Lock(chunk_handle);
     LockMutex(handle_lock);
-    chunk_tables_->Lock();
-    retval = chunk_tables_->handle2fd.Lookup(chunk_handle, &chunk_fd);
+    ChunkTables::Shard *handle_shard =
+      chunk_tables_->Handle2Shard(chunk_handle);
+    handle_shard->Lock();
+    retval = handle_shard->handle2fd.Lookup(chunk_handle, &chunk_fd);
     assert(retval);
-    chunk_tables_->Unlock();
+    handle_shard->Unlock();
+
+    // If the read spans several chunks that are not yet open, download them
+    // in parallel.  The loop below takes their file descriptors from
+    // fetched_fds, indexed relative to chunk_idx_first, -1 if not fetched.
+    const unsigned chunk_idx_first = chunk_idx;
+    vector<int> fetched_fds;
+    unsigned num_unopened = chunk_idx_last - chunk_idx + 1;
+    if ((chunk_fd.fd != -1) &&
+        (chunk_fd.chunk_idx >= chunk_idx) &&
+        (chunk_fd.chunk_idx <= chunk_idx_last))
+    {
+      num_unopened--;
+    }
+    if (num_unopened > 1) {
+      FileChunkList batch;
+      vector<unsigned> batch_idx;
+      for (unsigned i = chunk_idx; i <= chunk_idx_last; ++i) {
+        if ((chunk_fd.fd == -1) || (chunk_fd.chunk_idx != i)) {
+          batch.PushBack(*chunks.list->AtPtr(i));
+          batch_idx.push_back(i - chunk_idx_first);
+        }
+      }
+      vector<int> batch_fds;
+      const unsigned num_failed =
+        cache::FetchChunks(batch, "Part of " + chunks.path.ToString(),
+                           volatile_repository_, download_manager_,
+                           &batch_fds);
+      if (num_failed > 0) {
+        CloseChunkFds(batch_fds);
+        UnlockMutex(handle_lock);
+        fuse_reply_err(req, EIO);
+        return;
+      }
+      fetched_fds.assign(chunk_idx_last - chunk_idx_first + 1, -1);
+      for (unsigned i = 0; i < batch_fds.size(); ++i)
+        fetched_fds[batch_idx[i]] = batch_fds[i];
+    }
 
     // Fetch all needed chunks and read the requested data
     off_t offset_in_chunk = off - chunks.list->AtPtr(chunk_idx)->offset();
     do {
       // Open file descriptor to chunk
       if ((chunk_fd.fd == -1) || (chunk_fd.chunk_idx != chunk_idx)) {
-        if (chunk_fd.fd != -1) close(chunk_fd.fd);
-        string verbose_path = "Part of " + chunks.path.ToString();
-        chunk_fd.fd = cache::FetchChunk(*chunks.list->AtPtr(chunk_idx),
-                                        verbose_path,
-                                        volatile_repository_,
-                                        download_manager_);
+        if (chunk_fd.fd != -1) {
+          if (zero_copy && (bufv->count > 0))
+            spliced_fds[num_spliced_fds++] = chunk_fd.fd;
+          else
+            close(chunk_fd.fd);
+        }
+        const unsigned fetched_idx = chunk_idx - chunk_idx_first;
+        if ((fetched_idx < fetched_fds.size()) &&
+            (fetched_fds[fetched_idx] >= 0))
+        {
+          chunk_fd.fd = fetched_fds[fetched_idx];
+          fetched_fds[fetched_idx] = -1;
+        } else {
+          string verbose_path = "Part of " + chunks.path.ToString();
+          chunk_fd.fd = cache::FetchChunk(*chunks.list->AtPtr(chunk_idx),
+                                          verbose_path,
+                                          volatile_repository_,
+                                          download_manager_);
+        }
         if (chunk_fd.fd < 0) {
           chunk_fd.fd = -1;
-          chunk_tables_->Lock();
-          chunk_tables_->handle2fd.Insert(chunk_handle, chunk_fd);
-          chunk_tables_->Unlock();
+          handle_shard->Lock();
+          handle_shard->handle2fd.Insert(chunk_handle, chunk_fd);
+          handle_shard->Unlock();
           UnlockMutex(handle_lock);
+          for (unsigned i = 0; i < num_spliced_fds; ++i)
+            close(spliced_fds[i]);
+          CloseChunkFds(fetched_fds);
           fuse_reply_err(req, EIO);
           return;
         }
@@ -1272,18 +1469,32 @@ static void cvmfs_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
         chunks.list->AtPtr(chunk_idx)->size() - offset_in_chunk;
       size_t bytes_to_read_in_chunk =
         std::min(bytes_to_read, remaining_bytes_in_chunk);
-      const size_t bytes_fetched =
-        pread(chunk_fd.fd, data + overall_bytes_fetched,
-              bytes_to_read_in_chunk, offset_in_chunk);
+      size_t bytes_fetched;
+      if (zero_copy) {
+        assert(bufv->count < max_segments);
+        struct fuse_buf *segment = &bufv->buf[bufv->count++];
+        segment->size = bytes_to_read_in_chunk;
+        segment->flags = static_cast<enum fuse_buf_flags>(
+          FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK | FUSE_BUF_FD_RETRY);
+        segment->mem = NULL;
+        segment->fd = chunk_fd.fd;
+        segment->pos = offset_in_chunk;
+        bytes_fetched = bytes_to_read_in_chunk;
+      } else {
+        bytes_fetched = pread(chunk_fd.fd, data + overall_bytes_fetched,
+                              bytes_to_read_in_chunk, offset_in_chunk);
+      }
 
       if (bytes_fetched == (size_t)-1) {
-        LogCvmfs(kLogCvmfs, kLogSyslogErr, "read err no %d result %d (%s)",
-                 errno, bytes_fetched, chunks.path.ToString().c_str());
-        chunk_tables_->Lock();
-        chunk_tables_->handle2fd.Insert(chunk_handle, chunk_fd);
-        chunk_tables_->Unlock();
+        LogCvmfs(kLogCvmfs, kLogSyslogErr, "read err no %d result %zd (%s)",
+                 errno, static_cast<ssize_t>(bytes_fetched),
+                 chunks.path.ToString().c_str());
+        handle_shard->Lock();
+        handle_shard->handle2fd.Insert(chunk_handle, chunk_fd);
+        handle_shard->Unlock();
         UnlockMutex(handle_lock);
         fuse_reply_err(req, errno);
+        CloseChunkFds(fetched_fds);
         return;
       }
       overall_bytes_fetched += bytes_fetched;
@@ -1293,16 +1504,44 @@ static void cvmfs_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
       offset_in_chunk = 0;
     } while ((overall_bytes_fetched < size) &&
              (chunk_idx < chunks.list->size()));
+    CloseChunkFds(fetched_fds);
+
+    // The file descriptors in the buffer vector must stay valid until the
+    // reply is sent, so reply before releasing the chunk handle.
+    if (zero_copy) {
+#ifdef CVMFS_ZERO_COPY_READ
+      ReplyData(req, bufv);
+#endif
+      for (unsigned i = 0; i < num_spliced_fds; ++i)
+        close(spliced_fds[i]);
+    }
 
     // Update chunk file descriptor
-    chunk_tables_->Lock();
-    chunk_tables_->handle2fd.Insert(chunk_handle, chunk_fd);
-    chunk_tables_->Unlock();
+    handle_shard->Lock();
+    handle_shard->handle2fd.Insert(chunk_handle, chunk_fd);
+    handle_shard->Unlock();
     UnlockMutex(handle_lock);
     LogCvmfs(kLogCvmfs, kLogDebug, "released chunk file descriptor %d",
              chunk_fd.fd);
+    if (zero_copy) {
+      LogCvmfs(kLogCvmfs, kLogDebug, "spliced %u bytes to user",
+               overall_bytes_fetched);
+      return;
+    }
   } else {
     const int64_t fd = fi->fh;
+#ifdef CVMFS_ZERO_COPY_READ
+    if (zero_copy) {
+      struct fuse_bufvec bufv = FUSE_BUFVEC_INIT(size);
+      bufv.buf[0].flags = static_cast<enum fuse_buf_flags>(
+        FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK | FUSE_BUF_FD_RETRY);
+      bufv.buf[0].fd = fd;
+      bufv.buf[0].pos = off;
+      ReplyData(req, &bufv);
+      LogCvmfs(kLogCvmfs, kLogDebug, "spliced up to %zu bytes to user", size);
+      return;
+    }
+#endif
     overall_bytes_fetched = pread(fd, data, size, off);
   }
 
@@ -1324,6 +1563,12 @@ static void cvmfs_release(fuse_req_t req, fuse_ino_t ino,
            uint64_t(ino));
   const int64_t fd = fi->fh;
 
+  if (cache::MemoryCache::IsMemoryHandle(fi->fh)) {
+    cache::MemoryCache::Release(cache::MemoryCache::Handle2Object(fi->fh));
+    fuse_reply_err(req, 0);
+    return;
+  }
+
   // do we have a chunked file?
   if (static_cast<int64_t>(fi->fh) < 0) {
     const uint64_t chunk_handle =
@@ -1335,28 +1580,35 @@ static void cvmfs_release(fuse_req_t req, fuse_ino_t ino,
     uint32_t refctr;
     bool retval;
 
-    chunk_tables_->Lock();
-    retval = chunk_tables_->handle2fd.Lookup(chunk_handle, &chunk_fd);
+    ChunkTables::Shard *handle_shard =
+      chunk_tables_->Handle2Shard(chunk_handle);
+    handle_shard->Lock();
+    retval = handle_shard->handle2fd.Lookup(chunk_handle, &chunk_fd);
     assert(retval);
-    chunk_tables_->handle2fd.Erase(chunk_handle);
+    handle_shard->handle2fd.Erase(chunk_handle);
+    handle_shard->Unlock();
 
-    retval = chunk_tables_->inode2references.Lookup(ino, &refctr);
+    ChunkTables::Shard *inode_shard = chunk_tables_->Inode2Shard(ino);
+    inode_shard->Lock();
+    retval = inode_shard->inode2references.Lookup(ino, &refctr);
     assert(retval);
     refctr--;
     if (refctr == 0) {
       LogCvmfs(kLogCvmfs, kLogDebug, "releasing chunk list for inode %"PRIu64,
                uint64_t(ino));
       FileChunkReflist to_delete;
-      retval = chunk_tables_->inode2chunks.Lookup(ino, &to_delete);
+      retval = inode_shard->inode2chunks.Lookup(ino, &to_delete);
       assert(retval);
-      chunk_tables_->inode2references.Erase(ino);
-      chunk_tables_->inode2chunks.Erase(ino);
+      inode_shard->inode2references.Erase(ino);
+      inode_shard->inode2chunks.Erase(ino);
       delete to_delete.list;
     } else {
-      chunk_tables_->inode2references.Insert(ino, refctr);
+      inode_shard->inode2references.Insert(ino, refctr);
     }
-    chunk_tables_->Unlock();
+    inode_shard->Unlock();
 
+    if (chunk_prefetcher_)
+      chunk_prefetcher_->OnRelease(chunk_handle);
     if (chunk_fd.fd != -1)
       close(chunk_fd.fd);
     atomic_dec32(&open_files_);
@@ -1706,20 +1958,26 @@ bool Pin(const string &path) {
                    "Part of " + path, false);
       if (!retval)
         return false;
-      int fd = cache::FetchChunk(*chunks.AtPtr(i), "Part of " + path,
-                                 volatile_repository_, download_manager_);
-      if (fd < 0) {
+    }
+    vector<int> fds;
+    cache::FetchChunks(chunks, "Part of " + path, volatile_repository_,
+                       download_manager_, &fds);
+    bool result = true;
+    for (unsigned i = 0; i < chunks.size(); ++i) {
+      if (fds[i] < 0) {
         quota::Unpin(chunks.AtPtr(i)->content_hash());
-        return false;
+        result = false;
+        continue;
       }
-      retval =
+      // Again because it was overwritten by FetchChunks
+      bool retval =
         quota::Pin(chunks.AtPtr(i)->content_hash(), chunks.AtPtr(i)->size(),
                    "Part of " + path, false);
-      close(fd);
+      close(fds[i]);
       if (!retval)
-        return false;
+        result = false;
     }
-    return true;
+    return result;
   }
 
   bool retval = quota::Pin(dirent.checksum(), dirent.size(), path, false);
@@ -1748,6 +2006,19 @@ static void cvmfs_init(void *userdata, struct fuse_conn_info *conn) {
 #ifdef CVMFS_NFS_SUPPORT
   conn->want |= FUSE_CAP_EXPORT_SUPPORT;
 #endif
+
+#ifdef CVMFS_ZERO_COPY_READ
+  if (zero_copy_read_) {
+    if (conn->capable & FUSE_CAP_SPLICE_WRITE) {
+      conn->want |= FUSE_CAP_SPLICE_WRITE;
+    } else {
+      LogCvmfs(kLogCvmfs, kLogDebug | kLogSyslogWarn,
+               "fuse device does not support splice, "
+               "zero-copy reads fall back to copying");
+      zero_copy_read_ = false;
+    }
+  }
+#endif
 }
 
 static void cvmfs_destroy(void *unused __attribute__((unused))) {
@@ -1872,6 +2143,19 @@ static int Init(const loader::LoaderExports *loader_exports) {
   cvmfs::Uuid *uuid;
   bool use_geo_api = false;
   bool follow_redirects = false;
+  bool use_http2 = false;
+  unsigned download_threads = 1;
+  unsigned download_workers = 0;
+  download::DownloadManager::ShardingModes download_sharding =
+    download::DownloadManager::kShardRoundRobin;
+  unsigned chunk_prefetch = 0;
+  uint64_t object_memcache_size = 0;
+  uint64_t object_memcache_max_object = 64*1024;
+  unsigned quota_touch_delay = 0;
+  uint64_t catalog_mmap_size = 0;
+  bool quota_journal = false;
+  bool quota_background_rebuild = false;
+  bool catalog_lookup_filter = false;
 
   cvmfs::boot_time_ = loader_exports->boot_time;
   cvmfs::backoff_throttle_ = new BackoffThrottle();
@@ -1944,6 +2228,21 @@ static int Init(const loader::LoaderExports *loader_exports) {
   {
     follow_redirects = true;
   }
+  if (cvmfs::options_manager_->GetValue("CVMFS_USE_HTTP2", &parameter) &&
+      cvmfs::options_manager_->IsOn(parameter))
+  {
+    use_http2 = true;
+  }
+  if (cvmfs::options_manager_->GetValue("CVMFS_DOWNLOAD_THREADS", &parameter))
+    download_threads = String2Uint64(parameter);
+  if (cvmfs::options_manager_->GetValue("CVMFS_DOWNLOAD_SHARDING",
+                                        &parameter) &&
+      (parameter == "host"))
+  {
+    download_sharding = download::DownloadManager::kShardByHost;
+  }
+  if (cvmfs::options_manager_->GetValue("CVMFS_DOWNLOAD_WORKERS", &parameter))
+    download_workers = String2Uint64(parameter);
   if (cvmfs::options_manager_->GetValue("CVMFS_TRACEFILE", &parameter))
     tracefile = parameter;
   if (cvmfs::options_manager_->GetValue("CVMFS_MAX_TTL", &parameter))
@@ -1994,6 +2293,16 @@ static int Init(const loader::LoaderExports *loader_exports) {
   {
     cvmfs::hide_magic_xattrs_ = true;
   }
+  if (cvmfs::options_manager_->GetValue("CVMFS_ZERO_COPY_READ", &parameter)
+      && cvmfs::options_manager_->IsOn(parameter))
+  {
+#ifdef CVMFS_ZERO_COPY_READ
+    cvmfs::zero_copy_read_ = true;
+#else
+    LogCvmfs(kLogCvmfs, kLogDebug | kLogSyslogWarn,
+             "CVMFS_ZERO_COPY_READ requires libfuse >= 2.9, ignored");
+#endif
+  }
   if (cvmfs::options_manager_->GetValue("CVMFS_SERVER_URL", &parameter)) {
     vector<string> tokens = SplitString(loader_exports->repository_name, '.');
     const string org = tokens[0];
@@ -2042,6 +2351,39 @@ static int Init(const loader::LoaderExports *loader_exports) {
   if (cvmfs::options_manager_->GetValue("CVMFS_PROXY_TEMPLATE", &parameter)) {
     proxy_template = parameter;
   }
+  if (cvmfs::options_manager_->GetValue("CVMFS_CHUNK_PREFETCH", &parameter))
+    chunk_prefetch = String2Uint64(parameter);
+  if (cvmfs::options_manager_->GetValue("CVMFS_OBJECT_MEMCACHE_SIZE",
+                                        &parameter))
+  {
+    object_memcache_size = String2Uint64(parameter) * 1024*1024;
+  }
+  if (cvmfs::options_manager_->GetValue("CVMFS_OBJECT_MEMCACHE_MAX_OBJECT",
+                                        &parameter))
+  {
+    object_memcache_max_object = String2Uint64(parameter) * 1024;
+  }
+  if (cvmfs::options_manager_->GetValue("CVMFS_QUOTA_TOUCH_DELAY", &parameter))
+    quota_touch_delay = String2Uint64(parameter);
+  if (cvmfs::options_manager_->GetValue("CVMFS_CATALOG_MMAP_SIZE", &parameter))
+    catalog_mmap_size = String2Uint64(parameter) * 1024*1024;
+  if (cvmfs::options_manager_->GetValue("CVMFS_QUOTA_JOURNAL", &parameter) &&
+      cvmfs::options_manager_->IsOn(parameter))
+  {
+    quota_journal = true;
+  }
+  if (cvmfs::options_manager_->GetValue("CVMFS_QUOTA_BACKGROUND_REBUILD",
+                                        &parameter) &&
+      cvmfs::options_manager_->IsOn(parameter))
+  {
+    quota_background_rebuild = true;
+  }
+  if (cvmfs::options_manager_->GetValue("CVMFS_CATALOG_LOOKUP_FILTER",
+                                        &parameter) &&
+      cvmfs::options_manager_->IsOn(parameter))
+  {
+    catalog_lookup_filter = true;
+  }
 
   cvmfs::statistics_ = new perf::Statistics();
 
@@ -2239,6 +2581,10 @@ static int Init(const loader::LoaderExports *loader_exports) {
   if (quota_limit < 0)
     quota_limit = 0;
   int64_t quota_threshold = quota_limit/2;
+  if (quota_journal)
+    quota::EnableJournal();
+  if (quota_background_rebuild)
+    quota::EnableBackgroundRebuild();
   if (shared_cache) {
     if (!quota::InitShared(loader_exports->program_name, ".",
                            (uint64_t)quota_limit, (uint64_t)quota_threshold))
@@ -2271,6 +2617,8 @@ static int Init(const loader::LoaderExports *loader_exports) {
              "CernVM-FS: quota initialized, current size %luMB",
              quota::GetSize()/(1024*1024));
   }
+  if (quota_touch_delay > 0)
+    quota::EnableTouchBuffer(quota_touch_delay);
 
   // Monitor, check for maximum number of open files
   if (cvmfs::UseWatchdog()) {
@@ -2309,6 +2657,11 @@ static int Init(const loader::LoaderExports *loader_exports) {
   if (follow_redirects) {
     cvmfs::download_manager_->EnableRedirects();
   }
+  if (use_http2) {
+    cvmfs::download_manager_->EnableHttp2();
+  }
+  cvmfs::download_manager_->SetIoThreads(download_threads, download_sharding);
+  cvmfs::download_manager_->SetDataWorkers(download_workers);
   cvmfs::download_manager_->SetTimeout(timeout, timeout_direct);
   cvmfs::download_manager_->SetLowSpeedLimit(low_speed_limit);
   cvmfs::download_manager_->SetProxyGroupResetDelay(proxy_reset_after);
@@ -2333,6 +2686,19 @@ static int Init(const loader::LoaderExports *loader_exports) {
   if (use_geo_api) {
     cvmfs::download_manager_->ProbeGeo();
   }
+  if (chunk_prefetch > 0) {
+    cvmfs::chunk_prefetcher_ =
+      new cache::ChunkPrefetcher(chunk_prefetch, cache::PrefetchChunks,
+                                 cvmfs::download_manager_,
+                                 cvmfs::statistics_);
+  }
+  if ((object_memcache_size > 0) && (object_memcache_max_object > 0)) {
+    if (object_memcache_max_object > object_memcache_size)
+      object_memcache_max_object = object_memcache_size;
+    cvmfs::memory_cache_ =
+      new cache::MemoryCache(object_memcache_size, object_memcache_max_object,
+                             cvmfs::statistics_);
+  }
 
   cvmfs::signature_manager_ = new signature::SignatureManager();
   cvmfs::signature_manager_->Init();
@@ -2373,6 +2739,9 @@ static int Init(const loader::LoaderExports *loader_exports) {
     cvmfs::catalog_manager_->SetInodeAnnotation(cvmfs::inode_annotation_);
   }
   cvmfs::catalog_manager_->SetOwnerMaps(uid_map, gid_map);
+  cvmfs::catalog_manager_->SetCatalogMmapSize(catalog_mmap_size);
+  if (catalog_lookup_filter)
+    cvmfs::catalog_manager_->EnableLookupFilter(cvmfs::statistics_);
 
   // Load specific tag (root hash has precedence, then repository_tag)
   if ((root_hash == "") &&
@@ -2538,6 +2907,13 @@ static void Fini() {
   cvmfs::catalog_manager_ = NULL;
 
   tracer::Fini();
+  // Waits for the prefetched chunks, must be before the download manager and
+  // the cache are stopped
+  delete cvmfs::chunk_prefetcher_;
+  cvmfs::chunk_prefetcher_ = NULL;
+  // Objects of open files survive until they are released
+  delete cvmfs::memory_cache_;
+  cvmfs::memory_cache_ = NULL;
   if (g_signature_ready) cvmfs::signature_manager_->Fini();
   if (g_download_ready) cvmfs::download_manager_->Fini();
   if (g_quota_ready) {
@@ -2688,7 +3064,7 @@ static bool SaveState(const int fd_progress, loader::StateList *saved_states) {
   SendMsg2Socket(fd_progress, msg_progress);
   ChunkTables *saved_chunk_tables = new ChunkTables(*cvmfs::chunk_tables_);
   loader::SavedState *state_chunk_tables = new loader::SavedState();
-  state_chunk_tables->state_id = loader::kStateOpenFilesV2;
+  state_chunk_tables->state_id = loader::kStateOpenFilesV3;
   state_chunk_tables->state = saved_chunk_tables;
   saved_states->push_back(state_chunk_tables);
 
@@ -2774,15 +3150,25 @@ static bool RestoreState(const int fd_progress,
     }
 
     if (saved_states[i]->state_id == loader::kStateOpenFiles) {
-      SendMsg2Socket(fd_progress, "Migrating chunk tables (v1 to v2)... ");
+      SendMsg2Socket(fd_progress, "Migrating chunk tables (v1 to v3)... ");
       compat::chunk_tables::ChunkTables *saved_chunk_tables =
         (compat::chunk_tables::ChunkTables *)saved_states[i]->state;
       compat::chunk_tables::Migrate(saved_chunk_tables, cvmfs::chunk_tables_);
       SendMsg2Socket(fd_progress,
-        StringifyInt(cvmfs::chunk_tables_->handle2fd.size()) + " handles\n");
+        StringifyInt(cvmfs::chunk_tables_->NumHandles()) + " handles\n");
     }
 
     if (saved_states[i]->state_id == loader::kStateOpenFilesV2) {
+      SendMsg2Socket(fd_progress, "Migrating chunk tables (v2 to v3)... ");
+      compat::chunk_tables_v2::ChunkTables *saved_chunk_tables =
+        (compat::chunk_tables_v2::ChunkTables *)saved_states[i]->state;
+      compat::chunk_tables_v2::Migrate(saved_chunk_tables,
+                                       cvmfs::chunk_tables_);
+      SendMsg2Socket(fd_progress,
+        StringifyInt(cvmfs::chunk_tables_->NumHandles()) + " handles\n");
+    }
+
+    if (saved_states[i]->state_id == loader::kStateOpenFilesV3) {
       SendMsg2Socket(fd_progress, "Restoring chunk tables... ");
       delete cvmfs::chunk_tables_;
       ChunkTables *saved_chunk_tables = reinterpret_cast<ChunkTables *>(
@@ -2862,6 +3248,11 @@ static void FreeSavedState(const int fd_progress,
           saved_states[i]->state);
         break;
       case loader::kStateOpenFilesV2:
+        SendMsg2Socket(fd_progress, "Releasing chunk tables (version 2)\n");
+        delete static_cast<compat::chunk_tables_v2::ChunkTables *>(
+          saved_states[i]->state);
+        break;
+      case loader::kStateOpenFilesV3:
         SendMsg2Socket(fd_progress, "Releasing chunk tables\n");
         delete static_cast<ChunkTables *>(saved_states[i]->state);
         break;
@@ -11,7 +11,10 @@
  * blocks but there is a separate I/O thread using asynchronous I/O, which
  * maintains all concurrent connections simultaneously.  As there might be more
  * than 1024 file descriptors for the CernVM-FS process, the I/O thread uses
- * poll and the libcurl multi socket interface.
+ * epoll (or poll, where epoll is not available) and the libcurl multi socket
+ * interface.  Jobs are handed to the I/O thread through a lock-free queue and
+ * an eventfd doorbell.  FetchAsync() submits batches of jobs to the I/O thread
+ * without blocking and reports every finished job to a callback.
  *
  * While downloading, files can be decompressed and the secure hash can be
  * calculated on the fly.
@@ -32,10 +35,18 @@
 
 #include <alloca.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <poll.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdint.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
 #include <sys/time.h>
 #include <unistd.h>
 
@@ -44,6 +55,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <set>
 
 #include "atomic.h"
@@ -51,10 +63,12 @@
 #include "duplex_curl.h"
 #include "hash.h"
 #include "logging.h"
+#include "murmur.h"
 #include "prng.h"
 #include "sanitizer.h"
 #include "smalloc.h"
 #include "util.h"
+#include "util_concurrency.h"
 
 using namespace std;  // NOLINT
 
@@ -136,6 +150,22 @@ static unsigned EscapeHeader(const string &header,
 }
 
 
+/**
+ * Shared by the jobs submitted together by FetchAsync().  The callback is
+ * deleted after it has been invoked for the last job of the batch.
+ */
+struct FetchBatch {
+  FetchBatch(const DownloadManager::CallbackTN *callback, const int32_t size)
+    : callback(callback)
+  {
+    atomic_init32(&pending);
+    atomic_xadd32(&pending, size);
+  }
+  const DownloadManager::CallbackTN *callback;
+  atomic_int32 pending;
+};
+
+
 static Failures PrepareDownloadDestination(JobInfo *info) {
   info->destination_mem.size = 0;
   info->destination_mem.pos = 0;
@@ -243,21 +273,19 @@ static size_t CallbackCurlHeader(void *ptr, size_t size, size_t nmemb,
 
 
 /**
- * Called by curl for every received data chunk.
+ * Hashes a chunk of received data and writes it to the destination.  For file
+ * destinations, this can run in a data worker instead of the I/O thread (see
+ * DownloadManager::SetDataWorkers()).
+ *
+ * \return kFailOk or the reason to abort the transfer
  */
-static size_t CallbackCurlData(void *ptr, size_t size, size_t nmemb,
-                               void *info_link)
+static Failures WriteData(JobInfo *info, const void *ptr,
+                          const size_t num_bytes)
 {
-  const size_t num_bytes = size*nmemb;
-  JobInfo *info = static_cast<JobInfo *>(info_link);
-
-  // LogCvmfs(kLogDownload, kLogDebug, "Data callback,  %d bytes", num_bytes);
-
-  if (num_bytes == 0)
-    return 0;
-
-  if (info->expected_hash)
-    shash::Update((unsigned char *)ptr, num_bytes, info->hash_context);
+  if (info->expected_hash) {
+    shash::Update(static_cast<const unsigned char *>(ptr), num_bytes,
+                  info->hash_context);
+  }
 
   if (info->destination == kDestinationMem) {
     // Write to memory
@@ -273,8 +301,7 @@ static size_t CallbackCurlData(void *ptr, size_t size, size_t nmemb,
                  num_bytes,
                  info->destination_mem.size);
       }
-      info->error_code = kFailBadData;
-      return 0;
+      return kFailBadData;
     }
     memcpy(info->destination_mem.data + info->destination_mem.pos,
            ptr, num_bytes);
@@ -285,39 +312,174 @@ static size_t CallbackCurlData(void *ptr, size_t size, size_t nmemb,
       // LogCvmfs(kLogDownload, kLogDebug, "REMOVE-ME: writing %d bytes for %s",
       //          num_bytes, info->url->c_str());
       zlib::StreamStates retval =
-        zlib::DecompressZStream2File(&info->zstream,
-                                     info->destination_file,
-                                     ptr, num_bytes);
+        info->decompressor->Inflate2File(ptr, num_bytes,
+                                         info->destination_file);
       if (retval == zlib::kStreamDataError) {
         LogCvmfs(kLogDownload, kLogDebug, "failed to decompress %s",
                  info->url->c_str());
-        info->error_code = kFailBadData;
-        return 0;
+        return kFailBadData;
       } else if (retval == zlib::kStreamIOError) {
         LogCvmfs(kLogDownload, kLogSyslogErr,
                  "decompressing %s, local IO error", info->url->c_str());
-        info->error_code = kFailLocalIO;
-        return 0;
+        return kFailLocalIO;
       }
     } else {
-      if (fwrite(ptr, 1, num_bytes, info->destination_file) != num_bytes) {
-        info->error_code = kFailLocalIO;
-        return 0;
-      }
+      if (fwrite(ptr, 1, num_bytes, info->destination_file) != num_bytes)
+        return kFailLocalIO;
     }
   }
 
+  return kFailOk;
+}
+
+
+/**
+ * Called by curl for every received data chunk.
+ */
+static size_t CallbackCurlData(void *ptr, size_t size, size_t nmemb,
+                               void *info_link)
+{
+  const size_t num_bytes = size*nmemb;
+  JobInfo *info = static_cast<JobInfo *>(info_link);
+
+  // LogCvmfs(kLogDownload, kLogDebug, "Data callback,  %d bytes", num_bytes);
+
+  if (num_bytes == 0)
+    return 0;
+
+  const Failures result = WriteData(info, ptr, num_bytes);
+  if (result != kFailOk) {
+    info->error_code = result;
+    return 0;
+  }
   return num_bytes;
 }
 
 
+/**
+ * Received data of a transfer on its way from the curl write callback to the
+ * data workers.  At most one worker at a time processes the chunks of a
+ * stream, so that they are hashed and decompressed in order.  Chunks are only
+ * queued as long as the stream is scheduled, i.e. queued for or processed by
+ * a worker.
+ */
+struct DataStream {
+  struct Chunk {
+    Chunk(char *data, const size_t size) : data(data), size(size) { }
+    char *data;
+    size_t size;
+  };
+
+  DataStream(DownloadManager *download_mgr, const unsigned io_thread)
+    : download_mgr(download_mgr)
+    , io_thread(io_thread)
+    , scheduled(false)
+    , pausable(false)
+    , paused(false)
+    , complete(false)
+    , curl_error(CURLE_OK)
+    , error_code(kFailOk)
+  {
+    int retval = pthread_mutex_init(&lock, NULL);
+    assert(retval == 0);
+  }
+  ~DataStream() {
+    pthread_mutex_destroy(&lock);
+  }
+
+  pthread_mutex_t lock;
+  std::deque<Chunk> chunks;
+  DownloadManager *download_mgr;
+  /**
+   * Index of the I/O thread that runs the transfer
+   */
+  unsigned io_thread;
+  bool scheduled;
+  /**
+   * Not for file:// URLs: curl completes those in one go, even while paused
+   */
+  bool pausable;
+  /**
+   * The transfer is paused because the data workers are behind.  The worker
+   * draining the stream hands the job back to the I/O thread to resume it.
+   */
+  bool paused;
+  /**
+   * The transfer finished while chunks were still pending.  The worker
+   * draining the stream hands the job back to the I/O thread.
+   */
+  bool complete;
+  int curl_error;
+  /**
+   * Failure of a worker; the transfer is aborted
+   */
+  Failures error_code;
+};
+
+
 //------------------------------------------------------------------------------
 
 const int DownloadManager::kProbeUnprobed = -1;
 const int DownloadManager::kProbeDown     = -2;
 const int DownloadManager::kProbeGeo      = -3;
 const unsigned DownloadManager::kMaxMemSize = 1024*1024;
+const unsigned DownloadManager::kJobQueueSize = 4096;
+const unsigned DownloadManager::kMaxIoThreads = 64;
+const unsigned DownloadManager::kMaxDataWorkers = 64;
+const uint64_t DownloadManager::kDataBufferSize = 16*1024*1024;
+
+
+#ifdef HAVE_SYS_EPOLL_H
+
+/**
+ * Called when new curl sockets arrive or existing curl sockets depart.  Known
+ * sockets are marked by a non-NULL socketp.
+ */
+int DownloadManager::CallbackCurlSocket(CURL *easy,
+                                        curl_socket_t s,
+                                        int action,
+                                        void *userp,
+                                        void *socketp)
+{
+  IoThread *io_thread = static_cast<IoThread *>(userp);
+  if (action == CURL_POLL_NONE)
+    return 0;
 
+  if (action == CURL_POLL_REMOVE) {
+    // The socket might be closed already
+    epoll_ctl(io_thread->epoll_fd, EPOLL_CTL_DEL, s, NULL);
+    return 0;
+  }
+
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.data.fd = s;
+  switch (action) {
+    case CURL_POLL_IN:
+      event.events = EPOLLIN | EPOLLPRI;
+      break;
+    case CURL_POLL_OUT:
+      event.events = EPOLLOUT;
+      break;
+    case CURL_POLL_INOUT:
+      event.events = EPOLLIN | EPOLLPRI | EPOLLOUT;
+      break;
+    default:
+      return 0;
+  }
+  if (socketp == NULL) {
+    int retval = epoll_ctl(io_thread->epoll_fd, EPOLL_CTL_ADD, s, &event);
+    assert(retval == 0);
+    curl_multi_assign(io_thread->curl_multi, s, io_thread);
+  } else {
+    int retval = epoll_ctl(io_thread->epoll_fd, EPOLL_CTL_MOD, s, &event);
+    assert(retval == 0);
+  }
+
+  return 0;
+}
+
+#else  // HAVE_SYS_EPOLL_H
 
 /**
  * Called when new curl sockets arrive or existing curl sockets depart.
@@ -330,60 +492,61 @@ int DownloadManager::CallbackCurlSocket(CURL *easy,
 {
   // LogCvmfs(kLogDownload, kLogDebug, "CallbackCurlSocket called with easy "
   //          "handle %p, socket %d, action %d", easy, s, action);
-  DownloadManager *download_mgr = static_cast<DownloadManager *>(userp);
+  IoThread *io_thread = static_cast<IoThread *>(userp);
   if (action == CURL_POLL_NONE)
     return 0;
 
-  // Find s in watch_fds_
+  // Find s in watch_fds
   unsigned index;
-  for (index = 0; index < download_mgr->watch_fds_inuse_; ++index) {
-    if (download_mgr->watch_fds_[index].fd == s)
+  for (index = 0; index < io_thread->watch_fds_inuse; ++index) {
+    if (io_thread->watch_fds[index].fd == s)
       break;
   }
   // Or create newly
-  if (index == download_mgr->watch_fds_inuse_) {
+  if (index == io_thread->watch_fds_inuse) {
     // Extend array if necessary
-    if (download_mgr->watch_fds_inuse_ == download_mgr->watch_fds_size_)
+    if (io_thread->watch_fds_inuse == io_thread->watch_fds_size)
     {
-      download_mgr->watch_fds_size_ *= 2;
-      download_mgr->watch_fds_ = static_cast<struct pollfd *>(
-        srealloc(download_mgr->watch_fds_,
-                 download_mgr->watch_fds_size_*sizeof(struct pollfd)));
+      io_thread->watch_fds_size *= 2;
+      io_thread->watch_fds = static_cast<struct pollfd *>(
+        srealloc(io_thread->watch_fds,
+                 io_thread->watch_fds_size*sizeof(struct pollfd)));
     }
-    download_mgr->watch_fds_[download_mgr->watch_fds_inuse_].fd = s;
-    download_mgr->watch_fds_[download_mgr->watch_fds_inuse_].events = 0;
-    download_mgr->watch_fds_[download_mgr->watch_fds_inuse_].revents = 0;
-    download_mgr->watch_fds_inuse_++;
+    io_thread->watch_fds[io_thread->watch_fds_inuse].fd = s;
+    io_thread->watch_fds[io_thread->watch_fds_inuse].events = 0;
+    io_thread->watch_fds[io_thread->watch_fds_inuse].revents = 0;
+    io_thread->watch_fds_inuse++;
   }
 
   switch (action) {
     case CURL_POLL_IN:
-      download_mgr->watch_fds_[index].events |= POLLIN | POLLPRI;
+      io_thread->watch_fds[index].events |= POLLIN | POLLPRI;
       break;
     case CURL_POLL_OUT:
-      download_mgr->watch_fds_[index].events |= POLLOUT | POLLWRBAND;
+      io_thread->watch_fds[index].events |= POLLOUT | POLLWRBAND;
       break;
     case CURL_POLL_INOUT:
-      download_mgr->watch_fds_[index].events |=
+      io_thread->watch_fds[index].events |=
         POLLIN | POLLPRI | POLLOUT | POLLWRBAND;
       break;
     case CURL_POLL_REMOVE:
-      if (index < download_mgr->watch_fds_inuse_-1)
-        download_mgr->watch_fds_[index] =
-          download_mgr->watch_fds_[download_mgr->watch_fds_inuse_-1];
-      download_mgr->watch_fds_inuse_--;
+      if (index < io_thread->watch_fds_inuse-1)
+        io_thread->watch_fds[index] =
+          io_thread->watch_fds[io_thread->watch_fds_inuse-1];
+      io_thread->watch_fds_inuse--;
       // Shrink array if necessary
-      if ((download_mgr->watch_fds_inuse_ > download_mgr->watch_fds_max_) &&
-          (download_mgr->watch_fds_inuse_ < download_mgr->watch_fds_size_/2))
+      if ((io_thread->watch_fds_inuse >
+           io_thread->download_mgr->watch_fds_max_) &&
+          (io_thread->watch_fds_inuse < io_thread->watch_fds_size/2))
       {
-        download_mgr->watch_fds_size_ /= 2;
-        // LogCvmfs(kLogDownload, kLogDebug, "shrinking watch_fds_ (%d)",
-        //          watch_fds_size_);
-        download_mgr->watch_fds_ = static_cast<struct pollfd *>(
-          srealloc(download_mgr->watch_fds_,
-                   download_mgr->watch_fds_size_*sizeof(struct pollfd)));
-        // LogCvmfs(kLogDownload, kLogDebug, "shrinking watch_fds_ done",
-        //          watch_fds_size_);
+        io_thread->watch_fds_size /= 2;
+        // LogCvmfs(kLogDownload, kLogDebug, "shrinking watch_fds (%d)",
+        //          watch_fds_size);
+        io_thread->watch_fds = static_cast<struct pollfd *>(
+          srealloc(io_thread->watch_fds,
+                   io_thread->watch_fds_size*sizeof(struct pollfd)));
+        // LogCvmfs(kLogDownload, kLogDebug, "shrinking watch_fds done",
+        //          watch_fds_size);
       }
       break;
     default:
@@ -393,140 +556,454 @@ int DownloadManager::CallbackCurlSocket(CURL *easy,
   return 0;
 }
 
+#endif  // HAVE_SYS_EPOLL_H
+
+
+/**
+ * Hands all jobs queued for the given I/O thread to its curl multi handle.
+ *
+ * \return the number of new jobs
+ */
+unsigned DownloadManager::DrainJobQueue(IoThread *io_thread) {
+  unsigned num_jobs = 0;
+  JobInfo *info;
+  while (io_thread->job_queue->TryDequeue(&info)) {
+    if ((num_data_workers_ > 0) &&
+        ((info->destination == kDestinationFile) ||
+         (info->destination == kDestinationPath)))
+    {
+      info->stream = new DataStream(this, io_thread->id);
+    }
+    CURL *handle = AcquireCurlHandle();
+    InitializeRequest(info, handle);
+    SetUrlOptions(info);
+    curl_multi_add_handle(io_thread->curl_multi, handle);
+    io_thread->handles.insert(handle);
+    ++num_jobs;
+  }
+  return num_jobs;
+}
+
+
+#ifdef HAVE_SYS_EPOLL_H
+
+/**
+ * Waits for activity on the curl sockets, the doorbell or the termination
+ * pipe and lets curl process the socket events.
+ *
+ * \return false if the I/O thread should terminate
+ */
+bool DownloadManager::WaitForEvents(IoThread *io_thread,
+                                    const int timeout,
+                                    int *still_running)
+{
+  const int kMaxEvents = 64;
+  struct epoll_event events[kMaxEvents];
+  const int num_events =
+    epoll_wait(io_thread->epoll_fd, events, kMaxEvents, timeout);
+  if (num_events < 0)
+    return true;
+
+  // Handle timeout
+  if (num_events == 0) {
+    curl_multi_socket_action(io_thread->curl_multi, CURL_SOCKET_TIMEOUT, 0,
+                             still_running);
+    return true;
+  }
+
+  for (int i = 0; i < num_events; ++i) {
+    const int fd = events[i].data.fd;
+    // Terminate I/O thread
+    if (fd == pipe_terminate_[0])
+      return false;
+    // New jobs are picked up from the queue by the caller
+    if (fd == io_thread->doorbell[0]) {
+      ClearDoorbell(io_thread);
+      continue;
+    }
+
+    // Activity on curl sockets
+    int ev_bitmask = 0;
+    if (events[i].events & (EPOLLIN | EPOLLPRI))
+      ev_bitmask |= CURL_CSELECT_IN;
+    if (events[i].events & EPOLLOUT)
+      ev_bitmask |= CURL_CSELECT_OUT;
+    if (events[i].events & (EPOLLERR | EPOLLHUP))
+      ev_bitmask |= CURL_CSELECT_ERR;
+    curl_multi_socket_action(io_thread->curl_multi, fd, ev_bitmask,
+                             still_running);
+  }
+  return true;
+}
+
+#else  // HAVE_SYS_EPOLL_H
+
+bool DownloadManager::WaitForEvents(IoThread *io_thread,
+                                    const int timeout,
+                                    int *still_running)
+{
+  int retval = poll(io_thread->watch_fds, io_thread->watch_fds_inuse, timeout);
+  if (retval < 0)
+    return true;
+
+  // Handle timeout
+  if (retval == 0) {
+    curl_multi_socket_action(io_thread->curl_multi, CURL_SOCKET_TIMEOUT, 0,
+                             still_running);
+  }
+
+  // Terminate I/O thread
+  if (io_thread->watch_fds[0].revents)
+    return false;
+
+  // New jobs are picked up from the queue by the caller
+  if (io_thread->watch_fds[1].revents) {
+    io_thread->watch_fds[1].revents = 0;
+    ClearDoorbell(io_thread);
+  }
+
+  // Activity on curl sockets
+  for (unsigned i = 2; i < io_thread->watch_fds_inuse; ++i) {
+    struct pollfd *watch_fd = &io_thread->watch_fds[i];
+    if (watch_fd->revents) {
+      int ev_bitmask = 0;
+      if (watch_fd->revents & (POLLIN | POLLPRI))
+        ev_bitmask |= CURL_CSELECT_IN;
+      if (watch_fd->revents & (POLLOUT | POLLWRBAND))
+        ev_bitmask |= CURL_CSELECT_IN;
+      if (watch_fd->revents & (POLLERR | POLLHUP | POLLNVAL))
+        ev_bitmask |= CURL_CSELECT_ERR;
+      watch_fd->revents = 0;
+
+      curl_multi_socket_action(io_thread->curl_multi, watch_fd->fd, ev_bitmask,
+                               still_running);
+    }
+  }
+  return true;
+}
+
+#endif  // HAVE_SYS_EPOLL_H
+
 
 /**
- * Worker thread event loop.  Waits on new JobInfo structs on a pipe.
+ * Event loop of an I/O thread.  Picks up all JobInfo structs queued for the
+ * thread whenever it wakes up.
  */
 void *DownloadManager::MainDownload(void *data) {
   LogCvmfs(kLogDownload, kLogDebug, "download I/O thread started");
-  DownloadManager *download_mgr = static_cast<DownloadManager *>(data);
+  IoThread *io_thread = static_cast<IoThread *>(data);
+  DownloadManager *download_mgr = io_thread->download_mgr;
 
-  download_mgr->watch_fds_ =
+#ifndef HAVE_SYS_EPOLL_H
+  io_thread->watch_fds =
     static_cast<struct pollfd *>(smalloc(2 * sizeof(struct pollfd)));
-  download_mgr->watch_fds_size_ = 2;
-  download_mgr->watch_fds_[0].fd = download_mgr->pipe_terminate_[0];
-  download_mgr->watch_fds_[0].events = POLLIN | POLLPRI;
-  download_mgr->watch_fds_[0].revents = 0;
-  download_mgr->watch_fds_[1].fd = download_mgr->pipe_jobs_[0];
-  download_mgr->watch_fds_[1].events = POLLIN | POLLPRI;
-  download_mgr->watch_fds_[1].revents = 0;
-  download_mgr->watch_fds_inuse_ = 2;
+  io_thread->watch_fds_size = 2;
+  io_thread->watch_fds[0].fd = download_mgr->pipe_terminate_[0];
+  io_thread->watch_fds[0].events = POLLIN | POLLPRI;
+  io_thread->watch_fds[0].revents = 0;
+  io_thread->watch_fds[1].fd = io_thread->doorbell[0];
+  io_thread->watch_fds[1].events = POLLIN | POLLPRI;
+  io_thread->watch_fds[1].revents = 0;
+  io_thread->watch_fds_inuse = 2;
+#endif
 
   int still_running = 0;
   struct timeval timeval_start, timeval_stop;
   gettimeofday(&timeval_start, NULL);
   while (true) {
-    int timeout;
-    if (still_running) {
-      timeout = 1;
-    } else {
-      timeout = -1;
-      gettimeofday(&timeval_stop, NULL);
-      download_mgr->statistics_->transfer_time +=
-        DiffTimeSeconds(timeval_start, timeval_stop);
-    }
-    int retval = poll(download_mgr->watch_fds_, download_mgr->watch_fds_inuse_,
-                      timeout);
-    if (retval < 0) {
-      continue;
-    }
-
-    // Handle timeout
-    if (retval == 0) {
-      retval = curl_multi_socket_action(download_mgr->curl_multi_,
-                                        CURL_SOCKET_TIMEOUT,
-                                        0,
-                                        &still_running);
-    }
-
-    // Terminate I/O thread
-    if (download_mgr->watch_fds_[0].revents)
-      break;
-
-    // New job arrives
-    if (download_mgr->watch_fds_[1].revents) {
-      download_mgr->watch_fds_[1].revents = 0;
-      JobInfo *info;
-      ReadPipe(download_mgr->pipe_jobs_[0], &info, sizeof(info));
+    // Submitters ring the doorbell from now on.  Jobs queued before are
+    // picked up right here.
+    atomic_write32(&io_thread->waiting, 1);
+    if (download_mgr->DrainJobQueue(io_thread) > 0) {
       if (!still_running)
         gettimeofday(&timeval_start, NULL);
-      CURL *handle = download_mgr->AcquireCurlHandle();
-      download_mgr->InitializeRequest(info, handle);
-      download_mgr->SetUrlOptions(info);
-      curl_multi_add_handle(download_mgr->curl_multi_, handle);
-      retval = curl_multi_socket_action(download_mgr->curl_multi_,
-                                        CURL_SOCKET_TIMEOUT,
-                                        0,
-                                        &still_running);
-    }
-
-    // Activity on curl sockets
-    for (unsigned i = 2; i < download_mgr->watch_fds_inuse_; ++i) {
-      if (download_mgr->watch_fds_[i].revents) {
-        int ev_bitmask = 0;
-        if (download_mgr->watch_fds_[i].revents & (POLLIN | POLLPRI))
-          ev_bitmask |= CURL_CSELECT_IN;
-        if (download_mgr->watch_fds_[i].revents & (POLLOUT | POLLWRBAND))
-          ev_bitmask |= CURL_CSELECT_IN;
-        if (download_mgr->watch_fds_[i].revents &
-            (POLLERR | POLLHUP | POLLNVAL))
-        {
-          ev_bitmask |= CURL_CSELECT_ERR;
-        }
-        download_mgr->watch_fds_[i].revents = 0;
-
-        retval = curl_multi_socket_action(download_mgr->curl_multi_,
-                                          download_mgr->watch_fds_[i].fd,
-                                          ev_bitmask,
-                                          &still_running);
-      }
+      curl_multi_socket_action(io_thread->curl_multi,
+                               CURL_SOCKET_TIMEOUT,
+                               0,
+                               &still_running);
     }
+    // Restarted transfers can complete right away (file:// URLs), so this
+    // goes before collecting the completed transfers
+    download_mgr->DrainFinished(io_thread, &still_running);
 
     // Check if transfers are completed
     CURLMsg *curl_msg;
     int msgs_in_queue;
-    while ((curl_msg = curl_multi_info_read(download_mgr->curl_multi_,
+    while ((curl_msg = curl_multi_info_read(io_thread->curl_multi,
                                             &msgs_in_queue)))
     {
       if (curl_msg->msg == CURLMSG_DONE) {
+        pthread_mutex_lock(download_mgr->lock_statistics_);
         download_mgr->statistics_->num_requests++;
+        pthread_mutex_unlock(download_mgr->lock_statistics_);
         JobInfo *info;
         CURL *easy_handle = curl_msg->easy_handle;
         int curl_error = curl_msg->data.result;
         curl_easy_getinfo(easy_handle, CURLINFO_PRIVATE, &info);
 
-        curl_multi_remove_handle(download_mgr->curl_multi_, easy_handle);
-        if (download_mgr->VerifyAndFinalize(curl_error, info)) {
-          curl_multi_add_handle(download_mgr->curl_multi_, easy_handle);
-          retval = curl_multi_socket_action(download_mgr->curl_multi_,
-                                            CURL_SOCKET_TIMEOUT,
-                                            0,
-                                            &still_running);
-        } else {
-          // Return easy handle into pool and write result back
-          download_mgr->ReleaseCurlHandle(easy_handle);
-
-          WritePipe(info->wait_at[1], &info->error_code,
-                    sizeof(info->error_code));
+        curl_multi_remove_handle(io_thread->curl_multi, easy_handle);
+        // Otherwise, the data workers hand the job back once they are done
+        if (!info->stream || download_mgr->CompleteStream(info, curl_error)) {
+          download_mgr->FinishTransfer(io_thread, info, curl_error,
+                                       &still_running);
         }
       }
     }
+
+    int timeout;
+    if (still_running) {
+      timeout = 1;
+    } else {
+      timeout = -1;
+      gettimeofday(&timeval_stop, NULL);
+      pthread_mutex_lock(download_mgr->lock_statistics_);
+      download_mgr->statistics_->transfer_time +=
+        DiffTimeSeconds(timeval_start, timeval_stop);
+      pthread_mutex_unlock(download_mgr->lock_statistics_);
+    }
+    const bool proceed =
+      download_mgr->WaitForEvents(io_thread, timeout, &still_running);
+    atomic_write32(&io_thread->waiting, 0);
+    if (!proceed)
+      break;
   }
 
-  for (set<CURL *>::iterator i = download_mgr->pool_handles_inuse_->begin(),
-       iEnd = download_mgr->pool_handles_inuse_->end(); i != iEnd; ++i)
+  pthread_mutex_lock(download_mgr->lock_handles_);
+  for (set<CURL *>::iterator i = io_thread->handles.begin(),
+       iEnd = io_thread->handles.end(); i != iEnd; ++i)
   {
-    curl_multi_remove_handle(download_mgr->curl_multi_, *i);
+    curl_multi_remove_handle(io_thread->curl_multi, *i);
     curl_easy_cleanup(*i);
+    download_mgr->pool_handles_inuse_->erase(*i);
   }
-  download_mgr->pool_handles_inuse_->clear();
-  free(download_mgr->watch_fds_);
+  pthread_mutex_unlock(download_mgr->lock_handles_);
+  io_thread->handles.clear();
+  free(io_thread->watch_fds);
+  io_thread->watch_fds = NULL;
 
   LogCvmfs(kLogDownload, kLogDebug, "download I/O thread terminated");
   return NULL;
 }
 
 
+/**
+ * Verifies a transfer whose data are written, i.e. its curl handle is removed
+ * from the multi handle and no data worker holds its stream.  Either restarts
+ * the transfer or hands the result back.
+ */
+void DownloadManager::FinishTransfer(IoThread *io_thread,
+                                     JobInfo *info,
+                                     int curl_error,
+                                     int *still_running)
+{
+  DataStream *stream = info->stream;
+  if (stream && (stream->error_code != kFailOk)) {
+    info->error_code = stream->error_code;
+    curl_error = CURLE_WRITE_ERROR;
+  }
+  if (stream) {
+    stream->complete = false;
+    stream->curl_error = CURLE_OK;
+    stream->error_code = kFailOk;
+  }
+
+  CURL *easy_handle = info->curl_handle;
+  if (VerifyAndFinalize(curl_error, info)) {
+    curl_multi_add_handle(io_thread->curl_multi, easy_handle);
+    curl_multi_socket_action(io_thread->curl_multi,
+                             CURL_SOCKET_TIMEOUT,
+                             0,
+                             still_running);
+  } else {
+    // Return easy handle into pool and hand the result back
+    io_thread->handles.erase(easy_handle);
+    ReleaseCurlHandle(easy_handle);
+    CleanupJob(info);
+    NotifyJob(info);
+  }
+}
+
+
+/**
+ * Finishes or resumes the transfers that the data workers handed back to the
+ * I/O thread.  The complete flag is only touched by the I/O thread.
+ */
+void DownloadManager::DrainFinished(IoThread *io_thread, int *still_running) {
+  vector<JobInfo *> finished;
+  pthread_mutex_lock(&io_thread->lock_finished);
+  finished.swap(io_thread->finished);
+  pthread_mutex_unlock(&io_thread->lock_finished);
+  for (unsigned i = 0; i < finished.size(); ++i) {
+    JobInfo *info = finished[i];
+    if (info->stream->complete) {
+      FinishTransfer(io_thread, info, info->stream->curl_error, still_running);
+    } else {
+      curl_easy_pause(info->curl_handle, CURLPAUSE_CONT);
+      curl_multi_socket_action(io_thread->curl_multi, CURL_SOCKET_TIMEOUT, 0,
+                               still_running);
+    }
+  }
+}
+
+
+/**
+ * Called by curl for every received data chunk of a transfer that is
+ * processed by the data workers.  Only copies the data.  While the data
+ * workers are behind by more than the buffer size, transfers with chunks
+ * queued for the workers are paused; the I/O thread keeps serving all other
+ * transfers.  Curl delivers the same data again once the transfer is resumed.
+ */
+size_t DownloadManager::CallbackCurlStream(void *ptr, size_t size,
+                                           size_t nmemb, void *info_link)
+{
+  const size_t num_bytes = size*nmemb;
+  JobInfo *info = static_cast<JobInfo *>(info_link);
+  DataStream *stream = info->stream;
+  DownloadManager *download_mgr = stream->download_mgr;
+
+  if (num_bytes == 0)
+    return 0;
+
+  pthread_mutex_lock(&stream->lock);
+  // Abort the transfer as soon as a worker failed
+  if (stream->error_code != kFailOk) {
+    pthread_mutex_unlock(&stream->lock);
+    return 0;
+  }
+  // Streams that are not scheduled take their chunk in any case, so that no
+  // transfer waits for a worker that never comes
+  if (!download_mgr->ReserveDataBuffer(num_bytes,
+                                       !stream->scheduled || !stream->pausable))
+  {
+    stream->paused = true;
+    pthread_mutex_unlock(&stream->lock);
+    return CURL_WRITEFUNC_PAUSE;
+  }
+  pthread_mutex_unlock(&stream->lock);
+
+  char *data = static_cast<char *>(smalloc(num_bytes));
+  memcpy(data, ptr, num_bytes);
+
+  pthread_mutex_lock(&stream->lock);
+  stream->chunks.push_back(DataStream::Chunk(data, num_bytes));
+  const bool schedule = !stream->scheduled;
+  stream->scheduled = true;
+  pthread_mutex_unlock(&stream->lock);
+
+  if (schedule)
+    download_mgr->data_jobs_->Enqueue(info);
+  return num_bytes;
+}
+
+
+/**
+ * Marks the stream of a finished transfer as complete.
+ *
+ * \return true if no chunks are pending and the transfer can be finished
+ *         right away, false if a data worker hands it back later
+ */
+bool DownloadManager::CompleteStream(JobInfo *info, const int curl_error) {
+  DataStream *stream = info->stream;
+  pthread_mutex_lock(&stream->lock);
+  const bool idle = !stream->scheduled;
+  if (!idle) {
+    stream->complete = true;
+    stream->curl_error = curl_error;
+  }
+  pthread_mutex_unlock(&stream->lock);
+  return idle;
+}
+
+
+/**
+ * Processes the pending chunks of a stream in order.  If the transfer is
+ * complete or paused, the job is handed back to its I/O thread.
+ */
+void DownloadManager::ProcessStream(JobInfo *info) {
+  DataStream *stream = info->stream;
+  while (true) {
+    pthread_mutex_lock(&stream->lock);
+    if (stream->chunks.empty()) {
+      stream->scheduled = false;
+      const bool hand_back = stream->complete || stream->paused;
+      stream->paused = false;
+      pthread_mutex_unlock(&stream->lock);
+      if (hand_back) {
+        IoThread *io_thread = (*io_threads_)[stream->io_thread];
+        pthread_mutex_lock(&io_thread->lock_finished);
+        io_thread->finished.push_back(info);
+        pthread_mutex_unlock(&io_thread->lock_finished);
+        WakeIoThread(io_thread);
+      }
+      return;
+    }
+    const DataStream::Chunk chunk = stream->chunks.front();
+    stream->chunks.pop_front();
+    const bool failed = (stream->error_code != kFailOk);
+    pthread_mutex_unlock(&stream->lock);
+
+    // Chunks received after a failure are dropped
+    if (!failed) {
+      const Failures result = WriteData(info, chunk.data, chunk.size);
+      if (result != kFailOk) {
+        pthread_mutex_lock(&stream->lock);
+        stream->error_code = result;
+        pthread_mutex_unlock(&stream->lock);
+      }
+    }
+    free(chunk.data);
+    ReleaseDataBuffer(chunk.size);
+  }
+}
+
+
+/**
+ * Main loop of a data worker.  Processes streams until it receives NULL.
+ */
+void *DownloadManager::MainDataWorker(void *data) {
+  LogCvmfs(kLogDownload, kLogDebug, "download data worker started");
+  DownloadManager *download_mgr = static_cast<DownloadManager *>(data);
+
+  JobInfo *info;
+  while ((info = download_mgr->data_jobs_->Dequeue()) != NULL)
+    download_mgr->ProcessStream(info);
+
+  LogCvmfs(kLogDownload, kLogDebug, "download data worker terminated");
+  return NULL;
+}
+
+
+/**
+ * Takes size bytes of the data buffer.  Never blocks.
+ *
+ * \return false if that would exceed the buffer size, unless nothing is
+ *         buffered at all or force is set
+ */
+bool DownloadManager::ReserveDataBuffer(const size_t size, const bool force) {
+  pthread_mutex_lock(lock_data_buffer_);
+  const bool reserved = force || (data_buffered_ == 0) ||
+                        (data_buffered_ + size <= data_buffer_size_);
+  if (reserved)
+    data_buffered_ += size;
+  pthread_mutex_unlock(lock_data_buffer_);
+
+  if (!reserved) {
+    pthread_mutex_lock(lock_statistics_);
+    statistics_->num_data_waits++;
+    pthread_mutex_unlock(lock_statistics_);
+  }
+  return reserved;
+}
+
+
+void DownloadManager::ReleaseDataBuffer(const size_t size) {
+  pthread_mutex_lock(lock_data_buffer_);
+  assert(data_buffered_ >= size);
+  data_buffered_ -= size;
+  pthread_mutex_unlock(lock_data_buffer_);
+}
+
+
 //------------------------------------------------------------------------------
 
 
@@ -651,12 +1128,19 @@ string DownloadManager::ProxyInfo::Print() {
 
 /**
  * Gets an idle CURL handle from the pool. Creates a new one and adds it to
- * the pool if necessary.
+ * the pool if necessary.  The pool is shared by the I/O threads.
  */
 CURL *DownloadManager::AcquireCurlHandle() {
-  CURL *handle;
+  CURL *handle = NULL;
+
+  pthread_mutex_lock(lock_handles_);
+  if (!pool_handles_idle_->empty()) {
+    handle = *(pool_handles_idle_->begin());
+    pool_handles_idle_->erase(pool_handles_idle_->begin());
+  }
+  pthread_mutex_unlock(lock_handles_);
 
-  if (pool_handles_idle_->empty()) {
+  if (handle == NULL) {
     // Create a new handle
     handle = curl_easy_init();
     assert(handle != NULL);
@@ -664,28 +1148,38 @@ CURL *DownloadManager::AcquireCurlHandle() {
     curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1);
     // curl_easy_setopt(curl_default, CURLOPT_FAILONERROR, 1);
     curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, CallbackCurlHeader);
-    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, CallbackCurlData);
-  } else {
-    handle = *(pool_handles_idle_->begin());
-    pool_handles_idle_->erase(pool_handles_idle_->begin());
   }
 
+  pthread_mutex_lock(lock_handles_);
   pool_handles_inuse_->insert(handle);
+  const uint64_t num_inuse = pool_handles_inuse_->size();
+  pthread_mutex_unlock(lock_handles_);
+
+  pthread_mutex_lock(lock_statistics_);
+  if (num_inuse > statistics_->max_concurrent_requests)
+    statistics_->max_concurrent_requests = num_inuse;
+  pthread_mutex_unlock(lock_statistics_);
 
   return handle;
 }
 
 
 void DownloadManager::ReleaseCurlHandle(CURL *handle) {
+  pthread_mutex_lock(lock_handles_);
   set<CURL *>::iterator elem = pool_handles_inuse_->find(handle);
   assert(elem != pool_handles_inuse_->end());
 
+  bool cleanup = false;
   if (pool_handles_idle_->size() > pool_max_handles_)
-    curl_easy_cleanup(*elem);
+    cleanup = true;
   else
     pool_handles_idle_->insert(*elem);
 
   pool_handles_inuse_->erase(elem);
+  pthread_mutex_unlock(lock_handles_);
+
+  if (cleanup)
+    curl_easy_cleanup(handle);
 }
 
 
@@ -703,12 +1197,14 @@ void DownloadManager::InitializeRequest(JobInfo *info, CURL *handle) {
   info->num_used_hosts = 1;
   info->num_retries = 0;
   info->backoff_ms = 0;
+  pthread_mutex_lock(lock_handles_);
   info->headers = header_lists_->DuplicateList(default_headers_);
   if (info->info_header) {
     header_lists_->AppendHeader(info->headers, info->info_header);
   }
+  pthread_mutex_unlock(lock_handles_);
   if (info->compressed) {
-    zlib::DecompressInit(&(info->zstream));
+    info->decompressor = new zlib::StreamDecompressor();
   }
   if (info->expected_hash) {
     assert(info->hash_context.buffer != NULL);
@@ -727,6 +1223,10 @@ void DownloadManager::InitializeRequest(JobInfo *info, CURL *handle) {
   curl_easy_setopt(handle, CURLOPT_WRITEHEADER,
                    static_cast<void *>(info));
   curl_easy_setopt(handle, CURLOPT_WRITEDATA, static_cast<void *>(info));
+  if (info->stream)
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, CallbackCurlStream);
+  else
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, CallbackCurlData);
   curl_easy_setopt(handle, CURLOPT_HTTPHEADER, info->headers);
   if (info->head_request)
     curl_easy_setopt(handle, CURLOPT_NOBODY, 1);
@@ -865,8 +1365,22 @@ void DownloadManager::SetUrlOptions(JobInfo *info) {
              replacement.c_str());
     url = ReplaceAll(url, "@proxy@", replacement);
   }
+#ifdef CURLPIPE_MULTIPLEX
+  if (enable_http2_) {
+    // Offer HTTP/2 unless the host or proxy is known to not support it.  Wait
+    // for connections in progress in order to multiplex on them.
+    info->http2 = (http1_endpoints_->find(GetEndpoint(info->proxy, url)) ==
+                   http1_endpoints_->end());
+    curl_easy_setopt(curl_handle, CURLOPT_HTTP_VERSION,
+                     info->http2 ? CURL_HTTP_VERSION_2_0 :
+                                   CURL_HTTP_VERSION_1_1);
+    curl_easy_setopt(curl_handle, CURLOPT_PIPEWAIT, info->http2 ? 1L : 0L);
+  }
+#endif
   pthread_mutex_unlock(lock_options_);
 
+  if (info->stream)
+    info->stream->pausable = !HasPrefix(url, "file://", false);
   curl_easy_setopt(curl_handle, CURLOPT_URL, EscapeUrl(url).c_str());
 }
 
@@ -951,11 +1465,120 @@ void DownloadManager::ValidateProxyIpsUnlocked(
 /**
  * Adds transfer time and downloaded bytes to the global counters.
  */
-void DownloadManager::UpdateStatistics(CURL *handle) {
-  double val;
+void DownloadManager::UpdateStatistics(JobInfo *info) {
+  CURL *handle = info->curl_handle;
+  double transferred_bytes = 0.0;
+  long num_connects = -1;  // NOLINT(runtime/int)
+  double connect_time = 0.0;
+  double appconnect_time = 0.0;
+
+  curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD, &transferred_bytes);
+  char *effective_url = NULL;
+  curl_easy_getinfo(handle, CURLINFO_EFFECTIVE_URL, &effective_url);
+  if ((effective_url != NULL) && !HasPrefix(effective_url, "file://", false)) {
+    if (curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &num_connects) !=
+        CURLE_OK)
+    {
+      num_connects = -1;
+    }
+    if (num_connects > 0) {
+      curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME, &connect_time);
+      // Time until the TLS handshake finished, 0 for plain HTTP
+      curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME, &appconnect_time);
+    }
+  }
 
-  if (curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD, &val) == CURLE_OK)
-    statistics_->transferred_bytes += val;
+  pthread_mutex_lock(lock_statistics_);
+  statistics_->transferred_bytes += transferred_bytes;
+  if (num_connects == 0) {
+    statistics_->num_reused_connections++;
+  } else if (num_connects > 0) {
+    statistics_->num_connections += num_connects;
+    statistics_->connect_time += connect_time;
+    if (appconnect_time > connect_time)
+      statistics_->tls_time += appconnect_time - connect_time;
+  }
+  pthread_mutex_unlock(lock_statistics_);
+}
+
+
+/**
+ * Hosts and proxies are identified by the proxy URL or, for direct
+ * connections, by the scheme, host, and port of the URL.
+ */
+string DownloadManager::GetEndpoint(const string &proxy, const string &url) {
+  if (!proxy.empty())
+    return proxy;
+  const size_t scheme_end = url.find("://");
+  if (scheme_end == string::npos)
+    return url;
+  return url.substr(0, url.find('/', scheme_end + 3));
+}
+
+
+/**
+ * Records hosts and proxies that don't speak HTTP/2, so that subsequent
+ * requests to them go out as plain HTTP/1.1 requests.  Servers might also
+ * choke on the offer (e.g. h2c upgrade headers).
+ *
+ * \return true if the request failed because of the HTTP/2 offer and should be
+ *         repeated with HTTP/1.1
+ */
+bool DownloadManager::UpdateHttpVersion(JobInfo *info, const int curl_error) {
+  if (!info->http2)
+    return false;
+
+  bool protocol_error = false;
+  bool http1_reply = false;
+  switch (curl_error) {
+    case CURLE_UNSUPPORTED_PROTOCOL:  // e.g. HTTP/0.9 reply
+#if LIBCURL_VERSION_NUM >= 0x072600
+    case CURLE_HTTP2:
+#endif
+#if LIBCURL_VERSION_NUM >= 0x073100
+    case CURLE_HTTP2_STREAM:
+#endif
+#if LIBCURL_VERSION_NUM >= 0x073300
+    case CURLE_WEIRD_SERVER_REPLY:
+#endif
+      protocol_error = true;
+      break;
+    case CURLE_OK:
+#if LIBCURL_VERSION_NUM >= 0x073200
+      {
+        long version = 0;  // NOLINT(runtime/int)
+        curl_easy_getinfo(info->curl_handle, CURLINFO_HTTP_VERSION, &version);
+        if (version == CURL_HTTP_VERSION_2_0) {
+          pthread_mutex_lock(lock_statistics_);
+          statistics_->num_http2_requests++;
+          pthread_mutex_unlock(lock_statistics_);
+        } else if (version != 0) {
+          http1_reply = true;
+        }
+      }
+#endif
+      break;
+    default:
+      break;
+  }
+  if (!protocol_error && !http1_reply)
+    return false;
+
+  char *effective_url = NULL;
+  curl_easy_getinfo(info->curl_handle, CURLINFO_EFFECTIVE_URL, &effective_url);
+  const string endpoint =
+    GetEndpoint(info->proxy, (effective_url == NULL) ? "" : effective_url);
+  pthread_mutex_lock(lock_options_);
+  const bool inserted = http1_endpoints_->insert(endpoint).second;
+  pthread_mutex_unlock(lock_options_);
+  if (inserted) {
+    pthread_mutex_lock(lock_statistics_);
+    statistics_->num_http1_fallbacks++;
+    pthread_mutex_unlock(lock_statistics_);
+    LogCvmfs(kLogDownload, kLogDebug, "falling back to HTTP/1.1 for %s",
+             endpoint.c_str());
+  }
+  return protocol_error;
 }
 
 
@@ -984,12 +1607,16 @@ void DownloadManager::Backoff(JobInfo *info) {
   pthread_mutex_lock(lock_options_);
   unsigned backoff_init_ms = opt_backoff_init_ms_;
   unsigned backoff_max_ms = opt_backoff_max_ms_;
+  // Protect against concurrent access to prng_ by the I/O threads
+  const unsigned jitter_ms = prng_.Next(backoff_init_ms + 1);
   pthread_mutex_unlock(lock_options_);
 
   info->num_retries++;
+  pthread_mutex_lock(lock_statistics_);
   statistics_->num_retries++;
+  pthread_mutex_unlock(lock_statistics_);
   if (info->backoff_ms == 0) {
-    info->backoff_ms = prng_.Next(backoff_init_ms + 1);  // Must be != 0
+    info->backoff_ms = jitter_ms;  // Must be != 0
   } else {
     info->backoff_ms *= 2;
   }
@@ -1010,7 +1637,8 @@ void DownloadManager::Backoff(JobInfo *info) {
 bool DownloadManager::VerifyAndFinalize(const int curl_error, JobInfo *info) {
   LogCvmfs(kLogDownload, kLogDebug, "Verify downloaded url %s (curl error %d)",
            info->url->c_str(), curl_error);
-  UpdateStatistics(info->curl_handle);
+  UpdateStatistics(info);
+  const bool retry_http1 = UpdateHttpVersion(info, curl_error);
 
   // Verification and error classification
   switch (curl_error) {
@@ -1094,9 +1722,9 @@ bool DownloadManager::VerifyAndFinalize(const int curl_error, JobInfo *info) {
   }
 
   // Determination if download should be repeated
-  bool try_again = false;
+  bool try_again = retry_http1;
   bool same_url_retry = CanRetry(info);
-  if (info->error_code != kFailOk) {
+  if ((info->error_code != kFailOk) && !retry_http1) {
     pthread_mutex_lock(lock_options_);
     if ((info->error_code) == kFailBadData && !info->nocache)
       try_again = true;
@@ -1181,15 +1809,22 @@ bool DownloadManager::VerifyAndFinalize(const int curl_error, JobInfo *info) {
     if (info->expected_hash)
       shash::Init(info->hash_context);
     if (info->compressed)
-      zlib::DecompressInit(&info->zstream);
+      info->decompressor->Reset();
+
+    if (retry_http1) {
+      SetUrlOptions(info);
+      return true;  // try again
+    }
 
     // Failure handling
     bool switch_proxy = false;
     bool switch_host = false;
     switch (info->error_code) {
       case kFailBadData:
+        pthread_mutex_lock(lock_handles_);
         header_lists_->AppendHeader(info->headers, "Pragma: no-cache");
         header_lists_->AppendHeader(info->headers, "Cache-Control: no-cache");
+        pthread_mutex_unlock(lock_handles_);
         curl_easy_setopt(info->curl_handle, CURLOPT_HTTPHEADER, info->headers);
         info->nocache = true;
         break;
@@ -1244,11 +1879,15 @@ bool DownloadManager::VerifyAndFinalize(const int curl_error, JobInfo *info) {
     info->destination_file = NULL;
   }
 
-  if (info->compressed)
-    zlib::DecompressFini(&info->zstream);
+  if (info->compressed) {
+    delete info->decompressor;
+    info->decompressor = NULL;
+  }
 
   if (info->headers) {
+    pthread_mutex_lock(lock_handles_);
     header_lists_->PutList(info->headers);
+    pthread_mutex_unlock(lock_handles_);
     info->headers = NULL;
   }
 
@@ -1256,22 +1895,50 @@ bool DownloadManager::VerifyAndFinalize(const int curl_error, JobInfo *info) {
 }
 
 
+DownloadManager::IoThread::IoThread()
+  : download_mgr(NULL)
+  , id(0)
+  , curl_multi(NULL)
+  , job_queue(NULL)
+  , epoll_fd(-1)
+  , watch_fds(NULL)
+  , watch_fds_size(0)
+  , watch_fds_inuse(0)
+{
+  doorbell[0] = doorbell[1] = -1;
+  atomic_init32(&waiting);
+  int retval = pthread_mutex_init(&lock_finished, NULL);
+  assert(retval == 0);
+}
+
+
+DownloadManager::IoThread::~IoThread() {
+  pthread_mutex_destroy(&lock_finished);
+}
+
+
 DownloadManager::DownloadManager() {
   pool_handles_idle_ = NULL;
   pool_handles_inuse_ = NULL;
   pool_max_handles_ = 0;
-  curl_multi_ = NULL;
+  opt_pipelining_ = 0;
   default_headers_ = NULL;
 
   atomic_init32(&multi_threaded_);
   pipe_terminate_[0] = pipe_terminate_[1] = -1;
-
-  pipe_jobs_[0] = pipe_jobs_[1] = -1;
-  watch_fds_ = NULL;
-  watch_fds_size_ = 0;
-  watch_fds_inuse_ = 0;
   watch_fds_max_ = 0;
 
+  num_io_threads_ = 1;
+  sharding_mode_ = kShardRoundRobin;
+  io_threads_ = NULL;
+  atomic_init32(&next_io_thread_);
+
+  num_data_workers_ = 0;
+  data_buffer_size_ = kDataBufferSize;
+  data_buffered_ = 0;
+  data_workers_ = NULL;
+  data_jobs_ = NULL;
+
   lock_options_ =
   reinterpret_cast<pthread_mutex_t *>(smalloc(sizeof(pthread_mutex_t)));
   int retval = pthread_mutex_init(lock_options_, NULL);
@@ -1280,6 +1947,18 @@ DownloadManager::DownloadManager() {
   reinterpret_cast<pthread_mutex_t *>(smalloc(sizeof(pthread_mutex_t)));
   retval = pthread_mutex_init(lock_synchronous_mode_, NULL);
   assert(retval == 0);
+  lock_handles_ =
+  reinterpret_cast<pthread_mutex_t *>(smalloc(sizeof(pthread_mutex_t)));
+  retval = pthread_mutex_init(lock_handles_, NULL);
+  assert(retval == 0);
+  lock_statistics_ =
+  reinterpret_cast<pthread_mutex_t *>(smalloc(sizeof(pthread_mutex_t)));
+  retval = pthread_mutex_init(lock_statistics_, NULL);
+  assert(retval == 0);
+  lock_data_buffer_ =
+  reinterpret_cast<pthread_mutex_t *>(smalloc(sizeof(pthread_mutex_t)));
+  retval = pthread_mutex_init(lock_data_buffer_, NULL);
+  assert(retval == 0);
 
   opt_dns_server_ = NULL;
   opt_timeout_proxy_ = 0;
@@ -1297,6 +1976,8 @@ DownloadManager::DownloadManager() {
   opt_backoff_max_ms_ = 0;
   enable_info_header_ = false;
   opt_ipv4_only_ = false;
+  enable_http2_ = false;
+  http1_endpoints_ = NULL;
 
   resolver = NULL;
 
@@ -1313,8 +1994,14 @@ DownloadManager::DownloadManager() {
 DownloadManager::~DownloadManager() {
   pthread_mutex_destroy(lock_options_);
   pthread_mutex_destroy(lock_synchronous_mode_);
+  pthread_mutex_destroy(lock_handles_);
+  pthread_mutex_destroy(lock_statistics_);
+  pthread_mutex_destroy(lock_data_buffer_);
   free(lock_options_);
   free(lock_synchronous_mode_);
+  free(lock_handles_);
+  free(lock_statistics_);
+  free(lock_data_buffer_);
 }
 
 void DownloadManager::InitHeaders() {
@@ -1367,19 +2054,15 @@ void DownloadManager::Init(const unsigned max_pool_handles,
   opt_host_chain_current_ = 0;
 
   statistics_ = new Statistics();
+  http1_endpoints_ = new set<string>();
 
   user_agent_ = NULL;
   InitHeaders();
 
-  curl_multi_ = curl_multi_init();
-  assert(curl_multi_ != NULL);
-  curl_multi_setopt(curl_multi_, CURLMOPT_SOCKETFUNCTION, CallbackCurlSocket);
-  curl_multi_setopt(curl_multi_, CURLMOPT_SOCKETDATA,
-                    static_cast<void *>(this));
-  curl_multi_setopt(curl_multi_, CURLMOPT_MAXCONNECTS, watch_fds_max_);
-  curl_multi_setopt(curl_multi_, CURLMOPT_MAX_TOTAL_CONNECTIONS,
-                    pool_max_handles_);
-  // curl_multi_setopt(curl_multi_, CURLMOPT_PIPELINING, 1);
+  opt_pipelining_ = 0;
+  num_io_threads_ = 1;
+  sharding_mode_ = kShardRoundRobin;
+  io_threads_ = new vector<IoThread *>();
 
   prng_.InitLocaltime();
 
@@ -1406,16 +2089,40 @@ void DownloadManager::Init(const unsigned max_pool_handles,
 
 void DownloadManager::Fini() {
   if (atomic_xadd32(&multi_threaded_, 0) == 1) {
-    // Shutdown I/O thread
+    // Shutdown I/O threads
     char buf = 'T';
     WritePipe(pipe_terminate_[1], &buf, 1);
-    pthread_join(thread_download_, NULL);
-    // All handles are removed from the multi stack
+    for (unsigned i = 0; i < io_threads_->size(); ++i)
+      pthread_join((*io_threads_)[i]->thread, NULL);
+    // All handles are removed from the multi stacks
     close(pipe_terminate_[1]);
     close(pipe_terminate_[0]);
-    close(pipe_jobs_[1]);
-    close(pipe_jobs_[0]);
+
+    // The data workers finish the chunks that are still queued
+    if (data_workers_ != NULL) {
+      for (unsigned i = 0; i < data_workers_->size(); ++i)
+        data_jobs_->Enqueue(NULL);
+      for (unsigned i = 0; i < data_workers_->size(); ++i)
+        pthread_join((*data_workers_)[i], NULL);
+    }
   }
+  delete data_workers_;
+  delete data_jobs_;
+  data_workers_ = NULL;
+  data_jobs_ = NULL;
+  for (unsigned i = 0; i < io_threads_->size(); ++i) {
+    IoThread *io_thread = (*io_threads_)[i];
+    if (io_thread->doorbell[1] != io_thread->doorbell[0])
+      close(io_thread->doorbell[1]);
+    close(io_thread->doorbell[0]);
+    if (io_thread->epoll_fd >= 0)
+      close(io_thread->epoll_fd);
+    delete io_thread->job_queue;
+    curl_multi_cleanup(io_thread->curl_multi);
+    delete io_thread;
+  }
+  delete io_threads_;
+  io_threads_ = NULL;
 
   for (set<CURL *>::iterator i = pool_handles_idle_->begin(),
        iEnd = pool_handles_idle_->end(); i != iEnd; ++i)
@@ -1424,10 +2131,8 @@ void DownloadManager::Fini() {
   }
   delete pool_handles_idle_;
   delete pool_handles_inuse_;
-  curl_multi_cleanup(curl_multi_);
   pool_handles_idle_ = NULL;
   pool_handles_inuse_ = NULL;
-  curl_multi_ = NULL;
 
   FiniHeaders();
   if (user_agent_)
@@ -1436,6 +2141,8 @@ void DownloadManager::Fini() {
 
   delete statistics_;
   statistics_ = NULL;
+  delete http1_endpoints_;
+  http1_endpoints_ = NULL;
 
   delete opt_host_chain_;
   delete opt_host_chain_rtt_;
@@ -1449,30 +2156,101 @@ void DownloadManager::Fini() {
 
 
 /**
- * Spawns the I/O worker thread and switches the module in multi-threaded mode.
- * No way back except Fini(); Init();
+ * Creates the curl multi handle, the job queue and the doorbell of an I/O
+ * thread and starts its event loop.
  */
-void DownloadManager::Spawn() {
-  MakePipe(pipe_terminate_);
-  MakePipe(pipe_jobs_);
+void DownloadManager::SpawnIoThread(IoThread *io_thread) {
+  io_thread->download_mgr = this;
+  io_thread->curl_multi = curl_multi_init();
+  assert(io_thread->curl_multi != NULL);
+  CURLM *curl_multi = io_thread->curl_multi;
+  curl_multi_setopt(curl_multi, CURLMOPT_SOCKETFUNCTION, CallbackCurlSocket);
+  curl_multi_setopt(curl_multi, CURLMOPT_SOCKETDATA,
+                    static_cast<void *>(io_thread));
+  // The connection limits are split among the I/O threads
+  const long max_connections =  // NOLINT(runtime/int)
+    (pool_max_handles_ + num_io_threads_ - 1) / num_io_threads_;
+  const long max_cached_connections =  // NOLINT(runtime/int)
+    (watch_fds_max_ + num_io_threads_ - 1) / num_io_threads_;
+  curl_multi_setopt(curl_multi, CURLMOPT_MAXCONNECTS, max_cached_connections);
+  curl_multi_setopt(curl_multi, CURLMOPT_MAX_TOTAL_CONNECTIONS,
+                    max_connections);
+  if (opt_pipelining_ != 0)
+    curl_multi_setopt(curl_multi, CURLMOPT_PIPELINING, opt_pipelining_);
+
+  io_thread->job_queue = new MpscRing<JobInfo *>(kJobQueueSize);
+#ifdef HAVE_SYS_EVENTFD_H
+  io_thread->doorbell[0] = io_thread->doorbell[1] = eventfd(0, EFD_NONBLOCK);
+  assert(io_thread->doorbell[0] >= 0);
+#else
+  MakePipe(io_thread->doorbell);
+  int flags = fcntl(io_thread->doorbell[0], F_GETFL);
+  assert(flags != -1);
+  int retval_fcntl = fcntl(io_thread->doorbell[0], F_SETFL, flags | O_NONBLOCK);
+  assert(retval_fcntl == 0);
+#endif
+#ifdef HAVE_SYS_EPOLL_H
+  io_thread->epoll_fd = epoll_create(64);
+  assert(io_thread->epoll_fd >= 0);
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.fd = pipe_terminate_[0];
+  int retval_epoll =
+    epoll_ctl(io_thread->epoll_fd, EPOLL_CTL_ADD, pipe_terminate_[0], &event);
+  assert(retval_epoll == 0);
+  event.data.fd = io_thread->doorbell[0];
+  retval_epoll = epoll_ctl(io_thread->epoll_fd, EPOLL_CTL_ADD,
+                           io_thread->doorbell[0], &event);
+  assert(retval_epoll == 0);
+#endif
 
-  int retval = pthread_create(&thread_download_, NULL, MainDownload,
-                              static_cast<void *>(this));
+  int retval = pthread_create(&io_thread->thread, NULL, MainDownload,
+                              static_cast<void *>(io_thread));
   assert(retval == 0);
+}
+
+
+/**
+ * Spawns the I/O worker threads and switches the module in multi-threaded
+ * mode.  No way back except Fini(); Init();
+ */
+void DownloadManager::Spawn() {
+  MakePipe(pipe_terminate_);
+  for (unsigned i = 0; i < num_io_threads_; ++i) {
+    IoThread *io_thread = new IoThread();
+    io_thread->id = i;
+    io_threads_->push_back(io_thread);
+    SpawnIoThread(io_thread);
+  }
+  LogCvmfs(kLogDownload, kLogDebug, "spawned %u download I/O thread(s)",
+           num_io_threads_);
+
+  if (num_data_workers_ > 0) {
+    data_jobs_ = new FifoChannel<JobInfo *>(kJobQueueSize, kJobQueueSize);
+    data_workers_ = new vector<pthread_t>(num_data_workers_);
+    for (unsigned i = 0; i < num_data_workers_; ++i) {
+      int retval = pthread_create(&(*data_workers_)[i], NULL, MainDataWorker,
+                                  static_cast<void *>(this));
+      assert(retval == 0);
+    }
+    LogCvmfs(kLogDownload, kLogDebug, "spawned %u download data worker(s)",
+             num_data_workers_);
+  }
 
   atomic_inc32(&multi_threaded_);
 }
 
 
 /**
- * Downloads data from an unsecure outside channel (currently HTTP or file).
+ * Prepares the destination, the hash context and the cvmfs-info header of a
+ * job.  The buffers are freed again by CleanupJob().
  */
-Failures DownloadManager::Fetch(JobInfo *info) {
+Failures DownloadManager::PrepareJob(JobInfo *info) {
   assert(info != NULL);
   assert(info->url != NULL);
 
-  Failures result;
-  result = PrepareDownloadDestination(info);
+  Failures result = PrepareDownloadDestination(info);
   if (result != kFailOk)
     return result;
 
@@ -1480,52 +2258,58 @@ Failures DownloadManager::Fetch(JobInfo *info) {
     const shash::Algorithms algorithm = info->expected_hash->algorithm;
     info->hash_context.algorithm = algorithm;
     info->hash_context.size = shash::GetContextSize(algorithm);
-    info->hash_context.buffer = alloca(info->hash_context.size);
+    info->hash_context.buffer = smalloc(info->hash_context.size);
   }
 
-  // Prepare cvmfs-info: header, allocate string on the stack
+  // Prepare cvmfs-info: header.  Jobs can outlive the stack frame of the
+  // submitting function, so the string lives on the heap.
   info->info_header = NULL;
   if (enable_info_header_ && info->extra_info) {
     const char *header_name = "cvmfs-info: ";
     const size_t header_name_len = strlen(header_name);
     const unsigned header_size = 1 + header_name_len +
       EscapeHeader(*(info->extra_info), NULL, 0);
-    info->info_header = static_cast<char *>(alloca(header_size));
+    info->info_header = static_cast<char *>(smalloc(header_size));
     memcpy(info->info_header, header_name, header_name_len);
     EscapeHeader(*(info->extra_info), info->info_header + header_name_len,
                  header_size - header_name_len);
     info->info_header[header_size-1] = '\0';
   }
 
-  if (atomic_xadd32(&multi_threaded_, 0) == 1) {
-    if (info->wait_at[0] == -1) {
-      MakePipe(info->wait_at);
-    }
+  return kFailOk;
+}
 
-    // LogCvmfs(kLogDownload, kLogDebug, "send job to thread, pipe %d %d",
-    //          info->wait_at[0], info->wait_at[1]);
-    WritePipe(pipe_jobs_[1], &info, sizeof(info));
-    ReadPipe(info->wait_at[0], &result, sizeof(result));
-    // LogCvmfs(kLogDownload, kLogDebug, "got result %d", result);
-  } else {
-    pthread_mutex_lock(lock_synchronous_mode_);
-    CURL *handle = AcquireCurlHandle();
-    InitializeRequest(info, handle);
-    SetUrlOptions(info);
-    // curl_easy_setopt(handle, CURLOPT_VERBOSE, 1);
-    int retval;
-    do {
-      retval = curl_easy_perform(handle);
-      statistics_->num_requests++;
-      double elapsed;
-      if (curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME, &elapsed) == CURLE_OK)
-        statistics_->transfer_time += elapsed;
-    } while (VerifyAndFinalize(retval, info));
-    result = info->error_code;
-    ReleaseCurlHandle(info->curl_handle);
-    pthread_mutex_unlock(lock_synchronous_mode_);
-  }
 
+/**
+ * Runs a job to completion in the calling thread.  Used before Spawn().
+ */
+void DownloadManager::PerformJob(JobInfo *info) {
+  pthread_mutex_lock(lock_synchronous_mode_);
+  CURL *handle = AcquireCurlHandle();
+  InitializeRequest(info, handle);
+  SetUrlOptions(info);
+  // curl_easy_setopt(handle, CURLOPT_VERBOSE, 1);
+  int retval;
+  do {
+    retval = curl_easy_perform(handle);
+    double elapsed = 0.0;
+    curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME, &elapsed);
+    pthread_mutex_lock(lock_statistics_);
+    statistics_->num_requests++;
+    statistics_->transfer_time += elapsed;
+    pthread_mutex_unlock(lock_statistics_);
+  } while (VerifyAndFinalize(retval, info));
+  ReleaseCurlHandle(info->curl_handle);
+  pthread_mutex_unlock(lock_synchronous_mode_);
+}
+
+
+/**
+ * Removes the traces of a failed download and frees the buffers allocated by
+ * PrepareJob().
+ */
+void DownloadManager::CleanupJob(JobInfo *info) {
+  const Failures result = info->error_code;
   if (result != kFailOk) {
     LogCvmfs(kLogDownload, kLogDebug, "download failed (error %d - %s)", result,
              Code2Ascii(result));
@@ -1540,10 +2324,222 @@ Failures DownloadManager::Fetch(JobInfo *info) {
     }
   }
 
+  free(info->hash_context.buffer);
+  info->hash_context.buffer = NULL;
+  free(info->info_header);
+  info->info_header = NULL;
+  delete info->stream;
+  info->stream = NULL;
+}
+
+
+/**
+ * Hands the result of a finished job either to the thread blocked in Fetch()
+ * or to the callback of the FetchAsync() batch.  The JobInfo must not be
+ * touched afterwards, the callback might have deleted it.
+ */
+void DownloadManager::NotifyJob(JobInfo *info) {
+  FetchBatch *batch = info->batch;
+  if (batch == NULL) {
+    // Fetch() can return as soon as the result is written
+    const Failures result = info->error_code;
+    WritePipe(info->wait_at[1], &result, sizeof(result));
+    return;
+  }
+
+  info->batch = NULL;
+  (*batch->callback)(info);
+  if (atomic_xadd32(&batch->pending, -1) == 1) {
+    delete batch->callback;
+    delete batch;
+  }
+}
+
+
+void DownloadManager::RingDoorbell(IoThread *io_thread) {
+#ifdef HAVE_SYS_EVENTFD_H
+  const uint64_t one = 1;
+  WritePipe(io_thread->doorbell[1], &one, sizeof(one));
+#else
+  const char wakeup = 'W';
+  WritePipe(io_thread->doorbell[1], &wakeup, 1);
+#endif
+}
+
+
+void DownloadManager::ClearDoorbell(IoThread *io_thread) {
+#ifdef HAVE_SYS_EVENTFD_H
+  uint64_t counter;
+  const ssize_t retval = read(io_thread->doorbell[0], &counter,
+                              sizeof(counter));
+  assert((retval == sizeof(counter)) || (errno == EAGAIN));
+#else
+  char buf[64];
+  while (read(io_thread->doorbell[0], buf, sizeof(buf)) == sizeof(buf)) { }
+#endif
+}
+
+
+/**
+ * Only rings the doorbell if the I/O thread is (about to be) waiting.  It
+ * drains the queue after it announced to wait, so no job is missed.
+ */
+void DownloadManager::WakeIoThread(IoThread *io_thread) {
+  if (atomic_cas32(&io_thread->waiting, 1, 0))
+    RingDoorbell(io_thread);
+}
+
+
+/**
+ * Picks the I/O thread for a new job.  Sharding by host keeps the jobs to the
+ * same proxy or host on the same curl multi handle, so that they share its
+ * connections.  The choice is made with the proxy and host that are active at
+ * submission time.
+ *
+ * \return the index of the I/O thread in io_threads_
+ */
+unsigned DownloadManager::SelectIoThread(const JobInfo *info) {
+  if (num_io_threads_ == 1)
+    return 0;
+
+  uint32_t index;
+  if (sharding_mode_ == kShardByHost) {
+    string endpoint;
+    pthread_mutex_lock(lock_options_);
+    if (opt_proxy_groups_)
+      endpoint = (*opt_proxy_groups_)[opt_proxy_groups_current_][0].url;
+    if ((endpoint.empty() || (endpoint == "DIRECT")) && info->probe_hosts &&
+        opt_host_chain_)
+    {
+      endpoint = (*opt_host_chain_)[opt_host_chain_current_];
+    }
+    pthread_mutex_unlock(lock_options_);
+    if (endpoint.empty() || (endpoint == "DIRECT"))
+      endpoint = GetEndpoint("", *info->url);
+    index = MurmurHash2(endpoint.data(), endpoint.length(), 0x07387a4f);
+  } else {
+    index = atomic_xadd32(&next_io_thread_, 1);
+  }
+  return index % num_io_threads_;
+}
+
+
+/**
+ * Puts a prepared job in the queue of an I/O thread.  If the queue is full,
+ * waits for the I/O thread to catch up.  Call WakeIoThread() afterwards.
+ */
+void DownloadManager::EnqueueJob(IoThread *io_thread, JobInfo *info) {
+  while (!io_thread->job_queue->TryEnqueue(info)) {
+    WakeIoThread(io_thread);
+    sched_yield();
+  }
+}
+
+
+/**
+ * Queues prepared jobs for the I/O threads and wakes up each of the involved
+ * threads once.
+ */
+void DownloadManager::SubmitJobs(const vector<JobInfo *> &infos) {
+  vector<bool> touched(num_io_threads_, false);
+  for (unsigned i = 0; i < infos.size(); ++i) {
+    const unsigned index = SelectIoThread(infos[i]);
+    EnqueueJob((*io_threads_)[index], infos[i]);
+    touched[index] = true;
+  }
+  for (unsigned i = 0; i < num_io_threads_; ++i) {
+    if (touched[i])
+      WakeIoThread((*io_threads_)[i]);
+  }
+}
+
+
+/**
+ * Downloads data from an unsecure outside channel (currently HTTP or file).
+ */
+Failures DownloadManager::Fetch(JobInfo *info) {
+  info->batch = NULL;
+  Failures result = PrepareJob(info);
+  if (result != kFailOk)
+    return result;
+
+  if (atomic_xadd32(&multi_threaded_, 0) == 1) {
+    if (info->wait_at[0] == -1) {
+      MakePipe(info->wait_at);
+    }
+
+    // LogCvmfs(kLogDownload, kLogDebug, "send job to thread, pipe %d %d",
+    //          info->wait_at[0], info->wait_at[1]);
+    // The I/O thread cleans up before writing back the result
+    IoThread *io_thread = (*io_threads_)[SelectIoThread(info)];
+    EnqueueJob(io_thread, info);
+    WakeIoThread(io_thread);
+    ReadPipe(info->wait_at[0], &result, sizeof(result));
+    // LogCvmfs(kLogDownload, kLogDebug, "got result %d", result);
+  } else {
+    PerformJob(info);
+    result = info->error_code;
+    CleanupJob(info);
+  }
+
   return result;
 }
 
 
+/**
+ * Submits a single job without waiting for it, see the batch version below.
+ */
+void DownloadManager::FetchAsync(JobInfo *info, const CallbackTN *callback) {
+  FetchAsync(vector<JobInfo *>(1, info), callback);
+}
+
+
+/**
+ * Submits a batch of jobs and returns immediately.  The callback is invoked
+ * once for every job with the finished JobInfo, whose error_code carries the
+ * result.  It takes ownership of the callback.  The JobInfo objects, and the
+ * strings and hashes they point to, must stay valid until their callback ran.
+ *
+ * After Spawn(), callbacks run in the I/O threads and must therefore be short
+ * and must neither call Fetch() nor FetchAsync().  With several I/O threads
+ * (see SetIoThreads()), callbacks of a batch can run concurrently.  Jobs that
+ * cannot be prepared, as well as all jobs submitted before Spawn(), are
+ * processed and reported in the calling thread.
+ */
+void DownloadManager::FetchAsync(const vector<JobInfo *> &infos,
+                                 const CallbackTN *callback)
+{
+  assert(callback != NULL);
+  if (infos.empty()) {
+    delete callback;
+    return;
+  }
+
+  const bool multi_threaded = (atomic_xadd32(&multi_threaded_, 0) == 1);
+  FetchBatch *batch = new FetchBatch(callback, infos.size());
+  vector<JobInfo *> prepared;
+  prepared.reserve(infos.size());
+  for (unsigned i = 0; i < infos.size(); ++i) {
+    JobInfo *info = infos[i];
+    info->batch = batch;
+    info->error_code = PrepareJob(info);
+    if (info->error_code != kFailOk) {
+      NotifyJob(info);
+      continue;
+    }
+
+    if (multi_threaded) {
+      prepared.push_back(info);
+    } else {
+      PerformJob(info);
+      CleanupJob(info);
+      NotifyJob(info);
+    }
+  }
+  SubmitJobs(prepared);
+}
+
+
 /**
  * Sets a DNS server.  Only for testing as it cannot be reverted to the system
  * default.
@@ -2424,8 +3420,11 @@ void DownloadManager::EnableInfoHeader() {
 }
 
 
+/**
+ * Needs to be called before Spawn().
+ */
 void DownloadManager::EnablePipelining() {
-  curl_multi_setopt(curl_multi_, CURLMOPT_PIPELINING, 1);
+  opt_pipelining_ = 1;
 }
 
 
@@ -2434,6 +3433,71 @@ void DownloadManager::EnableRedirects() {
 }
 
 
+/**
+ * Offers HTTP/2 to hosts and proxies and multiplexes concurrent requests on a
+ * single connection.  Hosts and proxies that don't support it are detected
+ * on the fly and used with HTTP/1.1.  Needs to be called before Spawn().
+ *
+ * \return false if libcurl lacks HTTP/2 support
+ */
+bool DownloadManager::EnableHttp2() {
+#ifdef CURLPIPE_MULTIPLEX
+  curl_version_info_data *version_info = curl_version_info(CURLVERSION_NOW);
+  if (version_info->features & CURL_VERSION_HTTP2) {
+    opt_pipelining_ = CURLPIPE_MULTIPLEX;
+    enable_http2_ = true;
+    return true;
+  }
+#endif
+  LogCvmfs(kLogDownload, kLogDebug | kLogSyslogWarn,
+           "libcurl lacks HTTP/2 support, using HTTP/1.1");
+  return false;
+}
+
+
+/**
+ * Sets the number of I/O threads that run the transfers, each with its own
+ * curl multi handle.  The connection limit given to Init() is split among
+ * them.  Needs to be called before Spawn().
+ */
+void DownloadManager::SetIoThreads(const unsigned num_threads,
+                                   const ShardingModes mode)
+{
+  assert(atomic_xadd32(&multi_threaded_, 0) == 0);
+  num_io_threads_ = num_threads;
+  if (num_io_threads_ == 0)
+    num_io_threads_ = 1;
+  if (num_io_threads_ > kMaxIoThreads) {
+    LogCvmfs(kLogDownload, kLogDebug | kLogSyslogWarn,
+             "limiting the number of download threads to %u", kMaxIoThreads);
+    num_io_threads_ = kMaxIoThreads;
+  }
+  sharding_mode_ = mode;
+}
+
+
+/**
+ * Moves decompressing, hashing and writing of file downloads from the I/O
+ * threads to the given number of data workers.  The I/O threads only copy the
+ * received data, which can use up to buffer_size bytes.  Needs to be called
+ * before Spawn().  With zero workers, the I/O threads process the data
+ * themselves.
+ */
+void DownloadManager::SetDataWorkers(const unsigned num_workers,
+                                     const uint64_t buffer_size)
+{
+  assert(atomic_xadd32(&multi_threaded_, 0) == 0);
+  num_data_workers_ = num_workers;
+  if (num_data_workers_ > kMaxDataWorkers) {
+    LogCvmfs(kLogDownload, kLogDebug | kLogSyslogWarn,
+             "limiting the number of download data workers to %u",
+             kMaxDataWorkers);
+    num_data_workers_ = kMaxDataWorkers;
+  }
+  data_buffer_size_ = buffer_size;
+}
+
+
 //------------------------------------------------------------------------------
 
 
@@ -2444,7 +3508,18 @@ string Statistics::Print() const {
   "Number of requests: " + StringifyInt(num_requests) + "\n" +
   "Number of retries: " + StringifyInt(num_retries) + "\n" +
   "Number of proxy failovers: " + StringifyInt(num_proxy_failover) + "\n" +
-  "Number of host failovers: " + StringifyInt(num_host_failover) + "\n";
+  "Number of host failovers: " + StringifyInt(num_host_failover) + "\n" +
+  "Number of new connections: " + StringifyInt(num_connections) + "\n" +
+  "Number of reused connections: " + StringifyInt(num_reused_connections) +
+    "\n" +
+  "Number of HTTP/2 requests: " + StringifyInt(num_http2_requests) + "\n" +
+  "Number of HTTP/1.1 fallbacks: " + StringifyInt(num_http1_fallbacks) + "\n" +
+  "Maximum concurrent requests: " + StringifyInt(max_concurrent_requests) +
+    "\n" +
+  "Transfers paused for data workers: " + StringifyInt(num_data_waits) + "\n" +
+  "Connect time: " + StringifyInt(uint64_t(connect_time * 1000.0)) + " ms\n" +
+  "TLS handshake time: " + StringifyInt(uint64_t(tls_time * 1000.0)) +
+    " ms\n";
 }
 
 }  // namespace download
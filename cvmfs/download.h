@@ -23,6 +23,8 @@
 #include "duplex_curl.h"
 #include "hash.h"
 #include "prng.h"
+#include "util.h"
+#include "util_concurrency.h"
 
 
 namespace download {
@@ -90,6 +92,27 @@ struct Statistics {
   uint64_t num_retries;
   uint64_t num_proxy_failover;
   uint64_t num_host_failover;
+  /**
+   * HTTP(S) transfers that opened new connections respectively went over an
+   * already open one
+   */
+  uint64_t num_connections;
+  uint64_t num_reused_connections;
+  uint64_t num_http2_requests;
+  /**
+   * Hosts and proxies that answered with HTTP/1.x although HTTP/2 was offered
+   */
+  uint64_t num_http1_fallbacks;
+  /**
+   * Largest number of transfers handled by the I/O threads at the same time
+   */
+  uint64_t max_concurrent_requests;
+  /**
+   * Times a transfer was paused because the data workers fell behind
+   */
+  uint64_t num_data_waits;
+  double connect_time;  ///< Seconds to establish the new connections
+  double tls_time;      ///< Seconds for TLS handshakes of new connections
 
   Statistics() {
     transferred_bytes = 0.0;
@@ -98,12 +121,23 @@ struct Statistics {
     num_retries = 0;
     num_proxy_failover = 0;
     num_host_failover = 0;
+    num_connections = 0;
+    num_reused_connections = 0;
+    num_http2_requests = 0;
+    num_http1_fallbacks = 0;
+    max_concurrent_requests = 0;
+    num_data_waits = 0;
+    connect_time = 0.0;
+    tls_time = 0.0;
   }
 
   std::string Print() const;
 };  // Statistics
 
 
+struct FetchBatch;
+struct DataStream;
+
 /**
  * Contains all the information to specify a download job.
  */
@@ -141,10 +175,13 @@ struct JobInfo {
 
     curl_handle = NULL;
     headers = NULL;
-    memset(&zstream, 0, sizeof(zstream));
+    decompressor = NULL;
     info_header = NULL;
     wait_at[0] = wait_at[1] = -1;
+    batch = NULL;
+    stream = NULL;
     nocache = false;
+    http2 = false;
     error_code = kFailOther;
     num_used_proxies = num_used_hosts = num_retries = 0;
     backoff_ms = 0;
@@ -202,11 +239,14 @@ struct JobInfo {
   CURL *curl_handle;
   curl_slist *headers;
   char *info_header;
-  z_stream zstream;
+  zlib::StreamDecompressor *decompressor;
   shash::ContextPtr hash_context;
   int wait_at[2];  /**< Pipe used for the return value */
+  FetchBatch *batch;  /**< Set for jobs submitted by FetchAsync() */
+  DataStream *stream;  /**< Set if data workers process the received data */
   std::string proxy;
   bool nocache;
+  bool http2;  /**< HTTP/2 is offered in the current attempt */
   Failures error_code;
   unsigned char num_used_proxies;
   unsigned char num_used_hosts;
@@ -246,9 +286,11 @@ class HeaderLists {
 };
 
 
-class DownloadManager {
+class DownloadManager : public Callbackable<JobInfo *> {
   FRIEND_TEST(T_Download, ValidateGeoReply);
   FRIEND_TEST(T_Download, StripDirect);
+  FRIEND_TEST(T_Download, GetEndpoint);
+  FRIEND_TEST(T_Download, SelectIoThread);
 
  public:
   struct ProxyInfo {
@@ -269,6 +311,14 @@ class DownloadManager {
     kSetProxyBoth,
   };
 
+  /**
+   * How jobs are distributed over the I/O threads
+   */
+  enum ShardingModes {
+    kShardRoundRobin = 0,
+    kShardByHost,  ///< Jobs to the same proxy or host share a thread
+  };
+
   /**
    * No attempt was made to order stratum 1 servers
    */
@@ -287,6 +337,22 @@ class DownloadManager {
    * Do not download files larger than 1M into memory.
    */
   static const unsigned kMaxMemSize;
+  /**
+   * Number of submitted jobs that can wait for the I/O thread
+   */
+  static const unsigned kJobQueueSize;
+  /**
+   * Upper limit for the number of I/O threads
+   */
+  static const unsigned kMaxIoThreads;
+  /**
+   * Upper limit for the number of data workers
+   */
+  static const unsigned kMaxDataWorkers;
+  /**
+   * Default for the received bytes that can wait for the data workers
+   */
+  static const uint64_t kDataBufferSize;
 
   DownloadManager();
   ~DownloadManager();
@@ -295,6 +361,9 @@ class DownloadManager {
   void Fini();
   void Spawn();
   Failures Fetch(JobInfo *info);
+  void FetchAsync(JobInfo *info, const CallbackTN *callback);
+  void FetchAsync(const std::vector<JobInfo *> &infos,
+                  const CallbackTN *callback);
 
   void SetDnsServer(const std::string &address);
   void SetDnsParameters(const unsigned retries, const unsigned timeout_sec);
@@ -329,11 +398,60 @@ class DownloadManager {
   void EnableInfoHeader();
   void EnablePipelining();
   void EnableRedirects();
+  bool EnableHttp2();
+  void SetIoThreads(const unsigned num_threads, const ShardingModes mode);
+  unsigned GetNumIoThreads() { return num_io_threads_; }
+  void SetDataWorkers(const unsigned num_workers,
+                      const uint64_t buffer_size = kDataBufferSize);
+  unsigned GetNumDataWorkers() { return num_data_workers_; }
 
  private:
+  /**
+   * State of an I/O thread.  Every thread runs its own event loop on its own
+   * curl multi handle; the curl easy handles are taken from the shared pool.
+   */
+  struct IoThread {
+    IoThread();
+    ~IoThread();
+
+    DownloadManager *download_mgr;
+    unsigned id;
+    pthread_t thread;
+    CURLM *curl_multi;
+    /**
+     * Easy handles currently added to curl_multi
+     */
+    std::set<CURL *> handles;
+    /**
+     * Submitted jobs, drained by the I/O thread whenever it wakes up.  The
+     * doorbell is an eventfd (both ends are the same descriptor) or a pipe.
+     * It is only rung if the I/O thread is about to wait for events.
+     */
+    MpscRing<JobInfo *> *job_queue;
+    int doorbell[2];
+    atomic_int32 waiting;
+    /**
+     * Watches the curl sockets if epoll is available, otherwise watch_fds is
+     * used with poll()
+     */
+    int epoll_fd;
+    struct pollfd *watch_fds;
+    uint32_t watch_fds_size;
+    uint32_t watch_fds_inuse;
+    /**
+     * Jobs whose transfer finished before the data workers were done or was
+     * paused until they caught up; handed back by the workers
+     */
+    pthread_mutex_t lock_finished;
+    std::vector<JobInfo *> finished;
+  };
+
   static int CallbackCurlSocket(CURL *easy, curl_socket_t s, int action,
                                 void *userp, void *socketp);
   static void *MainDownload(void *data);
+  static size_t CallbackCurlStream(void *ptr, size_t size, size_t nmemb,
+                                   void *info_link);
+  static void *MainDataWorker(void *data);
 
   bool StripDirect(const std::string &proxy_list, std::string *cleaned_list);
   bool ValidateGeoReply(const std::string &reply_order,
@@ -347,34 +465,80 @@ class DownloadManager {
   void InitializeRequest(JobInfo *info, CURL *handle);
   void SetUrlOptions(JobInfo *info);
   void ValidateProxyIpsUnlocked(const std::string &url, const dns::Host &host);
-  void UpdateStatistics(CURL *handle);
+  static std::string GetEndpoint(const std::string &proxy,
+                                 const std::string &url);
+  void UpdateStatistics(JobInfo *info);
+  bool UpdateHttpVersion(JobInfo *info, const int curl_error);
   bool CanRetry(const JobInfo *info);
   void Backoff(JobInfo *info);
   bool VerifyAndFinalize(const int curl_error, JobInfo *info);
+  Failures PrepareJob(JobInfo *info);
+  void PerformJob(JobInfo *info);
+  void CleanupJob(JobInfo *info);
+  void NotifyJob(JobInfo *info);
+  void FinishTransfer(IoThread *io_thread, JobInfo *info, int curl_error,
+                      int *still_running);
+  void ProcessStream(JobInfo *info);
+  bool CompleteStream(JobInfo *info, const int curl_error);
+  void DrainFinished(IoThread *io_thread, int *still_running);
+  bool ReserveDataBuffer(const size_t size, const bool force);
+  void ReleaseDataBuffer(const size_t size);
+  unsigned SelectIoThread(const JobInfo *info);
+  void EnqueueJob(IoThread *io_thread, JobInfo *info);
+  void SubmitJobs(const std::vector<JobInfo *> &infos);
+  void SpawnIoThread(IoThread *io_thread);
+  void WakeIoThread(IoThread *io_thread);
+  void RingDoorbell(IoThread *io_thread);
+  void ClearDoorbell(IoThread *io_thread);
+  unsigned DrainJobQueue(IoThread *io_thread);
+  bool WaitForEvents(IoThread *io_thread, const int timeout,
+                     int *still_running);
   void InitHeaders();
   void FiniHeaders();
 
   Prng prng_;
+  /**
+   * Shared by the I/O threads, protected by lock_handles_ (as well as the
+   * header lists)
+   */
   std::set<CURL *> *pool_handles_idle_;
   std::set<CURL *> *pool_handles_inuse_;
   uint32_t pool_max_handles_;
-  CURLM *curl_multi_;
+  /**
+   * CURLMOPT_PIPELINING of the curl multi handles created by Spawn()
+   */
+  long opt_pipelining_;  // NOLINT(runtime/int)
   HeaderLists *header_lists_;
   curl_slist *default_headers_;
   char *user_agent_;
 
-  pthread_t thread_download_;
   atomic_int32 multi_threaded_;
+  /**
+   * Never read; its read end becomes readable for all I/O threads at once
+   */
   int pipe_terminate_[2];
-
-  int pipe_jobs_[2];
-  struct pollfd *watch_fds_;
-  uint32_t watch_fds_size_;
-  uint32_t watch_fds_inuse_;
   uint32_t watch_fds_max_;
 
+  unsigned num_io_threads_;
+  ShardingModes sharding_mode_;
+  std::vector<IoThread *> *io_threads_;
+  atomic_int32 next_io_thread_;
+
+  /**
+   * Decompress, hash and write the data of file downloads if num_data_workers_
+   * is set.  Received chunks take up to data_buffer_size_ bytes.
+   */
+  unsigned num_data_workers_;
+  uint64_t data_buffer_size_;
+  uint64_t data_buffered_;
+  std::vector<pthread_t> *data_workers_;
+  FifoChannel<JobInfo *> *data_jobs_;
+  pthread_mutex_t *lock_data_buffer_;
+
   pthread_mutex_t *lock_options_;
   pthread_mutex_t *lock_synchronous_mode_;
+  pthread_mutex_t *lock_handles_;
+  pthread_mutex_t *lock_statistics_;
   char *opt_dns_server_;
   unsigned opt_timeout_proxy_;
   unsigned opt_timeout_direct_;
@@ -385,6 +549,12 @@ class DownloadManager {
   bool enable_info_header_;
   bool opt_ipv4_only_;
   bool follow_redirects_;
+  bool enable_http2_;
+  /**
+   * Hosts and proxies (see GetEndpoint()) that don't speak HTTP/2.  Requests
+   * to them stick to HTTP/1.1.  Protected by lock_options_.
+   */
+  std::set<std::string> *http1_endpoints_;
 
   // Host list
   std::vector<std::string> *opt_host_chain_;
@@ -461,7 +631,7 @@ class DownloadManager {
   unsigned opt_host_reset_after_;
 
   // Writes and reads should be atomic because reading happens in a different
-  // thread than writing.
+  // thread than writing.  The I/O threads update it under lock_statistics_.
   Statistics *statistics_;
 };  // DownloadManager
 
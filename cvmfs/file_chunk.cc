@@ -16,10 +16,12 @@ static inline uint32_t hasher_uint64t(const uint64_t &value) {
 }
 
 void ChunkTables::InitLocks() {
-  lock =
-    reinterpret_cast<pthread_mutex_t *>(smalloc(sizeof(pthread_mutex_t)));
-  int retval = pthread_mutex_init(lock, NULL);
-  assert(retval == 0);
+  for (unsigned i = 0; i < kNumShards; ++i) {
+    shards[i].lock =
+      reinterpret_cast<pthread_mutex_t *>(smalloc(sizeof(pthread_mutex_t)));
+    int retval = pthread_mutex_init(shards[i].lock, NULL);
+    assert(retval == 0);
+  }
 
   for (unsigned i = 0; i < kNumHandleLocks; ++i) {
     pthread_mutex_t *m =
@@ -32,9 +34,11 @@ void ChunkTables::InitLocks() {
 
 
 void ChunkTables::InitHashmaps() {
-  handle2fd.Init(16, 0, hasher_uint64t);
-  inode2chunks.Init(16, 0, hasher_uint64t);
-  inode2references.Init(16, 0, hasher_uint64t);
+  for (unsigned i = 0; i < kNumShards; ++i) {
+    shards[i].handle2fd.Init(16, 0, hasher_uint64t);
+    shards[i].inode2chunks.Init(16, 0, hasher_uint64t);
+    shards[i].inode2references.Init(16, 0, hasher_uint64t);
+  }
 }
 
 
@@ -47,8 +51,10 @@ ChunkTables::ChunkTables() {
 
 
 ChunkTables::~ChunkTables() {
-  pthread_mutex_destroy(lock);
-  free(lock);
+  for (unsigned i = 0; i < kNumShards; ++i) {
+    pthread_mutex_destroy(shards[i].lock);
+    free(shards[i].lock);
+  }
   for (unsigned i = 0; i < kNumHandleLocks; ++i) {
     pthread_mutex_destroy(handle_locks.At(i));
     free(handle_locks.At(i));
@@ -68,9 +74,11 @@ ChunkTables &ChunkTables::operator= (const ChunkTables &other) {
   if (&other == this)
     return *this;
 
-  handle2fd.Clear();
-  inode2chunks.Clear();
-  inode2references.Clear();
+  for (unsigned i = 0; i < kNumShards; ++i) {
+    shards[i].handle2fd.Clear();
+    shards[i].inode2chunks.Clear();
+    shards[i].inode2references.Clear();
+  }
   CopyFrom(other);
   return *this;
 }
@@ -79,9 +87,11 @@ ChunkTables &ChunkTables::operator= (const ChunkTables &other) {
 void ChunkTables::CopyFrom(const ChunkTables &other) {
   assert(version == other.version);
   next_handle = other.next_handle;
-  inode2references = other.inode2references;
-  inode2chunks = other.inode2chunks;
-  handle2fd = other.handle2fd;
+  for (unsigned i = 0; i < kNumShards; ++i) {
+    shards[i].inode2references = other.shards[i].inode2references;
+    shards[i].inode2chunks = other.shards[i].inode2chunks;
+    shards[i].handle2fd = other.shards[i].handle2fd;
+  }
 }
 
 
@@ -92,3 +102,28 @@ pthread_mutex_t *ChunkTables::Handle2Lock(const uint64_t handle) const {
     static_cast<double>((uint32_t)(-1));
   return handle_locks.At((uint32_t)bucket % kNumHandleLocks);
 }
+
+
+ChunkTables::Shard *ChunkTables::Inode2Shard(const uint64_t inode) {
+  return &shards[hasher_uint64t(inode) % kNumShards];
+}
+
+
+ChunkTables::Shard *ChunkTables::Handle2Shard(const uint64_t handle) {
+  return &shards[hasher_uint64t(handle) % kNumShards];
+}
+
+
+/**
+ * Number of open chunk handles, for reporting only.  Takes the shard locks one
+ * after another, so the result is not an atomic snapshot.
+ */
+uint64_t ChunkTables::NumHandles() {
+  uint64_t result = 0;
+  for (unsigned i = 0; i < kNumShards; ++i) {
+    shards[i].Lock();
+    result += shards[i].handle2fd.size();
+    shards[i].Unlock();
+  }
+  return result;
+}
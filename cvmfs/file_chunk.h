@@ -13,6 +13,7 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <cassert>
 #include <string>
 #include <vector>
 
@@ -73,9 +74,30 @@ struct ChunkFd {
 
 
 /**
- * All chunk related data structures in the Fuse module.
+ * All chunk related data structures in the Fuse module.  The tables are split
+ * into kNumShards partitions, each with its own lock.  Inode related entries
+ * are placed by the hash of the inode, file descriptors by the hash of the
+ * chunk handle, so that concurrent open(), read() and close() calls on
+ * different files do not contend on a single mutex.
  */
 struct ChunkTables {
+  struct Shard {
+    inline void Lock() {
+      int retval = pthread_mutex_lock(lock);
+      assert(retval == 0);
+    }
+
+    inline void Unlock() {
+      int retval = pthread_mutex_unlock(lock);
+      assert(retval == 0);
+    }
+
+    SmallHashDynamic<uint64_t, ChunkFd> handle2fd;
+    SmallHashDynamic<uint64_t, FileChunkReflist> inode2chunks;
+    SmallHashDynamic<uint64_t, uint32_t> inode2references;
+    pthread_mutex_t *lock;
+  };
+
   ChunkTables();
   ~ChunkTables();
   ChunkTables(const ChunkTables &other);
@@ -85,29 +107,24 @@ struct ChunkTables {
   void InitHashmaps();
 
   pthread_mutex_t *Handle2Lock(const uint64_t handle) const;
+  Shard *Inode2Shard(const uint64_t inode);
+  Shard *Handle2Shard(const uint64_t handle);
+  uint64_t NumHandles();
 
-  inline void Lock() {
-    int retval = pthread_mutex_lock(lock);
-    assert(retval == 0);
-  }
-
-  inline void Unlock() {
-    int retval = pthread_mutex_unlock(lock);
-    assert(retval == 0);
+  inline uint64_t NextHandle() {
+    return atomic_xadd64(&next_handle, 1);
   }
 
-  static const unsigned kVersion = 2;
+  static const unsigned kVersion = 3;
+  static const unsigned kNumShards = 32;
 
   int version;
   static const unsigned kNumHandleLocks = 128;
-  SmallHashDynamic<uint64_t, ChunkFd> handle2fd;
   // The file descriptors attached to handles need to be locked.
   // Using a hash map to survive with a small, fixed number of locks
   BigVector<pthread_mutex_t *> handle_locks;
-  SmallHashDynamic<uint64_t, FileChunkReflist> inode2chunks;
-  SmallHashDynamic<uint64_t, uint32_t> inode2references;
-  uint64_t next_handle;
-  pthread_mutex_t *lock;
+  Shard shards[kNumShards];
+  atomic_int64 next_handle;
 };
 
 #endif  // CVMFS_FILE_CHUNK_H_
@@ -9,14 +9,21 @@ namespace upload {
 
 CharBuffer* AbstractReader::CreateBuffer(const size_t size) {
   ++buffers_in_flight_counter_;
-  CharBuffer *buffer = new CharBuffer(size);
+  CharBuffer *buffer = (buffer_pool_ != NULL) ? buffer_pool_->Acquire(size)
+                                              : new CharBuffer(size);
   return buffer;
 }
 
 
 void AbstractReader::ReleaseBuffer(CharBuffer *buffer) {
-  delete buffer;
+  // the Reader might wait for this release (see Reader::WaitForMemory()), thus
+  // the Buffer must not be in flight anymore when it is handed back
   --buffers_in_flight_counter_;
+  if (buffer_pool_ != NULL) {
+    buffer_pool_->Release(buffer);
+  } else {
+    delete buffer;
+  }
 }
 
 }  // namespace upload
@@ -9,11 +9,16 @@
 #include <tbb/task.h>
 #include <tbb/tbb_thread.h>
 
+#include <sys/uio.h>
+
+#include <deque>
 #include <list>
 #include <string>
 
 #include "../util_concurrency.h"
 #include "char_buffer.h"
+#include "char_buffer_pool.h"
+#include "io_uring.h"
 
 // TODO(rmeusel): remove this... wrong namespace (for testing)
 namespace upload {
@@ -22,8 +27,14 @@ class AbstractFile;
 
 class AbstractReader {
  public:
-  explicit AbstractReader(const unsigned int max_buffers_in_flight) :
-    buffers_in_flight_counter_(max_buffers_in_flight)
+  /**
+   * @param buffer_pool  (weak) reference to the CharBufferPool used for data
+   *                     Blocks, NULL to allocate each Block individually
+   */
+  explicit AbstractReader(const unsigned int  max_buffers_in_flight,
+                          CharBufferPool     *buffer_pool = NULL) :
+    buffers_in_flight_counter_(max_buffers_in_flight),
+    buffer_pool_(buffer_pool)
   {}
 
   virtual ~AbstractReader() {}
@@ -46,9 +57,12 @@ class AbstractReader {
    */
   CharBuffer *CreateBuffer(const size_t size);
 
+  uint32_t buffers_in_flight() const { return buffers_in_flight_counter_; }
+  CharBufferPool *buffer_pool() const { return buffer_pool_; }
 
  private:
   SynchronizingCounter<uint32_t> buffers_in_flight_counter_;
+  CharBufferPool *buffer_pool_;
 };
 
 
@@ -65,6 +79,17 @@ class AbstractReader {
  * Note: The Reader produces CharBuffers that are passed into the processing
  *       pipeline. The Reader claims ownership of these specific CharBuffers,
  *       thus they need to be released using the Reader::ReleaseBuffer() method!
+ *
+ * By default, Files are read with blocking read() calls.  Optionally, the reads
+ * are issued through io_uring: the read thread then keeps a couple of reads
+ * per File in flight for all open Files at the same time and schedules the
+ * data Blocks in order as they arrive.  This keeps the pipeline fed from fast
+ * storage where a single blocking reader falls behind.  If io_uring is not
+ * available, the Reader silently falls back to blocking reads.
+ *
+ * Given a CharBufferPool with a memory limit, the Reader stops reading ahead
+ * while the pipeline holds more memory than allowed, as long as there are data
+ * Blocks in processing that will free memory without further read-in.
  */
 template <class FileScrubbingTaskT, class FileT>
 class Reader : public AbstractReader,
@@ -73,14 +98,20 @@ class Reader : public AbstractReader,
   /**
    * Internal structure to keep information about each currently open File.
    */
+  struct ReadRequest;
   struct OpenFile {
     OpenFile() :
-      file(NULL), file_descriptor(0), file_marker(0), previous_task(NULL),
-      previous_sync_task(NULL) {}
+      file(NULL), file_descriptor(0), file_marker(0), read_marker(0),
+      previous_task(NULL), previous_sync_task(NULL) {}
 
     FileT *file;  ///< reference to the associated File structure
     int file_descriptor;  ///< open file descriptor of the file
     off_t file_marker;  ///< current position of file read-in
+    off_t read_marker;  ///< end of the issued io_uring reads
+    /**
+     * io_uring reads in flight, in file order
+     */
+    std::deque<ReadRequest*> pending_reads;
 
     /**
      * Previously scheduled TBB task (for synchronization)
@@ -93,6 +124,27 @@ class Reader : public AbstractReader,
   };
   typedef std::list<OpenFile> OpenFileList;
 
+  /**
+   * A read of one data Block issued through io_uring
+   */
+  struct ReadRequest {
+    ReadRequest(OpenFile *open_file, CharBuffer *buffer,
+                const size_t bytes_to_read) :
+      open_file(open_file), buffer(buffer), bytes_to_read(bytes_to_read),
+      bytes_read(0), done(false)
+    {
+      iov.iov_base = buffer->ptr();
+      iov.iov_len  = bytes_to_read;
+    }
+
+    OpenFile     *open_file;
+    CharBuffer   *buffer;  ///< might be larger than the data Block (pool)
+    struct iovec  iov;  ///< remaining part of the buffer to be read
+    size_t        bytes_to_read;
+    size_t        bytes_read;
+    bool          done;
+  };
+
   struct FileJob {
     explicit FileJob(FileT *file) : file(file), terminate(false) {}
     FileJob() : file(NULL), terminate(true) {}
@@ -103,18 +155,27 @@ class Reader : public AbstractReader,
   typedef tbb::concurrent_bounded_queue<FileJob> JobQueue;
 
  public:
-  Reader(const size_t       max_buffer_size,
-         const unsigned int max_files_in_flight) :
-    AbstractReader(max_files_in_flight * 5),
+  Reader(const size_t        max_buffer_size,
+         const unsigned int  max_files_in_flight,
+         const bool          use_io_uring = false,
+         CharBufferPool     *buffer_pool = NULL) :
+    AbstractReader(max_files_in_flight * 5, buffer_pool),
     max_buffer_size_(max_buffer_size),
     draining_(false),
     files_in_flight_counter_(max_files_in_flight),
+    ring_(use_io_uring
+          ? IoUring::Create(max_files_in_flight * kMaxReadsPerFile)
+          : NULL),
     running_(false) {}
 
   virtual ~Reader() {
     assert(!running_);
+    delete ring_;
   }
 
+  /** False if io_uring was requested but is not available */
+  bool UsesIoUring() const { return ring_ != NULL; }
+
   bool Initialize();
   void TearDown() { Terminate(); }
 
@@ -142,6 +203,7 @@ class Reader : public AbstractReader,
 
  protected:
   void ReadThread();
+  void IoUringReadThread();
 
   /** Checks if there is still data to be worked on */
   bool HasData() const { return !draining_ || open_files_.size() > 0; }
@@ -157,6 +219,13 @@ class Reader : public AbstractReader,
   void CloseFile(OpenFile         *file);
 
   bool ReadAndScheduleNextBuffer(OpenFile *open_file);
+  bool ScheduleBuffer(OpenFile *open_file, CharBuffer *buffer);
+
+  bool IssueReads(OpenFile *open_file);
+  void ReadCompleted(ReadRequest *request, const int result);
+
+  void WaitForMemory();
+  unsigned HeldBuffers() const;
 
   void FinalizedFile(AbstractFile *file);
 
@@ -169,6 +238,14 @@ class Reader : public AbstractReader,
 
   SynchronizingCounter<uint32_t>  files_in_flight_counter_;
 
+  /**
+   * Number of io_uring reads kept in flight for each open File.  Together with
+   * the one data Block per File that waits for its successor, this needs to
+   * stay well below the number of buffers in flight.
+   */
+  static const unsigned kMaxReadsPerFile = 2;
+  IoUring                        *ring_;
+
   tbb::tbb_thread                 read_thread_;
   Future<bool>                    thread_started_executing_;
   bool                            running_;
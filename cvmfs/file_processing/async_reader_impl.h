@@ -42,6 +42,11 @@ template <class FileScrubbingTaskT, class FileT>
 void Reader<FileScrubbingTaskT, FileT>::ReadThread() {
   thread_started_executing_.Set(true);
 
+  if (ring_ != NULL) {
+    IoUringReadThread();
+    return;
+  }
+
   while (HasData()) {
     // acquire a new job from the job queue:
     // -> if the queue is empty, just continue on the work currently in flight
@@ -195,6 +200,7 @@ bool Reader<FileScrubbingTaskT, FileT>::
   const size_t bytes_to_read =
     std::min(file_size - static_cast<size_t>(open_file->file_marker),
              max_buffer_size_);
+  WaitForMemory();
   CharBuffer *buffer = CreateBuffer(bytes_to_read);
   buffer->SetBaseOffset(open_file->file_marker);
 
@@ -205,11 +211,21 @@ bool Reader<FileScrubbingTaskT, FileT>::
                                  bytes_to_read);
   assert(bytes_to_read == bytes_read);
   buffer->SetUsedBytes(bytes_read);
-  open_file->file_marker += bytes_read;
+
+  return ScheduleBuffer(open_file, buffer);
+}
+
+
+template <class FileScrubbingTaskT, class FileT>
+bool Reader<FileScrubbingTaskT, FileT>::ScheduleBuffer(OpenFile   *open_file,
+                                                       CharBuffer *buffer)
+{
+  assert(buffer->base_offset() == open_file->file_marker);
+  open_file->file_marker += buffer->used_bytes();
 
   // check if the file has been fully read
   const bool finished_reading =
-    (static_cast<size_t>(open_file->file_marker) == file_size);
+    (static_cast<size_t>(open_file->file_marker) == open_file->file->size());
 
   // create an asynchronous task (FileScrubbingTaskT) to process the data chunk,
   // together with a synchronization task that ensures the correct execution
@@ -240,6 +256,172 @@ bool Reader<FileScrubbingTaskT, FileT>::
   return finished_reading;
 }
 
+
+template <class FileScrubbingTaskT, class FileT>
+void Reader<FileScrubbingTaskT, FileT>::IoUringReadThread() {
+  while (HasData()) {
+    // open all newly scheduled Files; block only if there is nothing to do
+    FileJob job;
+    while (TryToAcquireNewJob(&job)) {
+      if (job.terminate) {
+        EnableDraining();
+        break;
+      }
+      OpenNewFile(job.file);
+    }
+
+    // issue the next reads for all open Files (round robin) and close Files
+    // that were completely scheduled for processing
+    typename OpenFileList::iterator       i    = open_files_.begin();
+    typename OpenFileList::const_iterator iend = open_files_.end();
+    while (i != iend) {
+      if (IssueReads(&(*i))) {
+        OpenFile file = *i;
+        i = open_files_.erase(i);
+        CloseFile(&file);
+      } else {
+        ++i;
+      }
+    }
+    const bool submitted = ring_->Submit();
+    assert(submitted);
+
+    // wait for at least one finished read, then collect all available ones
+    bool wait = (ring_->in_flight() > 0);
+    void *tag;
+    int result;
+    while ((ring_->in_flight() > 0) && ring_->Reap(wait, &tag, &result)) {
+      ReadCompleted(static_cast<ReadRequest *>(tag), result);
+      wait = false;
+    }
+  }
+}
+
+
+/**
+ * Issues reads for the next data Blocks of an open File through io_uring and
+ * schedules the Blocks that arrived in the meantime.
+ * @return  true if the File is completely scheduled for processing
+ */
+template <class FileScrubbingTaskT, class FileT>
+bool Reader<FileScrubbingTaskT, FileT>::IssueReads(OpenFile *open_file) {
+  const size_t file_size = open_file->file->size();
+
+  // schedule the finished reads in the order of the data Blocks
+  while (!open_file->pending_reads.empty() &&
+         open_file->pending_reads.front()->done)
+  {
+    ReadRequest *request = open_file->pending_reads.front();
+    open_file->pending_reads.pop_front();
+    CharBuffer *buffer = request->buffer;
+    delete request;
+    if (ScheduleBuffer(open_file, buffer))
+      return true;
+  }
+
+  // empty files don't need any read
+  if (file_size == 0) {
+    CharBuffer *buffer = CreateBuffer(0);
+    buffer->SetBaseOffset(0);
+    buffer->SetUsedBytes(0);
+    return ScheduleBuffer(open_file, buffer);
+  }
+
+  while ((open_file->pending_reads.size() < kMaxReadsPerFile) &&
+         (static_cast<size_t>(open_file->read_marker) < file_size) &&
+         (ring_->in_flight() < ring_->queue_depth()))
+  {
+    const size_t bytes_to_read =
+      std::min(file_size - static_cast<size_t>(open_file->read_marker),
+               max_buffer_size_);
+    WaitForMemory();
+    CharBuffer *buffer = CreateBuffer(bytes_to_read);
+    buffer->SetBaseOffset(open_file->read_marker);
+    ReadRequest *request = new ReadRequest(open_file, buffer, bytes_to_read);
+    const bool prepared = ring_->PrepareRead(open_file->file_descriptor,
+                                             &request->iov,
+                                             open_file->read_marker,
+                                             request);
+    assert(prepared);
+    open_file->pending_reads.push_back(request);
+    open_file->read_marker += bytes_to_read;
+  }
+
+  return false;
+}
+
+
+template <class FileScrubbingTaskT, class FileT>
+void Reader<FileScrubbingTaskT, FileT>::ReadCompleted(ReadRequest *request,
+                                                      const int    result)
+{
+  OpenFile *open_file = request->open_file;
+  if ((result == -EINTR) || (result == -EAGAIN)) {
+    // retry as is
+  } else if (result <= 0) {
+    LogCvmfs(kLogSpooler, kLogStderr, "failed to read '%s' (%d)",
+             open_file->file->path().c_str(), -result);
+    abort();
+  } else {
+    request->bytes_read += result;
+    if (request->bytes_read == request->bytes_to_read) {
+      request->buffer->SetUsedBytes(request->bytes_read);
+      request->done = true;
+      return;
+    }
+    request->iov.iov_base = request->buffer->ptr() + request->bytes_read;
+    request->iov.iov_len  = request->bytes_to_read - request->bytes_read;
+  }
+
+  // short read, read the rest of the data Block
+  const bool prepared = ring_->PrepareRead(
+    open_file->file_descriptor,
+    &request->iov,
+    request->buffer->base_offset() + request->bytes_read,
+    request);
+  assert(prepared);
+}
+
+
+/**
+ * Blocks the read-in while the CharBufferPool is over its memory limit.  The
+ * Reader only waits as long as some data Block is in processing: each open File
+ * holds back its latest Block until the next one arrives (see ScheduleBuffer())
+ * and these Blocks are only released by reading on.
+ */
+template <class FileScrubbingTaskT, class FileT>
+void Reader<FileScrubbingTaskT, FileT>::WaitForMemory() {
+  CharBufferPool *pool = buffer_pool();
+  if (pool == NULL)
+    return;
+
+  while (true) {
+    // take the release count first in order not to miss a release in between
+    const uint64_t release_count = pool->release_count();
+    if (!pool->IsOverLimit() || (buffers_in_flight() <= HeldBuffers()))
+      return;
+    pool->WaitForRelease(release_count);
+  }
+}
+
+
+/**
+ * Counts the data Blocks that wait for the Reader, i.e. the latest Block of
+ * each open File as well as the io_uring reads in flight.
+ */
+template <class FileScrubbingTaskT, class FileT>
+unsigned Reader<FileScrubbingTaskT, FileT>::HeldBuffers() const {
+  unsigned held_buffers = 0;
+  typename OpenFileList::const_iterator i    = open_files_.begin();
+  typename OpenFileList::const_iterator iend = open_files_.end();
+  for (; i != iend; ++i) {
+    if (i->previous_task != NULL)
+      ++held_buffers;
+    held_buffers += i->pending_reads.size();
+  }
+  return held_buffers;
+}
+
 }  // namespace upload
 
 #endif  // CVMFS_FILE_PROCESSING_ASYNC_READER_IMPL_H_
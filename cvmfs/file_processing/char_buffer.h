@@ -15,6 +15,8 @@
 
 namespace upload {
 
+class CharBufferPool;
+
 /**
  * Specialization of a Buffer object for an ordinary unsigned char buffer.
  * We are using the scalable_allocator of TBB which brings measurable advantage
@@ -25,10 +27,10 @@ namespace upload {
 class CharBuffer : public Buffer<unsigned char,
                                  tbb::scalable_allocator<unsigned char> > {
  public:
-  CharBuffer() : base_offset_(0) {}
+  CharBuffer() : base_offset_(0), pool_cache_(NULL) {}
   explicit CharBuffer(const size_t size) :
     Buffer<unsigned char, tbb::scalable_allocator<unsigned char> >(size),
-    base_offset_(0) {}
+    base_offset_(0), pool_cache_(NULL) {}
 
   CharBuffer* Clone() const {
     assert(IsInitialized());
@@ -36,7 +38,7 @@ class CharBuffer : public Buffer<unsigned char,
     assert(new_buffer->IsInitialized());
     new_buffer->SetUsedBytes(used_bytes());
     new_buffer->SetBaseOffset(base_offset());
-    memcpy(new_buffer->ptr(), ptr(), size_bytes());
+    memcpy(new_buffer->ptr(), ptr(), used_bytes());
     return new_buffer;
   }
 
@@ -44,7 +46,13 @@ class CharBuffer : public Buffer<unsigned char,
   off_t base_offset() const { return base_offset_; }
 
  private:
+  friend class CharBufferPool;
+
   off_t base_offset_;
+  /**
+   * Thread cache of the CharBufferPool that handed out this buffer
+   */
+  void *pool_cache_;
 };
 
 typedef std::vector<CharBuffer*> CharBufferVector;
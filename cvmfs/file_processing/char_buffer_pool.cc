@@ -0,0 +1,206 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "char_buffer_pool.h"
+
+#include <cassert>
+#include <cstring>
+
+namespace upload {
+
+std::string CharBufferPool::Statistics::Print() const {
+  return
+  "Buffer requests: " + StringifyInt(acquisitions) + "\n" +
+  "Recycled buffers: " + StringifyInt(hits) + " (" +
+    StringifyInt(static_cast<int64_t>(HitRate() * 100.0)) + "%)\n" +
+  "Peak buffer memory: " + StringifyInt(peak_bytes / 1024) + " kB\n" +
+  "Waits for buffer memory: " + StringifyInt(memory_waits) + "\n";
+}
+
+
+CharBufferPool::CharBufferPool(const uint64_t memory_limit) :
+  memory_limit_(memory_limit)
+{
+  // tbb::atomic has no init constructor
+  release_count_ = 0;
+  waiters_       = 0;
+  acquisitions_  = 0;
+  hits_          = 0;
+  bytes_in_use_  = 0;
+  bytes_cached_  = 0;
+  peak_bytes_    = 0;
+  memory_waits_  = 0;
+
+  const bool init_successful = (
+    pthread_mutex_init(&lock_,            NULL) == 0 &&
+    pthread_cond_init(&buffer_released_, NULL) == 0);
+  assert(init_successful);
+}
+
+
+CharBufferPool::~CharBufferPool() {
+  FreeAll(&global_cache_);
+  ThreadCaches::iterator i    = thread_caches_.begin();
+  ThreadCaches::iterator iend = thread_caches_.end();
+  for (; i != iend; ++i) {
+    FreeAll(&(*i));
+  }
+
+  pthread_cond_destroy(&buffer_released_);
+  pthread_mutex_destroy(&lock_);
+}
+
+
+void CharBufferPool::FreeAll(FreeList *free_list) {
+  for (unsigned i = 0; i < kNumSizeClasses; ++i) {
+    std::vector<CharBuffer*> &buffers = free_list->buffers[i];
+    for (unsigned j = 0; j < buffers.size(); ++j) {
+      delete buffers[j];
+    }
+    buffers.clear();
+  }
+}
+
+
+unsigned CharBufferPool::GetSizeClass(const size_t size) {
+  unsigned size_class = 0;
+  while ((size_class < kNumSizeClasses) && (GetClassSize(size_class) < size))
+    ++size_class;
+  return size_class;
+}
+
+
+CharBuffer *CharBufferPool::Acquire(const size_t size) {
+  ++acquisitions_;
+  const unsigned size_class = GetSizeClass(size);
+
+  CharBuffer *buffer = NULL;
+  FreeList &thread_cache = thread_caches_.local();
+  if (size_class < kNumSizeClasses) {
+    std::vector<CharBuffer*> &local = thread_cache.buffers[size_class];
+    if (!local.empty()) {
+      buffer = local.back();
+      local.pop_back();
+    } else {
+      pthread_mutex_lock(&lock_);
+      std::vector<CharBuffer*> &global = global_cache_.buffers[size_class];
+      if (!global.empty()) {
+        buffer = global.back();
+        global.pop_back();
+      }
+      pthread_mutex_unlock(&lock_);
+    }
+  }
+
+  if (buffer != NULL) {
+    ++hits_;
+    bytes_cached_ -= buffer->size();
+  } else {
+    buffer = new CharBuffer((size_class < kNumSizeClasses)
+                            ? GetClassSize(size_class)
+                            : size);
+  }
+  assert(buffer->IsInitialized());
+  buffer->pool_cache_ = &thread_cache;
+
+  bytes_in_use_ += buffer->size();
+  UpdatePeak();
+  return buffer;
+}
+
+
+void CharBufferPool::Release(CharBuffer *buffer) {
+  assert(buffer != NULL);
+  const size_t size = buffer->size();
+  const unsigned size_class = GetSizeClass(size);
+  bytes_in_use_ -= size;
+
+  if ((size_class < kNumSizeClasses) &&
+      (GetClassSize(size_class) == size) &&
+      MayCache(size))
+  {
+    buffer->SetUsedBytes(0);
+    buffer->SetBaseOffset(0);
+    bytes_cached_ += size;
+    // Buffers released by another thread than the one that acquired them go
+    // to the global list, otherwise they pile up in the cache of a thread
+    // that never acquires buffers of this size
+    FreeList &thread_cache = thread_caches_.local();
+    std::vector<CharBuffer*> &local = thread_cache.buffers[size_class];
+    if ((buffer->pool_cache_ == &thread_cache) &&
+        (local.size() < kThreadCacheSize))
+    {
+      local.push_back(buffer);
+    } else {
+      pthread_mutex_lock(&lock_);
+      global_cache_.buffers[size_class].push_back(buffer);
+      pthread_mutex_unlock(&lock_);
+    }
+  } else {
+    delete buffer;
+  }
+
+  ++release_count_;
+  if (waiters_ > 0) {
+    pthread_mutex_lock(&lock_);
+    pthread_cond_broadcast(&buffer_released_);
+    pthread_mutex_unlock(&lock_);
+  }
+}
+
+
+CharBuffer *CharBufferPool::Clone(const CharBuffer &buffer) {
+  assert(buffer.IsInitialized());
+  CharBuffer *new_buffer = Acquire(buffer.size());
+  new_buffer->SetUsedBytes(buffer.used_bytes());
+  new_buffer->SetBaseOffset(buffer.base_offset());
+  memcpy(new_buffer->ptr(), buffer.ptr(), buffer.used_bytes());
+  return new_buffer;
+}
+
+
+bool CharBufferPool::MayCache(const size_t size) const {
+  if (memory_limit_ == 0)
+    return bytes_cached_ + size <= kMaxCachedBytes;
+  return bytes_in_use_ + bytes_cached_ + size <= memory_limit_;
+}
+
+
+void CharBufferPool::UpdatePeak() {
+  const uint64_t current = bytes_in_use_ + bytes_cached_;
+  uint64_t peak = peak_bytes_;
+  while (current > peak) {
+    const uint64_t previous = peak_bytes_.compare_and_swap(current, peak);
+    if (previous == peak)
+      break;
+    peak = previous;
+  }
+}
+
+
+void CharBufferPool::WaitForRelease(const uint64_t release_count) {
+  ++memory_waits_;
+  pthread_mutex_lock(&lock_);
+  ++waiters_;
+  while (release_count_ == release_count) {
+    pthread_cond_wait(&buffer_released_, &lock_);
+  }
+  --waiters_;
+  pthread_mutex_unlock(&lock_);
+}
+
+
+CharBufferPool::Statistics CharBufferPool::GetStatistics() const {
+  Statistics statistics;
+  statistics.acquisitions = acquisitions_;
+  statistics.hits         = hits_;
+  statistics.bytes_in_use = bytes_in_use_;
+  statistics.bytes_cached = bytes_cached_;
+  statistics.peak_bytes   = peak_bytes_;
+  statistics.memory_waits = memory_waits_;
+  return statistics;
+}
+
+}  // namespace upload
@@ -0,0 +1,149 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_FILE_PROCESSING_CHAR_BUFFER_POOL_H_
+#define CVMFS_FILE_PROCESSING_CHAR_BUFFER_POOL_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <tbb/atomic.h>
+#include <tbb/enumerable_thread_specific.h>
+
+#include <string>
+#include <vector>
+
+#include "../util.h"
+#include "char_buffer.h"
+
+namespace upload {
+
+/**
+ * Recycles the CharBuffers of the file processing pipeline.  Every data Block
+ * read by the Reader and every compression output buffer of a Chunk is drawn
+ * from the pool and handed back to it once it has been processed respectively
+ * uploaded, instead of going through the allocator for each Block.
+ *
+ * Requested sizes are rounded up to the next power of two (4 kB to 16 MB).
+ * Each size class keeps a small cache per thread and a global free list behind
+ * a mutex.  Buffers released by the thread that acquired them go to its cache,
+ * buffers released by any other thread go to the global free list.  Bigger
+ * buffers are allocated and freed as is.  Note that a pooled CharBuffer can
+ * thus be larger than requested.
+ *
+ * Optionally, the pool keeps track of a memory limit.  Released buffers are
+ * only cached as long as the limit is not exceeded.  The pool itself never
+ * blocks; the stages that produce buffers (see Reader and IoDispatcher) use
+ * IsOverLimit() and WaitForRelease() to back off until memory is handed back.
+ *
+ * Thread-safe.
+ */
+class CharBufferPool : SingleCopy {
+ public:
+  struct Statistics {
+    uint64_t acquisitions;  ///< number of requested buffers
+    uint64_t hits;          ///< requests served by a recycled buffer
+    uint64_t bytes_in_use;  ///< memory handed out to the pipeline
+    uint64_t bytes_cached;  ///< memory kept in the free lists
+    uint64_t peak_bytes;    ///< maximum of bytes in use plus bytes cached
+    uint64_t memory_waits;  ///< number of times a stage backed off
+
+    Statistics() :
+      acquisitions(0), hits(0), bytes_in_use(0), bytes_cached(0),
+      peak_bytes(0), memory_waits(0) {}
+
+    double HitRate() const {
+      return (acquisitions == 0)
+        ? 0.0
+        : static_cast<double>(hits) / static_cast<double>(acquisitions);
+    }
+    std::string Print() const;
+  };
+
+  static const unsigned kMinSizeClassLog2 = 12;  // 4 kB
+  static const unsigned kMaxSizeClassLog2 = 24;  // 16 MB
+  static const unsigned kNumSizeClasses   =
+    kMaxSizeClassLog2 - kMinSizeClassLog2 + 1;
+  /**
+   * Number of buffers per size class kept in each thread's cache
+   */
+  static const unsigned kThreadCacheSize  = 4;
+  /**
+   * Without memory limit, the free lists keep at most this many bytes
+   */
+  static const uint64_t kMaxCachedBytes   = 128 * 1024 * 1024;
+
+  /**
+   * @param memory_limit  maximal memory of all buffers (0: no limit)
+   */
+  explicit CharBufferPool(const uint64_t memory_limit = 0);
+  ~CharBufferPool();
+
+  /**
+   * Provides an empty CharBuffer with at least the given size
+   */
+  CharBuffer *Acquire(const size_t size);
+  /**
+   * Hands a CharBuffer obtained by Acquire() back to the pool
+   */
+  void Release(CharBuffer *buffer);
+  /**
+   * Copies the used part of the given buffer into a pooled CharBuffer
+   */
+  CharBuffer *Clone(const CharBuffer &buffer);
+
+  bool IsOverLimit() const {
+    return (memory_limit_ > 0) && (bytes_in_use_ > memory_limit_);
+  }
+
+  /**
+   * Blocks until at least one buffer was released after release_count() re-
+   * turned the given value.  Callers must make sure that some release is
+   * still to come.
+   */
+  void WaitForRelease(const uint64_t release_count);
+  uint64_t release_count() const { return release_count_; }
+
+  uint64_t memory_limit() const { return memory_limit_; }
+  Statistics GetStatistics() const;
+
+ private:
+  struct FreeList {
+    std::vector<CharBuffer*> buffers[kNumSizeClasses];
+  };
+  typedef tbb::enumerable_thread_specific<FreeList> ThreadCaches;
+
+  /**
+   * @return  the size class for the given size or kNumSizeClasses if buffers
+   *          of this size are not pooled
+   */
+  static unsigned GetSizeClass(const size_t size);
+  static size_t GetClassSize(const unsigned size_class) {
+    return static_cast<size_t>(1) << (size_class + kMinSizeClassLog2);
+  }
+
+  bool MayCache(const size_t size) const;
+  void UpdatePeak();
+  static void FreeAll(FreeList *free_list);
+
+  const uint64_t           memory_limit_;
+
+  ThreadCaches             thread_caches_;
+  FreeList                 global_cache_;
+  pthread_mutex_t          lock_;
+  pthread_cond_t           buffer_released_;
+
+  tbb::atomic<uint64_t>    release_count_;
+  tbb::atomic<unsigned>    waiters_;
+
+  tbb::atomic<uint64_t>    acquisitions_;
+  tbb::atomic<uint64_t>    hits_;
+  tbb::atomic<uint64_t>    bytes_in_use_;
+  tbb::atomic<uint64_t>    bytes_cached_;
+  tbb::atomic<uint64_t>    peak_bytes_;
+  tbb::atomic<uint64_t>    memory_waits_;
+};
+
+}  // namespace upload
+
+#endif  // CVMFS_FILE_PROCESSING_CHAR_BUFFER_POOL_H_
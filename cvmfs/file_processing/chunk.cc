@@ -18,7 +18,8 @@ CharBuffer* Chunk::GetDeflateBuffer(const size_t bytes) {
     if (current_deflate_buffer_ != NULL) {
       ScheduleWrite(current_deflate_buffer_);
     }
-    current_deflate_buffer_ = new CharBuffer(bytes);
+    current_deflate_buffer_ =
+      file_->io_dispatcher()->buffer_pool()->Acquire(bytes);
   }
 
   return current_deflate_buffer_;
@@ -51,22 +52,16 @@ void Chunk::FlushDeferredWrites(const bool delete_buffers) {
 }
 
 
-void Chunk::Initialize() {
+void Chunk::Initialize(const zlib::Algorithms compression_algorithm) {
   done_            = false;
   compressed_size_ = 0;
 
   content_hash_context_.buffer = smalloc(content_hash_context_.size);
   shash::Init(content_hash_context_);
 
-  zlib_context_.zalloc   = Z_NULL;
-  zlib_context_.zfree    = Z_NULL;
-  zlib_context_.opaque   = Z_NULL;
-  zlib_context_.next_in  = Z_NULL;
-  zlib_context_.avail_in = 0;
-  const int zlib_retval = deflateInit(&zlib_context_, Z_DEFAULT_COMPRESSION);
-  assert(zlib_retval == 0);
+  compressor_ = zlib::Compressor::Construct(compression_algorithm);
+  assert(compressor_ != NULL);
 
-  zlib_initialized_         = true;
   content_hash_initialized_ = true;
 }
 
@@ -78,10 +73,6 @@ void Chunk::Finalize() {
   free(content_hash_context_.buffer);
   content_hash_context_.buffer = NULL;
 
-  assert(zlib_context_.avail_in == 0);
-  const int retcode = deflateEnd(&zlib_context_);
-  assert(retcode == Z_OK);
-
   if (current_deflate_buffer_ != NULL) {
     ScheduleWrite(current_deflate_buffer_);
     current_deflate_buffer_ = NULL;
@@ -91,6 +82,11 @@ void Chunk::Finalize() {
     FlushDeferredWrites();
   }
 
+  // the chunk counts as initialized as long as it has a compressor, thus the
+  // compressor is released only after the last buffer is handed to the writer
+  delete compressor_;
+  compressor_ = NULL;
+
   done_ = true;
 }
 
@@ -109,7 +105,7 @@ Chunk::Chunk(const Chunk &other) :
   is_fully_defined_(other.is_fully_defined_),
   deferred_write_(other.deferred_write_),
   deferred_buffers_(other.deferred_buffers_),
-  zlib_initialized_(false),
+  compressor_(NULL),
   content_hash_context_(other.content_hash_context_),
   content_hash_(other.content_hash_),
   content_hash_initialized_(other.content_hash_initialized_),
@@ -120,19 +116,18 @@ Chunk::Chunk(const Chunk &other) :
   assert(!other.done_);
   assert(!other.HasUploadStreamHandle());
   assert(other.bytes_written_ == 0);
-  assert(other.zlib_context_.avail_in == 0);
 
-  current_deflate_buffer_ = other.current_deflate_buffer_->Clone();
+  current_deflate_buffer_ =
+    file_->io_dispatcher()->buffer_pool()->Clone(
+      *other.current_deflate_buffer_);
 
   content_hash_context_.buffer = smalloc(content_hash_context_.size);
   memcpy(content_hash_context_.buffer,
          other.content_hash_context_.buffer,
          content_hash_context_.size);
 
-  const int retval = deflateCopy(&zlib_context_,
-                                 const_cast<z_streamp>(&other.zlib_context_));
-  assert(retval == Z_OK);
-  zlib_initialized_ = true;
+  compressor_ = other.compressor_->Clone();
+  assert(compressor_ != NULL);
 }
 
 
@@ -12,7 +12,7 @@
 #include <string>
 #include <vector>
 
-#include "../duplex_zlib.h"
+#include "../compression.h"
 #include "../hash.h"
 #include "char_buffer.h"
 
@@ -31,18 +31,19 @@ class File;
  */
 class Chunk {
  public:
-  Chunk(File* file, const off_t offset, shash::Algorithms hash_algorithm) :
+  Chunk(File* file, const off_t offset, shash::Algorithms hash_algorithm,
+        zlib::Algorithms compression_algorithm) :
     file_(file), file_offset_(offset), chunk_size_(0),
     is_bulk_chunk_(false), is_fully_defined_(false), deferred_write_(false),
-    zlib_initialized_(false), content_hash_context_(hash_algorithm),
+    compressor_(NULL), content_hash_context_(hash_algorithm),
     content_hash_(hash_algorithm), content_hash_initialized_(false),
     upload_stream_handle_(NULL), current_deflate_buffer_(NULL),
     bytes_written_(0)
   {
-    Initialize();
+    Initialize(compression_algorithm);
   }
 
-  bool IsInitialized()         const { return zlib_initialized_ &&
+  bool IsInitialized()         const { return compressor_ != NULL &&
                                               content_hash_initialized_;     }
   bool IsFullyProcessed()      const { return done_;                         }
   bool IsBulkChunk()           const { return is_bulk_chunk_;                }
@@ -60,7 +61,7 @@ class Chunk {
    * used_bytes_ field of the provided CharBuffer after data has been added.
    * This method returns always the same buffer until it is full. In that case
    * the filled CharBuffer is automatically scheduled for writing and a fresh
-   * CharBuffer is provided.
+   * CharBuffer is drawn from the IoDispatcher's CharBufferPool.
    *
    * @param bytes  an estimate of how much memory needs to be provided.
    * @return       a CharBuffer to write compression results
@@ -79,6 +80,8 @@ class Chunk {
   void EnableDeferredWrite() {
     assert(!HasUploadStreamHandle());
     deferred_write_ = true;
+    // the bulk chunk is forked off from the first chunk (CopyAsBulkChunk())
+    compressor_->PrepareClone();
   }
 
   File* file() const { return file_; }
@@ -92,7 +95,7 @@ class Chunk {
   shash::ContextPtr& content_hash_context() { return content_hash_context_; }
   const shash::Any&  content_hash() const { return content_hash_; }
   shash::Suffix      hash_suffix() const;
-  z_stream&          zlib_context() { return zlib_context_; }
+  zlib::Compressor*  compressor() { return compressor_; }
 
   UploadStreamHandle* upload_stream_handle() const {
     return upload_stream_handle_;
@@ -109,7 +112,7 @@ class Chunk {
   }
 
  protected:
-  void Initialize();
+  void Initialize(const zlib::Algorithms compression_algorithm);
   void FlushDeferredWrites(const bool delete_buffers = true);
   void ScheduleWrite(CharBuffer *buffer);
 
@@ -136,8 +139,7 @@ class Chunk {
    */
   std::vector<CharBuffer*> deferred_buffers_;
 
-  z_stream                 zlib_context_;
-  bool                     zlib_initialized_;
+  zlib::Compressor        *compressor_;
 
   shash::ContextPtr        content_hash_context_;
   shash::Any               content_hash_;
@@ -120,4 +120,211 @@ off_t Xor32Detector::FindNextCutMark(CharBuffer *buffer) {
   }
 }
 
+
+//------------------------------------------------------------------------------
+
+
+// 256 random 64bit values, generated by splitmix64 seeded with
+// 0x4356464d53434443 ("CVFMSCDC").  You should never change this table, since
+// it affects the definition of cut marks.
+const uint64_t GearDetector::gear_table_[256] = {
+  0xee7bc9783259a463ULL, 0xae9057ec0e5e58bdULL, 0x4bbf0eb555ba36d1ULL,
+  0x1c3ab7643a895278ULL, 0x87a103dca1364c74ULL, 0x16406a1f074b449cULL,
+  0xb64396e3e79ed621ULL, 0xd372b26612012cfeULL, 0x703efc05c2c8c3bfULL,
+  0x2f8b6b0e649cc5b9ULL, 0xe709d5d666289489ULL, 0xf31c10e15c9f81fbULL,
+  0xbe2b2f7a3a0c15e1ULL, 0x6f832efd3db0d703ULL, 0x705bdcfe57895ccdULL,
+  0xd35063e73ba172b9ULL, 0xb8436e7c1c20d355ULL, 0x1d6747143ec0c730ULL,
+  0xb49de958de19fda5ULL, 0xd59141311c6209d9ULL, 0x1eee00d929f0ac67ULL,
+  0x9cb91b4716289bddULL, 0xb14bda1c55d99a34ULL, 0x9d67a855573a3152ULL,
+  0x217073288ae447eaULL, 0x729eff65f103965dULL, 0x9258431c88859fecULL,
+  0xe6a0b8aa489e6555ULL, 0x046827e08f1a98e1ULL, 0x0b8d6e0a4bb0da9aULL,
+  0x9339596d07e00240ULL, 0xc1c610225cb7cfe2ULL, 0x9de37ddf68df59c1ULL,
+  0xe18a336a13b016e5ULL, 0xf7c122b0bd7302fbULL, 0x8cf1997bd279b80dULL,
+  0xc95bacad39bffab5ULL, 0x9e40a7531834af53ULL, 0x2af6cc5989907f77ULL,
+  0x9339914494f3fbc5ULL, 0xefc7d5e0012bbf7cULL, 0xb907245a4ac2a8fcULL,
+  0xbd9ccab254618cbeULL, 0x147efea863bed9b7ULL, 0xf16869ce78fa26acULL,
+  0x4fb76713a87c07d6ULL, 0x2a31dce05c9091ffULL, 0x565ef6083765ba0bULL,
+  0xee974712c88eb009ULL, 0x4f4be90aa29fe1d0ULL, 0xd3e57d9fd608e232ULL,
+  0xdc99d6937414da36ULL, 0xfcd49e54761f3e90ULL, 0x43b9cf501f7ed11fULL,
+  0x6b76b1e762a7598cULL, 0x20c490c5aea92298ULL, 0x287d0c7f9a6d3021ULL,
+  0x4399152a40379578ULL, 0x7ba7cd0a51f91e38ULL, 0x3e6ade4d1266a2d9ULL,
+  0x63c120d550c6d8a0ULL, 0xe5ae640991f53d19ULL, 0xd6cbdd54cd925836ULL,
+  0xb4ce3a8d3a253033ULL, 0xf01ceb3de11763cdULL, 0x9ed329b2fac66bb6ULL,
+  0x55001d928a514debULL, 0xefb8d164e1f14f5cULL, 0xa7b3a6fd370f412cULL,
+  0x6018409b29c9c90eULL, 0x956ca205248d123aULL, 0x4eec9a33aaa46530ULL,
+  0xe868b5267b3b0b4eULL, 0x81c42d93412801e3ULL, 0x7f9178299b2b72dcULL,
+  0xf6ef5e2b88a64fe4ULL, 0x70045066c25b00e4ULL, 0x685b781326ae4ce4ULL,
+  0xe42fce4e5248bb87ULL, 0x253cd1c7ad9bc07fULL, 0xc7f90b886b2a5d09ULL,
+  0x66fe1e34c73ab2efULL, 0xc08faf2554d20fe7ULL, 0x5d8168a5720fd16fULL,
+  0xf3317dcf41b4e0d1ULL, 0x2800f76d342535dfULL, 0x2d6c320b2ae417a1ULL,
+  0xc46b24cfdf2784e0ULL, 0x6eee9b9af3ecd64cULL, 0xad661ef984fe6d54ULL,
+  0x912c62798c8372b7ULL, 0xf393ab0596de32e1ULL, 0xfedccba63ceab348ULL,
+  0x987f71698106ec41ULL, 0xd54c2dfc882821fdULL, 0xd39a324ec5b0fd14ULL,
+  0xe0cae9afbc77ab31ULL, 0xbb6a590287f1146bULL, 0x919be69e9a2da819ULL,
+  0xedd47b243a6c0308ULL, 0xc76c4f93467e7eabULL, 0xedf2fd0af970bed4ULL,
+  0xbc9075802b52ad8cULL, 0x6aee8e6755ee6749ULL, 0x04e796be65119f5aULL,
+  0xcfd50336929b6953ULL, 0x86eb2b37c02449b2ULL, 0x9846c2e614bd4921ULL,
+  0x45054fbfc3e88cb5ULL, 0x225afafba43733a3ULL, 0x32f0bc8765c9d10cULL,
+  0x4bc41e3faceb7dd1ULL, 0xdc1f8a6d9359b8dbULL, 0x8624d61462c69c55ULL,
+  0xa806c7d918d9074dULL, 0x4e71803c87196cf1ULL, 0xb56beb613e9876eaULL,
+  0x996975bac74d25ecULL, 0xf9f891eab932c4d6ULL, 0x987b67fd4398bbe7ULL,
+  0x684304ca2fb68cb5ULL, 0x589fd72a2a1b98f0ULL, 0x511107cecba094d8ULL,
+  0x3c117e62d8c70c83ULL, 0xd985dea0854cd646ULL, 0x35bfcfd969b61159ULL,
+  0x3dd128f235eb7821ULL, 0x74e42317f7093d8aULL, 0x5e6da82f65690cd7ULL,
+  0x032b54d3c2c4af90ULL, 0x3658119f37768a4bULL, 0x68aab602a325a61dULL,
+  0x67e20d67a4747e16ULL, 0x5d38c993cbc6c908ULL, 0xa7bc711a767c9b7aULL,
+  0x5354d2249e715344ULL, 0x10eef9c11c73e66bULL, 0x6764b8169941788bULL,
+  0x26292843350cf08aULL, 0x11910528734e0291ULL, 0xc9ab14be42098d01ULL,
+  0x4b431cc56deea28bULL, 0xa4b31fbf19fd9dd7ULL, 0x2d51e16395dc0d64ULL,
+  0xd1a3415285376613ULL, 0x8216bdbe947aa801ULL, 0xf4d9aa383bc8ccd6ULL,
+  0xfca2d3f5f9aa6fecULL, 0x7e051f6134121e4fULL, 0xea5dc73ffdf819f3ULL,
+  0xa30e56ba9b3e164cULL, 0x32f459f3c902ede8ULL, 0xec2769078e2609c2ULL,
+  0xb8fee4c2db90705aULL, 0xf433f926b0ceb5cbULL, 0x0c7a8af09a0e3f38ULL,
+  0xe32957098bedf8bbULL, 0xc2f502545effc2c5ULL, 0xa6cfecb76405118cULL,
+  0xb13e3052b65bed89ULL, 0xc58f7f35ca5b3103ULL, 0x8487a12987cd83daULL,
+  0x4a507ed0d1410d28ULL, 0xa386d27735a4ecc8ULL, 0xddfc685b41f35a9aULL,
+  0x6be3eca0fc24e142ULL, 0xadc990ffd65bf3d3ULL, 0x9140ed1dc6f2cd64ULL,
+  0x940b82b55bd7de1cULL, 0x130f5add846f3a86ULL, 0x1658f6a1382b1c79ULL,
+  0x27fc83e67a035ac7ULL, 0x08aeed0bc3a6db7fULL, 0xfd563bbef96ec872ULL,
+  0x4f55297a0ac579d1ULL, 0xaa0849a946ca87a8ULL, 0xe722f5b3eed0099bULL,
+  0xb29ed02105048d3eULL, 0xd2673aaeb4aa50e7ULL, 0x2f3859e767f44890ULL,
+  0x22358d37ef81a997ULL, 0x1d377b9e0b77c87fULL, 0x30fefdeae87f41eaULL,
+  0xa8ccb4aa05ebedd3ULL, 0x1c102477195e3accULL, 0xab67de4c4827102cULL,
+  0x9324d9224f59c04bULL, 0xb8a1fe391c8bafadULL, 0xc79cd0a76bc336a1ULL,
+  0x795e7168e2e91768ULL, 0x027fbdf8f9569001ULL, 0x92d8cf7bb274cef2ULL,
+  0x6391fbff6638b2e2ULL, 0x390250f103565a79ULL, 0x3fe65f57dcfedee8ULL,
+  0x077d2dcbb7556fffULL, 0x5ee5bec82af7da34ULL, 0x19ece6681e37b524ULL,
+  0xf782cbb6d2b929d8ULL, 0xf1e4f9b0c28e98b7ULL, 0x3f72df04d0e66ab1ULL,
+  0x5324d1b6d48518b5ULL, 0x3d1d195598132b6bULL, 0x51bf87c66651779eULL,
+  0x599f57647785a6c8ULL, 0x17f8db123e85a5efULL, 0x960d5799d80ddfaaULL,
+  0x67e5cb09333421b8ULL, 0x35b9e8aba4889868ULL, 0x0725127d9af180b4ULL,
+  0x2f76a990cd48a809ULL, 0x1cd1a031f166e9dcULL, 0x815050b4aa72629eULL,
+  0xd744a89ba1575201ULL, 0x93e6aafb35824273ULL, 0x552d9471fbd4571dULL,
+  0x10de9d21fdf2e2eeULL, 0x1ca07ac521bf80b8ULL, 0x317f12765a3d2837ULL,
+  0x94c2d7d3de50bec5ULL, 0x0c3bd231fffb0157ULL, 0x0f4bd7bf6a188e6eULL,
+  0x7852c25b77f7be04ULL, 0x70b461ca163a4a39ULL, 0xc6599f9bcae8d17fULL,
+  0xb9621511fadd0767ULL, 0xf4b4f15894b767d1ULL, 0xe86f2ca6404f3c55ULL,
+  0x1278a962a959c137ULL, 0xa381666c8da76073ULL, 0x148bab26ed8a7b77ULL,
+  0xa5f0b1ff1738a253ULL, 0xf8ad49c16bce73dbULL, 0x4810f32f3d9052a6ULL,
+  0x998b32f6ee2a92a7ULL, 0xcdfdae354b952ed5ULL, 0x1f8be1c4c402033cULL,
+  0x3e35b6942a6a5e6fULL, 0x7a994698304b2444ULL, 0x7426ae4045732f54ULL,
+  0xf2e38cf76db96f99ULL, 0x369230a5c4b5c5bcULL, 0xc16134a6a8c4774fULL,
+  0x4dd531a03e8420a4ULL, 0x0c4c50a57604e1bfULL, 0xebfad9d61209f787ULL,
+  0xff20b64a0c8c9d98ULL, 0x51eb40bb50035690ULL, 0xc80b8d6320087f1dULL,
+  0xbc9d3e5a483eff2eULL, 0x35aa2d5852658898ULL, 0x7eb1fea10bf077fbULL,
+  0xb13cec7e6a8c3f8bULL, 0xdb310be94495936aULL, 0x05fbe2bd3db70e95ULL,
+  0xced6ebbf4fe84c3cULL
+};
+
+
+GearDetector::GearDetector(const size_t minimal_chunk_size,
+                           const size_t average_chunk_size,
+                           const size_t maximal_chunk_size) :
+  minimal_chunk_size_(minimal_chunk_size),
+  average_chunk_size_(average_chunk_size),
+  maximal_chunk_size_(maximal_chunk_size),
+  // In between the minimal and the average chunk size, a cut mark is found
+  // with a probability of 1 / 2^(bits+1) per byte, beyond the average chunk
+  // size with a probability of 1 / 2^(bits-1).
+  mask_small_(MakeMask(
+    Log2(average_chunk_size - std::min(average_chunk_size,
+                                       minimal_chunk_size)) + 1)),
+  mask_large_(MakeMask(
+    Log2(average_chunk_size - std::min(average_chunk_size,
+                                       minimal_chunk_size)) - 1)),
+  gear_ptr_(0), gear_(0)
+{
+  assert(minimal_chunk_size_ > 0);
+  assert(minimal_chunk_size_ < average_chunk_size_);
+  assert(average_chunk_size_ < maximal_chunk_size_);
+}
+
+
+/**
+ * Integer logarithm, rounded down, at least 2 so that both masks have bits.
+ */
+unsigned GearDetector::Log2(size_t value) {
+  unsigned result = 0;
+  while (value > 1) {
+    value >>= 1;
+    ++result;
+  }
+  return std::max(result, 2U);
+}
+
+
+/**
+ * Uses the highest bits of the gear hash, which depend on all of the bytes in
+ * the 64 byte window.
+ */
+uint64_t GearDetector::MakeMask(const unsigned bits) {
+  assert((bits > 0) && (bits < 64));
+  return ~uint64_t(0) << (64 - bits);
+}
+
+
+off_t GearDetector::FindNextCutMark(CharBuffer *buffer) {
+  assert(minimal_chunk_size_ >= gear_influence);
+  const unsigned char *data = buffer->ptr();
+  const off_t base_offset = buffer->base_offset();
+  const off_t used_bytes = static_cast<off_t>(buffer->used_bytes());
+
+  // get the offset where the gear hash computation needs to be continued
+  // (see Xor32Detector::FindNextCutMark)
+  const off_t global_offset =
+    std::max(last_cut() +
+             static_cast<off_t>(minimal_chunk_size_ - gear_influence),
+             gear_ptr_);
+  if (global_offset >= base_offset + used_bytes) {
+    return NoCut(global_offset);
+  }
+
+  off_t internal_offset = global_offset - base_offset;
+  assert(internal_offset >= 0);
+
+  // The hash is kept in a local variable to keep it in a register during the
+  // loops; it is written back whenever the function returns
+  uint64_t gear = gear_;
+
+  // precompute the gear hash up to the minimal chunk size
+  const off_t internal_precompute_end =
+    std::min(last_cut() + static_cast<off_t>(minimal_chunk_size_) - base_offset,
+             used_bytes);
+  for (; internal_offset < internal_precompute_end; ++internal_offset) {
+    gear = (gear << 1) + gear_table_[data[internal_offset]];
+  }
+
+  // look for a cut mark with the harder to satisfy mask up to the average
+  // chunk size and with the easier mask up to the maximal chunk size
+  const off_t internal_avg_chunk_size_end =
+    last_cut() + static_cast<off_t>(average_chunk_size_) - base_offset;
+  const off_t internal_max_chunk_size_end =
+    last_cut() + static_cast<off_t>(maximal_chunk_size_) - base_offset;
+
+  const off_t internal_small_end =
+    std::min(internal_avg_chunk_size_end, used_bytes);
+  for (; internal_offset < internal_small_end; ++internal_offset) {
+    gear = (gear << 1) + gear_table_[data[internal_offset]];
+    if ((gear & mask_small_) == 0)
+      return DoCut(internal_offset + base_offset);
+  }
+
+  const off_t internal_large_end =
+    std::min(internal_max_chunk_size_end, used_bytes);
+  for (; internal_offset < internal_large_end; ++internal_offset) {
+    gear = (gear << 1) + gear_table_[data[internal_offset]];
+    if ((gear & mask_large_) == 0)
+      return DoCut(internal_offset + base_offset);
+  }
+
+  // hard cut at the maximal chunk size, otherwise continue with the next
+  // buffer
+  if (internal_offset == internal_max_chunk_size_end) {
+    return DoCut(internal_offset + base_offset);
+  } else {
+    gear_ = gear;
+    return NoCut(internal_offset + base_offset);
+  }
+}
+
 }  // namespace upload
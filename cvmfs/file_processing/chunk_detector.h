@@ -6,6 +6,7 @@
 #define CVMFS_FILE_PROCESSING_CHUNK_DETECTOR_H_
 
 #include <gtest/gtest_prod.h>
+#include <stdint.h>
 #include <sys/types.h>
 
 #include <algorithm>
@@ -139,6 +140,74 @@ class Xor32Detector : public ChunkDetector {
   const int32_t threshold_;
 };
 
+
+/**
+ * The GearDetector implements the content defined chunking of FastCDC [1].
+ *
+ * The rolling "gear" hash is updated with a single shift, a table lookup and
+ * an addition per byte:  hash = (hash << 1) + gear[byte].  Since every byte is
+ * shifted out after 64 steps, the hash only depends on the last 64 bytes of the
+ * data stream.  A cut mark is placed where the masked hash becomes zero.  The
+ * mask has more bits set before the average chunk size is reached and fewer
+ * bits afterwards ("normalized chunking"), which narrows the chunk size
+ * distribution around the average.  Compared to Xor32Detector, the inner loop
+ * has no data-dependent branches besides the cut mark check and it runs
+ * several times faster.
+ *
+ * Note: the gear table and the masks define the cut marks; changing them
+ *       breaks deduplication against previously published chunks.
+ *
+ * [1]     "FastCDC: a Fast and Efficient Content-Defined Chunking Approach
+ *          for Data Deduplication"
+ *     Wen Xia et al., USENIX ATC 2016
+ */
+class GearDetector : public ChunkDetector {
+  FRIEND_TEST(T_ChunkDetectors, GearTable);
+
+ protected:
+  // the gear hash only depends on a window of the last 64 bytes
+  static const size_t gear_influence = 64;
+
+ public:
+  GearDetector(const size_t minimal_chunk_size,
+               const size_t average_chunk_size,
+               const size_t maximal_chunk_size);
+
+  bool MightFindChunks(const size_t size) const {
+    return size > minimal_chunk_size_;
+  }
+
+  off_t FindNextCutMark(CharBuffer *buffer);
+
+ protected:
+  virtual off_t DoCut(const off_t offset) {
+    gear_      = 0;
+    gear_ptr_  = offset;
+    return ChunkDetector::DoCut(offset);
+  }
+
+  virtual off_t NoCut(const off_t offset) {
+    gear_ptr_ = offset;
+    return ChunkDetector::NoCut(offset);
+  }
+
+  static unsigned Log2(size_t value);
+  static uint64_t MakeMask(const unsigned bits);
+
+ private:
+  const size_t minimal_chunk_size_;
+  const size_t average_chunk_size_;
+  const size_t maximal_chunk_size_;
+
+  const uint64_t mask_small_;  //!< used before the average chunk size
+  const uint64_t mask_large_;  //!< used after the average chunk size
+
+  off_t    gear_ptr_;
+  uint64_t gear_;
+
+  static const uint64_t gear_table_[256];
+};
+
 }  // namespace upload
 
 #endif  // CVMFS_FILE_PROCESSING_CHUNK_DETECTOR_H_
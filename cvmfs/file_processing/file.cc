@@ -16,11 +16,17 @@ File::File(const std::string    &path,
            IoDispatcher         *io_dispatcher,
            ChunkDetector        *chunk_detector,
            shash::Algorithms     hash_algorithm,
+           zlib::Algorithms      compression_algorithm,
+           const size_t          bulk_chunk_threshold,
            const shash::Suffix   hash_suffix) :
   AbstractFile(path, GetFileSize(path)),
   might_become_chunked_(chunk_detector != NULL &&
                         chunk_detector->MightFindChunks(size())),
+  skip_bulk_chunk_(might_become_chunked_ &&
+                   bulk_chunk_threshold > 0 &&
+                   size() > bulk_chunk_threshold),
   hash_algorithm_(hash_algorithm),
+  compression_algorithm_(compression_algorithm),
   hash_suffix_(hash_suffix),
   bulk_chunk_(NULL),
   io_dispatcher_(io_dispatcher),
@@ -69,14 +75,19 @@ void File::CreateInitialChunk() {
   assert(chunks_.size() == 0);
 
   const off_t offset = 0;
-  Chunk *new_chunk   = new Chunk(this, offset, hash_algorithm_);
+  Chunk *new_chunk   = new Chunk(this, offset, hash_algorithm_,
+                                  compression_algorithm_);
 
   if (might_become_chunked_) {
     // for a potentially chunked file, the initial chunk needs to defer the
     // write back of data until a final decision has been made
     // as soon as a second chunk has been generated, this chunk will be
     // duplicated and serve as the beginning of the bulk chunk as well
-    new_chunk->EnableDeferredWrite();
+    // Note: without a bulk chunk there is nothing to duplicate, the initial
+    //       chunk writes its data right away and is promoted to be the bulk
+    //       chunk if no cut mark is found (PromoteSingleChunkAsBulkChunk())
+    if (!skip_bulk_chunk_)
+      new_chunk->EnableDeferredWrite();
   } else {
     // if we are dealing with a file that will definitely _not_ be chunked, we
     // directly mark the initial chunk as being a bulk chunk
@@ -101,7 +112,7 @@ Chunk* File::CreateNextChunk(const off_t offset) {
   // copy the initially created Chunk as the bulk_chunk_ as soon as we create
   // a second Chunk, thus defining the file to be chunked in general
   // (see CreateInitialChunk())
-  if (!HasBulkChunk()) {
+  if (!HasBulkChunk() && !skip_bulk_chunk_) {
     ForkOffBulkChunk();
   }
 
@@ -109,7 +120,7 @@ Chunk* File::CreateNextChunk(const off_t offset) {
   // will start at 'offset'
   latest_chunk->set_size(offset - latest_chunk->offset());
   Chunk *predecessor = latest_chunk;
-  AddChunk(new Chunk(this, offset, hash_algorithm_));
+  AddChunk(new Chunk(this, offset, hash_algorithm_, compression_algorithm_));
 
   return predecessor;
 }
@@ -164,7 +175,7 @@ void File::FullyDefineLastChunk() {
   // only one Chunk was generated during the processing of this file, though it
   // was classified as possible chunked file --> re-define the file as not being
   // chunked and use the single generated Chunk as bulk Chunk
-  if (might_become_chunked_ && !HasBulkChunk()) {
+  if (might_become_chunked_ && chunks_.size() == 1 && !HasBulkChunk()) {
     PromoteSingleChunkAsBulkChunk();
   }
 }
@@ -194,10 +205,14 @@ void File::Finalize() {
 #endif
 
   // more sanity checks
-  assert(HasBulkChunk());
-  assert(bulk_chunk_->offset() == 0);
-  assert(bulk_chunk_->size()   == size());
-  assert(bulk_chunk_->IsFullyProcessed());
+  if (skip_bulk_chunk_ && !HasBulkChunk()) {
+    assert(chunks_.size() > 1);
+  } else {
+    assert(HasBulkChunk());
+    assert(bulk_chunk_->offset() == 0);
+    assert(bulk_chunk_->size()   == size());
+    assert(bulk_chunk_->IsFullyProcessed());
+  }
 
   // notify about the finished file processing
   io_dispatcher_->CommitFile(this);
@@ -10,6 +10,7 @@
 #include <string>
 #include <vector>
 
+#include "../compression.h"
 #include "../hash.h"
 #include "../platform.h"
 #include "char_buffer.h"
@@ -34,6 +35,8 @@ class File : public AbstractFile {
        IoDispatcher         *io_dispatcher,
        ChunkDetector        *chunk_detector,
        shash::Algorithms     hash_algorithm,
+       zlib::Algorithms      compression_algorithm,
+       const size_t          bulk_chunk_threshold = 0,
        const shash::Suffix   hash_suffix = shash::kSuffixNone);
   ~File();
 
@@ -92,10 +95,19 @@ class File : public AbstractFile {
 
  private:
   const bool might_become_chunked_;  ///< Result of the chunkedness forecast
+  /**
+   * Large files that get chunked are stored without a bulk Chunk. Saves
+   * compressing, hashing, and uploading the entire file a second time.
+   */
+  const bool skip_bulk_chunk_;
   /**
    * Secure hash algorithm creating content-addressable storage
    */
   const shash::Algorithms hash_algorithm_;
+  /**
+   * Compression algorithm of the generated chunks
+   */
+  const zlib::Algorithms compression_algorithm_;
   /**
    * Suffix to be appended to the bulk chunk content hash
    */
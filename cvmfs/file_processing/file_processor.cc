@@ -20,12 +20,17 @@ FileProcessor::FileProcessor(AbstractUploader         *uploader,
                              const SpoolerDefinition  &spooler_definition) :
   io_dispatcher_(new IoDispatcher(uploader,
                                   this,
-                                  spooler_definition.number_of_threads)),
+                                  spooler_definition.number_of_threads,
+                                  spooler_definition.use_io_uring,
+                                  spooler_definition.processing_memory_limit)),
   hash_algorithm_(spooler_definition.hash_algorithm),
+  compression_algorithm_(spooler_definition.compression_algorithm),
   chunking_enabled_(spooler_definition.use_file_chunking),
   minimal_chunk_size_(spooler_definition.min_file_chunk_size),
   average_chunk_size_(spooler_definition.avg_file_chunk_size),
-  maximal_chunk_size_(spooler_definition.max_file_chunk_size)
+  maximal_chunk_size_(spooler_definition.max_file_chunk_size),
+  bulk_chunk_threshold_(spooler_definition.bulk_chunk_threshold),
+  chunk_detector_type_(spooler_definition.chunk_detector_type)
 {
   assert(io_dispatcher_ != NULL);
   assert(!chunking_enabled_ || minimal_chunk_size_ > 0);
@@ -42,18 +47,33 @@ FileProcessor::~FileProcessor() {
 }
 
 
+ChunkDetector *FileProcessor::CreateChunkDetector() const {
+  switch (chunk_detector_type_) {
+    case SpoolerDefinition::Gear:
+      return new GearDetector(minimal_chunk_size_,
+                              average_chunk_size_,
+                              maximal_chunk_size_);
+    case SpoolerDefinition::Xor32:
+    default:
+      return new Xor32Detector(minimal_chunk_size_,
+                               average_chunk_size_,
+                               maximal_chunk_size_);
+  }
+}
+
+
 void FileProcessor::Process(const std::string   &local_path,
                             const bool           allow_chunking,
                             const shash::Suffix  hash_suffix) {
   ChunkDetector *chunk_detector = (chunking_enabled_ && allow_chunking)
-                                        ? new Xor32Detector(minimal_chunk_size_,
-                                                            average_chunk_size_,
-                                                            maximal_chunk_size_)
+                                        ? CreateChunkDetector()
                                         : NULL;
   File *file = new File(local_path,
                         io_dispatcher_,
                         chunk_detector,
                         hash_algorithm_,
+                        compression_algorithm_,
+                        bulk_chunk_threshold_,
                         hash_suffix);
 
   LogCvmfs(kLogSpooler, kLogVerboseMsg, "Scheduling '%s' for processing ("
@@ -68,8 +88,9 @@ void FileProcessor::Process(const std::string   &local_path,
 void FileProcessor::FileDone(File *file) {
   assert(file != NULL);
   assert(!file->path().empty());
-  assert(file->bulk_chunk() != NULL);
-  assert(!file->bulk_chunk()->content_hash().IsNull());
+  assert(file->HasBulkChunk() || file->chunks().size() > 1);
+  assert(!file->HasBulkChunk() ||
+         !file->bulk_chunk()->content_hash().IsNull());
 
   // extract crucial information from the Chunk structures and wrap them into
   // the global FileChunk data structure
@@ -86,11 +107,17 @@ void FileProcessor::FileDone(File *file) {
                                         current_chunk->size()));
   }
 
+  // files above the bulk chunk threshold are only described by their chunks
+  // and have no content hash of their own
+  const shash::Any content_hash = file->HasBulkChunk()
+                                    ? file->bulk_chunk()->content_hash()
+                                    : shash::Any();
+
   LogCvmfs(kLogSpooler, kLogVerboseMsg, "File '%s' processed completely",
            file->path().c_str());
   NotifyListeners(SpoolerResult(0,
                                 file->path(),
-                                file->bulk_chunk()->content_hash(),
+                                content_hash,
                                 resulting_chunks));
 }
 
@@ -7,7 +7,9 @@
 
 #include <string>
 
+#include "../compression.h"
 #include "../hash.h"
+#include "../upload_spooler_definition.h"
 #include "../upload_spooler_result.h"
 #include "../util.h"
 #include "../util_concurrency.h"
@@ -61,9 +63,9 @@ namespace upload {
 
 
 class AbstractUploader;
+class ChunkDetector;
 class IoDispatcher;
 class File;
-class SpoolerDefinition;
 
 /**
  * This is the outer most wrapper class that should be used by the Spooler.
@@ -89,13 +91,19 @@ class FileProcessor : public Observable<SpoolerResult> {
   void FileDone(File *file);
 
  private:
+  ChunkDetector *CreateChunkDetector() const;
+
   IoDispatcher  *io_dispatcher_;
 
   shash::Algorithms  hash_algorithm_;
+  zlib::Algorithms   compression_algorithm_;
   const bool         chunking_enabled_;
   const size_t       minimal_chunk_size_;
   const size_t       average_chunk_size_;
   const size_t       maximal_chunk_size_;
+  const size_t       bulk_chunk_threshold_;
+
+  const SpoolerDefinition::ChunkDetectorType chunk_detector_type_;
 };
 
 }  // namespace upload
@@ -25,6 +25,18 @@ void IoDispatcher::ScheduleWrite(Chunk       *chunk,
   assert(buffer != NULL);
   assert(buffer->IsInitialized());
 
+  // Back off while the pipeline is over its memory limit.  This only waits for
+  // uploads in flight, since those free their buffers without further help.
+  while (buffer_pool_.IsOverLimit()) {
+    const uint64_t release_count = buffer_pool_.release_count();
+    if (!buffer_pool_.IsOverLimit() || (writes_in_flight_ == 0))
+      break;
+    buffer_pool_.WaitForRelease(release_count);
+  }
+  if (delete_buffer) {
+    ++writes_in_flight_;
+  }
+
   // Initialize a streamed upload in the AbstractUploader implementation if it
   // has not been done before for this Chunk.
   if (!chunk->HasUploadStreamHandle()) {
@@ -78,7 +90,8 @@ void IoDispatcher::BufferUploadCompleteCallback(
 
   chunk->add_bytes_written(buffer->used_bytes());
   if (delete_buffer) {
-    delete buffer;
+    --writes_in_flight_;
+    buffer_pool_.Release(buffer);
   }
 }
 
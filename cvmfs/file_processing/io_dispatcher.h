@@ -15,9 +15,11 @@
 
 #include <list>
 
+#include "../logging.h"
 #include "../upload_facility.h"
 #include "async_reader.h"
 #include "char_buffer.h"
+#include "char_buffer_pool.h"
 #include "file.h"
 #include "processor.h"
 
@@ -46,6 +48,12 @@ class FileProcessor;
  *       IoDispatcher itself. If this thread gets blocked by the Uploader for an
  *       extended period of time it might affect the performance of the file
  *       processing as well.
+ *
+ * All CharBuffers of the pipeline (read-in and compression results) are drawn
+ * from the IoDispatcher's CharBufferPool.  If the pool has a memory limit, both
+ * the Reader and ScheduleWrite() back off while the limit is exceeded: the
+ * former until processing caught up, the latter until the Uploader finished
+ * some of the pending writes.
  */
 class IoDispatcher {
  protected:
@@ -122,14 +130,23 @@ class IoDispatcher {
   IoDispatcher(AbstractUploader    *uploader,
                FileProcessor       *file_processor,
                const unsigned int   number_of_threads,
+               const bool           use_io_uring = false,
+               const uint64_t       memory_limit = 0,
                const size_t         max_read_buffer_size = 512 * 1024) :
     max_read_buffer_size_(max_read_buffer_size),
-    reader_(max_read_buffer_size_, number_of_threads * 10),
+    buffer_pool_(memory_limit),
+    reader_(max_read_buffer_size_, number_of_threads * 10, use_io_uring,
+            &buffer_pool_),
     uploader_(uploader),
     file_processor_(file_processor)
   {
     chunks_in_flight_  = 0;
     file_count_        = 0;
+    writes_in_flight_  = 0;
+    if (use_io_uring && !reader_.UsesIoUring()) {
+      LogCvmfs(kLogSpooler, kLogStderr, "io_uring not available, falling "
+                                        "back to blocking reads");
+    }
     reader_.Initialize();
     const bool mutex_inits_successful = (
       pthread_mutex_init(&processing_done_mutex_,    NULL) == 0 &&
@@ -142,6 +159,9 @@ class IoDispatcher {
 
     reader_.TearDown();
 
+    LogCvmfs(kLogSpooler, kLogVerboseMsg, "CharBuffer pool statistics:\n%s",
+             buffer_pool_.GetStatistics().Print().c_str());
+
     pthread_mutex_destroy(&processing_done_mutex_);
     pthread_cond_destroy(&processing_done_condition_);
   }
@@ -173,6 +193,10 @@ class IoDispatcher {
 
   void CommitFile(File *file);
 
+  CharBufferPool::Statistics GetBufferPoolStatistics() const {
+    return buffer_pool_.GetStatistics();
+  }
+
  protected:
   friend class Chunk;
   friend class File;
@@ -201,6 +225,8 @@ class IoDispatcher {
     ++chunks_in_flight_;
   }
 
+  CharBufferPool* buffer_pool() { return &buffer_pool_; }
+
   void ChunkUploadCompleteCallback(const UploaderResults &results,
                                    Chunk* chunk);
   void BufferUploadCompleteCallback(const UploaderResults      &results,
@@ -212,11 +238,20 @@ class IoDispatcher {
    */
   const size_t max_read_buffer_size_;
 
+  /**
+   * Source of all CharBuffers in the pipeline (must outlive the Reader)
+   */
+  CharBufferPool buffer_pool_;
+
   /**
    * Number of Chunks currently in processing
    */
   tbb::atomic<unsigned int> chunks_in_flight_;
   tbb::atomic<unsigned int> file_count_;  ///< overall number of processed files
+  /**
+   * Scheduled uploads of CharBuffers that are released after the upload
+   */
+  tbb::atomic<unsigned int> writes_in_flight_;
 
   pthread_mutex_t processing_done_mutex_;
   pthread_cond_t processing_done_condition_;
@@ -0,0 +1,262 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "io_uring.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
+
+#include "../logging.h"
+
+// Older C libraries do not know the system call numbers yet; they are the same
+// on all architectures but alpha
+#ifdef HAVE_LINUX_IO_URING_H
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+#endif
+
+namespace upload {
+
+IoUring::IoUring()
+  : ring_fd_(-1)
+  , queue_depth_(0)
+  , in_flight_(0)
+  , to_submit_(0)
+  , sq_ring_(MAP_FAILED)
+  , sq_ring_size_(0)
+  , cq_ring_(MAP_FAILED)
+  , cq_ring_size_(0)
+  , sqes_(MAP_FAILED)
+  , sqes_size_(0)
+  , sq_head_(NULL)
+  , sq_tail_(NULL)
+  , sq_mask_(NULL)
+  , sq_array_(NULL)
+  , cq_head_(NULL)
+  , cq_tail_(NULL)
+  , cq_mask_(NULL)
+  , cqes_(NULL)
+{ }
+
+
+IoUring::~IoUring() {
+  if (sqes_ != MAP_FAILED)
+    munmap(sqes_, sqes_size_);
+  if ((cq_ring_ != MAP_FAILED) && (cq_ring_ != sq_ring_))
+    munmap(cq_ring_, cq_ring_size_);
+  if (sq_ring_ != MAP_FAILED)
+    munmap(sq_ring_, sq_ring_size_);
+  if (ring_fd_ >= 0)
+    close(ring_fd_);
+}
+
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+IoUring *IoUring::Create(const unsigned queue_depth) {
+  assert(queue_depth > 0);
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  const int fd = syscall(__NR_io_uring_setup, queue_depth, &params);
+  if (fd < 0) {
+    LogCvmfs(kLogSpooler, kLogDebug, "io_uring not available (%d)", errno);
+    return NULL;
+  }
+
+  IoUring *ring = new IoUring();
+  ring->ring_fd_ = fd;
+  ring->queue_depth_ = params.sq_entries;
+
+  ring->sq_ring_size_ = params.sq_off.array +
+                        params.sq_entries * sizeof(unsigned);
+  ring->cq_ring_size_ = params.cq_off.cqes +
+                        params.cq_entries * sizeof(struct io_uring_cqe);
+  bool single_mmap = false;
+#ifdef IORING_FEAT_SINGLE_MMAP
+  single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+#endif
+  if (single_mmap) {
+    if (ring->cq_ring_size_ > ring->sq_ring_size_)
+      ring->sq_ring_size_ = ring->cq_ring_size_;
+    ring->cq_ring_size_ = ring->sq_ring_size_;
+  }
+
+  ring->sq_ring_ = mmap(NULL, ring->sq_ring_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (ring->sq_ring_ == MAP_FAILED) {
+    delete ring;
+    return NULL;
+  }
+  if (single_mmap) {
+    ring->cq_ring_ = ring->sq_ring_;
+  } else {
+    ring->cq_ring_ = mmap(NULL, ring->cq_ring_size_, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (ring->cq_ring_ == MAP_FAILED) {
+      delete ring;
+      return NULL;
+    }
+  }
+  ring->sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes_ = mmap(NULL, ring->sqes_size_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (ring->sqes_ == MAP_FAILED) {
+    delete ring;
+    return NULL;
+  }
+
+  char *sq = static_cast<char *>(ring->sq_ring_);
+  char *cq = static_cast<char *>(ring->cq_ring_);
+  ring->sq_head_  = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+  ring->sq_tail_  = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  ring->sq_mask_  = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  ring->sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  ring->cq_head_  = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  ring->cq_tail_  = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  ring->cq_mask_  = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  ring->cqes_     = cq + params.cq_off.cqes;
+
+  LogCvmfs(kLogSpooler, kLogDebug, "io_uring set up with %u entries",
+           ring->queue_depth_);
+  return ring;
+}
+
+
+bool IoUring::PrepareRead(const int fd, struct iovec *iov, const off_t offset,
+                          void *tag)
+{
+  // Limiting the reads in flight to the submission queue size guarantees that
+  // the (twice as large) completion queue never overflows
+  if (in_flight_ >= queue_depth_)
+    return false;
+
+  const unsigned tail = *sq_tail_;
+  const unsigned index = tail & *sq_mask_;
+  struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe *>(sqes_) + index;
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode    = IORING_OP_READV;
+  sqe->fd        = fd;
+  sqe->off       = offset;
+  sqe->addr      = reinterpret_cast<uintptr_t>(iov);
+  sqe->len       = 1;
+  sqe->user_data = reinterpret_cast<uintptr_t>(tag);
+  sq_array_[index] = index;
+
+  // the kernel must see the filled entry before the new tail
+  __sync_synchronize();
+  *sq_tail_ = tail + 1;
+  __sync_synchronize();
+
+  ++in_flight_;
+  ++to_submit_;
+  return true;
+}
+
+
+int IoUring::Enter(const unsigned to_submit, const unsigned min_complete,
+                   const unsigned flags)
+{
+  int retval;
+  do {
+    retval = syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete,
+                     flags, NULL, 0);
+  } while ((retval < 0) && (errno == EINTR));
+  return retval;
+}
+
+
+bool IoUring::Submit() {
+  while (to_submit_ > 0) {
+    const int retval = Enter(to_submit_, 0, 0);
+    if (retval < 0) {
+      LogCvmfs(kLogSpooler, kLogStderr, "io_uring submission failed (%d)",
+               errno);
+      return false;
+    }
+    to_submit_ -= retval;
+  }
+  return true;
+}
+
+
+bool IoUring::Reap(const bool wait, void **tag, int *result) {
+  while (true) {
+    const unsigned head = *cq_head_;
+    __sync_synchronize();
+    if (head != *cq_tail_) {
+      __sync_synchronize();
+      const struct io_uring_cqe *cqe =
+        static_cast<struct io_uring_cqe *>(cqes_) + (head & *cq_mask_);
+      *tag    = reinterpret_cast<void *>(static_cast<uintptr_t>(
+                                           cqe->user_data));
+      *result = cqe->res;
+      __sync_synchronize();
+      *cq_head_ = head + 1;
+      --in_flight_;
+      return true;
+    }
+
+    if (!wait)
+      return false;
+    assert(in_flight_ > 0);
+    if (Enter(0, 1, IORING_ENTER_GETEVENTS) < 0) {
+      LogCvmfs(kLogSpooler, kLogStderr, "waiting for io_uring failed (%d)",
+               errno);
+      abort();
+    }
+  }
+}
+
+#else  // HAVE_LINUX_IO_URING_H
+
+IoUring *IoUring::Create(const unsigned queue_depth) {
+  return NULL;
+}
+
+bool IoUring::PrepareRead(const int fd, struct iovec *iov, const off_t offset,
+                          void *tag)
+{
+  abort();
+}
+
+int IoUring::Enter(const unsigned to_submit, const unsigned min_complete,
+                   const unsigned flags)
+{
+  abort();
+}
+
+bool IoUring::Submit() {
+  abort();
+}
+
+bool IoUring::Reap(const bool wait, void **tag, int *result) {
+  abort();
+}
+
+#endif  // HAVE_LINUX_IO_URING_H
+
+
+bool IoUring::IsAvailable() {
+  IoUring *ring = Create(1);
+  delete ring;
+  return ring != NULL;
+}
+
+}  // namespace upload
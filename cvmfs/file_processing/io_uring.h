@@ -0,0 +1,99 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_FILE_PROCESSING_IO_URING_H_
+#define CVMFS_FILE_PROCESSING_IO_URING_H_
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <cstddef>
+
+namespace upload {
+
+/**
+ * Minimal wrapper around a Linux io_uring submission/completion queue pair,
+ * used by the Reader to keep many reads of different files in flight from a
+ * single thread.  It talks to the kernel through the raw system calls, so no
+ * liburing is required.
+ *
+ * Without <linux/io_uring.h> at build time, or if the kernel refuses to set up
+ * a ring (too old, disabled by sysctl or seccomp), Create() returns NULL and
+ * the caller is expected to fall back to blocking reads.
+ *
+ * Not thread-safe; owned and driven by one thread.
+ */
+class IoUring {
+ public:
+  /**
+   * @param queue_depth  maximal number of reads in flight
+   * @return  a ready to use ring or NULL if io_uring is not available
+   */
+  static IoUring *Create(const unsigned queue_depth);
+  static bool IsAvailable();
+  ~IoUring();
+
+  /**
+   * Queues a read of the given iovec at offset.  The iovec must stay valid
+   * until the matching completion is reaped.  Nothing is passed to the kernel
+   * before Submit().
+   *
+   * @param tag  returned unchanged by the matching completion
+   * @return  false if the submission queue is full
+   */
+  bool PrepareRead(const int fd, struct iovec *iov, const off_t offset,
+                   void *tag);
+
+  /**
+   * Hands all prepared reads to the kernel.
+   * @return  false on error
+   */
+  bool Submit();
+
+  /**
+   * Reaps one completion.  Blocks until one is available if wait is true.
+   *
+   * @param tag     the tag given to PrepareRead()
+   * @param result  number of bytes read or -errno
+   * @return  false if no completion is available (only if !wait)
+   */
+  bool Reap(const bool wait, void **tag, int *result);
+
+  unsigned queue_depth() const { return queue_depth_; }
+  /** Prepared or submitted reads without reaped completion */
+  unsigned in_flight() const { return in_flight_; }
+
+ private:
+  IoUring();
+  IoUring(const IoUring &other);
+  IoUring& operator=(const IoUring &other);
+
+  int Enter(const unsigned to_submit, const unsigned min_complete,
+            const unsigned flags);
+
+  int ring_fd_;
+  unsigned queue_depth_;
+  unsigned in_flight_;
+  unsigned to_submit_;
+
+  void *sq_ring_;
+  size_t sq_ring_size_;
+  void *cq_ring_;
+  size_t cq_ring_size_;
+  void *sqes_;
+  size_t sqes_size_;
+
+  unsigned *sq_head_;
+  unsigned *sq_tail_;
+  unsigned *sq_mask_;
+  unsigned *sq_array_;
+  unsigned *cq_head_;
+  unsigned *cq_tail_;
+  unsigned *cq_mask_;
+  void *cqes_;
+};
+
+}  // namespace upload
+
+#endif  // CVMFS_FILE_PROCESSING_IO_URING_H_
@@ -75,19 +75,16 @@ tbb::task* ChunkProcessingTask::execute() {
 void ChunkProcessingTask::Crunch(const unsigned char  *data,
                                  const size_t          bytes,
                                  const bool            finalize) {
-  z_stream          &stream = chunk_->zlib_context();
+  zlib::Compressor  *compressor = chunk_->compressor();
   shash::ContextPtr &ch_ctx = chunk_->content_hash_context();
 
   // estimate how much space we are going to need approximately
-  const size_t max_output_size = deflateBound(&stream, bytes);
+  const size_t max_output_size = compressor->DeflateBound(bytes);
 
-  // state the input data in the zlib stream for the next compression step
-  stream.avail_in = bytes;
   // sry, but zlib forces me...
-  stream.next_in  = const_cast<unsigned char*>(data);
-  const int flush = (finalize) ? Z_FINISH : Z_NO_FLUSH;
+  unsigned char *input = const_cast<unsigned char*>(data);
+  size_t input_size = bytes;
 
-  int retcode = -1;
   while (true) {
     // obtain a destination CharBuffer for the compression results from the
     // currently processed Chunk.
@@ -95,34 +92,27 @@ void ChunkProcessingTask::Crunch(const unsigned char  *data,
     assert(compress_buffer != NULL);
     assert(compress_buffer->free_bytes() > 0);
 
-    // initialize the zlib stream with the characteristics of the output buffer
+    // do the compression step into the free space of the output buffer
     const CharBuffer::pointer_t output_start =
       compress_buffer->free_space_ptr();
     const size_t output_space = compress_buffer->free_bytes();
-    stream.avail_out = output_space;
-    stream.next_out = output_start;
-
-    // do the compression step
-    retcode = deflate(&stream, flush);
-    assert(retcode == Z_OK || retcode == Z_STREAM_END);
-
-    // check if zlib produced any bytes, update the used_bytes information in
-    // the compression buffer and update the running content hash with the fresh
-    // data
-    const size_t bytes_produced = output_space - stream.avail_out;
+    unsigned char *output = output_start;
+    size_t output_free = output_space;
+    const bool done = compressor->Deflate(finalize, &input, &input_size,
+                                          &output, &output_free);
+
+    // check if the compressor produced any bytes, update the used_bytes
+    // information in the compression buffer and update the running content
+    // hash with the fresh data
+    const size_t bytes_produced = output_space - output_free;
     compress_buffer->SetUsedBytes(
       compress_buffer->used_bytes() + bytes_produced);
     shash::Update(output_start, bytes_produced, ch_ctx);
 
     // check if the compression for the given input data has finished and stop
     // the compression loop
-    if ((flush == Z_NO_FLUSH && retcode == Z_OK && stream.avail_in == 0) ||
-        (flush == Z_FINISH   && retcode == Z_STREAM_END))
-    {
+    if (done)
       break;
-    }
-
-    assert(stream.avail_out == 0);
   }
 }
 
@@ -9,13 +9,17 @@
 #define CVMFS_FS_TRAVERSAL_H_
 
 #include <errno.h>
+#include <pthread.h>
 
 #include <cassert>
 #include <cstdlib>
 
+#include <deque>
 #include <set>
 #include <string>
+#include <vector>
 
+#include "atomic.h"
 #include "logging.h"
 #include "platform.h"
 #include "util.h"
@@ -31,6 +35,15 @@ namespace CVMFS_NAMESPACE_GUARD {
  *
  * Callbacks are called for every directory entry found by the recursion engine.
  * The recursion can be influenced by return values of these callbacks.
+ *
+ * With set_num_threads(), directories are read and stat'ed ahead of time by a
+ * pool of scanner threads that steal directories from each other.  The
+ * callbacks are still called from the thread that runs Recurse() and in the
+ * very same order as in the serial traversal, so delegates don't need to be
+ * thread-safe.  The exception is fn_ignore_file, which the scanners call
+ * concurrently.  The scanners read the entire tree below the start directory
+ * unless the delegate decides not to recurse into a directory before they
+ * reach it.  Don't use it if the callbacks modify the traversed tree.
  */
 template <class T>
 class FileSystemTraversal {
@@ -52,7 +65,8 @@ class FileSystemTraversal {
    * true then the file will not be processed (this is a replacement
    * for the ignored_files set, and it allows to ignore based on names
    * or something else). If the function is not specified, no files
-   * will be ignored (except for "." and "..").
+   * will be ignored (except for "." and "..").  In the parallel traversal,
+   * it is called by the scanner threads and has to be thread-safe.
    */
   BoolCallback fn_ignore_file;
 
@@ -91,11 +105,20 @@ class FileSystemTraversal {
     fn_new_dir_postfix(NULL),
     delegate_(delegate),
     relative_to_directory_(relative_to_directory),
-    recurse_(recurse)
+    recurse_(recurse),
+    num_threads_(0)
   {
     Init();
   }
 
+  /**
+   * Number of threads that read directories ahead of the callbacks.  Zero
+   * (the default) reads every directory only when it is entered.
+   */
+  void set_num_threads(const unsigned num_threads) {
+    num_threads_ = num_threads;
+  }
+
   /**
    * Start the recursion.
    * @param dir_path The directory to start the recursion at
@@ -111,16 +134,320 @@ class FileSystemTraversal {
            dir_path.substr(0, relative_to_directory_.length()) ==
              relative_to_directory_);
 
-    DoRecursion(dir_path, "");
+    if (num_threads_ == 0) {
+      DoRecursion(dir_path, "");
+      return;
+    }
+
+    ParallelScan scan(this, num_threads_);
+    DoRecursionParallel(&scan, dir_path, "", scan.Start(dir_path));
+    scan.Stop();
   }
 
  private:
+  enum EntryType {
+    kEntryDirectory,
+    kEntryRegular,
+    kEntrySymlink,
+    kEntryOther
+  };
+
+  struct Listing;
+  struct Entry {
+    std::string name;
+    EntryType type;
+    Listing *subdir;  /**< Only for directories if recursing */
+  };
+
+  /**
+   * The contents of a directory, filled by a scanner thread.  The entries
+   * ignored by fn_ignore_file are not listed.
+   */
+  struct Listing {
+    enum State {
+      kStatePending = 0,
+      kStateScanning,
+      kStateReady
+    };
+
+    explicit Listing(const std::string &p) : path(p), open_errno(0) {
+      atomic_init32(&state);
+      atomic_init32(&pruned);
+      atomic_init32(&refs);
+      atomic_write32(&refs, 2);
+    }
+
+    std::string path;
+    std::vector<Entry> entries;
+    int open_errno;
+    atomic_int32 state;
+    atomic_int32 pruned;  /**< The delegate skipped this directory */
+    /**
+     * One reference for the work queue until the listing is popped, one for
+     * the callback thread until the listing is consumed or discarded
+     */
+    atomic_int32 refs;
+  };
+
+  /**
+   * Directories that wait to be scanned.  The owning thread works on the back
+   * (depth first, like the callbacks), other threads steal from the front.
+   */
+  struct WorkQueue {
+    WorkQueue() { pthread_mutex_init(&lock, NULL); }
+    ~WorkQueue() { pthread_mutex_destroy(&lock); }
+    pthread_mutex_t lock;
+    std::deque<Listing *> listings;
+  };
+
+  class ParallelScan : SingleCopy {
+   public:
+    ParallelScan(const FileSystemTraversal *traversal,
+                 const unsigned num_threads)
+      : traversal_(traversal)
+      , stop_(false)
+      , threads_(num_threads)
+    {
+      atomic_init32(&num_queued_);
+      pthread_mutex_init(&lock_, NULL);
+      pthread_cond_init(&cond_work_, NULL);
+      pthread_cond_init(&cond_ready_, NULL);
+      // The last queue is filled by the thread running the callbacks
+      for (unsigned i = 0; i <= num_threads; ++i)
+        queues_.push_back(new WorkQueue());
+    }
+
+    ~ParallelScan() {
+      for (unsigned i = 0; i < queues_.size(); ++i) {
+        for (unsigned j = 0; j < queues_[i]->listings.size(); ++j)
+          Release(queues_[i]->listings[j]);
+        delete queues_[i];
+      }
+      pthread_cond_destroy(&cond_ready_);
+      pthread_cond_destroy(&cond_work_);
+      pthread_mutex_destroy(&lock_);
+    }
+
+    Listing *Start(const std::string &path) {
+      Listing *root = new Listing(path);
+      Push(threads_.size(), root);
+      for (unsigned i = 0; i < threads_.size(); ++i) {
+        ThreadInfo *info = new ThreadInfo(this, i);
+        int retval = pthread_create(&threads_[i], NULL, MainScan, info);
+        assert(retval == 0);
+      }
+      return root;
+    }
+
+    void Stop() {
+      pthread_mutex_lock(&lock_);
+      stop_ = true;
+      pthread_cond_broadcast(&cond_work_);
+      pthread_mutex_unlock(&lock_);
+      for (unsigned i = 0; i < threads_.size(); ++i)
+        pthread_join(threads_[i], NULL);
+    }
+
+    /**
+     * Returns the listing once it is scanned.  Scans it right away if no
+     * scanner thread got to it yet.
+     */
+    void Wait(Listing *listing) {
+      if (atomic_cas32(&listing->state, Listing::kStatePending,
+                       Listing::kStateScanning))
+      {
+        Scan(listing, threads_.size());
+        return;
+      }
+      pthread_mutex_lock(&lock_);
+      while (atomic_read32(&listing->state) != Listing::kStateReady)
+        pthread_cond_wait(&cond_ready_, &lock_);
+      pthread_mutex_unlock(&lock_);
+    }
+
+    /**
+     * Drops a directory that the delegate does not recurse into, together
+     * with the listings the scanners created below it in the meantime.
+     * Directories that are not scanned yet are not read anymore.
+     */
+    void Discard(Listing *listing) {
+      atomic_write32(&listing->pruned, 1);
+      Wait(listing);
+      for (unsigned i = 0; i < listing->entries.size(); ++i) {
+        if (listing->entries[i].subdir != NULL)
+          Discard(listing->entries[i].subdir);
+      }
+      Release(listing);
+    }
+
+    static void Release(Listing *listing) {
+      if (atomic_xadd32(&listing->refs, -1) == 1)
+        delete listing;
+    }
+
+   private:
+    struct ThreadInfo {
+      ThreadInfo(ParallelScan *s, const unsigned i) : scan(s), id(i) { }
+      ParallelScan *scan;
+      unsigned id;
+    };
+
+    static void *MainScan(void *data) {
+      ThreadInfo *info = reinterpret_cast<ThreadInfo *>(data);
+      ParallelScan *scan = info->scan;
+      const unsigned id = info->id;
+      delete info;
+
+      while (true) {
+        Listing *listing = scan->Pop(id);
+        if (listing != NULL) {
+          if (atomic_cas32(&listing->state, Listing::kStatePending,
+                           Listing::kStateScanning))
+          {
+            scan->Scan(listing, id);
+          }
+          Release(listing);
+          continue;
+        }
+
+        pthread_mutex_lock(&scan->lock_);
+        while (!scan->stop_ && (atomic_read32(&scan->num_queued_) == 0))
+          pthread_cond_wait(&scan->cond_work_, &scan->lock_);
+        const bool stop = scan->stop_;
+        pthread_mutex_unlock(&scan->lock_);
+        if (stop)
+          break;
+      }
+      return NULL;
+    }
+
+    void Push(const unsigned queue, Listing *listing) {
+      WorkQueue *q = queues_[queue];
+      pthread_mutex_lock(&q->lock);
+      q->listings.push_back(listing);
+      pthread_mutex_unlock(&q->lock);
+      atomic_inc32(&num_queued_);
+      pthread_mutex_lock(&lock_);
+      pthread_cond_signal(&cond_work_);
+      pthread_mutex_unlock(&lock_);
+    }
+
+    /**
+     * Takes the most recent directory from the own queue, otherwise steals the
+     * oldest one from another queue.
+     */
+    Listing *Pop(const unsigned queue) {
+      Listing *listing = NULL;
+      WorkQueue *q = queues_[queue];
+      pthread_mutex_lock(&q->lock);
+      if (!q->listings.empty()) {
+        listing = q->listings.back();
+        q->listings.pop_back();
+      }
+      pthread_mutex_unlock(&q->lock);
+
+      for (unsigned i = 1; (listing == NULL) && (i < queues_.size()); ++i) {
+        q = queues_[(queue + i) % queues_.size()];
+        pthread_mutex_lock(&q->lock);
+        if (!q->listings.empty()) {
+          listing = q->listings.front();
+          q->listings.pop_front();
+        }
+        pthread_mutex_unlock(&q->lock);
+      }
+
+      if (listing != NULL)
+        atomic_dec32(&num_queued_);
+      return listing;
+    }
+
+    /**
+     * Reads and stats a directory that was claimed by the calling thread.
+     * Sub directories are queued in the given queue.
+     */
+    void Scan(Listing *listing, const unsigned queue) {
+      if (atomic_read32(&listing->pruned)) {
+        LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "not scanning %s (skipped)",
+                 listing->path.c_str());
+        Ready(listing);
+        return;
+      }
+
+      DIR *dip = opendir(listing->path.c_str());
+      if (!dip) {
+        listing->open_errno = errno;
+        Ready(listing);
+        return;
+      }
+
+      std::vector<Listing *> subdirs;
+      platform_dirent64 *dit;
+      while ((dit = platform_readdir(dip)) != NULL) {
+        const std::string name(dit->d_name);
+        if (name == "." || name == "..")
+          continue;
+        if ((traversal_->fn_ignore_file != NULL) &&
+            traversal_->Notify(traversal_->fn_ignore_file, listing->path, name))
+        {
+          LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "ignoring %s/%s",
+                   listing->path.c_str(), name.c_str());
+          continue;
+        }
+
+        Entry entry;
+        entry.name = name;
+        entry.subdir = NULL;
+        platform_stat64 info;
+        int retval = platform_lstat((listing->path + "/" + name).c_str(),
+                                    &info);
+        assert(retval == 0);
+        if (S_ISDIR(info.st_mode)) {
+          entry.type = kEntryDirectory;
+          if (traversal_->recurse_) {
+            entry.subdir = new Listing(listing->path + "/" + name);
+            subdirs.push_back(entry.subdir);
+          }
+        } else if (S_ISREG(info.st_mode)) {
+          entry.type = kEntryRegular;
+        } else if (S_ISLNK(info.st_mode)) {
+          entry.type = kEntrySymlink;
+        } else {
+          entry.type = kEntryOther;
+        }
+        listing->entries.push_back(entry);
+      }
+      closedir(dip);
+      Ready(listing);
+
+      // The first sub directory ends up at the back of the queue
+      for (unsigned i = subdirs.size(); i > 0; --i)
+        Push(queue, subdirs[i - 1]);
+    }
+
+    void Ready(Listing *listing) {
+      pthread_mutex_lock(&lock_);
+      atomic_write32(&listing->state, Listing::kStateReady);
+      pthread_cond_broadcast(&cond_ready_);
+      pthread_mutex_unlock(&lock_);
+    }
+
+    const FileSystemTraversal *traversal_;
+    bool stop_;
+    std::vector<pthread_t> threads_;
+    std::vector<WorkQueue *> queues_;
+    atomic_int32 num_queued_;
+    pthread_mutex_t lock_;
+    pthread_cond_t cond_work_;
+    pthread_cond_t cond_ready_;
+  };
+
   // The delegate all hooks are called on
   T *delegate_;
 
   /** dir_path in callbacks will be relative to this directory */
   std::string relative_to_directory_;
   bool recurse_;
+  unsigned num_threads_;
 
 
   void Init() {
@@ -194,6 +521,64 @@ class FileSystemTraversal {
     Notify(fn_leave_dir, parent_path, dir_name);
   }
 
+  /**
+   * Same as DoRecursion() but works on the listings prepared by the scanner
+   * threads.
+   */
+  void DoRecursionParallel(ParallelScan *scan,
+                           const std::string &parent_path,
+                           const std::string &dir_name,
+                           Listing *listing) const
+  {
+    const std::string path = parent_path + ((!dir_name.empty()) ?
+                                           ("/" + dir_name) : "");
+
+    LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "entering %s (%s -- %s)",
+             path.c_str(), parent_path.c_str(), dir_name.c_str());
+    scan->Wait(listing);
+    if (listing->open_errno != 0) {
+      LogCvmfs(kLogFsTraversal, kLogStderr, "Failed to open %s (%d).\n"
+               "Please check directory permissions.",
+               path.c_str(), listing->open_errno);
+      abort();
+    }
+    Notify(fn_enter_dir, parent_path, dir_name);
+
+    for (unsigned i = 0; i < listing->entries.size(); ++i) {
+      const Entry &entry = listing->entries[i];
+      const char *name = entry.name.c_str();
+      switch (entry.type) {
+        case kEntryDirectory:
+          LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "passing directory %s/%s",
+                   path.c_str(), name);
+          if (Notify(fn_new_dir_prefix, path, entry.name) && recurse_) {
+            DoRecursionParallel(scan, path, entry.name, entry.subdir);
+          } else if (entry.subdir != NULL) {
+            scan->Discard(entry.subdir);
+          }
+          Notify(fn_new_dir_postfix, path, entry.name);
+          break;
+        case kEntryRegular:
+          LogCvmfs(kLogFsTraversal, kLogVerboseMsg,
+                   "passing regular file %s/%s", path.c_str(), name);
+          Notify(fn_new_file, path, entry.name);
+          break;
+        case kEntrySymlink:
+          LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "passing symlink %s/%s",
+                   path.c_str(), name);
+          Notify(fn_new_symlink, path, entry.name);
+          break;
+        default:
+          LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "unknown file type %s/%s",
+                   path.c_str(), name);
+      }
+    }
+    scan->Release(listing);
+
+    LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "leaving %s", path.c_str());
+    Notify(fn_leave_dir, parent_path, dir_name);
+  }
+
   inline bool Notify(const BoolCallback callback,
                      const std::string &parent_path,
                      const std::string &entry_name) const
@@ -10,7 +10,11 @@
 #include <openssl/ripemd.h>
 #include <openssl/sha.h>
 
+#include <algorithm>
 #include <cstdio>
+#include <vector>
+
+#include "hash_accel.h"
 
 using namespace std;  // NOLINT
 
@@ -121,6 +125,85 @@ void Init(ContextPtr context) {
   }
 }
 
+static inline void Sha1GetState(const SHA_CTX *ctx, uint32_t state[5]) {
+  state[0] = ctx->h0;
+  state[1] = ctx->h1;
+  state[2] = ctx->h2;
+  state[3] = ctx->h3;
+  state[4] = ctx->h4;
+}
+
+
+static inline void Sha1SetState(const uint32_t state[5], SHA_CTX *ctx) {
+  ctx->h0 = state[0];
+  ctx->h1 = state[1];
+  ctx->h2 = state[2];
+  ctx->h3 = state[3];
+  ctx->h4 = state[4];
+}
+
+
+/**
+ * Accounts for buffer_size new bytes in the SHA-1 context and completes the
+ * buffered partial block.  The trailing bytes of the buffer are buffered in
+ * the context.  Keeps the context compatible with the OpenSSL functions.
+ * Returns the number of whole blocks at *blocks that are left to process.
+ */
+static size_t Sha1Buffer(SHA_CTX *ctx,
+                         const unsigned char *buffer, size_t buffer_size,
+                         const unsigned char **blocks)
+{
+  const uint64_t num_bits =
+    ((static_cast<uint64_t>(ctx->Nh) << 32) | ctx->Nl) +
+    (static_cast<uint64_t>(buffer_size) << 3);
+  ctx->Nl = num_bits & 0xffffffff;
+  ctx->Nh = num_bits >> 32;
+
+  unsigned char *partial = reinterpret_cast<unsigned char *>(ctx->data);
+  if (ctx->num > 0) {
+    const size_t nbytes = std::min(buffer_size, size_t(SHA_CBLOCK - ctx->num));
+    memcpy(partial + ctx->num, buffer, nbytes);
+    ctx->num += nbytes;
+    buffer += nbytes;
+    buffer_size -= nbytes;
+    if (ctx->num < SHA_CBLOCK) {
+      *blocks = buffer;
+      return 0;
+    }
+    uint32_t state[5];
+    Sha1GetState(ctx, state);
+    accel::Sha1Blocks(state, partial, 1);
+    Sha1SetState(state, ctx);
+    ctx->num = 0;
+  }
+
+  const size_t num_blocks = buffer_size / SHA_CBLOCK;
+  const size_t tail = buffer_size % SHA_CBLOCK;
+  memcpy(partial, buffer + num_blocks * SHA_CBLOCK, tail);
+  ctx->num = tail;
+  *blocks = buffer;
+  return num_blocks;
+}
+
+
+/**
+ * SHA-1 with the SHA extensions of the CPU.  OpenSSL versions before 1.0.2
+ * don't use them.
+ */
+static void Sha1Update(SHA_CTX *ctx,
+                       const unsigned char *buffer, const size_t buffer_size)
+{
+  const unsigned char *blocks;
+  const size_t num_blocks = Sha1Buffer(ctx, buffer, buffer_size, &blocks);
+  if (num_blocks == 0)
+    return;
+  uint32_t state[5];
+  Sha1GetState(ctx, state);
+  accel::Sha1Blocks(state, blocks, num_blocks);
+  Sha1SetState(state, ctx);
+}
+
+
 void Update(const unsigned char *buffer, const unsigned buffer_length,
             ContextPtr context)
 {
@@ -132,8 +215,13 @@ void Update(const unsigned char *buffer, const unsigned buffer_length,
       break;
     case kSha1:
       assert(context.size == sizeof(SHA_CTX));
-      SHA1_Update(reinterpret_cast<SHA_CTX *>(context.buffer),
-                  buffer, buffer_length);
+      if (accel::GetCpuFeatures() & accel::kCpuSha) {
+        Sha1Update(reinterpret_cast<SHA_CTX *>(context.buffer),
+                   buffer, buffer_length);
+      } else {
+        SHA1_Update(reinterpret_cast<SHA_CTX *>(context.buffer),
+                    buffer, buffer_length);
+      }
       break;
     case kRmd160:
       assert(context.size == sizeof(RIPEMD160_CTX));
@@ -169,6 +257,108 @@ void Final(ContextPtr context, Any *any_digest) {
 }
 
 
+namespace {
+
+/**
+ * The whole blocks of a buffer in UpdateMulti() that wait for a free SIMD lane
+ */
+struct Sha1Job {
+  Sha1Job(SHA_CTX *c, const unsigned char *b, const size_t n)
+    : ctx(c), blocks(b), num_blocks(n)
+  {
+    Sha1GetState(c, state);
+  }
+  void Commit() { Sha1SetState(state, ctx); }
+
+  SHA_CTX *ctx;
+  uint32_t state[5];
+  const unsigned char *blocks;
+  size_t num_blocks;
+};
+
+}  // anonymous namespace
+
+
+void UpdateMulti(const unsigned char * const *buffers,
+                 const unsigned *buffer_sizes,
+                 ContextPtr *contexts,
+                 const unsigned num_contexts)
+{
+  const unsigned num_lanes = accel::Sha1Lanes();
+  const bool sha_extensions = accel::GetCpuFeatures() & accel::kCpuSha;
+  vector<Sha1Job> jobs;
+  for (unsigned i = 0; i < num_contexts; ++i) {
+    if ((contexts[i].algorithm != kSha1) || (num_lanes == 1)) {
+      Update(buffers[i], buffer_sizes[i], contexts[i]);
+      continue;
+    }
+    assert(contexts[i].size == sizeof(SHA_CTX));
+    SHA_CTX *ctx = reinterpret_cast<SHA_CTX *>(contexts[i].buffer);
+    const unsigned char *blocks;
+    const size_t num_blocks =
+      Sha1Buffer(ctx, buffers[i], buffer_sizes[i], &blocks);
+    if (num_blocks > 0)
+      jobs.push_back(Sha1Job(ctx, blocks, num_blocks));
+  }
+
+  // Every lane gets the next waiting job as soon as its job is finished.
+  // Lanes without a job hash a copy of another lane into a dummy state.
+  Sha1Job *lanes[8];
+  assert(num_lanes <= 8);
+  for (unsigned l = 0; l < num_lanes; ++l)
+    lanes[l] = NULL;
+  uint32_t dummy_state[5];
+  uint32_t *states[8];
+  const unsigned char *data[8];
+  unsigned next_job = 0;
+  while (true) {
+    unsigned num_busy = 0;
+    size_t num_blocks = 0;
+    Sha1Job *busy = NULL;
+    for (unsigned l = 0; l < num_lanes; ++l) {
+      if ((lanes[l] == NULL) && (next_job < jobs.size()))
+        lanes[l] = &jobs[next_job++];
+      if (lanes[l] == NULL)
+        continue;
+      busy = lanes[l];
+      num_blocks = (num_busy == 0) ?
+                   busy->num_blocks : std::min(num_blocks, busy->num_blocks);
+      num_busy++;
+    }
+    if (num_busy == 0)
+      break;
+    // Once the queue is drained, a few remaining streams are faster one after
+    // another than in mostly idle lanes
+    if ((num_busy == 1) || (sha_extensions && (2 * num_busy <= num_lanes))) {
+      for (unsigned l = 0; l < num_lanes; ++l) {
+        if (lanes[l] == NULL)
+          continue;
+        accel::Sha1Blocks(lanes[l]->state, lanes[l]->blocks,
+                          lanes[l]->num_blocks);
+        lanes[l]->Commit();
+      }
+      break;
+    }
+
+    for (unsigned l = 0; l < num_lanes; ++l) {
+      states[l] = (lanes[l] == NULL) ? dummy_state : lanes[l]->state;
+      data[l] = (lanes[l] == NULL) ? busy->blocks : lanes[l]->blocks;
+    }
+    accel::Sha1BlocksMulti(states, data, num_blocks);
+    for (unsigned l = 0; l < num_lanes; ++l) {
+      if (lanes[l] == NULL)
+        continue;
+      lanes[l]->blocks += num_blocks * SHA_CBLOCK;
+      lanes[l]->num_blocks -= num_blocks;
+      if (lanes[l]->num_blocks == 0) {
+        lanes[l]->Commit();
+        lanes[l] = NULL;
+      }
+    }
+  }
+}
+
+
 void HashMem(const unsigned char *buffer, const unsigned buffer_size,
              Any *any_digest)
 {
@@ -182,6 +372,33 @@ void HashMem(const unsigned char *buffer, const unsigned buffer_size,
 }
 
 
+void HashMemMulti(const unsigned char * const *buffers,
+                  const unsigned *buffer_sizes,
+                  const unsigned num_buffers,
+                  Any *any_digests)
+{
+  if (num_buffers == 0)
+    return;
+  vector<ContextPtr> contexts;
+  size_t storage_size = 0;
+  for (unsigned i = 0; i < num_buffers; ++i) {
+    contexts.push_back(ContextPtr(any_digests[i].algorithm));
+    storage_size += (contexts[i].size + 7) / 8;
+  }
+  // uint64_t for the alignment of the contexts
+  vector<uint64_t> storage(storage_size);
+  uint64_t *buffer = &storage[0];
+  for (unsigned i = 0; i < num_buffers; ++i) {
+    contexts[i].buffer = buffer;
+    buffer += (contexts[i].size + 7) / 8;
+    Init(contexts[i]);
+  }
+  UpdateMulti(buffers, buffer_sizes, &contexts[0], num_buffers);
+  for (unsigned i = 0; i < num_buffers; ++i)
+    Final(contexts[i], &any_digests[i]);
+}
+
+
 void Hmac(
   const string &key,
   const unsigned char *buffer,
@@ -411,8 +411,21 @@ void Init(ContextPtr context);
 void Update(const unsigned char *buffer, const unsigned buffer_size,
             ContextPtr context);
 void Final(ContextPtr context, Any *any_digest);
+/**
+ * Updates several independent contexts at once.  SHA-1 contexts are
+ * processed in lockstep in SIMD lanes if the CPU supports it, other
+ * algorithms one after another.
+ */
+void UpdateMulti(const unsigned char * const *buffers,
+                 const unsigned *buffer_sizes,
+                 ContextPtr *contexts,
+                 const unsigned num_contexts);
 void HashMem(const unsigned char *buffer, const unsigned buffer_size,
              Any *any_digest);
+void HashMemMulti(const unsigned char * const *buffers,
+                  const unsigned *buffer_sizes,
+                  const unsigned num_buffers,
+                  Any *any_digests);
 void Hmac(const std::string &key,
           const unsigned char *buffer, const unsigned buffer_size,
           Any *any_digest);
@@ -0,0 +1,384 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "hash_accel.h"
+
+#include <cstring>
+
+// The SHA intrinsics and the target attribute for them appeared in gcc 4.9
+#if defined(__x86_64__) && defined(__GNUC__) && \
+    ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9)))
+#define CVMFS_HASH_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+using namespace std;  // NOLINT
+
+#ifdef CVMFS_NAMESPACE_GUARD
+namespace CVMFS_NAMESPACE_GUARD {
+#endif
+
+namespace shash {
+namespace accel {
+
+static const uint32_t kSha1K[4] =
+  {0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6};
+
+/**
+ * -1 until the first call to GetCpuFeatures().  Concurrent detection is
+ * harmless, all threads come to the same result.
+ */
+static volatile int g_cpu_features = -1;
+
+
+unsigned DetectCpuFeatures() {
+  unsigned features = 0;
+#ifdef CVMFS_HASH_X86
+  unsigned eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return 0;
+  if (edx & (1 << 26))
+    features |= kCpuSse2;
+  const bool ssse3 = ecx & (1 << 9);
+  const bool sse41 = ecx & (1 << 19);
+  const bool osxsave = ecx & (1 << 27);
+  const bool avx = ecx & (1 << 28);
+
+  if (__get_cpuid_max(0, NULL) < 7)
+    return features;
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  if (osxsave && avx && (ebx & (1 << 5))) {
+    // The operating system has to preserve the ymm registers
+    unsigned xcr0_lo, xcr0_hi;
+    __asm__ __volatile__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 0x6) == 0x6)
+      features |= kCpuAvx2;
+  }
+  if (ssse3 && sse41 && (ebx & (1 << 29)))
+    features |= kCpuSha;
+#endif
+  return features;
+}
+
+
+unsigned GetCpuFeatures() {
+  if (g_cpu_features < 0)
+    g_cpu_features = DetectCpuFeatures();
+  return g_cpu_features;
+}
+
+
+void SetCpuFeatures(const unsigned features) {
+  g_cpu_features = features & DetectCpuFeatures();
+}
+
+
+string DescribeCpuFeatures(const unsigned features) {
+  string result;
+  if (features & kCpuSse2)
+    result += "sse2 ";
+  if (features & kCpuAvx2)
+    result += "avx2 ";
+  if (features & kCpuSha)
+    result += "sha ";
+  if (result.empty())
+    return "none";
+  result.erase(result.length() - 1);
+  return result;
+}
+
+
+//------------------------------------------------------------------------------
+
+
+static inline uint32_t Rotl(const uint32_t x, const unsigned n) {
+  return (x << n) | (x >> (32 - n));
+}
+
+
+static inline uint32_t LoadBe32(const unsigned char *p) {
+  return (static_cast<uint32_t>(p[0]) << 24) |
+         (static_cast<uint32_t>(p[1]) << 16) |
+         (static_cast<uint32_t>(p[2]) << 8) |
+          static_cast<uint32_t>(p[3]);
+}
+
+
+static void Sha1BlocksPortable(uint32_t state[5], const unsigned char *data,
+                               size_t num_blocks)
+{
+  for (; num_blocks > 0; --num_blocks, data += 64) {
+    uint32_t w[16];
+    for (unsigned t = 0; t < 16; ++t)
+      w[t] = LoadBe32(data + 4*t);
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3],
+             e = state[4];
+    for (unsigned t = 0; t < 80; ++t) {
+      if (t >= 16) {
+        w[t & 15] = Rotl(w[(t + 13) & 15] ^ w[(t + 8) & 15] ^
+                         w[(t + 2) & 15] ^ w[t & 15], 1);
+      }
+      uint32_t f;
+      if (t < 20)
+        f = d ^ (b & (c ^ d));
+      else if ((t >= 40) && (t < 60))
+        f = (b & c) | (d & (b | c));
+      else
+        f = b ^ c ^ d;
+      const uint32_t tmp = Rotl(a, 5) + f + e + kSha1K[t / 20] + w[t & 15];
+      e = d;
+      d = c;
+      c = Rotl(b, 30);
+      b = a;
+      a = tmp;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+  }
+}
+
+
+#ifdef CVMFS_HASH_X86
+
+/**
+ * Four rounds with the SHA extensions.  EC/EN alternate as the round input,
+ * M0 holds the current four message schedule words, M1-M3 the next ones.
+ */
+#define SHA1_NI_ROUNDS(G, EC, EN, M0, M1, M2, M3) \
+  EC = _mm_sha1nexte_epu32(EC, M0); \
+  EN = abcd; \
+  if ((G >= 3) && (G <= 18)) M1 = _mm_sha1msg2_epu32(M1, M0); \
+  abcd = _mm_sha1rnds4_epu32(abcd, EC, G / 5); \
+  if (G <= 16) M3 = _mm_sha1msg1_epu32(M3, M0); \
+  if (G <= 17) M2 = _mm_xor_si128(M2, M0);
+
+__attribute__((target("sha,sse4.1")))
+static void Sha1BlocksShaNi(uint32_t state[5], const unsigned char *data,
+                            size_t num_blocks)
+{
+  const __m128i kMask =
+    _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+  __m128i abcd = _mm_loadu_si128(reinterpret_cast<const __m128i *>(state));
+  abcd = _mm_shuffle_epi32(abcd, 0x1b);
+  __m128i e0 = _mm_set_epi32(state[4], 0, 0, 0);
+  __m128i e1;
+
+  for (; num_blocks > 0; --num_blocks, data += 64) {
+    const __m128i abcd_save = abcd;
+    const __m128i e0_save = e0;
+    __m128i m0, m1, m2, m3;
+
+    // Rounds 0-15 load the message block
+    m0 = _mm_shuffle_epi8(_mm_loadu_si128(
+      reinterpret_cast<const __m128i *>(data)), kMask);
+    e0 = _mm_add_epi32(e0, m0);
+    e1 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+    m1 = _mm_shuffle_epi8(_mm_loadu_si128(
+      reinterpret_cast<const __m128i *>(data + 16)), kMask);
+    e1 = _mm_sha1nexte_epu32(e1, m1);
+    e0 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+    m0 = _mm_sha1msg1_epu32(m0, m1);
+
+    m2 = _mm_shuffle_epi8(_mm_loadu_si128(
+      reinterpret_cast<const __m128i *>(data + 32)), kMask);
+    e0 = _mm_sha1nexte_epu32(e0, m2);
+    e1 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+    m1 = _mm_sha1msg1_epu32(m1, m2);
+    m0 = _mm_xor_si128(m0, m2);
+
+    m3 = _mm_shuffle_epi8(_mm_loadu_si128(
+      reinterpret_cast<const __m128i *>(data + 48)), kMask);
+    SHA1_NI_ROUNDS(3, e1, e0, m3, m0, m1, m2)
+
+    // Rounds 16-79 extend the message schedule
+    SHA1_NI_ROUNDS(4, e0, e1, m0, m1, m2, m3)
+    SHA1_NI_ROUNDS(5, e1, e0, m1, m2, m3, m0)
+    SHA1_NI_ROUNDS(6, e0, e1, m2, m3, m0, m1)
+    SHA1_NI_ROUNDS(7, e1, e0, m3, m0, m1, m2)
+    SHA1_NI_ROUNDS(8, e0, e1, m0, m1, m2, m3)
+    SHA1_NI_ROUNDS(9, e1, e0, m1, m2, m3, m0)
+    SHA1_NI_ROUNDS(10, e0, e1, m2, m3, m0, m1)
+    SHA1_NI_ROUNDS(11, e1, e0, m3, m0, m1, m2)
+    SHA1_NI_ROUNDS(12, e0, e1, m0, m1, m2, m3)
+    SHA1_NI_ROUNDS(13, e1, e0, m1, m2, m3, m0)
+    SHA1_NI_ROUNDS(14, e0, e1, m2, m3, m0, m1)
+    SHA1_NI_ROUNDS(15, e1, e0, m3, m0, m1, m2)
+    SHA1_NI_ROUNDS(16, e0, e1, m0, m1, m2, m3)
+    SHA1_NI_ROUNDS(17, e1, e0, m1, m2, m3, m0)
+    SHA1_NI_ROUNDS(18, e0, e1, m2, m3, m0, m1)
+    SHA1_NI_ROUNDS(19, e1, e0, m3, m0, m1, m2)
+
+    e0 = _mm_sha1nexte_epu32(e0, e0_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+  }
+
+  abcd = _mm_shuffle_epi32(abcd, 0x1b);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(state), abcd);
+  state[4] = _mm_extract_epi32(e0, 3);
+}
+
+#undef SHA1_NI_ROUNDS
+
+
+typedef uint32_t Vec4 __attribute__((vector_size(16)));
+typedef uint32_t Vec8 __attribute__((vector_size(32)));
+
+// A macro rather than a function, vectors are not passed by value (ABI)
+#define ROTL_LANES(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+/**
+ * Fully unrolled, so that the message schedule stays in registers and the
+ * round function is resolved at compile time.
+ */
+#define SHA1_LANES_ROUND(t) { \
+    if ((t) >= 16) { \
+      w[(t) & 15] = ROTL_LANES(w[((t) + 13) & 15] ^ w[((t) + 8) & 15] ^ \
+                               w[((t) + 2) & 15] ^ w[(t) & 15], 1); \
+    } \
+    const VecT f = ((t) < 20) ? (d ^ (b & (c ^ d))) : \
+      ((((t) >= 40) && ((t) < 60)) ? ((b & c) | (d & (b | c))) : \
+                                     (b ^ c ^ d)); \
+    const VecT tmp = \
+      ROTL_LANES(a, 5) + f + e + kSha1K[(t) / 20] + w[(t) & 15]; \
+    e = d; \
+    d = c; \
+    c = ROTL_LANES(b, 30); \
+    b = a; \
+    a = tmp; \
+  }
+#define SHA1_LANES_ROUNDS4(t) \
+  SHA1_LANES_ROUND(t) SHA1_LANES_ROUND(t + 1) \
+  SHA1_LANES_ROUND(t + 2) SHA1_LANES_ROUND(t + 3)
+#define SHA1_LANES_ROUNDS20(t) \
+  SHA1_LANES_ROUNDS4(t) SHA1_LANES_ROUNDS4(t + 4) SHA1_LANES_ROUNDS4(t + 8) \
+  SHA1_LANES_ROUNDS4(t + 12) SHA1_LANES_ROUNDS4(t + 16)
+
+/**
+ * The portable block function on vectors of NLanes streams.  Compiled for
+ * the instruction set of the calling function.
+ */
+template <typename VecT, unsigned NLanes>
+static inline __attribute__((always_inline))
+void Sha1BlocksLanes(uint32_t *states[], const unsigned char *data[],
+                     const size_t num_blocks)
+{
+  VecT a, b, c, d, e;
+  for (unsigned l = 0; l < NLanes; ++l) {
+    a[l] = states[l][0];
+    b[l] = states[l][1];
+    c[l] = states[l][2];
+    d[l] = states[l][3];
+    e[l] = states[l][4];
+  }
+
+  for (size_t offset = 0; offset < 64 * num_blocks; offset += 64) {
+    VecT w[16];
+    for (unsigned t = 0; t < 16; ++t) {
+      for (unsigned l = 0; l < NLanes; ++l)
+        w[t][l] = LoadBe32(data[l] + offset + 4*t);
+    }
+
+    const VecT a_save = a, b_save = b, c_save = c, d_save = d, e_save = e;
+    SHA1_LANES_ROUNDS20(0)
+    SHA1_LANES_ROUNDS20(20)
+    SHA1_LANES_ROUNDS20(40)
+    SHA1_LANES_ROUNDS20(60)
+    a += a_save;
+    b += b_save;
+    c += c_save;
+    d += d_save;
+    e += e_save;
+  }
+
+  for (unsigned l = 0; l < NLanes; ++l) {
+    states[l][0] = a[l];
+    states[l][1] = b[l];
+    states[l][2] = c[l];
+    states[l][3] = d[l];
+    states[l][4] = e[l];
+  }
+}
+
+
+static void Sha1BlocksSse2(uint32_t *states[], const unsigned char *data[],
+                           const size_t num_blocks)
+{
+  Sha1BlocksLanes<Vec4, 4>(states, data, num_blocks);
+}
+
+
+__attribute__((target("avx2")))
+static void Sha1BlocksAvx2(uint32_t *states[], const unsigned char *data[],
+                           const size_t num_blocks)
+{
+  Sha1BlocksLanes<Vec8, 8>(states, data, num_blocks);
+}
+
+#undef SHA1_LANES_ROUNDS20
+#undef SHA1_LANES_ROUNDS4
+#undef SHA1_LANES_ROUND
+#undef ROTL_LANES
+
+#endif  // CVMFS_HASH_X86
+
+
+//------------------------------------------------------------------------------
+
+
+void Sha1Blocks(uint32_t state[5], const unsigned char *data,
+                const size_t num_blocks)
+{
+#ifdef CVMFS_HASH_X86
+  if (GetCpuFeatures() & kCpuSha) {
+    Sha1BlocksShaNi(state, data, num_blocks);
+    return;
+  }
+#endif
+  Sha1BlocksPortable(state, data, num_blocks);
+}
+
+
+unsigned Sha1Lanes() {
+  const unsigned features = GetCpuFeatures();
+  if (features & kCpuAvx2)
+    return 8;
+  if (features & kCpuSse2)
+    return 4;
+  return 1;
+}
+
+
+void Sha1BlocksMulti(uint32_t *states[], const unsigned char *data[],
+                     const size_t num_blocks)
+{
+  switch (Sha1Lanes()) {
+#ifdef CVMFS_HASH_X86
+    case 8:
+      Sha1BlocksAvx2(states, data, num_blocks);
+      break;
+    case 4:
+      Sha1BlocksSse2(states, data, num_blocks);
+      break;
+#endif
+    default:
+      Sha1Blocks(states[0], data[0], num_blocks);
+  }
+}
+
+}  // namespace accel
+}  // namespace shash
+
+#ifdef CVMFS_NAMESPACE_GUARD
+}  // namespace CVMFS_NAMESPACE_GUARD
+#endif
@@ -0,0 +1,75 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * SIMD implementations of the SHA-1 block function, selected at runtime
+ * according to the features of the CPU.  Only used by hash.cc.
+ *
+ * On x86_64 CPUs with the SHA extensions, single streams are hashed with the
+ * dedicated SHA-1 instructions.  Independent streams can be hashed in
+ * lockstep in the lanes of SSE2 (4 streams) or AVX2 (8 streams) registers.
+ * Without compiler support (gcc < 4.9, non-x86), everything falls back to a
+ * portable implementation.
+ */
+
+#ifndef CVMFS_HASH_ACCEL_H_
+#define CVMFS_HASH_ACCEL_H_
+
+#include <stdint.h>
+
+#include <cstddef>
+#include <string>
+
+#ifdef CVMFS_NAMESPACE_GUARD
+namespace CVMFS_NAMESPACE_GUARD {
+#endif
+
+namespace shash {
+namespace accel {
+
+enum CpuFeatures {
+  kCpuSse2 = 0x01,
+  kCpuAvx2 = 0x02,
+  kCpuSha  = 0x04,
+};
+
+/**
+ * The CPU features that are supported by the processor, the operating system
+ * and the compiler used to build cvmfs.
+ */
+unsigned DetectCpuFeatures();
+/**
+ * The CPU features currently used for hashing.  Detected on first use.
+ */
+unsigned GetCpuFeatures();
+/**
+ * Restricts the used CPU features to a subset of the detected ones, so that
+ * benchmark_hash and the unit tests can compare the code paths.  Not
+ * thread-safe with respect to running hashes.
+ */
+void SetCpuFeatures(const unsigned features);
+std::string DescribeCpuFeatures(const unsigned features);
+
+/**
+ * Processes num_blocks consecutive 64 byte blocks into the SHA-1 state
+ * (h0 ... h4).
+ */
+void Sha1Blocks(uint32_t state[5], const unsigned char *data,
+                const size_t num_blocks);
+/**
+ * The number of streams that are processed at once by Sha1BlocksMulti().
+ */
+unsigned Sha1Lanes();
+/**
+ * Processes num_blocks blocks of Sha1Lanes() independent streams.
+ */
+void Sha1BlocksMulti(uint32_t *states[], const unsigned char *data[],
+                     const size_t num_blocks);
+
+}  // namespace accel
+}  // namespace shash
+
+#ifdef CVMFS_NAMESPACE_GUARD
+}  // namespace CVMFS_NAMESPACE_GUARD
+#endif
+
+#endif  // CVMFS_HASH_ACCEL_H_
@@ -571,6 +571,14 @@ int cvmfs_context::Open(const char *c_path) {
     return -ENOENT;
   }
 
+  // libcvmfs reads files only through their bulk object, which is missing for
+  // large chunked files published with swissknife sync -B
+  if (dirent.IsChunkedFile() && dirent.checksum().IsNull()) {
+    LogCvmfs(kLogCvmfs, kLogDebug | kLogSyslogErr,
+             "cannot open %s: chunked file without bulk object", c_path);
+    return -ENOTSUP;
+  }
+
   const bool volatile_content = false;
   fd = cache::FetchDirent(dirent, string(path.GetChars(), path.GetLength()),
                           volatile_content, download_manager_);
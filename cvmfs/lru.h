@@ -662,6 +662,33 @@ class LruCache : SingleCopy {
     return found;
   }
 
+  /**
+   * Removes the least recently used entry and hands it to the caller.  Used by
+   * caches that need to release resources attached to their values.
+   * @param key (out) the key of the removed entry
+   * @param value (out) the value of the removed entry
+   * @return false if the cache is empty, true otherwise
+   */
+  bool PopOldest(Key *key, Value *value) {
+    this->Lock();
+    if (this->IsEmpty()) {
+      this->Unlock();
+      return false;
+    }
+
+    atomic_inc64(&statistics_.num_replace);
+    *key = lru_list_.PopFront();
+    CacheEntry entry;
+    const bool found = this->DoLookup(*key, &entry);
+    assert(found);
+    *value = entry.value;
+    cache_.Erase(*key);
+    --cache_gauge_;
+
+    this->Unlock();
+    return true;
+  }
+
   /**
    * Clears all elements from the cache.
    * All memory of internal data structures will be freed but data of
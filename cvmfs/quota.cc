@@ -22,6 +22,8 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdint.h>
@@ -36,6 +38,7 @@
 #include <cstdlib>
 #include <cstring>
 
+#include <algorithm>
 #include <map>
 #include <set>
 #include <string>
@@ -47,17 +50,25 @@
 #include "logging.h"
 #include "monitor.h"
 #include "platform.h"
+#include "quota_journal.h"
 #include "smalloc.h"
 #include "util.h"
+#include "util_concurrency.h"
 
 using namespace std;  // NOLINT
 
 namespace quota {
 
-const uint32_t kProtocolRevision = 1;  // Start of keeping revisions
+/**
+ * Revision 1: start of keeping revisions
+ * Revision 2: kRebuildProgress
+ */
+const uint32_t kProtocolRevision = 2;
 const uint64_t kVolatileFlag = 1ULL << 63;
 
 static void GetLimits(uint64_t *limit, uint64_t *cleanup_threshold);
+static void UpdateRebuildEstimate();
+static void FinishRebuild();
 
 /**
  * Loaded catalogs are pinned in the LRU and have to be treated differently.
@@ -86,6 +97,8 @@ enum CommandType {
   kUnregisterBackChannel,
   kGetProtocolRevision,
   kInsertVolatile,
+  kRebuildProgress,
+  kRebuildDone,  // Only sent by the background rebuild to its cache manager
 };
 
 /**
@@ -135,6 +148,20 @@ struct LruCommand {
   }
 };
 
+/**
+ * A file found in the cache directory when rebuilding the cache catalog.
+ */
+struct CacheFile {
+  CacheFile(const shash::Any &h, const uint64_t s, const time_t a)
+    : hash(h), size(s), atime(a) { }
+  bool operator <(const CacheFile &other) const {
+    return atime < other.atime;
+  }
+  shash::Any hash;
+  uint64_t size;
+  time_t atime;
+};
+
 /**
  * Maximum page cache per thread (Bytes).
  */
@@ -145,6 +172,30 @@ const unsigned kMaxCvmfsPath = 512-sizeof(LruCommand);
 // Alarm when more than 75% of the cache fraction allowed for pinned files (50%)
 // is filled with pinned files
 const unsigned kHighPinWatermark = 75;
+/**
+ * Number of buffered touches.  The flusher is woken up early when the ring is
+ * half full.
+ */
+const unsigned kTouchRingSize = 8192;
+/**
+ * Touches are sent in bunches that fit into a single, atomic pipe write.
+ */
+const unsigned kTouchBunchSize = PIPE_BUF / sizeof(LruCommand);
+/**
+ * Number of threads scanning the cache directories on rebuild.  On a cold
+ * cache, the stat calls wait for the disk, so more threads than cores help.
+ */
+const unsigned kRebuildThreads = 8;
+/**
+ * Rows per transaction when rebuilding the SQLite cache catalog.
+ */
+const unsigned kRebuildTransactionSize = 64 * 1024;
+/**
+ * During a background rebuild, new entries start at this sequence number.
+ * The scanned files are merged later with the sequence numbers below, so
+ * that they are evicted first.
+ */
+const uint64_t kRebuildSeqOffset = 1ULL << 40;
 
 pthread_t thread_lru_;
 int pipe_lru_[2];
@@ -155,6 +206,17 @@ map<shash::Any, uint64_t> *pinned_chunks_ = NULL;
 int fd_lock_cachedb_;
 uint32_t protocol_revision_ = 0;
 
+/**
+ * Maximum delay of a buffered touch in milliseconds.  0 sends every touch
+ * immediately.
+ */
+unsigned touch_delay_ms_ = 0;
+MpscRing<shash::Any> *touch_ring_ = NULL;
+atomic_int32 touch_pending_;
+pthread_mutex_t lock_touch_flush_ = PTHREAD_MUTEX_INITIALIZER;
+pthread_t thread_touch_;
+int pipe_touch_[2];
+
 /**
  * If the cache grows above this size, we clean up until cleanup_threshold.
  */
@@ -174,6 +236,47 @@ string *cache_dir_ = NULL;
 // Maps Md5 over channel id to writeable file descriptor.
 map<shash::Md5, int> *back_channels_ = NULL;
 
+/**
+ * If set, the LRU bookkeeping is done by the journal instead of the SQLite
+ * cache catalog.
+ */
+bool use_journal_ = false;
+JournalIndex *journal_ = NULL;
+
+/**
+ * If set, a rebuild of the cache catalog runs in the background while the
+ * cache manager serves requests.  Until the scanned files are merged, the
+ * cache catalog only contains the files added in the meantime.
+ */
+bool background_rebuild_ = false;
+bool rebuild_pending_ = false;  /**< Set by InitDatabase() */
+bool rebuild_spawned_ = false;
+pthread_t thread_rebuild_;
+int fd_rebuild_notify_ = -1;  /**< Write end of the command pipe */
+atomic_int32 rebuild_running_;
+atomic_int32 rebuild_abort_;
+atomic_int32 rebuild_dirs_;  /**< Scanned cache directories (out of 256) */
+atomic_int64 rebuild_files_;  /**< Files found so far */
+atomic_int64 rebuild_bytes_;  /**< Size of the files found so far */
+vector<CacheFile> *rebuild_result_ = NULL;
+/**
+ * The part of gauge_ that stands for the not yet merged files.  Seeded with
+ * the size of the emptied cache catalog and raised to rebuild_bytes_ as the
+ * scan proceeds.
+ */
+uint64_t rebuild_estimate_ = 0;
+/**
+ * Signaled by the rebuild thread once rebuild_result_ is set, so that the
+ * command server can wait for it without joining the thread.
+ */
+bool rebuild_finished_ = false;
+pthread_mutex_t lock_rebuild_ = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t cond_rebuild_ = PTHREAD_COND_INITIALIZER;
+/**
+ * Files removed or evicted during the background rebuild must not be merged.
+ */
+set<shash::Any> *rebuild_removed_ = NULL;
+
 sqlite3 *db_ = NULL;
 sqlite3_stmt *stmt_touch_ = NULL;
 sqlite3_stmt *stmt_unpin_ = NULL;
@@ -295,51 +398,69 @@ static bool DoCleanup(const uint64_t leave_size) {
   string hash_str;
   vector<string> trash;
 
-  do {
-    sqlite3_reset(stmt_lru_);
-    if (sqlite3_step(stmt_lru_) != SQLITE_ROW) {
-      LogCvmfs(kLogQuota, kLogDebug, "could not get lru-entry");
-      break;
+  if (journal_ != NULL) {
+    // Pinned files that are not yet inserted are skipped, the journal
+    // finds the oldest entries in logarithmic time
+    vector<shash::Any> evicted;
+    gauge_ -= journal_->Evict(gauge_ - leave_size, *pinned_chunks_, &evicted);
+    for (unsigned i = 0, iEnd = evicted.size(); i < iEnd; ++i) {
+      trash.push_back((*cache_dir_) + evicted[i].MakePathExplicit(1, 2));
+      if (rebuild_removed_ != NULL)
+        rebuild_removed_->insert(evicted[i]);
     }
+    LogCvmfs(kLogQuota, kLogDebug, "lru cleanup of %u files, new gauge "
+             "%"PRIu64, evicted.size(), gauge_);
+    if (!journal_->Checkpoint())
+      return false;
+  } else {
+    do {
+      sqlite3_reset(stmt_lru_);
+      if (sqlite3_step(stmt_lru_) != SQLITE_ROW) {
+        LogCvmfs(kLogQuota, kLogDebug, "could not get lru-entry");
+        break;
+      }
 
-    hash_str = string(reinterpret_cast<const char *>(
-                      sqlite3_column_text(stmt_lru_, 0)));
-    LogCvmfs(kLogQuota, kLogDebug, "removing %s", hash_str.c_str());
-    shash::Any hash = shash::MkFromHexPtr(shash::HexPtr(hash_str));
-
-    // That's a critical condition.  We must not delete a not yet inserted
-    // pinned file as it is already reserved (but will be inserted later).
-    // Instead, set the pin bit in the db to not run into an endless loop
-    if (pinned_chunks_->find(hash) == pinned_chunks_->end()) {
-      trash.push_back((*cache_dir_) + hash.MakePathExplicit(1, 2));
-      gauge_ -= sqlite3_column_int64(stmt_lru_, 1);
-      LogCvmfs(kLogQuota, kLogDebug, "lru cleanup %s, new gauge %"PRIu64,
-               hash_str.c_str(), gauge_);
+      hash_str = string(reinterpret_cast<const char *>(
+                        sqlite3_column_text(stmt_lru_, 0)));
+      LogCvmfs(kLogQuota, kLogDebug, "removing %s", hash_str.c_str());
+      shash::Any hash = shash::MkFromHexPtr(shash::HexPtr(hash_str));
 
-      sqlite3_bind_text(stmt_rm_, 1, &hash_str[0], hash_str.length(),
-                        SQLITE_STATIC);
-      result = (sqlite3_step(stmt_rm_) == SQLITE_DONE);
-      sqlite3_reset(stmt_rm_);
-
-      if (!result) {
-        LogCvmfs(kLogQuota, kLogDebug | kLogSyslogErr,
-                 "failed to find %s in cache database (%d). "
-                 "Cache database is out of sync. "
-                 "Restart cvmfs with clean cache.", hash_str.c_str(), result);
-        return false;
+      // That's a critical condition.  We must not delete a not yet inserted
+      // pinned file as it is already reserved (but will be inserted later).
+      // Instead, set the pin bit in the db to not run into an endless loop
+      if (pinned_chunks_->find(hash) == pinned_chunks_->end()) {
+        trash.push_back((*cache_dir_) + hash.MakePathExplicit(1, 2));
+        if (rebuild_removed_ != NULL)
+          rebuild_removed_->insert(hash);
+        gauge_ -= sqlite3_column_int64(stmt_lru_, 1);
+        LogCvmfs(kLogQuota, kLogDebug, "lru cleanup %s, new gauge %"PRIu64,
+                 hash_str.c_str(), gauge_);
+
+        sqlite3_bind_text(stmt_rm_, 1, &hash_str[0], hash_str.length(),
+                          SQLITE_STATIC);
+        result = (sqlite3_step(stmt_rm_) == SQLITE_DONE);
+        sqlite3_reset(stmt_rm_);
+
+        if (!result) {
+          LogCvmfs(kLogQuota, kLogDebug | kLogSyslogErr,
+                   "failed to find %s in cache database (%d). "
+                   "Cache database is out of sync. "
+                   "Restart cvmfs with clean cache.", hash_str.c_str(), result);
+          return false;
+        }
+      } else {
+        sqlite3_bind_text(stmt_block_, 1, &hash_str[0], hash_str.length(),
+                          SQLITE_STATIC);
+        result = (sqlite3_step(stmt_block_) == SQLITE_DONE);
+        sqlite3_reset(stmt_block_);
+        assert(result);
       }
-    } else {
-      sqlite3_bind_text(stmt_block_, 1, &hash_str[0], hash_str.length(),
-                        SQLITE_STATIC);
-      result = (sqlite3_step(stmt_block_) == SQLITE_DONE);
-      sqlite3_reset(stmt_block_);
-      assert(result);
-    }
-  } while (gauge_ > leave_size);
+    } while (gauge_ > leave_size);
 
-  result = (sqlite3_step(stmt_unblock_) == SQLITE_DONE);
-  sqlite3_reset(stmt_unblock_);
-  assert(result);
+    result = (sqlite3_step(stmt_unblock_) == SQLITE_DONE);
+    sqlite3_reset(stmt_unblock_);
+    assert(result);
+  }
 
   // Double fork avoids zombie, forked removal process must not flush file
   // buffers
@@ -373,9 +494,12 @@ static bool DoCleanup(const uint64_t leave_size) {
 }
 
 
-static bool Contains(const string &hash_str) {
-  bool result = false;
+static bool Contains(const shash::Any &hash) {
+  if (journal_ != NULL)
+    return journal_->Contains(hash);
 
+  const string hash_str = hash.ToString();
+  bool result = false;
   sqlite3_bind_text(stmt_size_, 1, &hash_str[0], hash_str.length(),
                     SQLITE_STATIC);
   if (sqlite3_step(stmt_size_) == SQLITE_ROW)
@@ -402,8 +526,11 @@ static void CheckHighPinWatermark() {
 static void ProcessCommandBunch(const unsigned num,
                                 const LruCommand *commands, const char *paths)
 {
-  int retval = sqlite3_exec(db_, "BEGIN", NULL, NULL, NULL);
-  assert(retval == SQLITE_OK);
+  int retval;
+  if (journal_ == NULL) {
+    retval = sqlite3_exec(db_, "BEGIN", NULL, NULL, NULL);
+    assert(retval == SQLITE_OK);
+  }
 
   for (unsigned i = 0; i < num; ++i) {
     const shash::Any hash = commands[i].RetrieveHash();
@@ -415,6 +542,10 @@ static void ProcessCommandBunch(const unsigned num,
     bool exists;
     switch (commands[i].command_type) {
       case kTouch:
+        if (journal_ != NULL) {
+          journal_->Touch(hash, seq_++);
+          break;
+        }
         sqlite3_bind_int64(stmt_touch_, 1, seq_++);
         sqlite3_bind_text(stmt_touch_, 2, &hash_str[0], hash_str.length(),
                           SQLITE_STATIC);
@@ -430,6 +561,10 @@ static void ProcessCommandBunch(const unsigned num,
         sqlite3_reset(stmt_touch_);
         break;
       case kUnpin:
+        if (journal_ != NULL) {
+          journal_->Unpin(hash);
+          break;
+        }
         sqlite3_bind_text(stmt_unpin_, 1, &hash_str[0], hash_str.length(),
                           SQLITE_STATIC);
         retval = sqlite3_step(stmt_unpin_);
@@ -448,9 +583,14 @@ static void ProcessCommandBunch(const unsigned num,
       case kInsert:
       case kInsertVolatile:
         // It could already be in, check
-        exists = Contains(hash_str);
+        exists = Contains(hash);
 
         // Cleanup, move to trash and unlink
+        UpdateRebuildEstimate();
+        if (!exists && (gauge_ + size > limit_)) {
+          FinishRebuild();
+          exists = Contains(hash);
+        }
         if (!exists && (gauge_ + size > limit_)) {
           LogCvmfs(kLogQuota, kLogDebug, "over limit, gauge %lu, file size %lu",
                    gauge_, size);
@@ -458,6 +598,18 @@ static void ProcessCommandBunch(const unsigned num,
           assert(retval != 0);
         }
 
+        if (journal_ != NULL) {
+          journal_->Insert(hash, size,
+            (commands[i].command_type == kInsertVolatile) ?
+              ((seq_++) | kVolatileFlag) : seq_++,
+            string(&paths[i*kMaxCvmfsPath], commands[i].path_length),
+            (commands[i].command_type == kPin) ? kFileCatalog : kFileRegular,
+            (commands[i].command_type == kPin) ||
+            (commands[i].command_type == kPinRegular));
+          if (!exists) gauge_ += size;
+          break;
+        }
+
         // Insert or replace
         sqlite3_bind_text(stmt_new_, 1, &hash_str[0], hash_str.length(),
                           SQLITE_STATIC);
@@ -492,6 +644,14 @@ static void ProcessCommandBunch(const unsigned num,
     }
   }
 
+  if (journal_ != NULL) {
+    if (!journal_->Commit()) {
+      LogCvmfs(kLogQuota, kLogSyslogErr, "failed to commit to cache journal");
+      abort();
+    }
+    return;
+  }
+
   retval = sqlite3_exec(db_, "COMMIT", NULL, NULL, NULL);
   if (retval != SQLITE_OK) {
     LogCvmfs(kLogQuota, kLogSyslogErr,
@@ -501,6 +661,131 @@ static void ProcessCommandBunch(const unsigned num,
 }
 
 
+static string GetRebuildMarker() {
+  return (*cache_dir_) + "/cachedb.rebuilding";
+}
+
+
+/**
+ * Merges the files found by the background rebuild into the cache catalog.
+ * Files that were inserted or removed in the meantime are skipped.  The
+ * scanned files are older than the ones inserted during the rebuild, so they
+ * get the sequence numbers below kRebuildSeqOffset.
+ */
+static void MergeRebuild() {
+  vector<CacheFile> *files = rebuild_result_;
+  rebuild_result_ = NULL;
+  // The merged files replace the estimate
+  gauge_ -= rebuild_estimate_;
+  rebuild_estimate_ = 0;
+  if (files == NULL) {
+    LogCvmfs(kLogQuota, kLogDebug | kLogSyslogErr,
+             "background rebuild of cache database failed");
+  } else {
+    int retval;
+    uint64_t num_merged = 0;
+    const string path = "unknown (automatic rebuild)";
+    // Inserts over the limit merge within the transaction of their bunch
+    const bool own_transaction =
+      (journal_ == NULL) && (sqlite3_get_autocommit(db_) != 0);
+    if (own_transaction) {
+      retval = sqlite3_exec(db_, "BEGIN", NULL, NULL, NULL);
+      assert(retval == SQLITE_OK);
+    }
+    for (unsigned i = 0, iEnd = files->size(); i < iEnd; ++i) {
+      const shash::Any &hash = (*files)[i].hash;
+      if ((rebuild_removed_->find(hash) != rebuild_removed_->end()) ||
+          Contains(hash))
+      {
+        continue;
+      }
+      const uint64_t size = (*files)[i].size;
+      gauge_ += size;
+      num_merged++;
+
+      // Might also be a catalog (information is lost)
+      if (journal_ != NULL) {
+        journal_->Insert(hash, size, i, path, kFileRegular, false);
+        continue;
+      }
+      const string hash_str = hash.ToString();
+      sqlite3_bind_text(stmt_new_, 1, &hash_str[0], hash_str.length(),
+                        SQLITE_STATIC);
+      sqlite3_bind_int64(stmt_new_, 2, size);
+      sqlite3_bind_int64(stmt_new_, 3, i);
+      sqlite3_bind_text(stmt_new_, 4, &path[0], path.length(), SQLITE_STATIC);
+      sqlite3_bind_int64(stmt_new_, 5, kFileRegular);
+      sqlite3_bind_int64(stmt_new_, 6, 0);
+      retval = sqlite3_step(stmt_new_);
+      sqlite3_reset(stmt_new_);
+      if ((retval != SQLITE_DONE) && (retval != SQLITE_OK)) {
+        LogCvmfs(kLogQuota, kLogSyslogErr,
+                 "failed to merge %s into cachedb, error %d",
+                 hash_str.c_str(), retval);
+        abort();
+      }
+      if ((num_merged % kRebuildTransactionSize) == 0) {
+        retval = sqlite3_exec(db_, "COMMIT; BEGIN", NULL, NULL, NULL);
+        assert(retval == SQLITE_OK);
+      }
+    }
+    bool committed = true;
+    if (journal_ != NULL)
+      committed = journal_->Checkpoint();
+    else if (own_transaction)
+      committed = (sqlite3_exec(db_, "COMMIT", NULL, NULL, NULL) == SQLITE_OK);
+    if (!committed) {
+      LogCvmfs(kLogQuota, kLogSyslogErr, "failed to commit rebuilt cachedb");
+      abort();
+    }
+    delete files;
+    unlink(GetRebuildMarker().c_str());
+    LogCvmfs(kLogQuota, kLogSyslog | kLogDebug,
+             "background rebuild of cache database finished, merged "
+             "%"PRIu64" files, gauge %"PRIu64, num_merged, gauge_);
+  }
+  delete rebuild_removed_;
+  rebuild_removed_ = NULL;
+  atomic_write32(&rebuild_running_, 0);
+
+  if (gauge_ > limit_)
+    DoCleanup(cleanup_threshold_);
+}
+
+
+/**
+ * Raises the estimated size of the not yet merged files to what the scan
+ * found so far.  Used before checking the gauge against the limit.
+ */
+static void UpdateRebuildEstimate() {
+  if (!atomic_read32(&rebuild_running_))
+    return;
+  const uint64_t scanned = atomic_read64(&rebuild_bytes_);
+  if (scanned > rebuild_estimate_) {
+    gauge_ += scanned - rebuild_estimate_;
+    rebuild_estimate_ = scanned;
+  }
+}
+
+
+/**
+ * Cleaning up can only evict files that are in the cache catalog.  Before
+ * going over the limit during a background rebuild, the scan has to finish
+ * and its files have to be merged.  The rebuild thread does not wait for the
+ * command server, so this cannot deadlock.
+ */
+static void FinishRebuild() {
+  if (!atomic_read32(&rebuild_running_))
+    return;
+  LogCvmfs(kLogQuota, kLogDebug, "over limit, waiting for background rebuild");
+  pthread_mutex_lock(&lock_rebuild_);
+  while (!rebuild_finished_)
+    pthread_cond_wait(&cond_rebuild_, &lock_rebuild_);
+  pthread_mutex_unlock(&lock_rebuild_);
+  MergeRebuild();
+}
+
+
 /**
  * Event loop for processing commands.  Most of them are queued, some have
  * to be executed immediately.
@@ -541,6 +826,31 @@ static void *MainCommandServer(void *data __attribute__((unused))) {
       continue;
     }
 
+    if (command_type == kRebuildProgress) {
+      int return_pipe =
+        BindReturnPipe(command_buffer[num_commands].return_pipe);
+      if (return_pipe < 0)
+        continue;
+      const int32_t running = atomic_read32(&rebuild_running_);
+      const int32_t dirs = atomic_read32(&rebuild_dirs_);
+      const int64_t files = atomic_read64(&rebuild_files_);
+      WritePipe(return_pipe, &running, sizeof(running));
+      WritePipe(return_pipe, &dirs, sizeof(dirs));
+      WritePipe(return_pipe, &files, sizeof(files));
+      UnbindReturnPipe(return_pipe);
+      continue;
+    }
+
+    // The scanned files of the background rebuild are merged in one go,
+    // unless an insert over the limit merged them already
+    if (command_type == kRebuildDone) {
+      ProcessCommandBunch(num_commands, command_buffer, path_buffer);
+      num_commands = 0;
+      if (atomic_read32(&rebuild_running_))
+        MergeRebuild();
+      continue;
+    }
+
     // Reservations are handled immediately and "out of band"
     if (command_type == kReserve) {
       bool success = true;
@@ -661,6 +971,23 @@ static void *MainCommandServer(void *data __attribute__((unused))) {
           LogCvmfs(kLogQuota, kLogDebug, "manually removing %s",
                    hash_str.c_str());
           bool success = false;
+          if (rebuild_removed_ != NULL)
+            rebuild_removed_->insert(hash);
+
+          if (journal_ != NULL) {
+            JournalIndex::Entry entry;
+            if (journal_->Lookup(hash, &entry)) {
+              journal_->Remove(hash);
+              gauge_ -= entry.size;
+              if (entry.pinned) {
+                pinned_chunks_->erase(hash);
+                pinned_ -= entry.size;
+              }
+            }
+            success = journal_->Commit();
+            WritePipe(return_pipe, &success, sizeof(success));
+            break;
+          }
 
           sqlite3_bind_text(stmt_size_, 1, &hash_str[0], hash_str.length(),
                             SQLITE_STATIC);
@@ -705,6 +1032,24 @@ static void *MainCommandServer(void *data __attribute__((unused))) {
 
           // Pipe back the list, one by one
           int length;
+          if (journal_ != NULL) {
+            vector<string> paths;
+            if (command_type == kList)
+              journal_->ListByType(kFileRegular, &paths);
+            else if (command_type == kListPinned)
+              journal_->ListPinned(&paths);
+            else
+              journal_->ListByType(kFileCatalog, &paths);
+            for (unsigned i = 0, iEnd = paths.size(); i < iEnd; ++i) {
+              length = paths[i].length();
+              WritePipe(return_pipe, &length, sizeof(length));
+              if (length > 0)
+                WritePipe(return_pipe, &paths[i][0], length);
+            }
+            length = -1;
+            WritePipe(return_pipe, &length, sizeof(length));
+            break;
+          }
           while (sqlite3_step(this_stmt_list) == SQLITE_ROW) {
             string path = "(NULL)";
             if (sqlite3_column_type(this_stmt_list, 0) != SQLITE_NULL) {
@@ -839,23 +1184,245 @@ static uint32_t GetProtocolRevision() {
 
 
 /**
- * Rebuilds the SQLite cache catalog based on the stat-information of files
- * in the cache directory.
+ * Shared state of the threads that scan the cache directories.  Every scanned
+ * directory is queued as a batch of files for the consumer.
+ */
+struct ScanContext {
+  atomic_int32 next_dir;
+  atomic_int32 failed;
+  unsigned num_running;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  vector<vector<CacheFile> *> batches;
+};
+
+
+/**
+ * Reads the directory entries first and stats them relative to the directory
+ * afterwards.  This keeps the directory stream in one piece and avoids path
+ * lookups for every file.
+ */
+static bool ScanCacheDirectory(const int dir_index, vector<CacheFile> *files) {
+  char hex[3];
+  snprintf(hex, sizeof(hex), "%02x", dir_index);
+  const string path = (*cache_dir_) + "/" + string(hex);
+  DIR *dirp = opendir(path.c_str());
+  if (dirp == NULL) {
+    LogCvmfs(kLogQuota, kLogDebug | kLogSyslogErr,
+             "failed to open directory %s (tmpwatch interfering?)",
+             path.c_str());
+    return false;
+  }
+
+  vector<string> names;
+  platform_dirent64 *d;
+  while ((d = platform_readdir(dirp)) != NULL) {
+    if (d->d_name[0] != '.')
+      names.push_back(d->d_name);
+  }
+
+  const int fd_dir = dirfd(dirp);
+  struct stat info;
+  for (unsigned i = 0, iEnd = names.size(); i < iEnd; ++i) {
+    if (fstatat(fd_dir, names[i].c_str(), &info, 0) != 0) {
+      LogCvmfs(kLogQuota, kLogDebug, "could not stat %s/%s",
+               path.c_str(), names[i].c_str());
+      continue;
+    }
+    if (!S_ISREG(info.st_mode))
+      continue;
+    const string hash_str = string(hex) + names[i];
+    if (!shash::HexPtr(hash_str).IsValid())
+      continue;
+    files->push_back(CacheFile(shash::MkFromHexPtr(shash::HexPtr(hash_str)),
+                               info.st_size, info.st_atime));
+  }
+  closedir(dirp);
+  return true;
+}
+
+
+static void *MainScanCache(void *data) {
+  ScanContext *context = reinterpret_cast<ScanContext *>(data);
+  int dir_index;
+  while ((dir_index = atomic_xadd32(&context->next_dir, 1)) <= 0xff) {
+    if (atomic_read32(&context->failed) || atomic_read32(&rebuild_abort_))
+      break;
+    vector<CacheFile> *files = new vector<CacheFile>();
+    if (!ScanCacheDirectory(dir_index, files)) {
+      delete files;
+      atomic_write32(&context->failed, 1);
+      break;
+    }
+    atomic_inc32(&rebuild_dirs_);
+    atomic_xadd64(&rebuild_files_, files->size());
+    int64_t num_bytes = 0;
+    for (unsigned i = 0, iEnd = files->size(); i < iEnd; ++i)
+      num_bytes += (*files)[i].size;
+    atomic_xadd64(&rebuild_bytes_, num_bytes);
+
+    pthread_mutex_lock(&context->lock);
+    context->batches.push_back(files);
+    pthread_cond_signal(&context->cond);
+    pthread_mutex_unlock(&context->lock);
+  }
+
+  pthread_mutex_lock(&context->lock);
+  context->num_running--;
+  pthread_cond_signal(&context->cond);
+  pthread_mutex_unlock(&context->lock);
+  return NULL;
+}
+
+
+/**
+ * Scans the cache directories 00 - ff with kRebuildThreads threads.  Every
+ * scanned directory is handed to the consumer in the calling thread while the
+ * other directories are still being scanned.
  *
- * \return True on success, false otherwise
+ * \return True on success, false if a directory cannot be read, the consumer
+ * fails, or the rebuild is aborted
  */
-bool RebuildDatabase() {
+static bool ScanCache(bool (*consumer)(const vector<CacheFile> &files,
+                                       void *data),
+                      void *data)
+{
+  ScanContext context;
+  atomic_init32(&context.next_dir);
+  atomic_init32(&context.failed);
+  context.num_running = kRebuildThreads;
+  int retval = pthread_mutex_init(&context.lock, NULL);
+  assert(retval == 0);
+  retval = pthread_cond_init(&context.cond, NULL);
+  assert(retval == 0);
+  atomic_init32(&rebuild_dirs_);
+  atomic_init64(&rebuild_files_);
+  atomic_init64(&rebuild_bytes_);
+
+  pthread_t threads[kRebuildThreads];
+  for (unsigned i = 0; i < kRebuildThreads; ++i) {
+    if (pthread_create(&threads[i], NULL, MainScanCache, &context) != 0) {
+      LogCvmfs(kLogQuota, kLogDebug, "could not create scanner thread");
+      abort();
+    }
+  }
+
+  bool result = true;
+  pthread_mutex_lock(&context.lock);
+  while (true) {
+    while (context.batches.empty() && (context.num_running > 0))
+      pthread_cond_wait(&context.cond, &context.lock);
+    if (context.batches.empty())
+      break;
+    vector<CacheFile> *files = context.batches.back();
+    context.batches.pop_back();
+    pthread_mutex_unlock(&context.lock);
+
+    if (result && !consumer(*files, data)) {
+      result = false;
+      atomic_write32(&context.failed, 1);
+    }
+    delete files;
+    pthread_mutex_lock(&context.lock);
+  }
+  pthread_mutex_unlock(&context.lock);
+
+  for (unsigned i = 0; i < kRebuildThreads; ++i)
+    pthread_join(threads[i], NULL);
+  pthread_cond_destroy(&context.cond);
+  pthread_mutex_destroy(&context.lock);
+
+  if (atomic_read32(&rebuild_abort_))
+    return false;
+  return result && (atomic_read32(&context.failed) == 0);
+}
+
+
+static bool CollectCacheFiles(const vector<CacheFile> &files, void *data) {
+  vector<CacheFile> *all_files = reinterpret_cast<vector<CacheFile> *>(data);
+  all_files->insert(all_files->end(), files.begin(), files.end());
+  return true;
+}
+
+
+/**
+ * Like RebuildDatabase() but inserts into the journal.  The access time order
+ * of the files is established in memory instead of in a temporary table.
+ */
+static bool RebuildJournal() {
+  LogCvmfs(kLogQuota, kLogSyslog | kLogDebug, "re-building cache journal");
+  vector<CacheFile> files;
+  if (!ScanCache(CollectCacheFiles, &files))
+    return false;
+  sort(files.begin(), files.end());
+
+  if (!journal_->Clear())
+    return false;
+  gauge_ = 0;
+  seq_ = 0;
+  for (unsigned i = 0, iEnd = files.size(); i < iEnd; ++i) {
+    // Might also be a catalog (information is lost)
+    journal_->Insert(files[i].hash, files[i].size, seq_++,
+                     "unknown (automatic rebuild)", kFileRegular, false);
+    gauge_ += files[i].size;
+  }
+  if (!journal_->Checkpoint())
+    return false;
+  LogCvmfs(kLogQuota, kLogDebug,
+           "rebuilding finished, seqence %"PRIu64 ", gauge %"PRIu64,
+           seq_, gauge_);
+  return true;
+}
+
+
+/**
+ * Inserts the scanned files into the temporary table, committing every
+ * kRebuildTransactionSize rows.
+ */
+struct FsCacheInserter {
+  explicit FsCacheInserter(sqlite3_stmt *s) : stmt(s), num_rows(0) { }
+  sqlite3_stmt *stmt;
+  uint64_t num_rows;
+};
+
+static bool InsertFsCache(const vector<CacheFile> &files, void *data) {
+  FsCacheInserter *inserter = reinterpret_cast<FsCacheInserter *>(data);
+  for (unsigned i = 0, iEnd = files.size(); i < iEnd; ++i) {
+    const string hash = files[i].hash.ToString();
+    sqlite3_bind_text(inserter->stmt, 1, hash.data(), hash.length(),
+                      SQLITE_STATIC);
+    sqlite3_bind_int64(inserter->stmt, 2, files[i].size);
+    sqlite3_bind_int64(inserter->stmt, 3, files[i].atime);
+    const int retval = sqlite3_step(inserter->stmt);
+    sqlite3_reset(inserter->stmt);
+    if (retval != SQLITE_DONE) {
+      LogCvmfs(kLogQuota, kLogDebug, "could not insert into temp table");
+      return false;
+    }
+    gauge_ += files[i].size;
+
+    if ((++inserter->num_rows % kRebuildTransactionSize) == 0) {
+      if (sqlite3_exec(db_, "COMMIT; BEGIN", NULL, NULL, NULL) != SQLITE_OK)
+        return false;
+    }
+  }
+  return true;
+}
+
+
+/**
+ * Rebuilds the SQLite cache catalog based on the stat-information of files
+ * in the cache directory.  The cache directories are scanned in parallel and
+ * the rows are inserted in large transactions.
+ */
+static bool RebuildCatalog() {
   bool result = false;
+  bool in_transaction = false;
   string sql;
   sqlite3_stmt *stmt_select = NULL;
   sqlite3_stmt *stmt_insert = NULL;
   int sqlerr;
-  int seq = 0;
-  char hex[3];
-  struct stat info;
-  platform_dirent64 *d;
-  DIR *dirp = NULL;
-  string path;
+  uint64_t seq = 0;
 
   LogCvmfs(kLogQuota, kLogSyslog | kLogDebug, "re-building cache database");
 
@@ -872,40 +1439,13 @@ bool RebuildDatabase() {
   // Insert files from cache sub-directories 00 - ff
   sqlite3_prepare_v2(db_, "INSERT INTO fscache (sha1, size, actime) "
                      "VALUES (:sha1, :s, :t);", -1, &stmt_insert, NULL);
-
-  for (int i = 0; i <= 0xff; i++) {
-    snprintf(hex, sizeof(hex), "%02x", i);
-    path = (*cache_dir_) + "/" + string(hex);
-    if ((dirp = opendir(path.c_str())) == NULL) {
-      LogCvmfs(kLogQuota, kLogDebug | kLogSyslogErr,
-               "failed to open directory %s (tmpwatch interfering?)",
-               path.c_str());
+  if (sqlite3_exec(db_, "BEGIN", NULL, NULL, NULL) != SQLITE_OK)
+    goto build_return;
+  in_transaction = true;
+  {
+    FsCacheInserter inserter(stmt_insert);
+    if (!ScanCache(InsertFsCache, &inserter))
       goto build_return;
-    }
-    while ((d = platform_readdir(dirp)) != NULL) {
-      if (stat((path + "/" + string(d->d_name)).c_str(), &info) == 0) {
-        if (!S_ISREG(info.st_mode))
-          continue;
-
-        string hash = string(hex) + string(d->d_name);
-        sqlite3_bind_text(stmt_insert, 1, hash.data(), hash.length(),
-                          SQLITE_STATIC);
-        sqlite3_bind_int64(stmt_insert, 2, info.st_size);
-        sqlite3_bind_int64(stmt_insert, 3, info.st_atime);
-        if (sqlite3_step(stmt_insert) != SQLITE_DONE) {
-          LogCvmfs(kLogQuota, kLogDebug, "could not insert into temp table");
-          goto build_return;
-        }
-        sqlite3_reset(stmt_insert);
-
-        gauge_ += info.st_size;
-      } else {
-        LogCvmfs(kLogQuota, kLogDebug, "could not stat %s/%s",
-                 path.c_str(), d->d_name);
-      }
-    }
-    closedir(dirp);
-    dirp = NULL;
   }
   sqlite3_finalize(stmt_insert);
   stmt_insert = NULL;
@@ -932,15 +1472,18 @@ bool RebuildDatabase() {
     }
     sqlite3_reset(stmt_insert);
   }
+  sqlite3_finalize(stmt_select);
+  stmt_select = NULL;
 
   // Delete temporary table
-  sql = "DELETE FROM fscache;";
+  sql = "DELETE FROM fscache; COMMIT;";
   sqlerr = sqlite3_exec(db_, sql.c_str(), NULL, NULL, NULL);
   if (sqlerr != SQLITE_OK) {
     LogCvmfs(kLogQuota, kLogDebug, "could not clear temporary table (%d)",
              sqlerr);
     goto build_return;
   }
+  in_transaction = false;
 
   seq_ = seq;
   result = true;
@@ -951,11 +1494,162 @@ bool RebuildDatabase() {
  build_return:
   if (stmt_insert) sqlite3_finalize(stmt_insert);
   if (stmt_select) sqlite3_finalize(stmt_select);
-  if (dirp) closedir(dirp);
+  if (in_transaction) sqlite3_exec(db_, "ROLLBACK", NULL, NULL, NULL);
+  return result;
+}
+
+
+/**
+ * Rebuilds the cache catalog or the journal based on the stat-information of
+ * files in the cache directory.
+ *
+ * \return True on success, false otherwise
+ */
+bool RebuildDatabase() {
+  const bool result = (journal_ != NULL) ? RebuildJournal() : RebuildCatalog();
+  if (result)
+    unlink(GetRebuildMarker().c_str());
   return result;
 }
 
 
+/**
+ * Empties the cache catalog.  The files in the cache directory are merged
+ * by the command server once the background rebuild scanned them.  The marker
+ * file triggers another rebuild if the cache manager stops before.  Until
+ * then, the size of the emptied catalog serves as an estimate for the gauge.
+ */
+static bool PrepareBackgroundRebuild() {
+  LogCvmfs(kLogQuota, kLogSyslog | kLogDebug,
+           "re-building cache database in the background");
+  const int fd_marker = open(GetRebuildMarker().c_str(), O_WRONLY | O_CREAT,
+                             0600);
+  if (fd_marker < 0)
+    return false;
+  close(fd_marker);
+
+  if (journal_ != NULL) {
+    rebuild_estimate_ = journal_->total_size();
+    if (!journal_->Clear())
+      return false;
+  } else {
+    sqlite3_stmt *stmt;
+    sqlite3_prepare_v2(db_, "SELECT coalesce(sum(size), 0) FROM cache_catalog;",
+                       -1, &stmt, NULL);
+    rebuild_estimate_ = (sqlite3_step(stmt) == SQLITE_ROW) ?
+                        sqlite3_column_int64(stmt, 0) : 0;
+    sqlite3_finalize(stmt);
+    if (sqlite3_exec(db_, "DELETE FROM cache_catalog;", NULL, NULL, NULL) !=
+        SQLITE_OK)
+    {
+      return false;
+    }
+  }
+  rebuild_pending_ = true;
+  return true;
+}
+
+
+/**
+ * Scans the cache directory and hands the sorted files over to the command
+ * server.
+ */
+static void *MainRebuild(void *data __attribute__((unused))) {
+  LogCvmfs(kLogQuota, kLogDebug, "starting background rebuild");
+  vector<CacheFile> *files = new vector<CacheFile>();
+  if (ScanCache(CollectCacheFiles, files)) {
+    sort(files->begin(), files->end());
+    rebuild_result_ = files;
+  } else {
+    delete files;
+  }
+  pthread_mutex_lock(&lock_rebuild_);
+  rebuild_finished_ = true;
+  pthread_cond_signal(&cond_rebuild_);
+  pthread_mutex_unlock(&lock_rebuild_);
+
+  // On abort, the cache manager is stopping and the marker file triggers
+  // another rebuild on the next start
+  if (atomic_read32(&rebuild_abort_) == 0) {
+    LruCommand cmd;
+    cmd.command_type = kRebuildDone;
+    WritePipe(fd_rebuild_notify_, &cmd, sizeof(cmd));
+  }
+  close(fd_rebuild_notify_);
+  LogCvmfs(kLogQuota, kLogDebug, "stopping background rebuild");
+  return NULL;
+}
+
+
+/**
+ * Starts the background rebuild if InitDatabase() prepared it.  Takes
+ * ownership of fd_notify, a write end of the command pipe.
+ */
+static void SpawnRebuild(const int fd_notify) {
+  assert(rebuild_pending_ && !rebuild_spawned_);
+  rebuild_pending_ = false;
+  fd_rebuild_notify_ = fd_notify;
+  rebuild_removed_ = new set<shash::Any>();
+  rebuild_finished_ = false;
+  atomic_init32(&rebuild_abort_);
+  atomic_write32(&rebuild_running_, 1);
+  if (pthread_create(&thread_rebuild_, NULL, MainRebuild, NULL) != 0) {
+    LogCvmfs(kLogQuota, kLogDebug, "could not create rebuild thread");
+    abort();
+  }
+  rebuild_spawned_ = true;
+}
+
+
+static void StopRebuild() {
+  if (!rebuild_spawned_)
+    return;
+  atomic_write32(&rebuild_abort_, 1);
+  pthread_join(thread_rebuild_, NULL);
+  rebuild_spawned_ = false;
+}
+
+
+/**
+ * Opens the journal instead of the SQLite cache catalog.  After a crash, the
+ * journal is trusted as is.  Files that were added to the cache shortly before
+ * the crash might be missing in the journal.
+ */
+static bool InitJournal() {
+  const string journal_file = (*cache_dir_) + "/cachedb.journal";
+  const string db_file = (*cache_dir_) + "/cachedb";
+  // An SQLite cache catalog would be out of sync with the journal
+  unlink(db_file.c_str());
+  unlink((db_file + "-journal").c_str());
+
+  journal_ = JournalIndex::Open(journal_file);
+  if (journal_ == NULL)
+    return false;
+
+  if (limit_ == 0) {
+    gauge_ = 0;
+    return true;
+  }
+
+  if ((journal_->size() == 0) || FileExists(GetRebuildMarker())) {
+    LogCvmfs(kLogCvmfs, kLogDebug,
+             "CernVM-FS: building lru cache journal...");
+    const bool retval =
+      background_rebuild_ ? PrepareBackgroundRebuild() : RebuildDatabase();
+    if (!retval) {
+      LogCvmfs(kLogQuota, kLogDebug,
+               "could not build cache journal from file system");
+      delete journal_;
+      journal_ = NULL;
+      return false;
+    }
+  }
+  gauge_ = journal_->total_size() + rebuild_estimate_;
+  seq_ = rebuild_pending_ ? kRebuildSeqOffset : journal_->max_seq() + 1;
+  return true;
+}
+
+
 static bool InitDatabase(const bool rebuild_database) {
   string sql;
   sqlite3_stmt *stmt;
@@ -966,6 +1660,15 @@ static bool InitDatabase(const bool rebuild_database) {
     return false;
   }
 
+  if (use_journal_) {
+    if (InitJournal())
+      return true;
+    UnlockFile(fd_lock_cachedb_);
+    return false;
+  }
+  // The journal would be out of sync with the SQLite cache catalog
+  unlink(((*cache_dir_) + "/cachedb.journal").c_str());
+
   bool retry = false;
   const string db_file = (*cache_dir_) + "/cachedb";
   if (rebuild_database) {
@@ -1053,10 +1756,14 @@ init_recover:
   sql = "SELECT count(*) FROM cache_catalog;";
   sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, NULL);
   if (sqlite3_step(stmt) == SQLITE_ROW) {
-    if ((sqlite3_column_int64(stmt, 0)) == 0 || rebuild_database) {
+    if ((sqlite3_column_int64(stmt, 0)) == 0 || rebuild_database ||
+        FileExists(GetRebuildMarker()))
+    {
       LogCvmfs(kLogCvmfs, kLogDebug,
                "CernVM-FS: building lru cache database...");
-      if (!RebuildDatabase()) {
+      const bool retval =
+        background_rebuild_ ? PrepareBackgroundRebuild() : RebuildDatabase();
+      if (!retval) {
         LogCvmfs(kLogQuota, kLogDebug,
                  "could not build cache database from file system");
         goto init_database_fail;
@@ -1073,7 +1780,7 @@ init_recover:
   sql = "SELECT sum(size) FROM cache_catalog;";
   sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, NULL);
   if (sqlite3_step(stmt) == SQLITE_ROW) {
-    gauge_ = sqlite3_column_int64(stmt, 0);
+    gauge_ = sqlite3_column_int64(stmt, 0) + rebuild_estimate_;
   } else {
     LogCvmfs(kLogQuota, kLogDebug, "could not determine cache size");
     sqlite3_finalize(stmt);
@@ -1085,7 +1792,8 @@ init_recover:
   sql = "SELECT coalesce(max(acseq & (~(1<<63))), 0) FROM cache_catalog;";
   sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, NULL);
   if (sqlite3_step(stmt) == SQLITE_ROW) {
-    seq_ = sqlite3_column_int64(stmt, 0)+1;
+    seq_ = rebuild_pending_ ? kRebuildSeqOffset :
+                              sqlite3_column_int64(stmt, 0)+1;
   } else {
     LogCvmfs(kLogQuota, kLogDebug, "could not determine highest seq-no");
     sqlite3_finalize(stmt);
@@ -1138,6 +1846,13 @@ init_recover:
 
 
 static void CloseDatabase() {
+  delete journal_;
+  journal_ = NULL;
+  delete rebuild_result_;
+  rebuild_result_ = NULL;
+  delete rebuild_removed_;
+  rebuild_removed_ = NULL;
+  rebuild_estimate_ = 0;
   if (stmt_list_catalogs_) sqlite3_finalize(stmt_list_catalogs_);
   if (stmt_list_pinned_) sqlite3_finalize(stmt_list_pinned_);
   if (stmt_list_) sqlite3_finalize(stmt_list_);
@@ -1253,6 +1968,8 @@ bool InitShared(const std::string &exe_path, const std::string &cache_dir,
   command_line.push_back(StringifyInt(GetLogSyslogLevel()));
   command_line.push_back(StringifyInt(GetLogSyslogFacility()));
   command_line.push_back(GetLogDebugFile() + ":" + GetLogMicroSyslog());
+  command_line.push_back(StringifyInt(use_journal_));
+  command_line.push_back(StringifyInt(background_rebuild_));
 
   set<int> preserve_filedes;
   preserve_filedes.insert(0);
@@ -1370,6 +2087,10 @@ int MainCacheManager(int argc, char **argv) {
   int syslog_level = String2Int64(argv[8]);
   int syslog_facility = String2Int64(argv[9]);
   vector<string> logfiles = SplitString(argv[10], ':');
+  if (argc > 11)
+    use_journal_ = String2Int64(argv[11]);
+  if (argc > 12)
+    background_rebuild_ = String2Int64(argv[12]);
 
   SetLogSyslogLevel(syslog_level);
   SetLogSyslogFacility(syslog_facility);
@@ -1447,6 +2168,20 @@ int MainCacheManager(int argc, char **argv) {
   Nonblock2Block(pipe_lru_[0]);
   LogCvmfs(kLogQuota, kLogDebug, "shared cache manager listening");
 
+  // The rebuild keeps its own write end, so that the cache manager does not
+  // stop before the scanned files are merged
+  if (rebuild_pending_) {
+    const int fd_notify = open(fifo_path.c_str(), O_WRONLY | O_NONBLOCK);
+    if (fd_notify < 0) {
+      LogCvmfs(kLogQuota, kLogDebug | kLogSyslogErr,
+               "failed to connect background rebuild to FIFO (%d)", errno);
+      UnlockFile(fd_lockfile_fifo);
+      return 1;
+    }
+    Nonblock2Block(fd_notify);
+    SpawnRebuild(fd_notify);
+  }
+
   char buf = 'C';
   WritePipe(pipe_boot, &buf, 1);
   close(pipe_boot);
@@ -1461,6 +2196,7 @@ int MainCacheManager(int argc, char **argv) {
   signal(SIGINT, SIG_IGN);
 
   MainCommandServer(NULL);
+  StopRebuild();
   unlink(fifo_path.c_str());
   unlink(protocol_revision_path.c_str());
   CloseDatabase();
@@ -1521,16 +2257,144 @@ bool Init(const string &cache_dir, const uint64_t limit,
 
 
 /**
- * Spawns the LRU thread
+ * Sends the buffered touches in bunches to the cache manager.  Repeated
+ * touches of the same object within a flush interval are sent only once.  The
+ * cache manager processes a bunch in a single transaction.
+ */
+static void FlushTouches() {
+  pthread_mutex_lock(&lock_touch_flush_);
+  set<shash::Any> touched;
+  shash::Any hash;
+  while (touch_ring_->TryDequeue(&hash)) {
+    atomic_dec32(&touch_pending_);
+    touched.insert(hash);
+  }
+
+  LruCommand bunch[kTouchBunchSize];
+  unsigned num_commands = 0;
+  for (set<shash::Any>::const_iterator i = touched.begin(),
+       iEnd = touched.end(); i != iEnd; ++i)
+  {
+    new (&bunch[num_commands]) LruCommand;
+    bunch[num_commands].command_type = kTouch;
+    bunch[num_commands].StoreHash(*i);
+    if (++num_commands == kTouchBunchSize) {
+      WritePipe(pipe_lru_[1], bunch, num_commands * sizeof(LruCommand));
+      num_commands = 0;
+    }
+  }
+  if (num_commands > 0)
+    WritePipe(pipe_lru_[1], bunch, num_commands * sizeof(LruCommand));
+  pthread_mutex_unlock(&lock_touch_flush_);
+}
+
+
+/**
+ * Flushes buffered touches every touch_delay_ms_ or earlier, if the ring
+ * fills up.
+ */
+static void *MainTouchFlusher(void *data __attribute__((unused))) {
+  LogCvmfs(kLogQuota, kLogDebug, "starting touch flusher (delay %u ms)",
+           touch_delay_ms_);
+  struct pollfd watch_touch;
+  watch_touch.fd = pipe_touch_[0];
+  watch_touch.events = POLLIN | POLLPRI;
+  bool terminate = false;
+  while (!terminate) {
+    watch_touch.revents = 0;
+    int retval = poll(&watch_touch, 1, touch_delay_ms_);
+    if ((retval < 0) && (errno != EINTR)) {
+      LogCvmfs(kLogQuota, kLogSyslogErr, "touch flusher failed to poll (%d)",
+               errno);
+      abort();
+    }
+    if ((retval > 0) && (watch_touch.revents & (POLLIN | POLLPRI))) {
+      char signal;
+      ReadPipe(pipe_touch_[0], &signal, 1);
+      terminate = (signal == 'T');
+    }
+    FlushTouches();
+  }
+  LogCvmfs(kLogQuota, kLogDebug, "stopping touch flusher");
+  return NULL;
+}
+
+
+/**
+ * Buffers touches for up to max_delay_ms milliseconds instead of sending every
+ * touch to the cache manager.  Needs to be called before Spawn().
+ */
+void EnableTouchBuffer(const unsigned max_delay_ms) {
+  touch_delay_ms_ = max_delay_ms;
+}
+
+
+static void SpawnTouchFlusher() {
+  if ((touch_delay_ms_ == 0) || (touch_ring_ != NULL))
+    return;
+
+  touch_ring_ = new MpscRing<shash::Any>(kTouchRingSize);
+  atomic_init32(&touch_pending_);
+  MakePipe(pipe_touch_);
+  if (pthread_create(&thread_touch_, NULL, MainTouchFlusher, NULL) != 0) {
+    LogCvmfs(kLogQuota, kLogDebug, "could not create touch flusher thread");
+    abort();
+  }
+}
+
+
+/**
+ * Sends the remaining touches, must be called before pipe_lru_ is closed.
+ */
+static void StopTouchFlusher() {
+  if (touch_ring_ == NULL)
+    return;
+
+  const char terminate = 'T';
+  WritePipe(pipe_touch_[1], &terminate, 1);
+  pthread_join(thread_touch_, NULL);
+  ClosePipe(pipe_touch_);
+  delete touch_ring_;
+  touch_ring_ = NULL;
+}
+
+
+/**
+ * Keeps the LRU bookkeeping in memory and in a journal file instead of the
+ * SQLite cache catalog.  Needs to be called before Init() or InitShared().
+ */
+void EnableJournal() {
+  use_journal_ = true;
+}
+
+
+/**
+ * Rebuilds the cache catalog in the background instead of delaying the
+ * start until all cache directories are scanned.  Needs to be called before
+ * Init() or InitShared().
+ */
+void EnableBackgroundRebuild() {
+  background_rebuild_ = true;
+}
+
+
+/**
+ * Spawns the LRU thread, the touch flusher, and the background rebuild
  */
 void Spawn() {
-  if (spawned_ || (limit_ == 0))
+  if (limit_ == 0)
+    return;
+  // The shared cache manager is spawned in InitShared()
+  SpawnTouchFlusher();
+  if (spawned_)
     return;
 
   if (pthread_create(&thread_lru_, NULL, MainCommandServer, NULL) != 0) {
     LogCvmfs(kLogQuota, kLogDebug, "could not create lru thread");
     abort();
   }
+  if (rebuild_pending_)
+    SpawnRebuild(dup(pipe_lru_[1]));
 
   spawned_ = true;
 }
@@ -1542,16 +2406,19 @@ void Spawn() {
 void Fini() {
   if (!initialized_) return;
 
-  delete cache_dir_;
-  cache_dir_ = NULL;
+  StopTouchFlusher();
 
   if (shared_) {
     // Most of cleanup is done elsewhen by shared cache manager
     close(pipe_lru_[1]);
+    delete cache_dir_;
+    cache_dir_ = NULL;
     initialized_ = false;
     return;
   }
 
+  // A pending merge is still processed by the command server
+  StopRebuild();
   if (spawned_) {
     char fin = 0;
     WritePipe(pipe_lru_[1], &fin, 1);
@@ -1562,6 +2429,8 @@ void Fini() {
   }
 
   CloseDatabase();
+  delete cache_dir_;
+  cache_dir_ = NULL;
   initialized_ = false;
   protocol_revision_ = 0;
 
@@ -1586,6 +2455,11 @@ bool Cleanup(const uint64_t leave_size) {
     return DoCleanup(leave_size);
   }
 
+  // Touches sent after the cleanup command would not protect recently used
+  // files from being evicted
+  if (touch_ring_ != NULL)
+    FlushTouches();
+
   int pipe_cleanup[2];
   MakeReturnPipe(pipe_cleanup);
 
@@ -1682,13 +2556,20 @@ bool Pin(const shash::Any &hash, const uint64_t size,
         CheckHighPinWatermark();
       }
     }
-    bool exists = Contains(hash_str);
+    bool exists = Contains(hash);
     if (!exists && (gauge_ + size > limit_)) {
       LogCvmfs(kLogQuota, kLogDebug, "over limit, gauge %lu, file size %lu",
                gauge_, size);
       int retval = DoCleanup(cleanup_threshold_);
       assert(retval != 0);
     }
+    if (journal_ != NULL) {
+      journal_->Insert(hash, size, seq_++, cvmfs_path, kFileCatalog, true);
+      bool retval = journal_->Commit();
+      assert(retval);
+      if (!exists) gauge_ += size;
+      return true;
+    }
     sqlite3_bind_text(stmt_new_, 1, &hash_str[0], hash_str.length(),
                       SQLITE_STATIC);
     sqlite3_bind_int64(stmt_new_, 2, size);
@@ -1736,12 +2617,24 @@ void Unpin(const shash::Any &hash) {
 
 
 /**
- * Updates the sequence number of the file specified by the hash.
+ * Updates the sequence number of the file specified by the hash.  With the
+ * touch buffer enabled, the update is delayed by up to touch_delay_ms_.
  */
 void Touch(const shash::Any &hash) {
   assert(initialized_);
   if (limit_ == 0) return;
 
+  if ((touch_ring_ != NULL) && touch_ring_->TryEnqueue(hash)) {
+    if (atomic_xadd32(&touch_pending_, 1) ==
+        static_cast<int32_t>(touch_ring_->capacity() / 2))
+    {
+      const char wakeup = 'W';
+      WritePipe(pipe_touch_[1], &wakeup, 1);
+    }
+    return;
+  }
+
+  // No buffering or ring is full
   LruCommand cmd;
   cmd.command_type = kTouch;
   cmd.StoreHash(hash);
@@ -1920,6 +2813,43 @@ pid_t GetPid() {
 }
 
 
+/**
+ * Returns false if there is no background rebuild of the cache catalog in
+ * progress.  Otherwise, dirs_scanned out of 256 cache directories with
+ * files_scanned files are scanned so far.
+ */
+bool GetRebuildProgress(unsigned *dirs_scanned, uint64_t *files_scanned) {
+  *dirs_scanned = 0;
+  *files_scanned = 0;
+  if (!initialized_ || (limit_ == 0))
+    return false;
+  if (!spawned_)
+    return rebuild_pending_;
+  // Older cache managers don't know the command
+  if (protocol_revision_ < 2)
+    return false;
+
+  int32_t running;
+  int32_t dirs;
+  int64_t files;
+  int pipe_progress[2];
+  MakeReturnPipe(pipe_progress);
+
+  LruCommand cmd;
+  cmd.command_type = kRebuildProgress;
+  cmd.return_pipe = pipe_progress[1];
+  WritePipe(pipe_lru_[1], &cmd, sizeof(cmd));
+  ReadHalfPipe(pipe_progress[0], &running, sizeof(running));
+  ReadPipe(pipe_progress[0], &dirs, sizeof(dirs));
+  ReadPipe(pipe_progress[0], &files, sizeof(files));
+  CloseReturnPipe(pipe_progress);
+
+  *dirs_scanned = dirs;
+  *files_scanned = files;
+  return running != 0;
+}
+
+
 string GetMemoryUsage() {
   return "TBD\n";
 /*  if (limit == 0)
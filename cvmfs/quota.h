@@ -24,6 +24,9 @@ bool Init(const std::string &cache_dir, const uint64_t limit,
           const uint64_t cleanup_threshold, const bool rebuild_database);
 bool InitShared(const std::string &exe_path, const std::string &cache_dir,
                 const uint64_t limit, const uint64_t cleanup_threshold);
+void EnableJournal();
+void EnableBackgroundRebuild();
+void EnableTouchBuffer(const unsigned max_delay_ms);
 void Spawn();
 void Fini();
 int MainCacheManager(int argc, char **argv);
@@ -53,6 +56,7 @@ uint64_t GetCapacity();
 uint64_t GetSize();
 uint64_t GetSizePinned();
 pid_t GetPid();
+bool GetRebuildProgress(unsigned *dirs_scanned, uint64_t *files_scanned);
 std::string GetMemoryUsage();
 
 }  // namespace quota
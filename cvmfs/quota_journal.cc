@@ -0,0 +1,554 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#define __STDC_FORMAT_MACROS
+
+#include "cvmfs_config.h"
+#include "quota_journal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include "logging.h"
+#include "murmur.h"
+
+using namespace std;  // NOLINT
+
+namespace quota {
+
+const char JournalIndex::kMagic[8] = "CVMFSJ1";
+
+
+static bool WriteFully(const int fd, const void *buf, const size_t nbyte) {
+  size_t written = 0;
+  while (written < nbyte) {
+    const ssize_t retval = write(fd, reinterpret_cast<const char *>(buf) +
+                                 written, nbyte - written);
+    if (retval < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    written += retval;
+  }
+  return true;
+}
+
+
+JournalIndex::JournalIndex(const string &path)
+  : path_(path)
+  , fd_(-1)
+  , file_size_(0)
+  , num_records_(0)
+  , total_size_(0)
+  , max_seq_(0)
+{
+  entries_.Init(16, shash::Any(), hasher_any);
+}
+
+
+/**
+ * Opens or creates the journal and replays it.  An unreadable journal results
+ * in an empty index.
+ *
+ * \return NULL if the journal file cannot be opened or written
+ */
+JournalIndex *JournalIndex::Open(const string &path) {
+  JournalIndex *index = new JournalIndex(path);
+  index->fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0600);
+  if (index->fd_ < 0) {
+    LogCvmfs(kLogQuota, kLogDebug | kLogSyslogErr,
+             "failed to open cache journal %s (%d)", path.c_str(), errno);
+    delete index;
+    return NULL;
+  }
+  if (!index->Replay()) {
+    delete index;
+    return NULL;
+  }
+  // The journal might have been created just now
+  if (!SyncDirectory(path)) {
+    delete index;
+    return NULL;
+  }
+  LogCvmfs(kLogQuota, kLogDebug, "replayed %"PRIu64" journal records, "
+           "%u entries, %"PRIu64" bytes",
+           index->num_records_, index->size(), index->total_size_);
+  if ((index->num_records_ > kMinRecordsCompaction) &&
+      (index->num_records_ > kCompactionRatio * index->size()))
+  {
+    if (!index->Compact()) {
+      delete index;
+      return NULL;
+    }
+  }
+  return index;
+}
+
+
+JournalIndex::~JournalIndex() {
+  if (fd_ >= 0) {
+    Checkpoint();
+    close(fd_);
+  }
+}
+
+
+uint32_t JournalIndex::Checksum(const Record &record, const char *path) {
+  const unsigned char *begin = reinterpret_cast<const unsigned char *>(&record);
+  const unsigned offset = sizeof(record.checksum);
+  uint32_t result = MurmurHash2(begin + offset, sizeof(Record) - offset, 42);
+  if (record.path_length > 0)
+    result = MurmurHash2(path, record.path_length, result);
+  return result;
+}
+
+
+/**
+ * Makes a file creation or rename in the directory of path durable.
+ */
+bool JournalIndex::SyncDirectory(const string &path) {
+  const string parent_path = GetParentPath(path);
+  const int fd = open(parent_path.empty() ? "." : parent_path.c_str(),
+                      O_RDONLY);
+  if (fd < 0)
+    return false;
+  const bool result = (fsync(fd) == 0);
+  close(fd);
+  if (!result) {
+    LogCvmfs(kLogQuota, kLogDebug | kLogSyslogErr,
+             "failed to sync directory of %s (%d)", path.c_str(), errno);
+  }
+  return result;
+}
+
+
+void JournalIndex::DoInsert(const shash::Any &hash, const Entry &entry) {
+  entries_.Insert(hash, entry);
+  lru_.insert(make_pair(entry.seq, hash));
+  total_size_ += entry.size;
+  const uint64_t seq = entry.seq & ~kVolatileFlag;
+  if (seq > max_seq_)
+    max_seq_ = seq;
+}
+
+
+/**
+ * Changes the sequence number of an existing entry.
+ */
+void JournalIndex::DoMove(
+  const shash::Any &hash,
+  Entry *entry,
+  const int64_t seq)
+{
+  lru_.erase(make_pair(entry->seq, hash));
+  entry->seq = seq;
+  entries_.Insert(hash, *entry);
+  lru_.insert(make_pair(seq, hash));
+  const uint64_t plain_seq = seq & ~kVolatileFlag;
+  if (plain_seq > max_seq_)
+    max_seq_ = plain_seq;
+}
+
+
+void JournalIndex::DoErase(const shash::Any &hash, const Entry &entry) {
+  entries_.Erase(hash);
+  lru_.erase(make_pair(entry.seq, hash));
+  total_size_ -= entry.size;
+}
+
+
+/**
+ * Rebuilds the index from the journal file.  A journal of a different format
+ * is discarded.  Replay stops at the first broken record, which is cut off.
+ */
+bool JournalIndex::Replay() {
+  FILE *f = fdopen(dup(fd_), "r");
+  if (f == NULL)
+    return false;
+  rewind(f);
+
+  char magic[sizeof(kMagic)];
+  const size_t nbytes = fread(magic, 1, sizeof(magic), f);
+  if ((nbytes != sizeof(magic)) || (memcmp(magic, kMagic, sizeof(magic)) != 0))
+  {
+    if (nbytes > 0) {
+      LogCvmfs(kLogQuota, kLogDebug | kLogSyslogWarn,
+               "discarding cache journal %s of unknown format", path_.c_str());
+    }
+    fclose(f);
+    return Clear();
+  }
+
+  uint64_t offset = sizeof(kMagic);
+  Record record;
+  char path[kMaxPathLength];
+  while (fread(&record, sizeof(record), 1, f) == 1) {
+    if ((record.path_length > kMaxPathLength) ||
+        (fread(path, 1, record.path_length, f) != record.path_length) ||
+        (Checksum(record, path) != record.checksum) ||
+        (record.algorithm >= shash::kAny))
+    {
+      break;
+    }
+
+    shash::Any hash(static_cast<shash::Algorithms>(record.algorithm));
+    memcpy(hash.digest, record.digest, hash.GetDigestSize());
+    Entry entry;
+    const bool exists = entries_.Lookup(hash, &entry);
+    switch (record.record_type) {
+      case kRecordInsert:
+        if (exists)
+          DoErase(hash, entry);
+        entry.size = record.size;
+        entry.seq = record.seq;
+        entry.path_offset = offset + sizeof(Record);
+        entry.path_length = record.path_length;
+        entry.type = record.type;
+        entry.pinned = false;
+        DoInsert(hash, entry);
+        break;
+      case kRecordTouch:
+        if (exists)
+          DoMove(hash, &entry, record.seq);
+        break;
+      case kRecordRemove:
+        if (exists)
+          DoErase(hash, entry);
+        break;
+      default:
+        LogCvmfs(kLogQuota, kLogDebug, "unknown journal record type %d",
+                 record.record_type);
+    }
+    offset += sizeof(Record) + record.path_length;
+    num_records_++;
+  }
+  fclose(f);
+
+  file_size_ = GetFileSize(path_);
+  if (file_size_ != offset) {
+    LogCvmfs(kLogQuota, kLogDebug | kLogSyslogWarn,
+             "cutting off broken cache journal records at offset %"PRIu64,
+             offset);
+    if (ftruncate(fd_, offset) != 0)
+      return false;
+    file_size_ = offset;
+  }
+  return true;
+}
+
+
+/**
+ * Writes a new journal with one insert record per entry, in LRU order, and
+ * atomically replaces the current journal.
+ */
+bool JournalIndex::Compact() {
+  if (!Flush())
+    return false;
+  LogCvmfs(kLogQuota, kLogDebug, "compacting cache journal "
+           "(%"PRIu64" records, %u entries)", num_records_, size());
+
+  const uint64_t num_records = num_records_;
+  const string tmp_path = path_ + ".tmp";
+  int fd_tmp = open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND,
+                    0600);
+  if (fd_tmp < 0) {
+    LogCvmfs(kLogQuota, kLogDebug | kLogSyslogErr,
+             "failed to create %s (%d)", tmp_path.c_str(), errno);
+    return false;
+  }
+
+  // Stage the new locations, the old ones are needed to read the paths
+  vector<shash::Any> hashes;
+  vector<Entry> compacted;
+  hashes.reserve(size());
+  compacted.reserve(size());
+  uint64_t offset = sizeof(kMagic);
+  string buffer(kMagic, sizeof(kMagic));
+  bool retval = true;
+  for (LruSet::const_iterator i = lru_.begin(), iEnd = lru_.end();
+       i != iEnd; ++i)
+  {
+    Entry entry;
+    entries_.Lookup(i->second, &entry);
+    const string path = ReadPath(entry);
+    pending_.clear();
+    AppendRecord(kRecordInsert, i->second, entry.size, entry.seq, entry.type,
+                 path);
+    buffer += pending_;
+    entry.path_offset = offset + sizeof(Record);
+    entry.path_length = path.length();
+    offset += pending_.length();
+    hashes.push_back(i->second);
+    compacted.push_back(entry);
+
+    if (buffer.length() > 1024 * 1024) {
+      retval = WriteFully(fd_tmp, buffer.data(), buffer.length());
+      buffer.clear();
+      if (!retval)
+        break;
+    }
+  }
+  pending_.clear();
+  if (retval && !buffer.empty())
+    retval = WriteFully(fd_tmp, buffer.data(), buffer.length());
+  retval = retval && (fsync(fd_tmp) == 0) &&
+           (rename(tmp_path.c_str(), path_.c_str()) == 0);
+  if (!retval) {
+    LogCvmfs(kLogQuota, kLogDebug | kLogSyslogErr,
+             "failed to compact cache journal (%d)", errno);
+    close(fd_tmp);
+    unlink(tmp_path.c_str());
+    num_records_ = num_records;
+    return false;
+  }
+
+  for (unsigned i = 0; i < hashes.size(); ++i)
+    entries_.Insert(hashes[i], compacted[i]);
+  close(fd_);
+  fd_ = fd_tmp;
+  file_size_ = offset;
+  num_records_ = hashes.size();
+  // Without it, a crash can bring back the old journal with stale paths
+  return SyncDirectory(path_);
+}
+
+
+void JournalIndex::AppendRecord(
+  const RecordType record_type,
+  const shash::Any &hash,
+  const uint64_t size,
+  const int64_t seq,
+  const uint8_t type,
+  const string &path)
+{
+  Record record;
+  memset(&record, 0, sizeof(record));
+  record.record_type = record_type;
+  record.algorithm = hash.algorithm;
+  record.type = type;
+  record.path_length = path.length();
+  record.seq = seq;
+  record.size = size;
+  memcpy(record.digest, hash.digest, hash.GetDigestSize());
+  record.checksum = Checksum(record, path.data());
+  pending_.append(reinterpret_cast<const char *>(&record), sizeof(record));
+  pending_.append(path);
+  num_records_++;
+}
+
+
+/**
+ * Needs Commit() to be called before if the entry is new.
+ */
+string JournalIndex::ReadPath(const Entry &entry) {
+  if (entry.path_length == 0)
+    return "";
+  string result(entry.path_length, '\0');
+  const ssize_t nbytes =
+    pread(fd_, &result[0], entry.path_length, entry.path_offset);
+  if (nbytes != entry.path_length)
+    return "(NULL)";
+  return result;
+}
+
+
+bool JournalIndex::Lookup(const shash::Any &hash, Entry *entry) const {
+  return entries_.Lookup(hash, entry);
+}
+
+
+/**
+ * Inserts or replaces an entry.  The path is truncated to kMaxPathLength.
+ */
+void JournalIndex::Insert(
+  const shash::Any &hash,
+  const uint64_t size,
+  const int64_t seq,
+  const string &path,
+  const uint8_t type,
+  const bool pinned)
+{
+  Entry entry;
+  if (entries_.Lookup(hash, &entry))
+    DoErase(hash, entry);
+  const string truncated_path = (path.length() > kMaxPathLength) ?
+    path.substr(0, kMaxPathLength) : path;
+
+  entry.size = size;
+  entry.seq = seq;
+  entry.path_offset = file_size_ + pending_.length() + sizeof(Record);
+  entry.path_length = truncated_path.length();
+  entry.type = type;
+  entry.pinned = pinned;
+  AppendRecord(kRecordInsert, hash, size, seq, type, truncated_path);
+  DoInsert(hash, entry);
+}
+
+
+/**
+ * Moves the entry to the given sequence number, the volatile flag of the
+ * entry is preserved.
+ */
+bool JournalIndex::Touch(const shash::Any &hash, const uint64_t seq) {
+  Entry entry;
+  if (!entries_.Lookup(hash, &entry))
+    return false;
+  DoMove(hash, &entry, seq | (entry.seq & kVolatileFlag));
+  AppendRecord(kRecordTouch, hash, 0, entry.seq, 0, "");
+  return true;
+}
+
+
+bool JournalIndex::Unpin(const shash::Any &hash) {
+  Entry entry;
+  if (!entries_.Lookup(hash, &entry))
+    return false;
+  entry.pinned = false;
+  entries_.Insert(hash, entry);
+  return true;
+}
+
+
+bool JournalIndex::Remove(const shash::Any &hash) {
+  Entry entry;
+  if (!entries_.Lookup(hash, &entry))
+    return false;
+  DoErase(hash, entry);
+  AppendRecord(kRecordRemove, hash, 0, 0, 0, "");
+  return true;
+}
+
+
+/**
+ * Removes the least recently used entries that are not in keep until at least
+ * nbytes are freed or the index is empty.
+ *
+ * \return the number of bytes freed
+ */
+uint64_t JournalIndex::Evict(
+  const uint64_t nbytes,
+  const map<shash::Any, uint64_t> &keep,
+  vector<shash::Any> *evicted)
+{
+  uint64_t freed = 0;
+  LruSet::iterator i = lru_.begin();
+  while ((freed < nbytes) && (i != lru_.end())) {
+    const shash::Any hash = i->second;
+    if (keep.find(hash) != keep.end()) {
+      ++i;
+      continue;
+    }
+    Entry entry;
+    entries_.Lookup(hash, &entry);
+    lru_.erase(i++);
+    entries_.Erase(hash);
+    total_size_ -= entry.size;
+    freed += entry.size;
+    AppendRecord(kRecordRemove, hash, 0, 0, 0, "");
+    evicted->push_back(hash);
+  }
+  return freed;
+}
+
+
+void JournalIndex::ListByType(const uint8_t type, vector<string> *paths) {
+  Commit();
+  for (LruSet::const_iterator i = lru_.begin(), iEnd = lru_.end();
+       i != iEnd; ++i)
+  {
+    Entry entry;
+    entries_.Lookup(i->second, &entry);
+    if (entry.type == type)
+      paths->push_back(ReadPath(entry));
+  }
+}
+
+
+void JournalIndex::ListPinned(vector<string> *paths) {
+  Commit();
+  for (LruSet::const_iterator i = lru_.begin(), iEnd = lru_.end();
+       i != iEnd; ++i)
+  {
+    Entry entry;
+    entries_.Lookup(i->second, &entry);
+    if (entry.pinned)
+      paths->push_back(ReadPath(entry));
+  }
+}
+
+
+bool JournalIndex::Flush() {
+  if (pending_.empty())
+    return true;
+  if (!WriteFully(fd_, pending_.data(), pending_.length())) {
+    LogCvmfs(kLogQuota, kLogDebug | kLogSyslogErr,
+             "failed to write to cache journal (%d)", errno);
+    return false;
+  }
+  file_size_ += pending_.length();
+  pending_.clear();
+  return true;
+}
+
+
+/**
+ * Writes the pending records to the journal.  Compacts the journal if
+ * necessary.
+ */
+bool JournalIndex::Commit() {
+  if (!Flush())
+    return false;
+
+  if ((num_records_ > kMinRecordsCompaction) &&
+      (num_records_ > kCompactionRatio * size()))
+  {
+    return Compact();
+  }
+  return true;
+}
+
+
+/**
+ * Commits and syncs the journal to disk.  Used after cleanups and rebuilds,
+ * the records in between can be lost in a crash.
+ */
+bool JournalIndex::Checkpoint() {
+  if (!Commit())
+    return false;
+  if (fdatasync(fd_) != 0) {
+    LogCvmfs(kLogQuota, kLogDebug | kLogSyslogErr,
+             "failed to sync cache journal (%d)", errno);
+    return false;
+  }
+  return true;
+}
+
+
+/**
+ * Removes all entries and truncates the journal.
+ */
+bool JournalIndex::Clear() {
+  entries_.Clear();
+  lru_.clear();
+  pending_.clear();
+  total_size_ = 0;
+  max_seq_ = 0;
+  num_records_ = 0;
+  file_size_ = 0;
+  if (ftruncate(fd_, 0) != 0)
+    return false;
+  if (!WriteFully(fd_, kMagic, sizeof(kMagic)))
+    return false;
+  file_size_ = sizeof(kMagic);
+  return true;
+}
+
+}  // namespace quota
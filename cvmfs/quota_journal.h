@@ -0,0 +1,157 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_QUOTA_JOURNAL_H_
+#define CVMFS_QUOTA_JOURNAL_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "hash.h"
+#include "smallhash.h"
+#include "util.h"
+
+namespace quota {
+
+/**
+ * Alternative to the SQLite cache catalog of the quota manager.  The LRU
+ * bookkeeping is kept in memory: a hash table from content hash to entry and
+ * an ordered set of (access sequence number, content hash) pairs.  The oldest
+ * entries are thus found in O(log n).  Every change is appended as a record
+ * to a journal file, which is replayed on startup.  The journal is compacted
+ * into one record per entry when it grows too large.  Torn records at the end
+ * of the journal (crash while writing) are cut off on replay.
+ *
+ * Path names are not kept in memory.  Entries only remember the location of
+ * the path in the journal; listings read the path names from the file.
+ *
+ * Like the pinned column of the SQLite cache catalog, the pinned flag is not
+ * persistent.  All methods must be called from the same thread.
+ */
+class JournalIndex : SingleCopy {
+ public:
+  struct Entry {
+    Entry() : size(0), seq(0), path_offset(0), path_length(0), type(0),
+      pinned(false) { }
+    uint64_t size;
+    /**
+     * Signed to preserve the order of the SQLite cache catalog: volatile
+     * entries have the highest bit set and are evicted first.
+     */
+    int64_t seq;
+    uint64_t path_offset;
+    uint16_t path_length;
+    uint8_t type;
+    bool pinned;
+  };
+
+  static const uint64_t kVolatileFlag = 1ULL << 63;
+  static const unsigned kMaxPathLength = 4096;
+
+  static JournalIndex *Open(const std::string &path);
+  ~JournalIndex();
+
+  bool Lookup(const shash::Any &hash, Entry *entry) const;
+  bool Contains(const shash::Any &hash) const {
+    return entries_.Contains(hash);
+  }
+  void Insert(const shash::Any &hash, const uint64_t size, const int64_t seq,
+              const std::string &path, const uint8_t type, const bool pinned);
+  bool Touch(const shash::Any &hash, const uint64_t seq);
+  bool Unpin(const shash::Any &hash);
+  bool Remove(const shash::Any &hash);
+  uint64_t Evict(const uint64_t nbytes,
+                 const std::map<shash::Any, uint64_t> &keep,
+                 std::vector<shash::Any> *evicted);
+  void ListByType(const uint8_t type, std::vector<std::string> *paths);
+  void ListPinned(std::vector<std::string> *paths);
+  bool Commit();
+  bool Checkpoint();
+  bool Clear();
+
+  uint32_t size() const { return entries_.size(); }
+  uint64_t total_size() const { return total_size_; }
+  uint64_t max_seq() const { return max_seq_; }
+  uint64_t num_records() const { return num_records_; }
+
+ private:
+  enum RecordType {
+    kRecordInsert = 1,
+    kRecordTouch,
+    kRecordRemove,
+  };
+
+  /**
+   * On-disk journal record, followed by path_length bytes of the path name
+   * for insert records.  The checksum covers the rest of the record including
+   * the path.
+   */
+  struct Record {
+    uint32_t checksum;
+    uint8_t record_type;
+    uint8_t algorithm;
+    uint8_t type;
+    uint8_t reserved;
+    uint16_t path_length;
+    uint16_t reserved2;
+    uint32_t reserved3;
+    int64_t seq;
+    uint64_t size;
+    unsigned char digest[shash::kMaxDigestSize];
+  };
+
+  typedef std::set<std::pair<int64_t, shash::Any> > LruSet;
+
+  static const char kMagic[8];
+  /**
+   * Compact if the journal has that many times more records than entries.
+   */
+  static const unsigned kCompactionRatio = 4;
+  static const unsigned kMinRecordsCompaction = 64 * 1024;
+
+  static uint32_t hasher_any(const shash::Any &key) {
+    // Don't start with the first bytes, because == is using them as well
+    return (uint32_t) *(reinterpret_cast<const uint32_t *>(key.digest) + 1);
+  }
+  static uint32_t Checksum(const Record &record, const char *path);
+  static bool SyncDirectory(const std::string &path);
+
+  explicit JournalIndex(const std::string &path);
+  bool Replay();
+  bool Flush();
+  bool Compact();
+  void AppendRecord(const RecordType record_type, const shash::Any &hash,
+                    const uint64_t size, const int64_t seq,
+                    const uint8_t type, const std::string &path);
+  void DoInsert(const shash::Any &hash, const Entry &entry);
+  void DoMove(const shash::Any &hash, Entry *entry, const int64_t seq);
+  void DoErase(const shash::Any &hash, const Entry &entry);
+  std::string ReadPath(const Entry &entry);
+
+  std::string path_;
+  int fd_;
+  /**
+   * Size of the journal file without the pending records.
+   */
+  uint64_t file_size_;
+  std::string pending_;
+  uint64_t num_records_;
+
+  SmallHashDynamic<shash::Any, Entry> entries_;
+  /**
+   * Entries can share a sequence number, e.g. after a rebuild of the journal
+   */
+  LruSet lru_;
+  uint64_t total_size_;
+  uint64_t max_seq_;
+};
+
+}  // namespace quota
+
+#endif  // CVMFS_QUOTA_JOURNAL_H_
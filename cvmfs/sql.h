@@ -109,6 +109,13 @@ class Database : SingleCopy {
   bool BeginTransaction() const;
   bool CommitTransaction() const;
 
+  /**
+   * Lets SQLite access up to size bytes of the database file through a memory
+   * map instead of read() calls, if the VFS supports it.  0 disables memory
+   * mapped access.
+   */
+  bool SetMmapSize(const uint64_t size) const;
+
   template <typename T>
   T GetProperty(const std::string &key) const;
   template <typename T>
@@ -246,6 +246,13 @@ bool Database<DerivedT>::CommitTransaction() const {
 }
 
 
+template <class DerivedT>
+bool Database<DerivedT>::SetMmapSize(const uint64_t size) const {
+  return Sql(sqlite_db(),
+             "PRAGMA mmap_size=" + StringifyInt(size) + ";").Execute();
+}
+
+
 template <class DerivedT>
 bool Database<DerivedT>::CreatePropertiesTable() {
   return Sql(sqlite_db(),
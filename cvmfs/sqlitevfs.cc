@@ -14,6 +14,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdint.h>
+#include <sys/mman.h>
 #include <sys/select.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -25,6 +26,8 @@
 #include <cstring>
 #include <ctime>
 
+#include <algorithm>
+
 #include "duplex_sqlite3.h"
 #include "platform.h"
 #include "smalloc.h"
@@ -52,6 +55,8 @@ struct VfsRdOnly {
     , n_sleep(NULL)
     , sz_sleep(NULL)
     , n_time(NULL)
+    , n_fetch(NULL)
+    , sz_mmap(NULL)
   { }
   perf::Counter *n_access;
   perf::Counter *no_open;
@@ -62,6 +67,8 @@ struct VfsRdOnly {
   perf::Counter *n_sleep;
   perf::Counter *sz_sleep;
   perf::Counter *n_time;
+  perf::Counter *n_fetch;
+  perf::Counter *sz_mmap;
 };
 
 /**
@@ -72,13 +79,32 @@ struct VfsRdOnlyFile {
   VfsRdOnly *vfs_rdonly;
   int fd;
   uint64_t size;
+  /**
+   * Set by SQlite through PRAGMA mmap_size.  Files are mapped up to this
+   * size on the first xFetch call.  0 disables memory mapped access.
+   */
+  int64_t mmap_limit;
+  void *mapping;
+  uint64_t mapping_size;
+  unsigned num_fetched;  /**< Pages handed out and not yet released */
 };
 
 }  // anonymous namespace
 
 
+static void VfsRdOnlyUnmap(VfsRdOnlyFile *p) {
+  if (p->mapping == NULL)
+    return;
+  munmap(p->mapping, p->mapping_size);
+  perf::Xadd(p->vfs_rdonly->sz_mmap, -static_cast<int64_t>(p->mapping_size));
+  p->mapping = NULL;
+  p->mapping_size = 0;
+}
+
+
 static int VfsRdOnlyClose(sqlite3_file *pFile) {
   VfsRdOnlyFile *p = reinterpret_cast<VfsRdOnlyFile *>(pFile);
+  VfsRdOnlyUnmap(p);
   int retval = close(p->fd);
   if (retval == 0) {
     perf::Dec(p->vfs_rdonly->no_open);
@@ -89,7 +115,9 @@ static int VfsRdOnlyClose(sqlite3_file *pFile) {
 
 
 /**
- * On a short read, the remaining bytes must be zero'ed.
+ * On a short read, the remaining bytes must be zero'ed.  Reads within the
+ * memory map don't need a system call.  SQlite reads the file change counter
+ * on every transaction, even if all pages come from the map.
  * TODO(jblomer): the reads seem to be rather small.  Investigate buffered read.
  */
 static int VfsRdOnlyRead(
@@ -99,6 +127,10 @@ static int VfsRdOnlyRead(
   sqlite_int64 iOfst
 ) {
   VfsRdOnlyFile *p = reinterpret_cast<VfsRdOnlyFile *>(pFile);
+  if (static_cast<uint64_t>(iOfst + iAmt) <= p->mapping_size) {
+    memcpy(zBuf, reinterpret_cast<char *>(p->mapping) + iOfst, iAmt);
+    return SQLITE_OK;
+  }
   ssize_t got = pread(p->fd, zBuf, iAmt, iOfst);
   perf::Inc(p->vfs_rdonly->n_read);
   if (got == iAmt) {
@@ -173,14 +205,28 @@ static int VfsRdOnlyCheckReservedLock(
 
 
 /**
- *  No xFileControl() verbs are implemented by this VFS.
+ * Only the mmap size verb is implemented.  Like in the unix VFS, the previous
+ * limit is returned and a new limit becomes effective only if there are no
+ * pages fetched from the current mapping.
  */
 static int VfsRdOnlyFileControl(
-  sqlite3_file *p __attribute__((unused)),
-  int op __attribute__((unused)),
-  void *pArg __attribute__((unused))
+  sqlite3_file *pFile,
+  int op,
+  void *pArg
 ) {
-  return SQLITE_NOTFOUND;
+  if (op != SQLITE_FCNTL_MMAP_SIZE)
+    return SQLITE_NOTFOUND;
+
+  VfsRdOnlyFile *p = reinterpret_cast<VfsRdOnlyFile *>(pFile);
+  const int64_t new_limit = *reinterpret_cast<int64_t *>(pArg);
+  *reinterpret_cast<int64_t *>(pArg) = p->mmap_limit;
+  if ((new_limit >= 0) && (new_limit != p->mmap_limit) &&
+      (p->num_fetched == 0))
+  {
+    VfsRdOnlyUnmap(p);
+    p->mmap_limit = new_limit;
+  }
+  return SQLITE_OK;
 }
 
 
@@ -202,6 +248,67 @@ static int VfsRdOnlyDeviceCharacteristics(
 }
 
 
+/**
+ * Catalogs are immutable, so the file is mapped once and pages are handed out
+ * without copying.  If the requested page lies outside the mapping, *pp stays
+ * NULL and SQlite falls back to xRead.
+ */
+static int VfsRdOnlyFetch(
+  sqlite3_file *pFile,
+  sqlite3_int64 iOfst,
+  int iAmt,
+  void **pp)
+{
+  VfsRdOnlyFile *p = reinterpret_cast<VfsRdOnlyFile *>(pFile);
+  *pp = NULL;
+  if (p->mmap_limit <= 0)
+    return SQLITE_OK;
+
+  if (p->mapping == NULL) {
+    const uint64_t map_size =
+      std::min(p->size, static_cast<uint64_t>(p->mmap_limit));
+    if (map_size == 0)
+      return SQLITE_OK;
+    void *mapping = mmap(NULL, map_size, PROT_READ, MAP_SHARED, p->fd, 0);
+    if (mapping == MAP_FAILED) {
+      // Don't try again, plain reads work as well
+      p->mmap_limit = 0;
+      return SQLITE_OK;
+    }
+    p->mapping = mapping;
+    p->mapping_size = map_size;
+    perf::Xadd(p->vfs_rdonly->sz_mmap, map_size);
+  }
+
+  if (static_cast<uint64_t>(iOfst + iAmt) <= p->mapping_size) {
+    *pp = reinterpret_cast<char *>(p->mapping) + iOfst;
+    p->num_fetched++;
+    perf::Inc(p->vfs_rdonly->n_fetch);
+  }
+  return SQLITE_OK;
+}
+
+
+/**
+ * Releases a page handed out by xFetch.  A NULL page is a request to drop the
+ * mapping.
+ */
+static int VfsRdOnlyUnfetch(
+  sqlite3_file *pFile,
+  sqlite3_int64 iOfst __attribute__((unused)),
+  void *pPage)
+{
+  VfsRdOnlyFile *p = reinterpret_cast<VfsRdOnlyFile *>(pFile);
+  if (pPage != NULL) {
+    assert(p->num_fetched > 0);
+    p->num_fetched--;
+  } else if (p->num_fetched == 0) {
+    VfsRdOnlyUnmap(p);
+  }
+  return SQLITE_OK;
+}
+
+
 /**
  * Supports only read-only opens.
  */
@@ -213,7 +320,7 @@ static int VfsRdOnlyOpen(
   int *pOutFlags)
 {
   static const sqlite3_io_methods io_methods = {
-    1,  // iVersion
+    3,  // iVersion
     VfsRdOnlyClose,
     VfsRdOnlyRead,
     VfsRdOnlyWrite,
@@ -225,7 +332,13 @@ static int VfsRdOnlyOpen(
     VfsRdOnlyCheckReservedLock,
     VfsRdOnlyFileControl,
     VfsRdOnlySectorSize,
-    VfsRdOnlyDeviceCharacteristics
+    VfsRdOnlyDeviceCharacteristics,
+    NULL,  // xShmMap
+    NULL,  // xShmLock
+    NULL,  // xShmBarrier
+    NULL,  // xShmUnmap
+    VfsRdOnlyFetch,
+    VfsRdOnlyUnfetch
   };
 
   VfsRdOnlyFile *p = reinterpret_cast<VfsRdOnlyFile *>(pFile);
@@ -247,6 +360,10 @@ static int VfsRdOnlyOpen(
   if (retval != 0)
     return SQLITE_IOERR_FSTAT;
   p->size = info.st_size;
+  p->mmap_limit = 0;
+  p->mapping = NULL;
+  p->mapping_size = 0;
+  p->num_fetched = 0;
   if (pOutFlags)
     *pOutFlags = flags;
   p->vfs_rdonly = reinterpret_cast<VfsRdOnly *>(vfs->pAppData);
@@ -469,6 +586,11 @@ bool RegisterVfsRdOnly(
     statistics->Register("sqlite.sz_sleep", "overall microseconds slept");
   vfs_rdonly->n_time =
     statistics->Register("sqlite.n_time", "overall number of time() calls");
+  vfs_rdonly->n_fetch =
+    statistics->Register("sqlite.n_fetch",
+                         "overall number of pages served from memory maps");
+  vfs_rdonly->sz_mmap =
+    statistics->Register("sqlite.sz_mmap", "currently memory mapped bytes");
 
   return true;
 }
@@ -197,8 +197,10 @@ bool CommandCheck::Find(const catalog::Catalog *catalog,
       found_nested_marker = true;
     }
 
-    // Check if checksum is not null
-    if (entries[i].IsRegular() && entries[i].checksum().IsNull()) {
+    // Check if checksum is not null (large chunked files may lack a bulk hash)
+    if (entries[i].IsRegular() && !entries[i].IsChunkedFile() &&
+        entries[i].checksum().IsNull())
+    {
       LogCvmfs(kLogCvmfs, kLogStderr,
                "regular file pointing to zero-hash: '%s'", full_path.c_str());
       retval = false;
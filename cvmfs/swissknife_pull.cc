@@ -33,6 +33,7 @@
 #include "smalloc.h"
 #include "upload.h"
 #include "util.h"
+#include "util_concurrency.h"
 
 using namespace std;  // NOLINT
 
@@ -40,6 +41,10 @@ namespace swissknife {
 
 namespace {
 
+// Job types besides the chunk suffixes
+const unsigned char kJobFlush     = 254;
+const unsigned char kJobTerminate = 255;
+
 struct ChunkJob {
   unsigned char type;
   shash::Algorithms hash_algorithm;
@@ -70,6 +75,13 @@ unsigned             retries = 3;
 atomic_int64         overall_chunks;
 atomic_int64         overall_new;
 atomic_int64         chunk_queue;
+// bounds the chunk downloads submitted by the workers
+SynchronizingCounter<unsigned> *fetches_in_flight = NULL;
+// lets the workers wait for each other once they stored all their chunks
+pthread_mutex_t      lock_flush = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t       cond_flush = PTHREAD_COND_INITIALIZER;
+unsigned             num_flushed = 0;
+unsigned             flush_round = 0;
 bool                 preload_cache = false;
 string              *preload_cachedir = NULL;
 
@@ -146,14 +158,127 @@ static void WaitForStorage() {
 }
 
 
+/**
+ * Blocks until all workers processed a flush job.  Every worker takes exactly
+ * one of the flush jobs because it does not read further jobs while waiting.
+ */
+static void WaitForFlush() {
+  pthread_mutex_lock(&lock_flush);
+  const unsigned round = flush_round;
+  if (++num_flushed == num_parallel) {
+    num_flushed = 0;
+    flush_round++;
+    pthread_cond_broadcast(&cond_flush);
+  } else {
+    while (round == flush_round)
+      pthread_cond_wait(&cond_flush, &lock_flush);
+  }
+  pthread_mutex_unlock(&lock_flush);
+}
+
+
+class ChunkDownload;
+typedef FifoChannel<ChunkDownload *> FetchedChunks;
+
+/**
+ * A chunk download submitted by a worker.  Once the download manager reports
+ * the result, the download is handed back to the submitting worker, which
+ * stores the chunk and deletes the download.
+ */
+class ChunkDownload {
+ public:
+  ChunkDownload(const shash::Any &chunk_hash, const string &chunk_path,
+                const char suffix, FetchedChunks *fetched)
+    : chunk_hash_(chunk_hash)
+    , chunk_path_(chunk_path)
+    , suffix_(suffix)
+    , url_(*stratum0_url + "/" + chunk_path)
+    , fetched_(fetched)
+  {
+    if (suffix_ != 0)
+      url_.push_back(suffix_);
+    fchunk_ = CreateTempFile(*temp_dir + "/cvmfs", 0600, "w", &tmp_file_);
+    assert(fchunk_);
+    info_ = new download::JobInfo(&url_, false, false, fchunk_, &chunk_hash_);
+  }
+
+  ~ChunkDownload() { delete info_; }
+
+  void Submit() {
+    fetches_in_flight->Increment();
+    g_download_manager->FetchAsync(info_, g_download_manager->MakeCallback(
+      &ChunkDownload::OnFetched, this));
+  }
+
+  /**
+   * Runs in the download thread.  The channel of the worker never blocks:
+   * the worker empties it before it submits another download and there are
+   * at most num_parallel downloads in flight.
+   */
+  void OnFetched(download::JobInfo * const &info) {
+    const download::Failures retval = info->error_code;
+    if (retval != download::kFailOk) {
+      LogCvmfs(kLogCvmfs, kLogStderr, "failed to download %s (%d - %s), abort",
+               url_.c_str(), retval, download::Code2Ascii(retval));
+      abort();
+    }
+    fetched_->Enqueue(this);
+    fetches_in_flight->Decrement();
+  }
+
+  /**
+   * Runs in the worker that submitted the download
+   */
+  void Finish() {
+    fclose(fchunk_);
+    Store(tmp_file_, chunk_path_, suffix_);
+    atomic_inc64(&overall_new);
+    if (atomic_xadd64(&overall_chunks, 1) % 1000 == 0)
+      LogCvmfs(kLogCvmfs, kLogStdout | kLogNoLinebreak, ".");
+    atomic_dec64(&chunk_queue);
+    delete this;
+  }
+
+ private:
+  const shash::Any chunk_hash_;
+  const string chunk_path_;
+  const char suffix_;
+  string url_;
+  string tmp_file_;
+  FILE *fchunk_;
+  download::JobInfo *info_;
+  FetchedChunks *fetched_;
+};
+
+
+/**
+ * Workers check whether chunks are already present and submit the missing
+ * ones to the download manager without waiting for them.  Finished downloads
+ * come back through the worker's channel and are stored by the worker, before
+ * it takes the next job and, on flush or termination, for all downloads still
+ * pending.
+ */
 static void *MainWorker(void *data) {
+  FetchedChunks fetched(num_parallel, num_parallel);
+  unsigned num_pending = 0;
   while (1) {
+    while (!fetched.IsEmpty()) {
+      fetched.Dequeue()->Finish();
+      num_pending--;
+    }
+
     ChunkJob next_chunk;
     pthread_mutex_lock(&lock_pipe);
     ReadPipe(pipe_chunks[0], &next_chunk, sizeof(next_chunk));
     pthread_mutex_unlock(&lock_pipe);
-    if (next_chunk.type == 255)
-      break;
+    if ((next_chunk.type == kJobFlush) || (next_chunk.type == kJobTerminate)) {
+      for (; num_pending > 0; --num_pending)
+        fetched.Dequeue()->Finish();
+      if (next_chunk.type == kJobTerminate)
+        break;
+      WaitForFlush();
+      continue;
+    }
 
     shash::Any chunk_hash(next_chunk.hash_algorithm, next_chunk.digest,
                           shash::kDigestSizes[next_chunk.hash_algorithm]);
@@ -162,31 +287,11 @@ static void *MainWorker(void *data) {
     string chunk_path = "data" + chunk_hash.MakePathExplicit(1, 2);
 
     if (!Peek(chunk_path, next_chunk.type)) {
-      string tmp_file;
-      FILE *fchunk = CreateTempFile(*temp_dir + "/cvmfs", 0600, "w",
-                                    &tmp_file);
-      assert(fchunk);
-      string url_chunk = *stratum0_url + "/" + chunk_path;
-      if (next_chunk.type != 0)
-        url_chunk.push_back(next_chunk.type);
-      download::JobInfo download_chunk(&url_chunk, false, false, fchunk,
-                                       &chunk_hash);
-
-      unsigned attempts = 0;
-      download::Failures retval;
-      do {
-        retval = g_download_manager->Fetch(&download_chunk);
-        if (retval != download::kFailOk) {
-          LogCvmfs(kLogCvmfs, kLogStderr, "failed to download %s (%d - %s), "
-                   "abort", url_chunk.c_str(),
-                   retval, download::Code2Ascii(retval));
-          abort();
-        }
-        attempts++;
-      } while ((retval != download::kFailOk) && (attempts < retries));
-      fclose(fchunk);
-      Store(tmp_file, chunk_path, next_chunk.type);
-      atomic_inc64(&overall_new);
+      ChunkDownload *chunk_download =
+        new ChunkDownload(chunk_hash, chunk_path, next_chunk.type, &fetched);
+      chunk_download->Submit();
+      num_pending++;
+      continue;
     }
     if (atomic_xadd64(&overall_chunks, 1) % 1000 == 0)
       LogCvmfs(kLogCvmfs, kLogStdout | kLogNoLinebreak, ".");
@@ -288,6 +393,11 @@ static bool Pull(const shash::Any &catalog_hash, const std::string &path) {
     atomic_inc64(&chunk_queue);
   }
   catalog->AllChunksEnd();
+  for (unsigned i = 0; i < num_parallel; ++i) {
+    ChunkJob flush_workers;
+    flush_workers.type = kJobFlush;
+    WritePipe(pipe_chunks[1], &flush_workers, sizeof(flush_workers));
+  }
   while (atomic_read64(&chunk_queue) != 0) {
     SafeSleepMs(100);
   }
@@ -520,6 +630,7 @@ int swissknife::CommandPull::Main(const swissknife::ArgumentList &args) {
   }
 
   // Starting threads
+  fetches_in_flight = new SynchronizingCounter<unsigned>(num_parallel);
   MakePipe(pipe_chunks);
   LogCvmfs(kLogCvmfs, kLogStdout, "Starting %u workers", num_parallel);
   for (unsigned i = 0; i < num_parallel; ++i) {
@@ -543,7 +654,7 @@ int swissknife::CommandPull::Main(const swissknife::ArgumentList &args) {
   LogCvmfs(kLogCvmfs, kLogStdout, "Stopping %u workers", num_parallel);
   for (unsigned i = 0; i < num_parallel; ++i) {
     ChunkJob terminate_workers;
-    terminate_workers.type = 255;
+    terminate_workers.type = kJobTerminate;
     WritePipe(pipe_chunks[1], &terminate_workers, sizeof(terminate_workers));
   }
   for (unsigned i = 0; i < num_parallel; ++i) {
@@ -551,6 +662,9 @@ int swissknife::CommandPull::Main(const swissknife::ArgumentList &args) {
     assert(retval == 0);
   }
   ClosePipe(pipe_chunks);
+  fetches_in_flight->WaitForZero();
+  delete fetches_in_flight;
+  fetches_in_flight = NULL;
 
   if (!retval)
     goto fini;
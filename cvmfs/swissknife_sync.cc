@@ -481,6 +481,7 @@ int swissknife::CommandSync::Main(const swissknife::ArgumentList &args) {
   if (args.find('d') != args.end()) params.stop_for_catalog_tweaks = true;
   if (args.find('g') != args.end()) params.garbage_collectable = true;
   if (args.find('k') != args.end()) params.include_xattrs = true;
+  if (args.find('U') != args.end()) params.use_io_uring = true;
   if (args.find('z') != args.end()) {
     unsigned log_level =
     1 << (kLogLevel0 + String2Uint64(*args.find('z')->second));
@@ -497,6 +498,12 @@ int swissknife::CommandSync::Main(const swissknife::ArgumentList &args) {
       PrintError("Failed to read file chunk size values");
       return 2;
     }
+    if (args.find('C') != args.end())
+      params.chunk_detector = *args.find('C')->second;
+    if (args.find('B') != args.end()) {
+      params.bulk_chunk_threshold =
+        static_cast<size_t>(String2Uint64(*args.find('B')->second));
+    }
   }
   shash::Algorithms hash_algorithm = shash::kSha1;
   if (args.find('e') != args.end()) {
@@ -507,6 +514,16 @@ int swissknife::CommandSync::Main(const swissknife::ArgumentList &args) {
     }
   }
 
+  if (args.find('Z') != args.end()) {
+    const std::string name = *args.find('Z')->second;
+    if (!zlib::ParseAlgorithm(name, &params.compression_algorithm) ||
+        !zlib::IsAlgorithmSupported(params.compression_algorithm))
+    {
+      PrintError("unsupported compression algorithm: " + name);
+      return 1;
+    }
+  }
+
   if (args.find('j') != args.end()) {
     params.catalog_entry_warn_threshold =
       String2Uint64(*args.find('j')->second);
@@ -520,6 +537,14 @@ int swissknife::CommandSync::Main(const swissknife::ArgumentList &args) {
     params.max_concurrent_write_jobs = String2Uint64(*args.find('q')->second);
   }
 
+  if (args.find('T') != args.end()) {
+    params.num_traversal_threads = String2Uint64(*args.find('T')->second);
+  }
+
+  if (args.find('M') != args.end()) {
+    params.memory_limit_mb = String2Uint64(*args.find('M')->second);
+  }
+
   if (!CheckParams(params)) return 2;
 
   // Start spooler
@@ -530,6 +555,15 @@ int swissknife::CommandSync::Main(const swissknife::ArgumentList &args) {
     params.min_file_chunk_size,
     params.avg_file_chunk_size,
     params.max_file_chunk_size);
+  if (!spooler_definition.SetChunkDetectorType(params.chunk_detector)) {
+    PrintError("unknown chunking algorithm");
+    return 2;
+  }
+  spooler_definition.compression_algorithm = params.compression_algorithm;
+  spooler_definition.bulk_chunk_threshold = params.bulk_chunk_threshold;
+  spooler_definition.use_io_uring = params.use_io_uring;
+  spooler_definition.processing_memory_limit =
+    params.memory_limit_mb * 1024 * 1024;
   if (params.max_concurrent_write_jobs > 0) {
     spooler_definition.number_of_concurrent_uploads =
                                                params.max_concurrent_write_jobs;
@@ -564,6 +598,7 @@ int swissknife::CommandSync::Main(const swissknife::ArgumentList &args) {
     return 3;
   }
 
+  sync->set_num_traversal_threads(params.num_traversal_threads);
   sync->Traverse();
 
   LogCvmfs(kLogCvmfs, kLogStdout, "Exporting repository manifest");
@@ -23,12 +23,18 @@ struct SyncParameters {
     stop_for_catalog_tweaks(false),
     garbage_collectable(false),
     include_xattrs(false),
+    use_io_uring(false),
     catalog_entry_warn_threshold(500000),
     min_file_chunk_size(4*1024*1024),
     avg_file_chunk_size(8*1024*1024),
     max_file_chunk_size(16*1024*1024),
+    chunk_detector("xor32"),
+    compression_algorithm(zlib::kZlibDefault),
     manual_revision(0),
-    max_concurrent_write_jobs(0) {}
+    max_concurrent_write_jobs(0),
+    num_traversal_threads(0),
+    bulk_chunk_threshold(0),
+    memory_limit_mb(0) {}
 
   upload::Spooler *spooler;
   std::string      dir_union;
@@ -48,12 +54,18 @@ struct SyncParameters {
   bool             stop_for_catalog_tweaks;
   bool             garbage_collectable;
   bool             include_xattrs;
+  bool             use_io_uring;
   uint64_t         catalog_entry_warn_threshold;
   size_t           min_file_chunk_size;
   size_t           avg_file_chunk_size;
   size_t           max_file_chunk_size;
+  std::string      chunk_detector;
+  zlib::Algorithms compression_algorithm;
   uint64_t         manual_revision;
   uint64_t         max_concurrent_write_jobs;
+  unsigned         num_traversal_threads;
+  size_t           bulk_chunk_threshold;
+  uint64_t         memory_limit_mb;
 };
 
 namespace catalog {
@@ -207,16 +219,30 @@ class CommandSync : public Command {
     r.push_back(Parameter::Switch('g', "repo is garbage collectable"));
     r.push_back(Parameter::Switch('p', "enable file chunking"));
     r.push_back(Parameter::Switch('k', "include extended attributes"));
+    r.push_back(Parameter::Switch('U', "read files through io_uring"));
     r.push_back(Parameter::Optional('z', "log level (0-4, default: 2)"));
     r.push_back(Parameter::Optional('a',
       "desired average chunk size in bytes"));
     r.push_back(Parameter::Optional('l', "minimal file chunk size in bytes"));
     r.push_back(Parameter::Optional('h', "maximal file chunk size in bytes"));
+    r.push_back(Parameter::Optional('C', "chunking algorithm "
+                                         "(xor32 or gear, default: xor32)"));
     r.push_back(Parameter::Optional('f', "union filesystem type"));
+    r.push_back(Parameter::Optional('Z', "compression algorithm for file "
+                                         "contents (zlib or zstd, "
+                                         "default: zlib)"));
     r.push_back(Parameter::Optional('e', "hash algorithm (default: SHA-1)"));
     r.push_back(Parameter::Optional('j', "catalog entry warning threshold"));
     r.push_back(Parameter::Optional('v', "manual revision number"));
     r.push_back(Parameter::Optional('q', "number of concurrent write jobs"));
+    r.push_back(Parameter::Optional('T', "number of threads that read the "
+                                         "scratch area ahead"));
+    r.push_back(Parameter::Optional('B', "store chunked files larger than "
+                                         "this many bytes without bulk "
+                                         "object, not readable by libcvmfs "
+                                         "(default: 0 = never)"));
+    r.push_back(Parameter::Optional('M', "memory limit of the file processing "
+                                         "in megabytes (default: 0 = none)"));
     return r;
   }
   int Main(const ArgumentList &args);
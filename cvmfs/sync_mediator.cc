@@ -204,7 +204,9 @@ manifest::Manifest *SyncMediator::Commit() {
     {
       LogCvmfs(kLogPublish, kLogVerboseMsg, "Spooling hardlink group %s",
                i->master.GetUnionPath().c_str());
-      params_->spooler->Process(i->master.GetUnionPath());
+      // hardlink groups are published without a chunk list, they always need
+      // the bulk object
+      params_->spooler->Process(i->master.GetUnionPath(), false);
     }
 
     params_->spooler->WaitForUpload();
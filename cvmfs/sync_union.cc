@@ -35,6 +35,7 @@ SyncUnion::SyncUnion(SyncMediator *mediator,
   rdonly_path_(rdonly_path),
   scratch_path_(scratch_path),
   union_path_(union_path),
+  num_traversal_threads_(0),
   mediator_(mediator)
 {
   mediator_->RegisterUnionEngine(this);
@@ -158,6 +159,7 @@ void SyncUnionAufs::Traverse() {
   traversal.fn_ignore_file = &SyncUnionAufs::IgnoreFilePredicate;
   traversal.fn_new_dir_prefix = &SyncUnionAufs::ProcessDirectory;
   traversal.fn_new_symlink = &SyncUnionAufs::ProcessSymlink;
+  traversal.set_num_threads(num_traversal_threads_);
 
   traversal.Recurse(scratch_path());
 }
@@ -324,6 +326,7 @@ void SyncUnionOverlayfs::Traverse() {
   traversal.fn_ignore_file = &SyncUnionOverlayfs::IgnoreFilePredicate;
   traversal.fn_new_dir_prefix = &SyncUnionOverlayfs::ProcessDirectory;
   traversal.fn_new_symlink = &SyncUnionOverlayfs::ProcessSymlink;
+  traversal.set_num_threads(num_traversal_threads_);
 
   LogCvmfs(kLogUnionFs, kLogVerboseMsg, "OverlayFS starting traversal "
            "recursion for scratch_path=[%s]",
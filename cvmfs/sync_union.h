@@ -69,6 +69,14 @@ class SyncUnion {
   inline std::string union_path() const { return union_path_; }
   inline std::string scratch_path() const { return scratch_path_; }
 
+  /**
+   * Number of threads that read the scratch area ahead of the traversal
+   * callbacks, see FileSystemTraversal::set_num_threads()
+   */
+  void set_num_traversal_threads(const unsigned num_threads) {
+    num_traversal_threads_ = num_threads;
+  }
+
   /**
    * Whiteout files may have special naming conventions.
    * This method "unmangles" them and retrieves the original file name
@@ -111,6 +119,7 @@ class SyncUnion {
   std::string rdonly_path_;
   std::string scratch_path_;
   std::string union_path_;
+  unsigned num_traversal_threads_;
 
   SyncMediator *mediator_;
 
@@ -146,6 +146,20 @@ static void *MainTalk(void *data __attribute__((unused))) {
           vector<string> ls_catalogs = quota::ListCatalogs();
           AnswerStringList(con_fd, ls_catalogs);
         }
+      } else if (line == "cache rebuild status") {
+        if (quota::GetCapacity() == 0) {
+          Answer(con_fd, "Cache is unmanaged\n");
+        } else {
+          unsigned dirs_scanned;
+          uint64_t files_scanned;
+          if (quota::GetRebuildProgress(&dirs_scanned, &files_scanned)) {
+            Answer(con_fd, "Rebuilding cache database: " +
+                   StringifyInt(dirs_scanned) + " of 256 directories, " +
+                   StringifyInt(files_scanned) + " files scanned\n");
+          } else {
+            Answer(con_fd, "No cache rebuild in progress\n");
+          }
+        }
       } else if (line.substr(0, 7) == "cleanup") {
         if (quota::GetCapacity() == 0) {
           Answer(con_fd, "Cache is unmanaged\n");
@@ -25,6 +25,11 @@ SpoolerDefinition::SpoolerDefinition(
   min_file_chunk_size(min_file_chunk_size),
   avg_file_chunk_size(avg_file_chunk_size),
   max_file_chunk_size(max_file_chunk_size),
+  bulk_chunk_threshold(0),
+  chunk_detector_type(Xor32),
+  compression_algorithm(zlib::kZlibDefault),
+  use_io_uring(false),
+  processing_memory_limit(0),
   number_of_threads(tbb::task_scheduler_init::default_num_threads()),
   number_of_concurrent_uploads(number_of_threads * 100),
   valid_(false)
@@ -63,4 +68,18 @@ SpoolerDefinition::SpoolerDefinition(
   valid_ = true;
 }
 
+
+bool SpoolerDefinition::SetChunkDetectorType(const std::string &name) {
+  if (name == "xor32") {
+    chunk_detector_type = Xor32;
+  } else if (name == "gear") {
+    chunk_detector_type = Gear;
+  } else {
+    LogCvmfs(kLogSpooler, kLogStderr, "unknown chunking algorithm: %s",
+             name.c_str());
+    return false;
+  }
+  return true;
+}
+
 }  // namespace upload
@@ -5,8 +5,11 @@
 #ifndef CVMFS_UPLOAD_SPOOLER_DEFINITION_H_
 #define CVMFS_UPLOAD_SPOOLER_DEFINITION_H_
 
+#include <stdint.h>
+
 #include <string>
 
+#include "compression.h"
 #include "hash.h"
 
 namespace upload {
@@ -26,6 +29,14 @@ struct SpoolerDefinition {
     Unknown
   };
 
+  /**
+   * Content defined chunking algorithm, see chunk_detector.h
+   */
+  enum ChunkDetectorType {
+    Xor32,
+    Gear
+  };
+
   /**
    * Reads a given definition_string as described above and interprets
    * it. If the provided string turns out to be malformed the created
@@ -44,6 +55,12 @@ struct SpoolerDefinition {
     const size_t             max_file_chunk_size = 0);
   bool IsValid() const { return valid_; }
 
+  /**
+   * Sets chunk_detector_type from its name ("xor32" or "gear").
+   * @return  false if the name is unknown
+   */
+  bool SetChunkDetectorType(const std::string &name);
+
   DriverType  driver_type;            //!< the type of the spooler driver
   std::string temporary_path;         //!< scratch space for the FileProcessor
   /**
@@ -57,6 +74,19 @@ struct SpoolerDefinition {
   size_t             min_file_chunk_size;
   size_t             avg_file_chunk_size;
   size_t             max_file_chunk_size;
+  /**
+   * Chunked files larger than this are stored only as chunks, without the
+   * additional bulk object (0: always create the bulk object)
+   */
+  size_t             bulk_chunk_threshold;
+  ChunkDetectorType  chunk_detector_type;
+  zlib::Algorithms   compression_algorithm;
+  bool               use_io_uring;  ///< read files through io_uring
+  /**
+   * Memory limit in bytes for the data buffers of the file processing
+   * pipeline (0: no limit)
+   */
+  uint64_t           processing_memory_limit;
 
   const unsigned int number_of_threads;
   unsigned int       number_of_concurrent_uploads;
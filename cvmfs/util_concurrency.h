@@ -6,10 +6,13 @@
 #define CVMFS_UTIL_CONCURRENCY_H_
 
 #include <pthread.h>
+#include <sched.h>
 
 #include <cassert>
+#include <map>
 #include <queue>
 #include <set>
+#include <utility>
 #include <vector>
 
 #include "atomic.h"
@@ -478,6 +481,188 @@ class FifoChannel : protected std::queue<T> {
 };
 
 
+/**
+ * Bounded, lock-free ring buffer for many producers and a single consumer.
+ * Every slot carries a sequence number that tells whether it is free for the
+ * producer of a given round or filled for the consumer.  Producers only
+ * synchronize on an atomic head position, the consumer owns the tail.
+ * Neither side ever blocks; TryEnqueue() fails on a full ring and
+ * TryDequeue() on an empty one.
+ *
+ * @param T  the (copyable) data type to be stored in the ring
+ */
+template <class T>
+class MpscRing : SingleCopy {
+ public:
+  /**
+   * @param capacity  number of slots, has to be a power of 2
+   */
+  explicit MpscRing(const unsigned capacity);
+  ~MpscRing();
+
+  /**
+   * Thread-safe for any number of producers.
+   *
+   * @param data  the item to be stored
+   * @return      false if the ring is full
+   */
+  bool TryEnqueue(const T &data);
+
+  /**
+   * Must only be called by a single consumer thread.
+   *
+   * @param data  the oldest item in the ring
+   * @return      false if the ring is empty
+   */
+  bool TryDequeue(T *data);
+
+  unsigned capacity() const { return capacity_; }
+
+ private:
+  struct Slot {
+    atomic_int64 sequence;
+    T data;
+  };
+
+  const unsigned capacity_;
+  Slot *slots_;
+  atomic_int64 head_;
+  int64_t tail_;
+};
+
+
+/**
+ * Read-copy-update publication of an immutable object.  Readers never block:
+ * they register in one of two reader counters (selected by the parity of the
+ * current epoch) and use the object until they leave again.  A writer
+ * replaces the object and flips the epoch.  Once the readers of the epoch in
+ * which an object was replaced are gone, nobody can hold a reference to the
+ * old object anymore and it can be freed.
+ *
+ * Publish() waits for that moment.  Replace() doesn't wait; it keeps the old
+ * object in a list of retired objects, which are deleted by later calls to
+ * Replace() or Reclaim() when their readers have left.  The epoch only
+ * advances if the readers of the epoch before have left, so that an object
+ * replaced in epoch e is unused as soon as the epoch reaches e + 2.
+ *
+ * Writers have to be serialized by the caller.  A thread must not call
+ * Publish() or Drain() while it is itself inside a read-side section.
+ *
+ * @param T  the type of the published object
+ */
+template <class T>
+class RcuPtr : SingleCopy {
+ public:
+  explicit RcuPtr(T *object);
+  ~RcuPtr();
+
+  /**
+   * Enters a read-side section.  The returned object stays valid until
+   * Release() is called with the same ticket.
+   */
+  T *Acquire(unsigned *ticket);
+  void Release(const unsigned ticket);
+
+  /**
+   * Installs a new object and waits for the end of the grace period.
+   *
+   * @return  the previous object, which is no longer used by any reader
+   */
+  T *Publish(T *object);
+
+  /**
+   * Installs a new object without waiting for readers.  The previous object
+   * is deleted once it is unused.
+   */
+  void Replace(T *object);
+  /**
+   * Deletes the retired objects that are no longer used.
+   */
+  void Reclaim();
+  /**
+   * Waits until all retired objects are unused and deletes them.
+   */
+  void Drain();
+
+  /**
+   * The current object from the writer's point of view.
+   */
+  T *Peek() const { return object_; }
+  unsigned NumRetired() const { return retired_.size(); }
+
+ private:
+  void Synchronize();
+  bool TryAdvance();
+
+  T * volatile object_;
+  atomic_int32 epoch_;
+  atomic_int32 readers_[2];
+  /**
+   * Replaced objects together with the epoch in which they were replaced
+   */
+  std::vector<std::pair<int32_t, T *> > retired_;
+};
+
+
+/**
+ * Hands out the nodes of a tree to any number of threads such that a node is
+ * only handed out after all its children are done.  Independent subtrees are
+ * processed in parallel.  Used to snapshot nested catalogs, whose parents store
+ * the new content hashes of the children.
+ *
+ * All nodes are registered with Add() before Start().  Afterwards, Next() and
+ * Done() are thread-safe.
+ *
+ * @param T  the node type, only handled by pointer
+ */
+template <class T>
+class BottomUpScheduler : SingleCopy {
+ public:
+  BottomUpScheduler();
+  ~BottomUpScheduler();
+
+  /**
+   * Registers a node.  Unless it is NULL, the parent has to be registered as
+   * well, before or after its children.
+   */
+  void Add(T *node, T *parent);
+  /**
+   * Ends the registration of nodes.
+   *
+   * @return  the number of leafs, which are ready to be processed
+   */
+  unsigned Start();
+
+  /**
+   * Blocks until a node is ready to be processed.
+   *
+   * @return  the next node or NULL once all nodes are done
+   */
+  T *Next();
+  /**
+   * Marks a node returned by Next() as processed.  Its parent becomes ready
+   * once all its children are done.
+   */
+  void Done(T *node);
+
+ private:
+  struct Node {
+    Node() : parent(NULL), pending_children(0) { }
+    T *parent;
+    unsigned pending_children;
+  };
+  typedef std::map<T *, Node> NodeMap;
+
+  NodeMap nodes_;
+  std::vector<T *> ready_;
+  unsigned num_remaining_;
+  bool started_;
+
+  pthread_mutex_t lock_;
+  pthread_cond_t cond_ready_;
+};
+
+
 /**
  * This template implements a generic producer/consumer approach to concurrent
  * worker tasks. It spawns a given number of Workers derived from the base class
@@ -330,6 +330,255 @@ size_t FifoChannel<T>::GetMaximalItemCount() const {
 }
 
 
+//
+// +----------------------------------------------------------------------------
+// |  MpscRing
+//
+
+
+template <class T>
+MpscRing<T>::MpscRing(const unsigned capacity) :
+  capacity_(capacity),
+  tail_(0)
+{
+  assert((capacity_ > 0) && ((capacity_ & (capacity_ - 1)) == 0));
+  slots_ = new Slot[capacity_];
+  for (unsigned i = 0; i < capacity_; ++i)
+    atomic_write64(&slots_[i].sequence, i);
+  atomic_init64(&head_);
+}
+
+
+template <class T>
+MpscRing<T>::~MpscRing() {
+  delete[] slots_;
+}
+
+
+template <class T>
+bool MpscRing<T>::TryEnqueue(const T &data) {
+  int64_t position = atomic_read64(&head_);
+  Slot *slot;
+  while (true) {
+    slot = &slots_[position & (capacity_ - 1)];
+    const int64_t difference = atomic_read64(&slot->sequence) - position;
+    if (difference == 0) {
+      if (atomic_cas64(&head_, position, position + 1))
+        break;
+      position = atomic_read64(&head_);
+    } else if (difference < 0) {
+      // The consumer did not yet free the slot of the previous round
+      return false;
+    } else {
+      position = atomic_read64(&head_);
+    }
+  }
+
+  slot->data = data;
+  atomic_write64(&slot->sequence, position + 1);
+  return true;
+}
+
+
+template <class T>
+bool MpscRing<T>::TryDequeue(T *data) {
+  Slot *slot = &slots_[tail_ & (capacity_ - 1)];
+  if (atomic_read64(&slot->sequence) != tail_ + 1)
+    return false;
+
+  *data = slot->data;
+  atomic_write64(&slot->sequence, tail_ + capacity_);
+  ++tail_;
+  return true;
+}
+
+
+//
+// +----------------------------------------------------------------------------
+// |  RcuPtr
+//
+
+
+template <class T>
+RcuPtr<T>::RcuPtr(T *object) : object_(object) {
+  atomic_init32(&epoch_);
+  atomic_init32(&readers_[0]);
+  atomic_init32(&readers_[1]);
+}
+
+
+template <class T>
+RcuPtr<T>::~RcuPtr() {
+  Drain();
+}
+
+
+template <class T>
+T *RcuPtr<T>::Acquire(unsigned *ticket) {
+  while (true) {
+    const int32_t epoch = atomic_read32(&epoch_);
+    atomic_inc32(&readers_[epoch & 1]);
+    // If the epoch flipped in between, the writer might already wait for the
+    // other counter.  Retry in the new epoch.
+    if (atomic_read32(&epoch_) == epoch) {
+      *ticket = epoch & 1;
+      return object_;
+    }
+    atomic_dec32(&readers_[epoch & 1]);
+  }
+}
+
+
+template <class T>
+void RcuPtr<T>::Release(const unsigned ticket) {
+  atomic_dec32(&readers_[ticket]);
+}
+
+
+template <class T>
+T *RcuPtr<T>::Publish(T *object) {
+  T *previous = object_;
+  object_ = object;
+  Synchronize();
+  return previous;
+}
+
+
+template <class T>
+void RcuPtr<T>::Replace(T *object) {
+  retired_.push_back(std::make_pair(atomic_read32(&epoch_), object_));
+  object_ = object;
+  Reclaim();
+}
+
+
+template <class T>
+void RcuPtr<T>::Reclaim() {
+  // Two flips suffice for everything that is retired so far
+  if (TryAdvance())
+    TryAdvance();
+
+  const uint32_t epoch = atomic_read32(&epoch_);
+  unsigned num_unused = 0;
+  while ((num_unused < retired_.size()) &&
+         (epoch - static_cast<uint32_t>(retired_[num_unused].first) >= 2))
+  {
+    delete retired_[num_unused].second;
+    num_unused++;
+  }
+  retired_.erase(retired_.begin(), retired_.begin() + num_unused);
+}
+
+
+template <class T>
+void RcuPtr<T>::Drain() {
+  while (true) {
+    Reclaim();
+    if (retired_.empty())
+      return;
+    sched_yield();
+  }
+}
+
+
+/**
+ * Flips the epoch if the readers of the previous epoch have left.  Their
+ * counter is reused by the new epoch.  Full barrier: new readers see the
+ * current object.
+ */
+template <class T>
+bool RcuPtr<T>::TryAdvance() {
+  const int32_t epoch = atomic_read32(&epoch_);
+  if (atomic_read32(&readers_[(epoch + 1) & 1]) > 0)
+    return false;
+  atomic_inc32(&epoch_);
+  return true;
+}
+
+
+template <class T>
+void RcuPtr<T>::Synchronize() {
+  const int32_t epoch = atomic_read32(&epoch_);
+  while (!TryAdvance())
+    sched_yield();
+  while (atomic_read32(&readers_[epoch & 1]) > 0)
+    sched_yield();
+}
+
+//
+// +----------------------------------------------------------------------------
+// |  BottomUpScheduler
+//
+
+
+template <class T>
+BottomUpScheduler<T>::BottomUpScheduler() : num_remaining_(0), started_(false)
+{
+  const bool init_successful = (pthread_mutex_init(&lock_, NULL)      == 0 &&
+                                pthread_cond_init(&cond_ready_, NULL) == 0);
+  assert(init_successful);
+}
+
+
+template <class T>
+BottomUpScheduler<T>::~BottomUpScheduler() {
+  pthread_cond_destroy(&cond_ready_);
+  pthread_mutex_destroy(&lock_);
+}
+
+
+template <class T>
+void BottomUpScheduler<T>::Add(T *node, T *parent) {
+  assert(!started_);
+  assert(node != NULL);
+  nodes_[node].parent = parent;
+  if (parent != NULL)
+    nodes_[parent].pending_children++;
+}
+
+
+template <class T>
+unsigned BottomUpScheduler<T>::Start() {
+  assert(!started_);
+  typename NodeMap::const_iterator i = nodes_.begin();
+  typename NodeMap::const_iterator iend = nodes_.end();
+  for (; i != iend; ++i) {
+    if (i->second.pending_children == 0)
+      ready_.push_back(i->first);
+  }
+  num_remaining_ = nodes_.size();
+  started_ = true;
+  return ready_.size();
+}
+
+
+template <class T>
+T *BottomUpScheduler<T>::Next() {
+  MutexLockGuard guard(lock_);
+  assert(started_);
+  while (ready_.empty() && (num_remaining_ > 0))
+    pthread_cond_wait(&cond_ready_, &lock_);
+  if (num_remaining_ == 0)
+    return NULL;
+  T *node = ready_.back();
+  ready_.pop_back();
+  return node;
+}
+
+
+template <class T>
+void BottomUpScheduler<T>::Done(T *node) {
+  MutexLockGuard guard(lock_);
+  assert(num_remaining_ > 0);
+  num_remaining_--;
+  T *parent = nodes_[node].parent;
+  if ((parent != NULL) && (--nodes_[parent].pending_children == 0))
+    ready_.push_back(parent);
+  // Wakes up the waiting threads also when the last node is done
+  pthread_cond_broadcast(&cond_ready_);
+}
+
+
 //
 // +----------------------------------------------------------------------------
 // |  ConcurrentWorkers
@@ -9,10 +9,13 @@
 #include <unistd.h>
 
 #include <cassert>
+#include <string>
+#include <vector>
 
 #include "../../cvmfs/file_processing/async_reader.h"
 #include "../../cvmfs/file_processing/char_buffer.h"
 #include "../../cvmfs/file_processing/file_scrubbing_task.h"
+#include "../../cvmfs/file_processing/io_uring.h"
 #include "../../cvmfs/util.h"
 #include "c_file_sandbox.h"
 
@@ -357,4 +360,51 @@ TEST_F(T_AsyncReader, MultipleWaitsSlow) {
   }
 }
 
+
+
+TEST_F(T_AsyncReader, IoUringReadFiles) {
+  if (!IoUring::IsAvailable())
+    return;
+
+  std::vector<TestFile*> files;
+  files.push_back(new TestFile(GetBigFile(),   GetBigFileHash()));
+  files.push_back(new TestFile(GetEmptyFile(), GetEmptyFileHash()));
+  files.push_back(new TestFile(GetSmallFile(), GetSmallFileHash()));
+  files.push_back(new TestFile(GetSmallFile(), GetSmallFileHash()));
+  files.push_back(new TestFile(GetBigFile(),   GetBigFileHash()));
+
+  const size_t        max_buffer_size = 65536;
+  const unsigned int  max_buffers_in_flight = 3;  // less buffers than files
+  const bool          use_io_uring = true;
+  MyReader reader(max_buffer_size, max_buffers_in_flight, use_io_uring);
+  EXPECT_TRUE(reader.UsesIoUring());
+  reader.Initialize();
+
+  for (unsigned i = 0; i < files.size(); ++i)
+    reader.ScheduleRead(files[i]);
+  reader.Wait();
+
+  for (unsigned i = 0; i < files.size(); ++i) {
+    files[i]->CheckHash();
+    delete files[i];
+  }
+
+  reader.TearDown();
+}
+
+
+TEST_F(T_AsyncReader, IoUringReadHugeFileSlow) {
+  if (!IoUring::IsAvailable())
+    return;
+
+  TestFile *f = new TestFile(GetHugeFile(), GetHugeFileHash());
+  MyReader reader(524288, 10, true);
+  reader.Initialize();
+  reader.ScheduleRead(f);
+  reader.Wait();
+  f->CheckHash();
+  reader.TearDown();
+  delete f;
+}
+
 }  // namespace upload
@@ -186,6 +186,25 @@ TEST_F(T_Atomic, CompareAndSetAtomicInts) {
 }
 
 
+TEST_F(T_Atomic, CompareAndSetAtomicInts64) {
+  const int64_t off1 = 3141592653LL;
+  const int64_t off2 = 2;
+  const int64_t off3 = 0x1FFFFFFFFLL;
+
+  atomic_xadd64(&atomic64_, off1);
+
+  const int32_t res1   = atomic_cas64(&atomic64_, off2, off3);
+  const int64_t value1 = atomic_read64(&atomic64_);
+  EXPECT_FALSE(res1);
+  EXPECT_EQ(off1, value1);
+
+  const int32_t res2   = atomic_cas64(&atomic64_, off1, off3);
+  const int64_t value2 = atomic_read64(&atomic64_);
+  EXPECT_TRUE(res2);
+  EXPECT_EQ(off3, value2);
+}
+
+
 TEST_F(T_Atomic, TransactionalAssignment) {
   const int32_t value1 = 1337;
   const int32_t value2 = 42;
@@ -0,0 +1,72 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "../../cvmfs/bloom_filter.h"
+#include "../../cvmfs/hash.h"
+#include "../../cvmfs/util.h"
+
+using namespace std;  // NOLINT
+
+class T_BloomFilter : public ::testing::Test {
+ protected:
+  static shash::Md5 MakePath(const unsigned i) {
+    const string path = "/some/directory/file" + StringifyInt(i);
+    return shash::Md5(path.data(), path.length());
+  }
+
+  static void Add(BloomFilter *filter, const shash::Md5 &md5path) {
+    uint64_t lo, hi;
+    md5path.ToIntPair(&lo, &hi);
+    filter->Add(lo, hi);
+  }
+
+  static bool MayContain(const BloomFilter &filter, const shash::Md5 &md5path) {
+    uint64_t lo, hi;
+    md5path.ToIntPair(&lo, &hi);
+    return filter.MayContain(lo, hi);
+  }
+};
+
+
+TEST_F(T_BloomFilter, Empty) {
+  BloomFilter filter(0);
+  EXPECT_EQ(0U, filter.num_elements());
+  EXPECT_GT(filter.num_bits(), 0U);
+  EXPECT_EQ(0U, filter.num_bits() % 64);
+  EXPECT_FALSE(MayContain(filter, MakePath(0)));
+  Add(&filter, MakePath(0));
+  EXPECT_TRUE(MayContain(filter, MakePath(0)));
+}
+
+
+TEST_F(T_BloomFilter, NoFalseNegatives) {
+  const unsigned kNumElements = 10000;
+  BloomFilter filter(kNumElements);
+  for (unsigned i = 0; i < kNumElements; ++i)
+    Add(&filter, MakePath(i));
+  EXPECT_EQ(kNumElements, filter.num_elements());
+  for (unsigned i = 0; i < kNumElements; ++i)
+    EXPECT_TRUE(MayContain(filter, MakePath(i)));
+}
+
+
+TEST_F(T_BloomFilter, FalsePositiveRate) {
+  const unsigned kNumElements = 100000;
+  BloomFilter filter(kNumElements);
+  for (unsigned i = 0; i < kNumElements; ++i)
+    Add(&filter, MakePath(i));
+  EXPECT_LE(filter.bytes_allocated(), kNumElements * 10 / 8 + 16);
+
+  unsigned false_positives = 0;
+  for (unsigned i = kNumElements; i < 2 * kNumElements; ++i) {
+    if (MayContain(filter, MakePath(i)))
+      false_positives++;
+  }
+  // Expected rate is ~0.8% with the default parameters
+  EXPECT_LT(false_positives, kNumElements / 50);
+}
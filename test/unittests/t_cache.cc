@@ -0,0 +1,224 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "../../cvmfs/cache.h"
+#include "../../cvmfs/compression.h"
+#include "../../cvmfs/download.h"
+#include "../../cvmfs/file_chunk.h"
+#include "../../cvmfs/hash.h"
+#include "../../cvmfs/loader.h"
+#include "../../cvmfs/quota.h"
+#include "../../cvmfs/util.h"
+#include "../../cvmfs/util_concurrency.h"
+
+using namespace std;  // NOLINT
+
+// Defined by the fuse module
+namespace cvmfs {
+pid_t pid_ = 0;
+string *repository_name_ = NULL;
+bool foreground_ = false;
+}
+loader::CvmfsExports *g_cvmfs_exports = NULL;
+
+namespace cache {
+
+class T_Cache : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    // Reserve a unique name for the directory, file:// URLs need it absolute
+    tmp_path_ = CreateTempPath("/tmp/cvmfs_ut_cache", 0600);
+    ASSERT_FALSE(tmp_path_.empty());
+    ASSERT_EQ(0, unlink(tmp_path_.c_str()));
+    cache_path_ = tmp_path_ + "/cache";
+    server_path_ = tmp_path_ + "/server";
+    ASSERT_TRUE(MkdirDeep(cache_path_, 0700));
+    ASSERT_TRUE(MakeCacheDirectories(server_path_ + "/data", 0700));
+    ASSERT_TRUE(cache::Init(cache_path_, false));
+    ASSERT_TRUE(quota::Init(cache_path_, 0, 0, false));
+
+    download_mgr_.Init(8, false /* use_system_proxy */);
+    download_mgr_.SetHostChain("file://" + server_path_);
+    download_mgr_.Spawn();
+  }
+
+  virtual void TearDown() {
+    download_mgr_.Fini();
+    quota::Fini();
+    cache::Fini();
+    RemoveTree(tmp_path_);
+  }
+
+  // Puts a compressed chunk with the given content on the server
+  FileChunk MakeChunk(const string &content, const bool upload = true) {
+    void *buf;
+    uint64_t size;
+    EXPECT_TRUE(zlib::CompressMem2Mem(content.data(), content.length(),
+                                      &buf, &size));
+    shash::Any hash(shash::kSha1);
+    shash::HashMem(static_cast<unsigned char *>(buf), size, &hash);
+    if (upload) {
+      EXPECT_TRUE(CopyMem2Path(static_cast<unsigned char *>(buf), size,
+                               ServerPath(hash)));
+    }
+    free(buf);
+    return FileChunk(hash, 0, content.length());
+  }
+
+  string ServerPath(const shash::Any &hash) {
+    return server_path_ + "/data" +
+           hash.MakePathWithSuffix(1, 2, shash::kSuffixPartial);
+  }
+
+  string ReadFd(const int fd) {
+    string result;
+    char buf[4096];
+    ssize_t num_bytes;
+    while ((num_bytes = read(fd, buf, sizeof(buf))) > 0)
+      result.append(buf, num_bytes);
+    close(fd);
+    return result;
+  }
+
+  download::DownloadManager download_mgr_;
+  string tmp_path_;
+  string cache_path_;
+  string server_path_;
+};
+
+
+TEST_F(T_Cache, FetchChunks) {
+  const unsigned kNumChunks = 8;
+  FileChunkList chunks;
+  for (unsigned i = 0; i < kNumChunks; ++i)
+    chunks.PushBack(MakeChunk("chunk " + StringifyInt(i)));
+  // The same chunk twice in the list is downloaded only once
+  chunks.PushBack(*chunks.AtPtr(0));
+
+  // Chunk 1 is a cache hit
+  const int64_t num_downloads = GetNumDownloads();
+  ReadFd(FetchChunk(*chunks.AtPtr(1), "chunked", false, &download_mgr_));
+  EXPECT_EQ(num_downloads + 1, GetNumDownloads());
+
+  vector<int> fds;
+  EXPECT_EQ(0U, FetchChunks(chunks, "chunked", false, &download_mgr_, &fds));
+  EXPECT_EQ(num_downloads + kNumChunks, GetNumDownloads());
+  ASSERT_EQ(kNumChunks + 1, fds.size());
+  for (unsigned i = 0; i < kNumChunks; ++i) {
+    ASSERT_GE(fds[i], 0);
+    EXPECT_EQ("chunk " + StringifyInt(i), ReadFd(fds[i]));
+  }
+  ASSERT_GE(fds[kNumChunks], 0);
+  EXPECT_EQ("chunk 0", ReadFd(fds[kNumChunks]));
+
+  // Everything is cached now
+  EXPECT_EQ(0U, FetchChunks(chunks, "chunked", false, &download_mgr_, &fds));
+  EXPECT_EQ(num_downloads + kNumChunks, GetNumDownloads());
+  for (unsigned i = 0; i < fds.size(); ++i) {
+    ASSERT_GE(fds[i], 0);
+    close(fds[i]);
+  }
+}
+
+
+TEST_F(T_Cache, FetchChunksPartialFailure) {
+  FileChunkList chunks;
+  chunks.PushBack(MakeChunk("first"));
+  chunks.PushBack(MakeChunk("missing", false));
+  chunks.PushBack(MakeChunk("third"));
+
+  vector<int> fds;
+  EXPECT_EQ(1U, FetchChunks(chunks, "chunked", false, &download_mgr_, &fds));
+  ASSERT_EQ(3U, fds.size());
+  EXPECT_EQ("first", ReadFd(fds[0]));
+  EXPECT_LT(fds[1], 0);
+  EXPECT_EQ("third", ReadFd(fds[2]));
+  EXPECT_GT(0, Open(chunks.AtPtr(1)->content_hash()));
+
+  // The failed download does not block later attempts
+  MakeChunk("missing");
+  const int fd = FetchChunk(*chunks.AtPtr(1), "chunked", false, &download_mgr_);
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ("missing", ReadFd(fd));
+}
+
+
+TEST_F(T_Cache, PrefetchChunks) {
+  FileChunkList chunks;
+  chunks.PushBack(MakeChunk("first"));
+  chunks.PushBack(MakeChunk("missing", false));
+  chunks.PushBack(MakeChunk("third"));
+  // Cache hits are not downloaded again
+  ReadFd(FetchChunk(*chunks.AtPtr(0), "chunked", false, &download_mgr_));
+
+  SynchronizingCounter<int32_t> num_pending;
+  EXPECT_EQ(2U, PrefetchChunks(chunks, "chunked", false, &download_mgr_,
+                               &num_pending));
+  num_pending.WaitForZero();
+  int fd = Open(chunks.AtPtr(2)->content_hash());
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ("third", ReadFd(fd));
+  EXPECT_GT(0, Open(chunks.AtPtr(1)->content_hash()));
+
+  // Everything that could be fetched is cached now
+  EXPECT_EQ(1U, PrefetchChunks(chunks, "chunked", false, &download_mgr_,
+                               &num_pending));
+  num_pending.WaitForZero();
+  MakeChunk("missing");
+  EXPECT_EQ(1U, PrefetchChunks(chunks, "chunked", false, &download_mgr_,
+                               NULL));
+  // A reader of a chunk that is still prefetched waits for the download
+  fd = FetchChunk(*chunks.AtPtr(1), "chunked", false, &download_mgr_);
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ("missing", ReadFd(fd));
+}
+
+
+TEST_F(T_Cache, BackgroundRebuildGauge) {
+  quota::Fini();
+  const unsigned kNumFiles = 4;
+  const string content(1000, 'x');
+  for (unsigned i = 0; i < kNumFiles; ++i) {
+    shash::Any hash(shash::kSha1);
+    const string name = "file " + StringifyInt(i);
+    shash::HashMem(reinterpret_cast<const unsigned char *>(name.data()),
+                   name.length(), &hash);
+    EXPECT_TRUE(CopyMem2Path(reinterpret_cast<const unsigned char *>(
+                             content.data()), content.length(),
+                             cache_path_ + hash.MakePathExplicit(1, 2)));
+  }
+  ASSERT_TRUE(quota::Init(cache_path_, 10000, 5000, false));
+  EXPECT_EQ(kNumFiles * content.length(), quota::GetSize());
+  quota::Fini();
+
+  // Until the scanned files are merged, the gauge keeps the previous size
+  ASSERT_TRUE(CopyMem2Path(NULL, 0, cache_path_ + "/cachedb.rebuilding"));
+  quota::EnableBackgroundRebuild();
+  ASSERT_TRUE(quota::Init(cache_path_, 10000, 5000, false));
+  EXPECT_EQ(kNumFiles * content.length(), quota::GetSize());
+  quota::Spawn();
+  shash::Any hash(shash::kSha1);
+  hash.Randomize();
+  quota::Insert(hash, 2000, "/inserted");
+  EXPECT_EQ(kNumFiles * content.length() + 2000, quota::GetSize());
+
+  // Going over the limit waits for the rebuild and cleans up
+  hash.Randomize();
+  quota::Insert(hash, 5000, "/large");
+  EXPECT_GE(10000U, quota::GetSize());
+  unsigned dirs_scanned;
+  uint64_t files_scanned;
+  EXPECT_FALSE(quota::GetRebuildProgress(&dirs_scanned, &files_scanned));
+}
+
+}  // namespace cache
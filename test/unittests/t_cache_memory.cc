@@ -0,0 +1,128 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <string>
+
+#include "../../cvmfs/cache_memory.h"
+#include "../../cvmfs/hash.h"
+#include "../../cvmfs/statistics.h"
+#include "../../cvmfs/util.h"
+
+using namespace std;  // NOLINT
+
+class T_MemoryCache : public ::testing::Test {
+ protected:
+  static const uint64_t kMaxBytes = 64 * 1024;
+  static const uint64_t kMaxObjectSize = 16 * 1024;
+
+  virtual void SetUp() {
+    cache_ = new cache::MemoryCache(kMaxBytes, kMaxObjectSize, &statistics_);
+    path_ = CreateTempPath("./cvmfs_ut_cache_memory", 0600);
+    ASSERT_FALSE(path_.empty());
+  }
+
+  virtual void TearDown() {
+    delete cache_;
+    unlink(path_.c_str());
+  }
+
+  // Writes size bytes of content c to the temporary file and opens it
+  int MakeFile(const char c, const uint64_t size) {
+    FILE *f = fopen(path_.c_str(), "w");
+    assert(f != NULL);
+    for (uint64_t i = 0; i < size; ++i)
+      fputc(c, f);
+    fclose(f);
+    return open(path_.c_str(), O_RDONLY);
+  }
+
+  static shash::Any MakeId(const unsigned i) {
+    return shash::Any(shash::kSha1, shash::HexPtr(
+      "0123456789abcdef0123456789abcdef" + StringifyInt(10000000 + i)));
+  }
+
+  int64_t Counter(const string &name) {
+    return statistics_.Lookup(name)->Get();
+  }
+
+  perf::Statistics statistics_;
+  cache::MemoryCache *cache_;
+  string path_;
+};
+
+
+TEST_F(T_MemoryCache, InsertLookup) {
+  const shash::Any id = MakeId(1);
+  EXPECT_EQ(NULL, cache_->Lookup(id));
+  EXPECT_EQ(1, Counter("memcache.n_miss"));
+
+  int fd = MakeFile('x', 100);
+  cache::MemoryObject *object = cache_->Insert(id, fd, 100);
+  close(fd);
+  ASSERT_TRUE(object != NULL);
+  EXPECT_EQ(100U, object->size);
+  EXPECT_EQ('x', object->data[0]);
+  EXPECT_EQ('x', object->data[99]);
+  cache::MemoryCache::Release(object);
+
+  object = cache_->Lookup(id);
+  ASSERT_TRUE(object != NULL);
+  EXPECT_EQ(100U, object->size);
+  cache::MemoryCache::Release(object);
+  EXPECT_EQ(1, Counter("memcache.n_hit"));
+  EXPECT_EQ(1, Counter("memcache.n_insert"));
+  EXPECT_EQ(100, Counter("memcache.sz_bytes"));
+}
+
+
+TEST_F(T_MemoryCache, Limits) {
+  // Too large and short reads are rejected
+  int fd = MakeFile('x', kMaxObjectSize + 1);
+  EXPECT_EQ(NULL, cache_->Insert(MakeId(1), fd, kMaxObjectSize + 1));
+  close(fd);
+  fd = MakeFile('x', kMaxObjectSize - 1);
+  EXPECT_EQ(NULL, cache_->Insert(MakeId(1), fd, kMaxObjectSize));
+  close(fd);
+
+  fd = MakeFile('y', kMaxObjectSize);
+  const unsigned num_objects = 2 * kMaxBytes / kMaxObjectSize;
+  for (unsigned i = 0; i < num_objects; ++i) {
+    cache::MemoryObject *object = cache_->Insert(MakeId(i), fd, kMaxObjectSize);
+    ASSERT_TRUE(object != NULL);
+    cache::MemoryCache::Release(object);
+    EXPECT_LE(Counter("memcache.sz_bytes"), static_cast<int64_t>(kMaxBytes));
+  }
+  close(fd);
+  EXPECT_EQ(num_objects / 2, Counter("memcache.n_evict"));
+  EXPECT_EQ(NULL, cache_->Lookup(MakeId(0)));
+  cache::MemoryObject *object = cache_->Lookup(MakeId(num_objects - 1));
+  EXPECT_TRUE(object != NULL);
+  cache::MemoryCache::Release(object);
+}
+
+
+TEST_F(T_MemoryCache, Handles) {
+  int fd = MakeFile('z', 10);
+  cache::MemoryObject *object = cache_->Insert(MakeId(1), fd, 10);
+  close(fd);
+  ASSERT_TRUE(object != NULL);
+
+  const uint64_t handle = cache::MemoryCache::Object2Handle(object);
+  EXPECT_TRUE(cache::MemoryCache::IsMemoryHandle(handle));
+  EXPECT_FALSE(cache::MemoryCache::IsMemoryHandle(3));
+  EXPECT_FALSE(cache::MemoryCache::IsMemoryHandle(static_cast<uint64_t>(-2)));
+  EXPECT_EQ(object, cache::MemoryCache::Handle2Object(handle));
+
+  // An open handle keeps the object alive beyond the cache
+  delete cache_;
+  cache_ = NULL;
+  EXPECT_EQ('z', object->data[9]);
+  cache::MemoryCache::Release(object);
+}
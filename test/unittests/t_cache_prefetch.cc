@@ -0,0 +1,166 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "../../cvmfs/cache_prefetch.h"
+#include "../../cvmfs/file_chunk.h"
+#include "../../cvmfs/hash.h"
+#include "../../cvmfs/statistics.h"
+#include "../../cvmfs/util_concurrency.h"
+
+using namespace std;  // NOLINT
+
+namespace cache {
+
+static unsigned num_prefetched;
+static bool hold_downloads;
+
+/**
+ * Pretends that every chunk is downloaded.  If hold_downloads is set, the
+ * downloads stay in flight until the test decrements num_pending.
+ */
+static unsigned PrefetchNull(const FileChunkList &chunks,
+                             const string &cvmfs_path,
+                             const bool volatile_content,
+                             download::DownloadManager *download_manager,
+                             SynchronizingCounter<int32_t> *num_pending)
+{
+  num_prefetched += chunks.size();
+  if (hold_downloads) {
+    for (unsigned i = 0; i < chunks.size(); ++i)
+      num_pending->Increment();
+  }
+  return chunks.size();
+}
+
+
+class T_ChunkPrefetcher : public ::testing::Test {
+ protected:
+  static const unsigned kNumChunks = 32;
+  static const unsigned kChunkSize = 1000;
+
+  virtual void SetUp() {
+    for (unsigned i = 0; i < kNumChunks; ++i) {
+      chunk_list_.PushBack(
+        FileChunk(shash::Any(shash::kSha1), i * kChunkSize, kChunkSize));
+    }
+    chunks_ = FileChunkReflist(&chunk_list_, PathString("/chunked"));
+    num_prefetched = 0;
+    hold_downloads = false;
+  }
+
+  void ReadChunk(ChunkPrefetcher *prefetcher, const unsigned idx) {
+    prefetcher->OnRead(1, chunks_, idx, idx, idx * kChunkSize, kChunkSize,
+                       false);
+  }
+
+  int64_t GetCounter(const string &name) {
+    return statistics_.Lookup(name)->Get();
+  }
+
+  perf::Statistics statistics_;
+  FileChunkList chunk_list_;
+  FileChunkReflist chunks_;
+};
+
+
+TEST_F(T_ChunkPrefetcher, Sequential) {
+  ChunkPrefetcher prefetcher(4, PrefetchNull, NULL, &statistics_);
+
+  ReadChunk(&prefetcher, 0);
+  EXPECT_EQ(0U, num_prefetched);
+  // Sequential from now on, the read-ahead starts with a single chunk
+  ReadChunk(&prefetcher, 1);
+  EXPECT_EQ(1U, num_prefetched);
+  EXPECT_EQ(2U, prefetcher.streams_[1].window_begin);
+  EXPECT_EQ(3U, prefetcher.streams_[1].window_end);
+
+  // Every hit doubles the distance
+  ReadChunk(&prefetcher, 2);
+  EXPECT_EQ(2U, prefetcher.streams_[1].distance);
+  EXPECT_EQ(3U, num_prefetched);
+  EXPECT_EQ(5U, prefetcher.streams_[1].window_end);
+  ReadChunk(&prefetcher, 3);
+  EXPECT_EQ(4U, prefetcher.streams_[1].distance);
+  EXPECT_EQ(6U, num_prefetched);
+  EXPECT_EQ(8U, prefetcher.streams_[1].window_end);
+  // ...up to the window
+  ReadChunk(&prefetcher, 4);
+  EXPECT_EQ(4U, prefetcher.streams_[1].distance);
+  EXPECT_EQ(7U, num_prefetched);
+  EXPECT_EQ(9U, prefetcher.streams_[1].window_end);
+
+  EXPECT_EQ(7, GetCounter("prefetch.n_issued"));
+  EXPECT_EQ(3, GetCounter("prefetch.n_hit"));
+  EXPECT_EQ(0, GetCounter("prefetch.n_waste"));
+
+  // Chunks 5 to 8 were never read
+  prefetcher.OnRelease(1);
+  EXPECT_EQ(4, GetCounter("prefetch.n_waste"));
+  EXPECT_TRUE(prefetcher.streams_.empty());
+
+  // The end of the file limits the read-ahead
+  for (unsigned i = kNumChunks - 4; i < kNumChunks; ++i)
+    ReadChunk(&prefetcher, i);
+  EXPECT_EQ(chunk_list_.size(), prefetcher.streams_[1].window_end);
+}
+
+
+TEST_F(T_ChunkPrefetcher, Seek) {
+  ChunkPrefetcher prefetcher(8, PrefetchNull, NULL, &statistics_);
+
+  for (unsigned i = 0; i < 4; ++i)
+    ReadChunk(&prefetcher, i);
+  EXPECT_EQ(4U, prefetcher.streams_[1].distance);
+  EXPECT_EQ(4U, prefetcher.streams_[1].window_begin);
+  EXPECT_EQ(8U, prefetcher.streams_[1].window_end);
+  const int64_t issued = GetCounter("prefetch.n_issued");
+
+  // Seeking resets the detector and skips the scheduled chunks
+  ReadChunk(&prefetcher, 10);
+  EXPECT_EQ(0U, prefetcher.streams_[1].streak);
+  EXPECT_EQ(1U, prefetcher.streams_[1].distance);
+  EXPECT_EQ(4, GetCounter("prefetch.n_waste"));
+  EXPECT_EQ(issued, GetCounter("prefetch.n_issued"));
+
+  ReadChunk(&prefetcher, 11);
+  EXPECT_EQ(issued, GetCounter("prefetch.n_issued"));
+  ReadChunk(&prefetcher, 12);
+  EXPECT_EQ(issued + 1, GetCounter("prefetch.n_issued"));
+  EXPECT_EQ(13U, prefetcher.streams_[1].window_begin);
+  EXPECT_EQ(14U, prefetcher.streams_[1].window_end);
+
+  // Reading several chunks at once accounts for all of them
+  prefetcher.OnRead(1, chunks_, 13, 14, 13 * kChunkSize, 2 * kChunkSize,
+                    false);
+  EXPECT_EQ(3, GetCounter("prefetch.n_hit"));
+  EXPECT_EQ(2U, prefetcher.streams_[1].distance);
+  EXPECT_EQ(17U, prefetcher.streams_[1].window_end);
+}
+
+
+TEST_F(T_ChunkPrefetcher, Pending) {
+  ChunkPrefetcher prefetcher(1, PrefetchNull, NULL, &statistics_);
+  hold_downloads = true;
+
+  // A window of one chunk allows for 16 downloads in flight
+  for (unsigned i = 0; i < 18; ++i)
+    ReadChunk(&prefetcher, i);
+  EXPECT_EQ(16U, num_prefetched);
+  EXPECT_EQ(16, static_cast<int32_t>(prefetcher.num_pending_));
+  EXPECT_EQ(16, GetCounter("prefetch.n_issued"));
+  EXPECT_EQ(1, GetCounter("prefetch.n_dropped"));
+
+  // Finished downloads make room again
+  for (unsigned i = 0; i < 16; ++i)
+    prefetcher.num_pending_.Decrement();
+  ReadChunk(&prefetcher, 18);
+  EXPECT_EQ(17U, num_prefetched);
+  prefetcher.num_pending_.Decrement();
+}
+
+}  // namespace cache
@@ -0,0 +1,391 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+
+#include "../../cvmfs/atomic.h"
+#include "../../cvmfs/catalog.h"
+#include "../../cvmfs/catalog_mgr.h"
+#include "../../cvmfs/catalog_sql.h"
+#include "../../cvmfs/hash.h"
+#include "../../cvmfs/shortstring.h"
+#include "../../cvmfs/util.h"
+#include "testutil.h"
+
+using namespace std;  // NOLINT
+
+namespace catalog {
+
+// Catalogs are deleted by the base class destructor, too, so the counter
+// cannot live in the catalog manager
+static atomic_int32 num_deleted;
+
+/**
+ * Counts its deletion
+ */
+class MockCatalog : public Catalog {
+ public:
+  MockCatalog(const PathString &mountpoint, const shash::Any &catalog_hash,
+              Catalog *parent)
+    : Catalog(mountpoint, catalog_hash, parent)
+  { }
+  virtual ~MockCatalog() { atomic_inc32(&num_deleted); }
+};
+
+
+/**
+ * Serves catalog files from the local disk, optionally with a delay that
+ * simulates the download.  Loads can be held back until they are released.
+ */
+class MockCatalogManager : public AbstractCatalogManager {
+ public:
+  MockCatalogManager() : load_delay_ms(0) {
+    atomic_init32(&num_loads);
+    atomic_init32(&num_discarded);
+    atomic_init32(&num_held);
+    atomic_init32(&hold_loads);
+    atomic_init32(&num_running_loads);
+    atomic_init32(&num_parallel_loads);
+  }
+
+  // Mounts the nested catalogs of path the way a writer does, i.e. under the
+  // write lock
+  void MountUnderLock(const PathString &path) {
+    WriteLock();
+    Catalog *leaf;
+    bool retval = MountSubtree(path, NULL, &leaf);
+    assert(retval);
+    Unlock();
+  }
+
+  map<PathString, string> files;
+  unsigned load_delay_ms;
+  atomic_int32 num_loads;
+  atomic_int32 num_discarded;
+  atomic_int32 num_held;
+  atomic_int32 hold_loads;
+  atomic_int32 num_running_loads;
+  atomic_int32 num_parallel_loads;  /**< started while another one ran */
+
+ protected:
+  virtual LoadError LoadCatalog(const PathString &mountpoint,
+                                const shash::Any &hash,
+                                string *catalog_path,
+                                shash::Any *catalog_hash)
+  {
+    if (catalog_path == NULL)
+      return kLoadUp2Date;
+    if (atomic_xadd32(&num_running_loads, 1) > 0)
+      atomic_inc32(&num_parallel_loads);
+    if (atomic_read32(&hold_loads)) {
+      atomic_inc32(&num_held);
+      while (atomic_read32(&hold_loads))
+        SafeSleepMs(1);
+    }
+    if (load_delay_ms > 0)
+      SafeSleepMs(load_delay_ms);
+    atomic_inc32(&num_loads);
+    atomic_dec32(&num_running_loads);
+    *catalog_path = files[mountpoint];
+    *catalog_hash = hash;
+    return kLoadNew;
+  }
+
+  virtual void DiscardCatalog(const shash::Any &catalog_hash) {
+    atomic_inc32(&num_discarded);
+  }
+
+  virtual Catalog *CreateCatalog(const PathString &mountpoint,
+                                 const shash::Any &catalog_hash,
+                                 Catalog *parent_catalog)
+  {
+    return new MockCatalog(mountpoint, catalog_hash, parent_catalog);
+  }
+};
+
+}  // namespace catalog
+
+
+class T_CatalogManager : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    atomic_init32(&catalog::num_deleted);
+    // Root catalog with /dir and the nested catalog mountpoints /nested and
+    // /nested2
+    root_path_ = CreateTempPath("./cvmfs_ut_catalog_mgr", 0600);
+    ASSERT_FALSE(root_path_.empty());
+    catalog::CatalogDatabase *db = CreateDatabase(root_path_, "");
+    catalog::DirectoryEntry mountpoint =
+      catalog::DirectoryEntryTestFactory::Directory();
+    mountpoint.set_is_nested_catalog_mountpoint(true);
+    InsertEntry(db, "/dir", catalog::DirectoryEntryTestFactory::Directory());
+    InsertEntry(db, "/nested", mountpoint);
+    InsertEntry(db, "/nested2", mountpoint);
+    ASSERT_TRUE(sqlite::Sql(db->sqlite_db(),
+      "INSERT INTO nested_catalogs (path, sha1, size) VALUES "
+      "('/nested', '" + NestedHash(1).ToString() + "', 0), "
+      "('/nested2', '" + NestedHash(2).ToString() + "', 0);").Execute());
+    delete db;
+
+    nested_path_ = CreateNested("/nested");
+    nested2_path_ = CreateNested("/nested2");
+
+    catalog_mgr_ = new catalog::MockCatalogManager();
+    catalog_mgr_->files[PathString("")] = root_path_;
+    catalog_mgr_->files[PathString("/nested")] = nested_path_;
+    catalog_mgr_->files[PathString("/nested2")] = nested2_path_;
+    ASSERT_TRUE(catalog_mgr_->Init());
+  }
+
+  virtual void TearDown() {
+    delete catalog_mgr_;
+    unlink(root_path_.c_str());
+    unlink(nested_path_.c_str());
+    unlink(nested2_path_.c_str());
+  }
+
+  static shash::Any NestedHash(const unsigned i) {
+    return h("0123456789abcdef0123456789abcdef0123456" + StringifyInt(i),
+             shash::kSuffixCatalog);
+  }
+
+  static string CreateNested(const string &mountpoint) {
+    const string path = CreateTempPath("./cvmfs_ut_catalog_mgr", 0600);
+    assert(!path.empty());
+    catalog::CatalogDatabase *db = CreateDatabase(path, mountpoint);
+    InsertEntry(db, mountpoint + "/file",
+                catalog::DirectoryEntryTestFactory::RegularFile());
+    delete db;
+    return path;
+  }
+
+  static catalog::CatalogDatabase *CreateDatabase(const string &path,
+                                                  const string &root_path)
+  {
+    catalog::CatalogDatabase *db = catalog::CatalogDatabase::Create(path);
+    assert(db != NULL);
+    catalog::DirectoryEntry root_entry =
+      catalog::DirectoryEntryTestFactory::Directory();
+    if (!root_path.empty())
+      root_entry.set_is_nested_catalog_root(true);
+    const bool retval = db->InsertInitialValues(root_path, false, root_entry);
+    assert(retval);
+    return db;
+  }
+
+  static void InsertEntry(catalog::CatalogDatabase *db, const string &path,
+                          const catalog::DirectoryEntry &dirent)
+  {
+    catalog::SqlDirentInsert sql_insert(*db);
+    const string parent_path = GetParentPath(path);
+    const bool retval =
+      sql_insert.BindPathHash(shash::Md5(path.data(), path.length())) &&
+      sql_insert.BindParentPathHash(
+        shash::Md5(parent_path.data(), parent_path.length())) &&
+      sql_insert.BindDirent(dirent) &&
+      sql_insert.Execute();
+    assert(retval);
+  }
+
+  bool Lookup(const string &path) {
+    catalog::DirectoryEntry dirent;
+    return catalog_mgr_->LookupPath(path, catalog::kLookupSole, &dirent);
+  }
+
+  catalog::MockCatalogManager *catalog_mgr_;
+  string root_path_;
+  string nested_path_;
+  string nested2_path_;
+};
+
+
+TEST_F(T_CatalogManager, LookupNested) {
+  EXPECT_EQ(1, catalog_mgr_->GetNumCatalogs());
+  EXPECT_TRUE(Lookup(""));
+  EXPECT_TRUE(Lookup("/dir"));
+  EXPECT_FALSE(Lookup("/none"));
+  EXPECT_FALSE(Lookup("/dir/none"));
+  EXPECT_EQ(1, catalog_mgr_->GetNumCatalogs());
+
+  EXPECT_TRUE(Lookup("/nested/file"));
+  EXPECT_EQ(2, catalog_mgr_->GetNumCatalogs());
+  EXPECT_FALSE(Lookup("/nested/none"));
+  EXPECT_FALSE(Lookup("/nestedfile"));
+
+  // Transition point, the parent is found in the root catalog
+  catalog::DirectoryEntry dirent;
+  EXPECT_TRUE(catalog_mgr_->LookupPath(string("/nested"), catalog::kLookupFull,
+                                       &dirent));
+  EXPECT_TRUE(dirent.IsNestedCatalogRoot());
+  EXPECT_EQ(catalog_mgr_->GetRootInode(), dirent.parent_inode());
+
+  catalog::DirectoryEntryList listing;
+  EXPECT_TRUE(catalog_mgr_->Listing(string("/nested"), &listing));
+  EXPECT_EQ(1U, listing.size());
+  EXPECT_EQ(2, atomic_read32(&catalog_mgr_->num_loads));
+}
+
+
+TEST_F(T_CatalogManager, DetachNested) {
+  EXPECT_TRUE(Lookup("/nested/file"));
+  EXPECT_EQ(2, catalog_mgr_->GetNumCatalogs());
+  catalog_mgr_->DetachNested();
+  EXPECT_EQ(1, catalog_mgr_->GetNumCatalogs());
+  EXPECT_TRUE(Lookup("/dir"));
+  EXPECT_TRUE(Lookup("/nested/file"));
+  EXPECT_EQ(2, catalog_mgr_->GetNumCatalogs());
+  EXPECT_EQ(3, atomic_read32(&catalog_mgr_->num_loads));
+}
+
+
+struct MountThreadInfo {
+  catalog::MockCatalogManager *catalog_mgr;
+  PathString path;
+  bool found;
+};
+
+static void *MainMount(void *data) {
+  MountThreadInfo *info = reinterpret_cast<MountThreadInfo *>(data);
+  catalog::DirectoryEntry dirent;
+  info->found =
+    info->catalog_mgr->LookupPath(info->path, catalog::kLookupSole, &dirent);
+  return NULL;
+}
+
+
+// Concurrent lookups below the same nested catalog download it only once,
+// different nested catalogs are downloaded in parallel
+TEST_F(T_CatalogManager, ConcurrentMount) {
+  const unsigned kNumThreads = 6;
+  const unsigned kLoadDelayMs = 200;
+  catalog_mgr_->load_delay_ms = kLoadDelayMs;
+
+  pthread_t threads[kNumThreads];
+  MountThreadInfo infos[kNumThreads];
+  for (unsigned i = 0; i < kNumThreads; ++i) {
+    infos[i].catalog_mgr = catalog_mgr_;
+    infos[i].path = PathString((i % 2) ? "/nested/file" : "/nested2/file");
+    infos[i].found = false;
+    int retval = pthread_create(&threads[i], NULL, MainMount, &infos[i]);
+    ASSERT_EQ(0, retval);
+  }
+  for (unsigned i = 0; i < kNumThreads; ++i) {
+    pthread_join(threads[i], NULL);
+    EXPECT_TRUE(infos[i].found);
+  }
+
+  EXPECT_EQ(3, catalog_mgr_->GetNumCatalogs());
+  EXPECT_EQ(3, atomic_read32(&catalog_mgr_->num_loads));
+  EXPECT_EQ(1, atomic_read32(&catalog_mgr_->num_parallel_loads));
+  EXPECT_EQ(0, atomic_read32(&catalog_mgr_->num_discarded));
+}
+
+
+// The nested catalog is mounted by a writer while a lookup downloads it.  The
+// lookup drops its copy and uses the mounted catalog.
+TEST_F(T_CatalogManager, MountedDuringLoad) {
+  atomic_write32(&catalog_mgr_->hold_loads, 1);
+  pthread_t thread;
+  MountThreadInfo info;
+  info.catalog_mgr = catalog_mgr_;
+  info.path = PathString("/nested/file");
+  info.found = false;
+  ASSERT_EQ(0, pthread_create(&thread, NULL, MainMount, &info));
+  while (atomic_read32(&catalog_mgr_->num_held) == 0)
+    SafeSleepMs(1);
+
+  atomic_write32(&catalog_mgr_->hold_loads, 0);
+  catalog_mgr_->MountUnderLock(PathString("/nested/file"));
+  EXPECT_EQ(2, catalog_mgr_->GetNumCatalogs());
+  pthread_join(thread, NULL);
+  EXPECT_TRUE(info.found);
+
+  EXPECT_EQ(2, catalog_mgr_->GetNumCatalogs());
+  EXPECT_EQ(3, atomic_read32(&catalog_mgr_->num_loads));
+  EXPECT_EQ(1, atomic_read32(&catalog_mgr_->num_discarded));
+}
+
+
+struct LookupThreadInfo {
+  catalog::MockCatalogManager *catalog_mgr;
+  atomic_int32 *stop;
+  uint64_t num_lookups;
+  uint64_t num_failed;
+  uint64_t num_torn;
+};
+
+static void *MainLookup(void *data) {
+  LookupThreadInfo *info = reinterpret_cast<LookupThreadInfo *>(data);
+  const PathString path("/dir");
+  const PathString mountpoint("/nested");
+  catalog::DirectoryEntry dirent;
+  while (atomic_read32(info->stop) == 0) {
+    if (!info->catalog_mgr->LookupPath(path, catalog::kLookupSole, &dirent))
+      info->num_failed++;
+    // Whether or not the nested catalog is attached, the mount point and its
+    // parent have to be found
+    if (!info->catalog_mgr->LookupPath(mountpoint, catalog::kLookupFull,
+                                       &dirent) ||
+        (dirent.parent_inode() != info->catalog_mgr->GetRootInode()))
+    {
+      info->num_torn++;
+    }
+    const int num_catalogs = info->catalog_mgr->GetNumCatalogs();
+    if ((num_catalogs < 1) || (num_catalogs > 2))
+      info->num_torn++;
+    info->num_lookups++;
+  }
+  return NULL;
+}
+
+// Lookups in the root catalog continue while nested catalogs are mounted and
+// detached, and they never see a partially changed tree.  With the catalog
+// manager lock, every lookup would stall for the duration of the nested
+// catalog download.
+TEST_F(T_CatalogManager, ConcurrentLookupSlow) {
+  const unsigned kNumThreads = 4;
+  const unsigned kNumRounds = 10;
+  catalog_mgr_->load_delay_ms = 100;
+
+  atomic_int32 stop;
+  atomic_init32(&stop);
+  pthread_t threads[kNumThreads];
+  LookupThreadInfo infos[kNumThreads];
+  for (unsigned i = 0; i < kNumThreads; ++i) {
+    infos[i].catalog_mgr = catalog_mgr_;
+    infos[i].stop = &stop;
+    infos[i].num_lookups = 0;
+    infos[i].num_failed = 0;
+    infos[i].num_torn = 0;
+    int retval = pthread_create(&threads[i], NULL, MainLookup, &infos[i]);
+    ASSERT_EQ(0, retval);
+  }
+
+  for (unsigned i = 0; i < kNumRounds; ++i) {
+    EXPECT_TRUE(Lookup("/nested/file"));
+    catalog_mgr_->DetachNested();
+  }
+  atomic_write32(&stop, 1);
+
+  for (unsigned i = 0; i < kNumThreads; ++i) {
+    pthread_join(threads[i], NULL);
+    EXPECT_LT(0U, infos[i].num_lookups);
+    EXPECT_EQ(0U, infos[i].num_failed);
+    EXPECT_EQ(0U, infos[i].num_torn);
+  }
+  // One download per mount, the root catalog is loaded by Init()
+  EXPECT_EQ(static_cast<int>(1 + kNumRounds),
+            atomic_read32(&catalog_mgr_->num_loads));
+
+  // Without readers, the next change frees all detached catalogs
+  catalog_mgr_->DetachNested();
+  EXPECT_EQ(static_cast<int>(kNumRounds),
+            atomic_read32(&catalog::num_deleted));
+}
@@ -4,6 +4,9 @@
 
 #include <gtest/gtest.h>
 
+#include <set>
+#include <string>
+
 #include "../../cvmfs/catalog_counters.h"
 #include "../../cvmfs/catalog_sql.h"
 #include "../../cvmfs/util.h"
@@ -147,3 +150,67 @@ TEST_F(T_CatalogSql, SchemaMigration) {
     EXPECT_EQ(0, sql5.RetrieveInt(0));
   }
 }
+
+
+static void InsertEntry(catalog::CatalogDatabase *db, const int md5path,
+                        const shash::Any *hash, const int flags)
+{
+  const string hash_blob = (hash == NULL) ? "NULL" :
+    "x'" + hash->ToString() + "'";
+  ASSERT_TRUE(sqlite::Sql(db->sqlite_db(),
+    "INSERT INTO catalog (md5path_1, md5path_2, parent_1, parent_2, hash, "
+    "flags) VALUES (" + StringifyInt(md5path) + ", " + StringifyInt(md5path) +
+    ", 0, 0, " + hash_blob + ", " + StringifyInt(flags) + ");").Execute());
+}
+
+
+static void InsertChunk(catalog::CatalogDatabase *db, const int md5path,
+                        const int offset, const shash::Any &hash)
+{
+  ASSERT_TRUE(sqlite::Sql(db->sqlite_db(),
+    "INSERT INTO chunks (md5path_1, md5path_2, offset, size, hash) VALUES (" +
+    StringifyInt(md5path) + ", " + StringifyInt(md5path) + ", " +
+    StringifyInt(offset) + ", 1, x'" + hash.ToString() + "');").Execute());
+}
+
+
+TEST_F(T_CatalogSql, ListContentHashes) {
+  string path;
+  FILE *ftmp = CreateTempFile("/tmp/cvmfs-test", 0600, "w+", &path);
+  ASSERT_TRUE(ftmp != NULL);
+  fclose(ftmp);
+  UnlinkGuard unlink_guard(path);
+
+  UniquePtr<catalog::CatalogDatabase>
+    db(catalog::CatalogDatabase::Create(path));
+  ASSERT_TRUE(db.IsValid());
+  const int kFlagChunkedFile =
+    catalog::SqlDirent::kFlagFile | catalog::SqlDirent::kFlagFileChunk;
+  shash::Any hashes[5];
+  for (unsigned i = 0; i < 5; ++i) {
+    hashes[i] = shash::Any(shash::kSha1);
+    hashes[i].Randomize();
+  }
+  // A regular file, a chunked file with bulk object and a chunked file
+  // without bulk object (swissknife sync -B)
+  InsertEntry(db.weak_ref(), 1, &hashes[0], catalog::SqlDirent::kFlagFile);
+  InsertEntry(db.weak_ref(), 2, &hashes[1], kFlagChunkedFile);
+  InsertChunk(db.weak_ref(), 2, 0, hashes[2]);
+  InsertEntry(db.weak_ref(), 3, NULL, kFlagChunkedFile);
+  InsertChunk(db.weak_ref(), 3, 0, hashes[3]);
+  InsertChunk(db.weak_ref(), 3, 1, hashes[4]);
+
+  set<string> expected;
+  expected.insert(hashes[0].ToString(true));
+  expected.insert(hashes[1].ToString(true));
+  for (unsigned i = 2; i < 5; ++i) {
+    hashes[i].suffix = shash::kSuffixPartial;
+    expected.insert(hashes[i].ToString(true));
+  }
+
+  set<string> listed;
+  catalog::SqlListContentHashes sql(*db);
+  while (sql.FetchRow())
+    listed.insert(sql.GetHash().ToString(true));
+  EXPECT_EQ(expected, listed);
+}
@@ -0,0 +1,189 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <vector>
+
+#include "../../cvmfs/file_processing/char_buffer_pool.h"
+
+using upload::CharBuffer;
+using upload::CharBufferPool;
+
+
+TEST(T_CharBufferPool, SizeClasses) {
+  CharBufferPool pool;
+
+  CharBuffer *small = pool.Acquire(1);
+  EXPECT_EQ(4096u, small->size());
+  EXPECT_EQ(0u,    small->used_bytes());
+
+  CharBuffer *medium = pool.Acquire(512 * 1024);
+  EXPECT_EQ(512u * 1024u, medium->size());
+
+  CharBuffer *bigger = pool.Acquire(512 * 1024 + 1);
+  EXPECT_EQ(1024u * 1024u, bigger->size());
+
+  // not pooled
+  const size_t huge_size = 16 * 1024 * 1024 + 1;
+  CharBuffer *huge = pool.Acquire(huge_size);
+  EXPECT_EQ(huge_size, huge->size());
+
+  CharBufferPool::Statistics stats = pool.GetStatistics();
+  EXPECT_EQ(4u, stats.acquisitions);
+  EXPECT_EQ(0u, stats.hits);
+  EXPECT_EQ(4096u + 512u * 1024u + 1024u * 1024u + huge_size,
+            stats.bytes_in_use);
+
+  pool.Release(small);
+  pool.Release(medium);
+  pool.Release(bigger);
+  pool.Release(huge);
+
+  stats = pool.GetStatistics();
+  EXPECT_EQ(0u, stats.bytes_in_use);
+  EXPECT_EQ(4096u + 512u * 1024u + 1024u * 1024u, stats.bytes_cached);
+  EXPECT_EQ(4096u + 512u * 1024u + 1024u * 1024u + huge_size,
+            stats.peak_bytes);
+}
+
+
+TEST(T_CharBufferPool, Recycle) {
+  CharBufferPool pool;
+
+  CharBuffer *buffer = pool.Acquire(1000);
+  unsigned char *memory = buffer->ptr();
+  buffer->SetUsedBytes(100);
+  buffer->SetBaseOffset(42);
+  pool.Release(buffer);
+
+  CharBuffer *recycled = pool.Acquire(2000);
+  EXPECT_EQ(buffer, recycled);
+  EXPECT_EQ(memory, recycled->ptr());
+  EXPECT_EQ(0u, recycled->used_bytes());
+  EXPECT_EQ(0,  recycled->base_offset());
+
+  // different size class
+  CharBuffer *other = pool.Acquire(5000);
+  EXPECT_NE(recycled, other);
+
+  const CharBufferPool::Statistics stats = pool.GetStatistics();
+  EXPECT_EQ(3u, stats.acquisitions);
+  EXPECT_EQ(1u, stats.hits);
+  EXPECT_DOUBLE_EQ(1.0 / 3.0, stats.HitRate());
+
+  pool.Release(recycled);
+  pool.Release(other);
+}
+
+
+TEST(T_CharBufferPool, Clone) {
+  CharBufferPool pool;
+
+  const char *str = "This is a simple test!";
+  const size_t str_length = strlen(str) + 1;
+  CharBuffer *buffer = pool.Acquire(str_length);
+  memcpy(buffer->ptr(), str, str_length);
+  buffer->SetUsedBytes(str_length);
+  buffer->SetBaseOffset(128);
+
+  CharBuffer *clone = pool.Clone(*buffer);
+  EXPECT_NE(buffer->ptr(), clone->ptr());
+  EXPECT_EQ(buffer->size(), clone->size());
+  EXPECT_EQ(str_length, clone->used_bytes());
+  EXPECT_EQ(128, clone->base_offset());
+  EXPECT_EQ(std::string(str),
+            std::string(reinterpret_cast<const char*>(clone->ptr())));
+
+  pool.Release(buffer);
+  pool.Release(clone);
+}
+
+
+TEST(T_CharBufferPool, MemoryLimit) {
+  const uint64_t limit = 1024 * 1024;
+  CharBufferPool pool(limit);
+  EXPECT_EQ(limit, pool.memory_limit());
+
+  std::vector<CharBuffer*> buffers;
+  for (unsigned i = 0; i < 4; ++i) {
+    buffers.push_back(pool.Acquire(256 * 1024));
+    EXPECT_FALSE(pool.IsOverLimit());
+  }
+  buffers.push_back(pool.Acquire(256 * 1024));
+  EXPECT_TRUE(pool.IsOverLimit());
+
+  pool.Release(buffers.back());
+  buffers.pop_back();
+  EXPECT_FALSE(pool.IsOverLimit());
+
+  // cached buffers are dropped as long as the limit is reached
+  CharBufferPool::Statistics stats = pool.GetStatistics();
+  EXPECT_EQ(0u, stats.bytes_cached);
+
+  for (unsigned i = 0; i < buffers.size(); ++i)
+    pool.Release(buffers[i]);
+  stats = pool.GetStatistics();
+  EXPECT_EQ(0u, stats.bytes_in_use);
+  EXPECT_GE(limit, stats.bytes_cached);
+}
+
+
+struct ReleaseArgs {
+  CharBufferPool *pool;
+  CharBuffer     *buffer;
+};
+
+static void *ReleaseLater(void *data) {
+  ReleaseArgs *args = static_cast<ReleaseArgs*>(data);
+  usleep(100000);
+  args->pool->Release(args->buffer);
+  return NULL;
+}
+
+TEST(T_CharBufferPool, WaitForRelease) {
+  CharBufferPool pool(4096);
+
+  ReleaseArgs args;
+  args.pool   = &pool;
+  args.buffer = pool.Acquire(8192);
+  EXPECT_TRUE(pool.IsOverLimit());
+
+  const uint64_t release_count = pool.release_count();
+  pthread_t thread;
+  ASSERT_EQ(0, pthread_create(&thread, NULL, ReleaseLater, &args));
+  pool.WaitForRelease(release_count);
+  EXPECT_FALSE(pool.IsOverLimit());
+  EXPECT_EQ(release_count + 1, pool.release_count());
+  EXPECT_EQ(1u, pool.GetStatistics().memory_waits);
+  pthread_join(thread, NULL);
+}
+
+
+static void *ReleaseNow(void *data) {
+  ReleaseArgs *args = static_cast<ReleaseArgs*>(data);
+  args->pool->Release(args->buffer);
+  return NULL;
+}
+
+TEST(T_CharBufferPool, ReleaseFromOtherThread) {
+  CharBufferPool pool;
+
+  // Released by a thread that does not acquire buffers itself
+  ReleaseArgs args;
+  args.pool   = &pool;
+  args.buffer = pool.Acquire(1000);
+  pthread_t thread;
+  ASSERT_EQ(0, pthread_create(&thread, NULL, ReleaseNow, &args));
+  pthread_join(thread, NULL);
+
+  CharBuffer *recycled = pool.Acquire(1000);
+  EXPECT_EQ(args.buffer, recycled);
+  EXPECT_EQ(1u, pool.GetStatistics().hits);
+  pool.Release(recycled);
+}
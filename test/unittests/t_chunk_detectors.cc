@@ -4,6 +4,8 @@
 
 #include <gtest/gtest.h>
 
+#include <cstring>
+#include <set>
 #include <vector>
 
 #include "../../cvmfs/file_processing/char_buffer.h"
@@ -39,6 +41,96 @@ class T_ChunkDetectors : public ::testing::Test {
     }
   }
 
+  /**
+   * Chunks the given data into buffers of buffer_size bytes.
+   */
+  void CreateBuffers(const std::vector<unsigned char> &data,
+                     const size_t buffer_size)
+  {
+    ClearBuffers();
+    size_t i = 0;
+    while (i < data.size()) {
+      CharBuffer *buffer = new CharBuffer(buffer_size);
+      buffer->SetUsedBytes(std::min(data.size() - i, buffer_size));
+      buffer->SetBaseOffset(i);
+      memcpy(buffer->ptr(), &data[i], buffer->used_bytes());
+      buffers_.push_back(buffer);
+      i += buffer->used_bytes();
+    }
+  }
+
+  void CopyBuffers(std::vector<unsigned char> *data) const {
+    data->clear();
+    Buffers::const_iterator i    = buffers_.begin();
+    Buffers::const_iterator iend = buffers_.end();
+    for (; i != iend; ++i)
+      data->insert(data->end(), (*i)->ptr(), (*i)->ptr() + (*i)->used_bytes());
+  }
+
+  /**
+   * Runs the detector over the current buffers and returns the cut marks.
+   */
+  std::vector<off_t> FindCutMarks(ChunkDetector *detector) const {
+    std::vector<off_t> cut_marks;
+    off_t next_cut;
+    Buffers::const_iterator i    = buffers_.begin();
+    Buffers::const_iterator iend = buffers_.end();
+    for (; i != iend; ++i) {
+      while ((next_cut = detector->FindNextCutMark(*i)) != 0)
+        cut_marks.push_back(next_cut);
+    }
+    return cut_marks;
+  }
+
+  /**
+   * 64bit FNV-1a hashes of the chunk contents defined by the cut marks
+   */
+  static std::vector<uint64_t> HashChunks(
+    const std::vector<unsigned char> &data,
+    const std::vector<off_t> &cut_marks,
+    std::vector<size_t> *sizes)
+  {
+    std::vector<uint64_t> hashes;
+    sizes->clear();
+    size_t begin = 0;
+    for (unsigned i = 0; i <= cut_marks.size(); ++i) {
+      const size_t end = (i < cut_marks.size()) ? cut_marks[i] : data.size();
+      uint64_t hash = 14695981039346656037ULL;
+      for (size_t j = begin; j < end; ++j) {
+        hash ^= data[j];
+        hash *= 1099511628211ULL;
+      }
+      hashes.push_back(hash);
+      sizes->push_back(end - begin);
+      begin = end;
+    }
+    return hashes;
+  }
+
+  /**
+   * Fraction of the bytes in modified that are found in unchanged chunks of
+   * original.
+   */
+  static double DedupRatio(const std::vector<unsigned char> &original,
+                           const std::vector<off_t> &original_cuts,
+                           const std::vector<unsigned char> &modified,
+                           const std::vector<off_t> &modified_cuts)
+  {
+    std::vector<size_t> sizes;
+    const std::vector<uint64_t> original_hashes =
+      HashChunks(original, original_cuts, &sizes);
+    const std::set<uint64_t> known(original_hashes.begin(),
+                                   original_hashes.end());
+    const std::vector<uint64_t> modified_hashes =
+      HashChunks(modified, modified_cuts, &sizes);
+    size_t deduplicated = 0;
+    for (unsigned i = 0; i < modified_hashes.size(); ++i) {
+      if (known.find(modified_hashes[i]) != known.end())
+        deduplicated += sizes[i];
+    }
+    return static_cast<double>(deduplicated) / modified.size();
+  }
+
   virtual void TearDown() {
     ClearBuffers();
   }
@@ -255,4 +347,143 @@ TEST_F(T_ChunkDetectors, Xor32ChunkDetectorSlow) {
   }
 }
 
+
+
+TEST_F(T_ChunkDetectors, GearTable) {
+  // Never change the gear table, it defines the cut marks
+  EXPECT_EQ(0xee7bc9783259a463ULL, GearDetector::gear_table_[0]);
+  EXPECT_EQ(0xced6ebbf4fe84c3cULL, GearDetector::gear_table_[255]);
+
+  // The gear hash only depends on the last 64 bytes
+  Prng prng;
+  prng.InitSeed(42);
+  unsigned char window[GearDetector::gear_influence];
+  for (unsigned i = 0; i < GearDetector::gear_influence; ++i)
+    window[i] = static_cast<unsigned char>(prng.Next(256));
+  uint64_t gear1 = 0;
+  uint64_t gear2 = 0;
+  for (unsigned i = 0; i < 100; ++i) {
+    gear1 = (gear1 << 1) +
+            GearDetector::gear_table_[static_cast<unsigned char>(i)];
+  }
+  for (unsigned i = 0; i < GearDetector::gear_influence; ++i) {
+    gear1 = (gear1 << 1) + GearDetector::gear_table_[window[i]];
+    gear2 = (gear2 << 1) + GearDetector::gear_table_[window[i]];
+  }
+  EXPECT_EQ(gear1, gear2);
+}
+
+
+TEST_F(T_ChunkDetectors, GearChunkDetectorSlow) {
+  const size_t base = 512000;
+  const size_t min_chk_size = base;
+  const size_t avg_chk_size = base * 2;
+  const size_t max_chk_size = base * 4;
+  GearDetector gear_detector(min_chk_size, avg_chk_size, max_chk_size);
+
+  EXPECT_FALSE(gear_detector.MightFindChunks(0));
+  EXPECT_FALSE(gear_detector.MightFindChunks(base));
+  EXPECT_TRUE(gear_detector.MightFindChunks(base + 1));
+
+  // expected cut marks
+  const off_t expected[] = {
+      1032268,   2143118,   2875133,   3589389,   4597413,   5176772,
+      6430654,   7017802,   7645780,   8326082,   9357432,   9954962,
+     11124395,  11883410,  12454999,  13465834,  14492043,  15214682,
+     15865496,  17120643,  17962118,  18915435,  19965470,  21101891,
+     21912036,  22546120,  23197812,  23833810,  24347825,  25180057,
+     25758110,  27040575,  28075388,  28724114,  29708803,  30315565,
+     32257842,  32966366,  33745505,  34840112,  35495352,  36225004,
+     37262800,  37862647,  38439463,  39125642,  40661294,  41441674,
+     42544165,  43264270,  44063325,  45089964,  46154408,  46699412,
+     47808150,  48328742,  49703809,  50780673,  51984730,  52781815,
+     53348635,  54171993,  55283527,  56379162,  57533462,  58152784,
+     58695278,  59800185,  60483563,  61539998,  62259375,  63226630,
+     64442339,  65226394,  65958367,  66638446,  67222652,  67875998,
+     69079890,  69607003,  70979845,  71715442,  72837892,  73769038,
+     74808090,  76135917,  77242313,  78068862,  78640912,  79377647,
+     79919432,  80852113,  82140119,  83315354,  84214340,  85294116,
+     85977671,  86609002,  87650844,  88551061,  89116419,  89718996,
+     90691775,  91263455,  91854520,  92754191,  93972159,  94945009,
+     95555093,  96402976,  97660329,  98804711, 100133203, 100819290,
+    101846972, 102605409, 103638696, 104228105
+  };
+  const unsigned num_expected = sizeof(expected) / sizeof(expected[0]);
+
+  std::vector<size_t> buffer_sizes;
+  buffer_sizes.push_back(102400);    // 100kB
+  buffer_sizes.push_back(base);      // same as minimal chunk size
+  buffer_sizes.push_back(base * 2);  // same as average chunk size
+  buffer_sizes.push_back(10485760);  // 10MB
+
+  for (unsigned i = 0; i < buffer_sizes.size(); ++i) {
+    CreateBuffers(buffer_sizes[i]);
+    GearDetector detector(min_chk_size, avg_chk_size, max_chk_size);
+    const std::vector<off_t> cut_marks = FindCutMarks(&detector);
+    ASSERT_EQ(num_expected, cut_marks.size())
+      << "buffer size " << buffer_sizes[i] << " bytes";
+    off_t last_cut = 0;
+    for (unsigned j = 0; j < num_expected; ++j) {
+      EXPECT_EQ(expected[j], cut_marks[j])
+        << "unexpected cut mark with buffer size " << buffer_sizes[i];
+      EXPECT_LE(min_chk_size, static_cast<size_t>(cut_marks[j] - last_cut));
+      EXPECT_GE(max_chk_size, static_cast<size_t>(cut_marks[j] - last_cut));
+      last_cut = cut_marks[j];
+    }
+  }
+}
+
+
+static ChunkDetector *CreateDetector(const unsigned type, const size_t base) {
+  if (type == 0)
+    return new Xor32Detector(base, base * 2, base * 4);
+  return new GearDetector(base, base * 2, base * 4);
+}
+
+// Most of the data should be deduplicated after a few small insertions and
+// deletions
+TEST_F(T_ChunkDetectors, ChunkDetectorDedupSlow) {
+  const size_t base = 512000;
+  const size_t buffer_size = 1048576;
+  const unsigned kNumEdits = 20;
+
+  CreateBuffers(buffer_size);
+  std::vector<unsigned char> original;
+  CopyBuffers(&original);
+
+  // Insert or delete a few bytes at random positions
+  std::vector<unsigned char> modified(original);
+  Prng prng;
+  prng.InitSeed(7);
+  for (unsigned i = 0; i < kNumEdits; ++i) {
+    const size_t pos = prng.Next(modified.size() - 100);
+    const size_t len = 1 + prng.Next(100);
+    if (i % 2) {
+      modified.erase(modified.begin() + pos, modified.begin() + pos + len);
+    } else {
+      std::vector<unsigned char> insert(len);
+      for (unsigned j = 0; j < len; ++j)
+        insert[j] = static_cast<unsigned char>(prng.Next(256));
+      modified.insert(modified.begin() + pos, insert.begin(), insert.end());
+    }
+  }
+
+  for (unsigned d = 0; d < 2; ++d) {
+    ChunkDetector *detector1 = CreateDetector(d, base);
+    ChunkDetector *detector2 = CreateDetector(d, base);
+
+    CreateBuffers(original, buffer_size);
+    const std::vector<off_t> original_cuts = FindCutMarks(detector1);
+
+    CreateBuffers(modified, buffer_size);
+    const std::vector<off_t> modified_cuts = FindCutMarks(detector2);
+    const double ratio =
+      DedupRatio(original, original_cuts, modified, modified_cuts);
+    EXPECT_GT(ratio, 0.5) << "detector type " << d;
+
+    delete detector1;
+    delete detector2;
+  }
+}
+
 }  // namespace upload
@@ -0,0 +1,208 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "../../cvmfs/file_chunk.h"
+#include "../../cvmfs/shortstring.h"
+#include "../../cvmfs/util.h"
+
+class T_ChunkTables : public ::testing::Test {
+ protected:
+  static const unsigned kNumThreads = 64;
+  static const unsigned kNumInodes = 16;
+  static const unsigned kNumIterations = 20000;
+
+  struct ThreadInfo {
+    ChunkTables *tables;
+    unsigned id;
+  };
+
+  // Mimics cvmfs_open() for a chunked file
+  static uint64_t Open(ChunkTables *tables, const uint64_t inode) {
+    ChunkTables::Shard *inode_shard = tables->Inode2Shard(inode);
+    inode_shard->Lock();
+    if (!inode_shard->inode2chunks.Contains(inode)) {
+      FileChunkList *chunks = new FileChunkList();
+      chunks->PushBack(FileChunk(shash::Any(shash::kSha1), 0, 1024));
+      chunks->PushBack(FileChunk(shash::Any(shash::kSha1), 1024, 1024));
+      inode_shard->inode2chunks.Insert(inode,
+        FileChunkReflist(chunks, PathString("/chunked", 8)));
+      inode_shard->inode2references.Insert(inode, 1);
+    } else {
+      uint32_t refctr;
+      bool retval = inode_shard->inode2references.Lookup(inode, &refctr);
+      assert(retval);
+      inode_shard->inode2references.Insert(inode, refctr + 1);
+    }
+    inode_shard->Unlock();
+
+    const uint64_t handle = tables->NextHandle();
+    ChunkTables::Shard *handle_shard = tables->Handle2Shard(handle);
+    handle_shard->Lock();
+    handle_shard->handle2fd.Insert(handle, ChunkFd());
+    handle_shard->Unlock();
+    return handle;
+  }
+
+  // Mimics the table accesses of cvmfs_read()
+  static bool Read(ChunkTables *tables,
+                   const uint64_t inode,
+                   const uint64_t handle)
+  {
+    FileChunkReflist chunks;
+    ChunkTables::Shard *inode_shard = tables->Inode2Shard(inode);
+    inode_shard->Lock();
+    bool retval = inode_shard->inode2chunks.Lookup(inode, &chunks);
+    inode_shard->Unlock();
+    if (!retval || (chunks.list->size() != 2))
+      return false;
+
+    pthread_mutex_t *handle_lock = tables->Handle2Lock(handle);
+    LockMutex(handle_lock);
+    ChunkFd chunk_fd;
+    ChunkTables::Shard *handle_shard = tables->Handle2Shard(handle);
+    handle_shard->Lock();
+    retval = handle_shard->handle2fd.Lookup(handle, &chunk_fd);
+    handle_shard->Unlock();
+    chunk_fd.chunk_idx = (chunk_fd.chunk_idx + 1) % chunks.list->size();
+    handle_shard->Lock();
+    handle_shard->handle2fd.Insert(handle, chunk_fd);
+    handle_shard->Unlock();
+    UnlockMutex(handle_lock);
+    return retval;
+  }
+
+  // Mimics cvmfs_release()
+  static void Release(ChunkTables *tables,
+                      const uint64_t inode,
+                      const uint64_t handle)
+  {
+    ChunkTables::Shard *handle_shard = tables->Handle2Shard(handle);
+    handle_shard->Lock();
+    handle_shard->handle2fd.Erase(handle);
+    handle_shard->Unlock();
+
+    ChunkTables::Shard *inode_shard = tables->Inode2Shard(inode);
+    inode_shard->Lock();
+    uint32_t refctr;
+    bool retval = inode_shard->inode2references.Lookup(inode, &refctr);
+    assert(retval);
+    refctr--;
+    if (refctr == 0) {
+      FileChunkReflist to_delete;
+      retval = inode_shard->inode2chunks.Lookup(inode, &to_delete);
+      assert(retval);
+      inode_shard->inode2references.Erase(inode);
+      inode_shard->inode2chunks.Erase(inode);
+      delete to_delete.list;
+    } else {
+      inode_shard->inode2references.Insert(inode, refctr);
+    }
+    inode_shard->Unlock();
+  }
+
+  static void *MainOpenReadClose(void *data) {
+    ThreadInfo *info = reinterpret_cast<ThreadInfo *>(data);
+    for (unsigned i = 0; i < kNumIterations; ++i) {
+      const uint64_t inode = 1 + ((info->id + i) % kNumInodes);
+      const uint64_t handle = Open(info->tables, inode);
+      for (unsigned j = 0; j < 4; ++j) {
+        if (!Read(info->tables, inode, handle))
+          return reinterpret_cast<void *>(1);
+      }
+      Release(info->tables, inode, handle);
+    }
+    return NULL;
+  }
+
+  static uint64_t NumInodes(ChunkTables *tables) {
+    uint64_t result = 0;
+    for (unsigned i = 0; i < ChunkTables::kNumShards; ++i) {
+      EXPECT_EQ(tables->shards[i].inode2chunks.size(),
+                tables->shards[i].inode2references.size());
+      result += tables->shards[i].inode2chunks.size();
+    }
+    return result;
+  }
+};
+
+
+TEST_F(T_ChunkTables, Handles) {
+  ChunkTables tables;
+  const uint64_t first = tables.NextHandle();
+  EXPECT_EQ(2U, first);
+  EXPECT_EQ(first + 1, tables.NextHandle());
+  EXPECT_EQ(0U, tables.NumHandles());
+
+  const uint64_t handle = Open(&tables, 42);
+  EXPECT_EQ(1U, tables.NumHandles());
+  EXPECT_EQ(1U, NumInodes(&tables));
+  EXPECT_EQ(tables.Handle2Shard(handle), tables.Handle2Shard(handle));
+  EXPECT_EQ(tables.Inode2Shard(42), tables.Inode2Shard(42));
+
+  const uint64_t handle2 = Open(&tables, 42);
+  EXPECT_NE(handle, handle2);
+  EXPECT_EQ(2U, tables.NumHandles());
+  EXPECT_EQ(1U, NumInodes(&tables));
+
+  Release(&tables, 42, handle);
+  EXPECT_EQ(1U, tables.NumHandles());
+  EXPECT_EQ(1U, NumInodes(&tables));
+  Release(&tables, 42, handle2);
+  EXPECT_EQ(0U, tables.NumHandles());
+  EXPECT_EQ(0U, NumInodes(&tables));
+}
+
+
+TEST_F(T_ChunkTables, Copy) {
+  ChunkTables tables;
+  uint64_t handles[kNumInodes];
+  for (unsigned i = 0; i < kNumInodes; ++i)
+    handles[i] = Open(&tables, i + 1);
+
+  ChunkTables copy(tables);
+  const uint64_t num_inodes = kNumInodes;
+  EXPECT_EQ(num_inodes, copy.NumHandles());
+  EXPECT_EQ(num_inodes, NumInodes(&copy));
+  EXPECT_EQ(tables.NextHandle(), copy.NextHandle());
+  for (unsigned i = 0; i < kNumInodes; ++i) {
+    FileChunkReflist chunks;
+    EXPECT_TRUE(
+      copy.Inode2Shard(i + 1)->inode2chunks.Lookup(i + 1, &chunks));
+    EXPECT_TRUE(copy.Handle2Shard(handles[i])->handle2fd.Contains(handles[i]));
+  }
+
+  // Chunk lists are shared between the copies
+  for (unsigned i = 0; i < kNumInodes; ++i)
+    Release(&tables, i + 1, handles[i]);
+  EXPECT_EQ(0U, tables.NumHandles());
+}
+
+
+TEST_F(T_ChunkTables, ConcurrentOpenReadCloseSlow) {
+  ChunkTables tables;
+  pthread_t threads[kNumThreads];
+  ThreadInfo infos[kNumThreads];
+
+  for (unsigned i = 0; i < kNumThreads; ++i) {
+    infos[i].tables = &tables;
+    infos[i].id = i;
+    int retval = pthread_create(&threads[i], NULL, MainOpenReadClose,
+                                &infos[i]);
+    ASSERT_EQ(0, retval);
+  }
+  for (unsigned i = 0; i < kNumThreads; ++i) {
+    void *result;
+    pthread_join(threads[i], &result);
+    EXPECT_TRUE(result == NULL);
+  }
+
+  EXPECT_EQ(0U, tables.NumHandles());
+  EXPECT_EQ(0U, NumInodes(&tables));
+  EXPECT_EQ(2U + kNumThreads * kNumIterations, tables.NextHandle());
+}
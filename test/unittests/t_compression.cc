@@ -0,0 +1,219 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../../cvmfs/compression.h"
+#include "../../cvmfs/prng.h"
+#include "../../cvmfs/util.h"
+
+using namespace std;  // NOLINT
+
+class T_Compression : public ::testing::TestWithParam<zlib::Algorithms> {
+ protected:
+  virtual void SetUp() {
+    compressor_ = NULL;
+    if (!zlib::IsAlgorithmSupported(GetParam()))
+      return;
+    compressor_ = zlib::Compressor::Construct(GetParam());
+    ASSERT_TRUE(compressor_ != NULL);
+    prng_.InitSeed(42);
+  }
+
+  virtual void TearDown() {
+    delete compressor_;
+  }
+
+  bool Skip() const { return !zlib::IsAlgorithmSupported(GetParam()); }
+
+  /**
+   * Compressible test data: random words from a small vocabulary
+   */
+  vector<unsigned char> CreateData(const size_t size) {
+    const char *words[] = {"cvmfs ", "catalog ", "chunk ", "hash ", "file ",
+                           "directory ", "\n", "0x42 "};
+    vector<unsigned char> data;
+    while (data.size() < size) {
+      const char *word = words[prng_.Next(8)];
+      data.insert(data.end(), word, word + strlen(word));
+    }
+    data.resize(size);
+    return data;
+  }
+
+  /**
+   * Compresses the input in pieces of random size into output buffers of
+   * random size
+   */
+  void Compress(zlib::Compressor *compressor,
+                const unsigned char *data, const size_t size,
+                const bool flush, vector<unsigned char> *result)
+  {
+    size_t pos = 0;
+    do {
+      size_t nbytes = std::min(size - pos, size_t(1 + prng_.Next(100000)));
+      unsigned char *input = const_cast<unsigned char *>(data + pos);
+      const bool last = (pos + nbytes == size);
+      bool done;
+      do {
+        unsigned char buf[8192];
+        unsigned char *output = buf;
+        size_t output_size = 64 + prng_.Next(8192 - 64);
+        const size_t output_space = output_size;
+        done = compressor->Deflate(flush && last, &input, &nbytes,
+                                   &output, &output_size);
+        result->insert(result->end(), buf, buf + output_space - output_size);
+      } while (!done);
+      EXPECT_EQ(0U, nbytes);
+      pos = input - data;
+    } while (pos < size);
+  }
+
+  /**
+   * Decompresses with a StreamDecompressor in pieces of random size,
+   * starting with single bytes
+   */
+  bool Decompress(const vector<unsigned char> &compressed,
+                  vector<unsigned char> *result)
+  {
+    const string path = CreateTempPath("./cvmfs_ut_compression", 0600);
+    FILE *f = fopen(path.c_str(), "w+");
+    EXPECT_TRUE(f != NULL);
+    zlib::StreamDecompressor decompressor;
+    zlib::StreamStates state = zlib::kStreamContinue;
+    size_t pos = 0;
+    while (pos < compressed.size()) {
+      const size_t nbytes = std::min(compressed.size() - pos,
+        (pos < 8) ? size_t(1) : size_t(1 + prng_.Next(10000)));
+      state = decompressor.Inflate2File(&compressed[pos], nbytes, f);
+      if ((state == zlib::kStreamDataError) || (state == zlib::kStreamIOError))
+        break;
+      pos += nbytes;
+    }
+    rewind(f);
+    result->clear();
+    unsigned char buf[4096];
+    size_t have;
+    while ((have = fread(buf, 1, sizeof(buf), f)) > 0)
+      result->insert(result->end(), buf, buf + have);
+    fclose(f);
+    unlink(path.c_str());
+    return state == zlib::kStreamEnd;
+  }
+
+  zlib::Compressor *compressor_;
+  Prng prng_;
+};
+
+
+TEST(T_CompressionAlgorithms, Parse) {
+  zlib::Algorithms algorithm;
+  EXPECT_TRUE(zlib::ParseAlgorithm("zlib", &algorithm));
+  EXPECT_EQ(zlib::kZlibDefault, algorithm);
+  EXPECT_TRUE(zlib::ParseAlgorithm("zstd", &algorithm));
+  EXPECT_EQ(zlib::kZstd, algorithm);
+  EXPECT_FALSE(zlib::ParseAlgorithm("lzma", &algorithm));
+  EXPECT_EQ("zstd", zlib::AlgorithmName(zlib::kZstd));
+  EXPECT_TRUE(zlib::IsAlgorithmSupported(zlib::kZlibDefault));
+
+  const unsigned char zstd_frame[] = {0x28, 0xb5, 0x2f, 0xfd, 0x00};
+  const unsigned char zlib_stream[] = {0x78, 0x9c, 0x03, 0x00};
+  EXPECT_EQ(zlib::kZstd, zlib::DetectAlgorithm(zstd_frame, 5));
+  EXPECT_EQ(zlib::kZlibDefault, zlib::DetectAlgorithm(zstd_frame, 3));
+  EXPECT_EQ(zlib::kZlibDefault, zlib::DetectAlgorithm(zlib_stream, 4));
+}
+
+
+TEST_P(T_Compression, RoundTrip) {
+  if (Skip())
+    return;
+  const vector<unsigned char> data = CreateData(1024 * 1024);
+  vector<unsigned char> compressed;
+  Compress(compressor_, &data[0], data.size(), true, &compressed);
+  EXPECT_LT(compressed.size(), data.size() / 2);
+  EXPECT_EQ(GetParam(),
+            zlib::DetectAlgorithm(&compressed[0], compressed.size()));
+
+  vector<unsigned char> decompressed;
+  EXPECT_TRUE(Decompress(compressed, &decompressed));
+  EXPECT_TRUE(data == decompressed);
+
+  void *buf;
+  uint64_t size;
+  ASSERT_TRUE(zlib::DecompressMem2Mem(&compressed[0], compressed.size(),
+                                      &buf, &size));
+  EXPECT_EQ(data.size(), size);
+  EXPECT_EQ(0, memcmp(&data[0], buf, size));
+  free(buf);
+}
+
+
+TEST_P(T_Compression, Empty) {
+  if (Skip())
+    return;
+  vector<unsigned char> compressed;
+  unsigned char *input = NULL;
+  size_t input_size = 0;
+  unsigned char buf[1024];
+  unsigned char *output = buf;
+  size_t output_size = sizeof(buf);
+  EXPECT_TRUE(compressor_->Deflate(true, &input, &input_size,
+                                   &output, &output_size));
+  compressed.insert(compressed.end(), buf, output);
+  vector<unsigned char> decompressed;
+  EXPECT_TRUE(Decompress(compressed, &decompressed));
+  EXPECT_TRUE(decompressed.empty());
+}
+
+
+// The bulk chunk of a file is forked off from its first chunk
+TEST_P(T_Compression, Clone) {
+  if (Skip())
+    return;
+  const vector<unsigned char> data = CreateData(4 * 1024 * 1024);
+  const size_t fork = 1500000;
+  compressor_->PrepareClone();
+  vector<unsigned char> prefix;
+  Compress(compressor_, &data[0], fork, false, &prefix);
+
+  zlib::Compressor *clone = compressor_->Clone();
+  ASSERT_TRUE(clone != NULL);
+  vector<unsigned char> rest1;
+  vector<unsigned char> rest2;
+  Compress(compressor_, &data[fork], data.size() - fork, true, &rest1);
+  Compress(clone, &data[fork], data.size() - fork, true, &rest2);
+  delete clone;
+  EXPECT_TRUE(rest1 == rest2);
+
+  prefix.insert(prefix.end(), rest2.begin(), rest2.end());
+  vector<unsigned char> decompressed;
+  EXPECT_TRUE(Decompress(prefix, &decompressed));
+  EXPECT_TRUE(data == decompressed);
+}
+
+
+TEST_P(T_Compression, Corrupted) {
+  if (Skip())
+    return;
+  const vector<unsigned char> data = CreateData(100000);
+  vector<unsigned char> compressed;
+  Compress(compressor_, &data[0], data.size(), true, &compressed);
+  for (unsigned i = 16; i < compressed.size(); i += 64)
+    compressed[i] ^= 0x5a;
+  vector<unsigned char> decompressed;
+  EXPECT_FALSE(Decompress(compressed, &decompressed));
+}
+
+
+INSTANTIATE_TEST_CASE_P(CompressionAlgorithms, T_Compression,
+                        ::testing::Values(zlib::kZlibDefault, zlib::kZstd));
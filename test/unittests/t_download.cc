@@ -4,12 +4,21 @@
 
 #include "gtest/gtest.h"
 
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 #include <cstdio>
+#include <cstdlib>
 
+#include "../../cvmfs/atomic.h"
+#include "../../cvmfs/compression.h"
 #include "../../cvmfs/download.h"
+#include "../../cvmfs/prng.h"
 #include "../../cvmfs/util.h"
+#include "../../cvmfs/util_concurrency.h"
 
 using namespace std;  // NOLINT
 
@@ -30,6 +39,32 @@ class T_Download : public ::testing::Test {
     unlink(foo_path.c_str());
   }
 
+  /**
+   * A 1 MB object of half random, half zero bytes that compresses to roughly
+   * 50%.  The body is the zlib compressed object as served by a repository,
+   * the hash is the SHA-1 content hash of the body.
+   */
+  static void MakeCompressedObject(string *object,
+                                   string *body,
+                                   shash::Any *hash)
+  {
+    const unsigned kObjectSize = 1024 * 1024;
+    object->assign(kObjectSize, '\0');
+    Prng prng;
+    prng.InitSeed(42);
+    for (unsigned i = 0; i < kObjectSize; i += 2)
+      (*object)[i] = static_cast<char>(prng.Next(256));
+    void *compressed;
+    uint64_t compressed_size;
+    ASSERT_TRUE(zlib::CompressMem2Mem(object->data(), object->length(),
+                                      &compressed, &compressed_size));
+    body->assign(static_cast<char *>(compressed), compressed_size);
+    free(compressed);
+    *hash = shash::Any(shash::kSha1);
+    shash::HashMem(reinterpret_cast<const unsigned char *>(body->data()),
+                   body->length(), hash);
+  }
+
   DownloadManager download_mgr;
   FILE *ffoo;
   string foo_path;
@@ -37,6 +72,159 @@ class T_Download : public ::testing::Test {
 };
 
 
+/**
+ * Counts the jobs reported by FetchAsync(), possibly from several I/O threads
+ */
+class FetchCollector {
+ public:
+  FetchCollector() {
+    atomic_init32(&num_ok_);
+    atomic_init32(&num_failed_);
+  }
+
+  void OnFetched(JobInfo * const &info) {
+    if (info->error_code == kFailOk)
+      atomic_inc32(&num_ok_);
+    else
+      atomic_inc32(&num_failed_);
+    pending.Decrement();
+  }
+
+  int num_ok() { return atomic_read32(&num_ok_); }
+  int num_failed() { return atomic_read32(&num_failed_); }
+
+  SynchronizingCounter<int> pending;
+
+ private:
+  atomic_int32 num_ok_;
+  atomic_int32 num_failed_;
+};
+
+
+/**
+ * Minimal HTTP/1.1 server on an ephemeral loopback port.  Every request is
+ * answered with the same body over a persistent connection.
+ */
+class LocalHttpServer {
+ public:
+  explicit LocalHttpServer(const string &body)
+    : body_(body), listen_fd_(-1), port_(0)
+  {
+    pthread_mutex_init(&lock_, NULL);
+  }
+
+  ~LocalHttpServer() {
+    pthread_mutex_destroy(&lock_);
+  }
+
+  bool Start() {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd_ < 0)
+      return false;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t addr_len = sizeof(addr);
+    if ((bind(listen_fd_, reinterpret_cast<struct sockaddr *>(&addr),
+              sizeof(addr)) != 0) ||
+        (listen(listen_fd_, 128) != 0) ||
+        (getsockname(listen_fd_, reinterpret_cast<struct sockaddr *>(&addr),
+                     &addr_len) != 0))
+    {
+      close(listen_fd_);
+      return false;
+    }
+    port_ = ntohs(addr.sin_port);
+    return pthread_create(&thread_accept_, NULL, MainAccept, this) == 0;
+  }
+
+  void Stop() {
+    shutdown(listen_fd_, SHUT_RDWR);
+    pthread_join(thread_accept_, NULL);
+    close(listen_fd_);
+    pthread_mutex_lock(&lock_);
+    for (unsigned i = 0; i < connections_.size(); ++i)
+      shutdown(connections_[i], SHUT_RDWR);
+    pthread_mutex_unlock(&lock_);
+    for (unsigned i = 0; i < threads_.size(); ++i)
+      pthread_join(threads_[i], NULL);
+    for (unsigned i = 0; i < connections_.size(); ++i)
+      close(connections_[i]);
+  }
+
+  string url() const { return "http://127.0.0.1:" + StringifyInt(port_); }
+
+ private:
+  struct Connection {
+    LocalHttpServer *server;
+    int fd;
+  };
+
+  static bool WriteAll(const int fd, const char *buf, size_t size) {
+    while (size > 0) {
+      const ssize_t num_bytes = write(fd, buf, size);
+      if (num_bytes <= 0)
+        return false;
+      buf += num_bytes;
+      size -= num_bytes;
+    }
+    return true;
+  }
+
+  static void *MainAccept(void *data) {
+    LocalHttpServer *server = static_cast<LocalHttpServer *>(data);
+    int fd;
+    while ((fd = accept(server->listen_fd_, NULL, NULL)) >= 0) {
+      Connection *connection = new Connection();
+      connection->server = server;
+      connection->fd = fd;
+      pthread_t thread;
+      pthread_create(&thread, NULL, MainConnection, connection);
+      pthread_mutex_lock(&server->lock_);
+      server->connections_.push_back(fd);
+      server->threads_.push_back(thread);
+      pthread_mutex_unlock(&server->lock_);
+    }
+    return NULL;
+  }
+
+  static void *MainConnection(void *data) {
+    Connection *connection = static_cast<Connection *>(data);
+    const string &body = connection->server->body_;
+    const string header = "HTTP/1.1 200 OK\r\n"
+      "Content-Length: " + StringifyInt(body.length()) + "\r\n\r\n";
+    string request;
+    char buf[4096];
+    ssize_t num_bytes;
+    while ((num_bytes = read(connection->fd, buf, sizeof(buf))) > 0) {
+      request.append(buf, num_bytes);
+      size_t end_of_header;
+      while ((end_of_header = request.find("\r\n\r\n")) != string::npos) {
+        request.erase(0, end_of_header + 4);
+        if (!WriteAll(connection->fd, header.data(), header.length()) ||
+            !WriteAll(connection->fd, body.data(), body.length()))
+        {
+          delete connection;
+          return NULL;
+        }
+      }
+    }
+    delete connection;
+    return NULL;
+  }
+
+  string body_;
+  int listen_fd_;
+  int port_;
+  pthread_t thread_accept_;
+  pthread_mutex_t lock_;
+  vector<int> connections_;
+  vector<pthread_t> threads_;
+};
+
+
 //------------------------------------------------------------------------------
 
 
@@ -73,6 +261,360 @@ TEST_F(T_Download, LocalFile2Mem) {
 }
 
 
+TEST_F(T_Download, FetchAsyncSynchronous) {
+  fwrite("abc", 1, 3, ffoo);
+  fflush(ffoo);
+
+  FetchCollector collector;
+  string bad_url = "file:///no/such/file";
+  JobInfo info_ok(&foo_url, false /* compressed */, false /* probe hosts */,
+                  NULL);
+  JobInfo info_bad(&bad_url, false /* compressed */, false /* probe hosts */,
+                   NULL);
+  vector<JobInfo *> infos;
+  infos.push_back(&info_ok);
+  infos.push_back(&info_bad);
+  collector.pending.Increment();
+  collector.pending.Increment();
+
+  // Without Spawn(), jobs are processed before FetchAsync() returns
+  download_mgr.FetchAsync(infos, download_mgr.MakeCallback(
+    &FetchCollector::OnFetched, &collector));
+  EXPECT_EQ(0, collector.pending);
+  EXPECT_EQ(1, collector.num_ok());
+  EXPECT_EQ(1, collector.num_failed());
+  ASSERT_EQ(3U, info_ok.destination_mem.size);
+  EXPECT_EQ("abc", string(info_ok.destination_mem.data, 3));
+  EXPECT_EQ(NULL, info_bad.destination_mem.data);
+  free(info_ok.destination_mem.data);
+}
+
+
+TEST_F(T_Download, FetchAsyncBatch) {
+  fwrite("abc", 1, 3, ffoo);
+  fflush(ffoo);
+  shash::Any foo_hash(shash::kSha1);
+  shash::HashMem(reinterpret_cast<const unsigned char *>("abc"), 3, &foo_hash);
+  download_mgr.Spawn();
+
+  const unsigned kNumJobs = 1000;
+  vector<string> dest_paths;
+  vector<FILE *> dest_files;
+  vector<JobInfo *> infos;
+  for (unsigned i = 0; i < kNumJobs; ++i) {
+    string dest_path;
+    FILE *fdest = CreateTempFile("/tmp/cvmfstest", 0600, "w+", &dest_path);
+    ASSERT_TRUE(fdest != NULL);
+    dest_paths.push_back(dest_path);
+    dest_files.push_back(fdest);
+    infos.push_back(new JobInfo(&foo_url, false /* compressed */,
+                                false /* probe hosts */, fdest, &foo_hash));
+  }
+
+  FetchCollector collector;
+  for (unsigned i = 0; i < kNumJobs; ++i)
+    collector.pending.Increment();
+  download_mgr.FetchAsync(infos, download_mgr.MakeCallback(
+    &FetchCollector::OnFetched, &collector));
+  collector.pending.WaitForZero();
+  EXPECT_EQ(static_cast<int>(kNumJobs), collector.num_ok());
+  EXPECT_EQ(0, collector.num_failed());
+
+  // Blocking fetches still work alongside
+  JobInfo info(&foo_url, false /* compressed */, false /* probe hosts */,
+               &foo_hash);
+  EXPECT_EQ(kFailOk, download_mgr.Fetch(&info));
+  free(info.destination_mem.data);
+
+  for (unsigned i = 0; i < kNumJobs; ++i) {
+    fclose(dest_files[i]);
+    EXPECT_EQ(3, GetFileSize(dest_paths[i]));
+    unlink(dest_paths[i].c_str());
+    delete infos[i];
+  }
+}
+
+
+TEST_F(T_Download, FetchAsyncQueueFull) {
+  fwrite("abc", 1, 3, ffoo);
+  fflush(ffoo);
+  download_mgr.Spawn();
+
+  // Submitting blocks until the I/O thread made room in the job queue
+  const unsigned kNumJobs = 2 * DownloadManager::kJobQueueSize + 1;
+  vector<JobInfo *> infos;
+  FetchCollector collector;
+  for (unsigned i = 0; i < kNumJobs; ++i) {
+    infos.push_back(new JobInfo(&foo_url, false /* compressed */,
+                                false /* probe hosts */, NULL));
+    collector.pending.Increment();
+  }
+  download_mgr.FetchAsync(infos, download_mgr.MakeCallback(
+    &FetchCollector::OnFetched, &collector));
+  collector.pending.WaitForZero();
+  EXPECT_EQ(static_cast<int>(kNumJobs), collector.num_ok());
+
+  for (unsigned i = 0; i < kNumJobs; ++i) {
+    EXPECT_EQ(3U, infos[i]->destination_mem.size);
+    free(infos[i]->destination_mem.data);
+    delete infos[i];
+  }
+}
+
+
+TEST_F(T_Download, FetchAsyncIoThreads) {
+  fwrite("abc", 1, 3, ffoo);
+  fflush(ffoo);
+  download_mgr.SetIoThreads(4, DownloadManager::kShardRoundRobin);
+  EXPECT_EQ(4U, download_mgr.GetNumIoThreads());
+  download_mgr.Spawn();
+
+  const unsigned kNumJobs = 1000;
+  vector<JobInfo *> infos;
+  FetchCollector collector;
+  for (unsigned i = 0; i < kNumJobs; ++i) {
+    infos.push_back(new JobInfo(&foo_url, false /* compressed */,
+                                false /* probe hosts */, NULL));
+    collector.pending.Increment();
+  }
+  download_mgr.FetchAsync(infos, download_mgr.MakeCallback(
+    &FetchCollector::OnFetched, &collector));
+
+  // Blocking fetches are served by the I/O threads alongside
+  for (unsigned i = 0; i < 10; ++i) {
+    JobInfo info(&foo_url, false /* compressed */, false /* probe hosts */,
+                 NULL);
+    EXPECT_EQ(kFailOk, download_mgr.Fetch(&info));
+    free(info.destination_mem.data);
+  }
+
+  collector.pending.WaitForZero();
+  EXPECT_EQ(static_cast<int>(kNumJobs), collector.num_ok());
+  EXPECT_EQ(0, collector.num_failed());
+  for (unsigned i = 0; i < kNumJobs; ++i) {
+    EXPECT_EQ(3U, infos[i]->destination_mem.size);
+    free(infos[i]->destination_mem.data);
+    delete infos[i];
+  }
+  EXPECT_EQ(kNumJobs + 10, download_mgr.GetStatistics().num_requests);
+}
+
+
+TEST_F(T_Download, DataWorkers) {
+  download_mgr.SetDataWorkers(DownloadManager::kMaxDataWorkers + 1);
+  EXPECT_EQ(DownloadManager::kMaxDataWorkers,
+            download_mgr.GetNumDataWorkers());
+  // Small buffer, so that the I/O threads need to wait for the workers
+  download_mgr.SetDataWorkers(3, 64 * 1024);
+  EXPECT_EQ(3U, download_mgr.GetNumDataWorkers());
+  download_mgr.SetIoThreads(2, DownloadManager::kShardRoundRobin);
+  download_mgr.Spawn();
+
+  string object;
+  string body;
+  shash::Any hash;
+  MakeCompressedObject(&object, &body, &hash);
+  string object_path;
+  FILE *fobject = CreateTempFile("/tmp/cvmfstest", 0600, "w", &object_path);
+  ASSERT_TRUE(fobject != NULL);
+  UnlinkGuard unlink_guard(object_path);
+  EXPECT_EQ(body.length(), fwrite(body.data(), 1, body.length(), fobject));
+  fclose(fobject);
+  const string object_url = "file://" + object_path;
+
+  const unsigned kNumJobs = 16;
+  vector<string *> dest_paths;
+  vector<JobInfo *> infos;
+  FetchCollector collector;
+  for (unsigned i = 0; i < kNumJobs; ++i) {
+    dest_paths.push_back(
+      new string(CreateTempPath("/tmp/cvmfstest", 0600)));
+    infos.push_back(new JobInfo(&object_url, true /* compressed */,
+                                false /* probe hosts */, dest_paths[i],
+                                &hash));
+    collector.pending.Increment();
+  }
+  download_mgr.FetchAsync(infos, download_mgr.MakeCallback(
+    &FetchCollector::OnFetched, &collector));
+
+  // Corrupted data and a wrong hash are detected by the workers
+  fwrite("abc", 1, 3, ffoo);
+  fflush(ffoo);
+  string dest_path;
+  FILE *fdest = CreateTempFile("/tmp/cvmfstest", 0600, "w", &dest_path);
+  ASSERT_TRUE(fdest != NULL);
+  UnlinkGuard unlink_guard_dest(dest_path);
+  JobInfo info_corrupted(&foo_url, true /* compressed */,
+                         false /* probe hosts */, fdest, NULL);
+  EXPECT_EQ(kFailBadData, download_mgr.Fetch(&info_corrupted));
+  shash::Any wrong_hash(shash::kSha1);
+  JobInfo info_wrong_hash(&object_url, true /* compressed */,
+                          false /* probe hosts */, fdest, &wrong_hash);
+  EXPECT_EQ(kFailBadData, download_mgr.Fetch(&info_wrong_hash));
+  fclose(fdest);
+
+  collector.pending.WaitForZero();
+  EXPECT_EQ(static_cast<int>(kNumJobs), collector.num_ok());
+  for (unsigned i = 0; i < kNumJobs; ++i) {
+    unsigned char *buffer;
+    unsigned buffer_size;
+    ASSERT_TRUE(CopyPath2Mem(*dest_paths[i], &buffer, &buffer_size));
+    EXPECT_EQ(object, string(reinterpret_cast<char *>(buffer), buffer_size));
+    free(buffer);
+    unlink(dest_paths[i]->c_str());
+    delete dest_paths[i];
+    delete infos[i];
+  }
+}
+
+
+// Transfers are paused instead of blocking the I/O thread while the data
+// workers are behind
+TEST_F(T_Download, DataWorkersPause) {
+  download_mgr.SetDataWorkers(2, 64 * 1024);
+  download_mgr.Spawn();
+
+  string object;
+  string body;
+  shash::Any hash;
+  MakeCompressedObject(&object, &body, &hash);
+  LocalHttpServer server(body);
+  ASSERT_TRUE(server.Start());
+
+  const unsigned kNumJobs = 8;
+  vector<string *> urls;
+  vector<string *> dest_paths;
+  vector<JobInfo *> infos;
+  FetchCollector collector;
+  for (unsigned i = 0; i < kNumJobs; ++i) {
+    urls.push_back(new string(server.url() + "/data/" + StringifyInt(i)));
+    dest_paths.push_back(
+      new string(CreateTempPath("/tmp/cvmfstest", 0600)));
+    infos.push_back(new JobInfo(urls[i], true /* compressed */,
+                                false /* probe hosts */, dest_paths[i],
+                                &hash));
+    collector.pending.Increment();
+  }
+  download_mgr.FetchAsync(infos, download_mgr.MakeCallback(
+    &FetchCollector::OnFetched, &collector));
+  collector.pending.WaitForZero();
+  EXPECT_EQ(static_cast<int>(kNumJobs), collector.num_ok());
+  EXPECT_LT(0U, download_mgr.GetStatistics().num_data_waits);
+
+  for (unsigned i = 0; i < kNumJobs; ++i) {
+    unsigned char *buffer;
+    unsigned buffer_size;
+    ASSERT_TRUE(CopyPath2Mem(*dest_paths[i], &buffer, &buffer_size));
+    EXPECT_EQ(object, string(reinterpret_cast<char *>(buffer), buffer_size));
+    free(buffer);
+    unlink(dest_paths[i]->c_str());
+    delete dest_paths[i];
+    delete urls[i];
+    delete infos[i];
+  }
+  server.Stop();
+}
+
+
+TEST_F(T_Download, SelectIoThread) {
+  download_mgr.SetIoThreads(0, DownloadManager::kShardRoundRobin);
+  EXPECT_EQ(1U, download_mgr.GetNumIoThreads());
+  download_mgr.SetIoThreads(DownloadManager::kMaxIoThreads + 1,
+                            DownloadManager::kShardRoundRobin);
+  EXPECT_EQ(DownloadManager::kMaxIoThreads, download_mgr.GetNumIoThreads());
+
+  string url_a1 = "http://a.example.org/cvmfs/repo/data/1";
+  string url_a2 = "http://a.example.org/cvmfs/repo/data/2";
+  string url_b = "http://b.example.org:8000/cvmfs/repo/data/1";
+  JobInfo info_a1(&url_a1, false /* compressed */, false /* probe hosts */,
+                  NULL);
+  JobInfo info_a2(&url_a2, false /* compressed */, false /* probe hosts */,
+                  NULL);
+  JobInfo info_b(&url_b, false /* compressed */, false /* probe hosts */,
+                 NULL);
+
+  download_mgr.SetIoThreads(4, DownloadManager::kShardRoundRobin);
+  const unsigned first = download_mgr.SelectIoThread(&info_a1);
+  for (unsigned i = 1; i < 8; ++i)
+    EXPECT_EQ((first + i) % 4, download_mgr.SelectIoThread(&info_a1));
+
+  download_mgr.SetIoThreads(4, DownloadManager::kShardByHost);
+  const unsigned thread_a = download_mgr.SelectIoThread(&info_a1);
+  EXPECT_GT(4U, thread_a);
+  EXPECT_EQ(thread_a, download_mgr.SelectIoThread(&info_a1));
+  EXPECT_EQ(thread_a, download_mgr.SelectIoThread(&info_a2));
+  EXPECT_GT(4U, download_mgr.SelectIoThread(&info_b));
+
+  // All jobs go through the same proxy
+  download_mgr.SetProxyChain("http://127.0.0.1:3128", "",
+                             DownloadManager::kSetProxyRegular);
+  const unsigned thread_proxy = download_mgr.SelectIoThread(&info_a1);
+  EXPECT_EQ(thread_proxy, download_mgr.SelectIoThread(&info_b));
+}
+
+
+static void FetchMany(const string &url,
+                      const shash::Any &hash,
+                      const unsigned num_threads,
+                      const unsigned num_workers,
+                      const unsigned num_jobs)
+{
+  DownloadManager download_mgr;
+  download_mgr.Init(64, false /* use_system_proxy */);
+  download_mgr.SetIoThreads(num_threads, DownloadManager::kShardRoundRobin);
+  download_mgr.SetDataWorkers(num_workers);
+  download_mgr.Spawn();
+  FILE *fnull = fopen("/dev/null", "w");
+  assert(fnull != NULL);
+
+  vector<string *> urls;
+  vector<JobInfo *> infos;
+  FetchCollector collector;
+  for (unsigned i = 0; i < num_jobs; ++i) {
+    urls.push_back(new string(url + "/data/" + StringifyInt(i)));
+    infos.push_back(new JobInfo(urls[i], true /* compressed */,
+                                false /* probe hosts */, fnull, &hash));
+    collector.pending.Increment();
+  }
+
+  download_mgr.FetchAsync(infos, download_mgr.MakeCallback(
+    &FetchCollector::OnFetched, &collector));
+  collector.pending.WaitForZero();
+  EXPECT_EQ(static_cast<int>(num_jobs), collector.num_ok())
+    << num_threads << " download thread(s), "
+    << num_workers << " data worker(s)";
+
+  for (unsigned i = 0; i < num_jobs; ++i) {
+    delete infos[i];
+    delete urls[i];
+  }
+  download_mgr.Fini();
+  fclose(fnull);
+}
+
+// Downloads, decompresses, and verifies compressed objects from a local HTTP
+// server with an increasing number of I/O threads, with the data processed
+// either by the I/O threads or by data workers
+TEST_F(T_Download, ManyJobsSlow) {
+  const unsigned kNumJobs = 500;
+  string object;
+  string body;
+  shash::Any hash;
+  MakeCompressedObject(&object, &body, &hash);
+
+  LocalHttpServer server(body);
+  ASSERT_TRUE(server.Start());
+  const unsigned kThreads[] = {1, 2, 4, 8};
+  const unsigned kWorkers[] = {0, 4};
+  for (unsigned i = 0; i < sizeof(kThreads) / sizeof(kThreads[0]); ++i) {
+    for (unsigned j = 0; j < sizeof(kWorkers) / sizeof(kWorkers[0]); ++j) {
+      FetchMany(server.url(), hash, kThreads[i], kWorkers[j], kNumJobs);
+    }
+  }
+  server.Stop();
+}
+
+
 TEST_F(T_Download, StripDirect) {
   string cleaned = "FALSE";
   EXPECT_FALSE(download_mgr.StripDirect("", &cleaned));
@@ -98,6 +640,68 @@ TEST_F(T_Download, StripDirect) {
 }
 
 
+TEST_F(T_Download, GetEndpoint) {
+  EXPECT_EQ("http://proxy:3128",
+            DownloadManager::GetEndpoint("http://proxy:3128",
+                                         "http://host/cvmfs/repo/data"));
+  EXPECT_EQ("http://host:8000",
+            DownloadManager::GetEndpoint("", "http://host:8000/cvmfs/repo"));
+  EXPECT_EQ("https://host", DownloadManager::GetEndpoint("", "https://host"));
+  EXPECT_EQ("host/path", DownloadManager::GetEndpoint("", "host/path"));
+}
+
+
+TEST_F(T_Download, Http2LocalFile) {
+  download_mgr.EnableHttp2();
+  download_mgr.Spawn();
+  fwrite("abc", 1, 3, ffoo);
+  fflush(ffoo);
+
+  JobInfo info(&foo_url, false /* compressed */, false /* probe hosts */,
+               NULL);
+  EXPECT_EQ(kFailOk, download_mgr.Fetch(&info));
+  EXPECT_EQ(3U, info.destination_mem.size);
+  free(info.destination_mem.data);
+
+  // No connections for file:// URLs
+  const Statistics &statistics = download_mgr.GetStatistics();
+  EXPECT_EQ(1U, statistics.num_requests);
+  EXPECT_EQ(0U, statistics.num_connections);
+  EXPECT_EQ(0U, statistics.num_reused_connections);
+  EXPECT_EQ(0U, statistics.num_http1_fallbacks);
+  EXPECT_EQ(1U, statistics.max_concurrent_requests);
+}
+
+
+// The local server only speaks HTTP/1.1: the first request falls back and all
+// requests share a single connection
+TEST_F(T_Download, Http2Fallback) {
+  if (!download_mgr.EnableHttp2())
+    return;
+  download_mgr.Spawn();
+  LocalHttpServer server("abc");
+  ASSERT_TRUE(server.Start());
+  const string url = server.url() + "/data/foo";
+
+  const unsigned kNumRequests = 8;
+  for (unsigned i = 0; i < kNumRequests; ++i) {
+    JobInfo info(&url, false /* compressed */, false /* probe hosts */, NULL);
+    EXPECT_EQ(kFailOk, download_mgr.Fetch(&info));
+    ASSERT_EQ(3U, info.destination_mem.size);
+    EXPECT_EQ("abc", string(info.destination_mem.data, 3));
+    free(info.destination_mem.data);
+  }
+
+  const Statistics &statistics = download_mgr.GetStatistics();
+  EXPECT_EQ(kNumRequests, statistics.num_requests);
+  EXPECT_EQ(1U, statistics.num_http1_fallbacks);
+  EXPECT_EQ(0U, statistics.num_http2_requests);
+  EXPECT_EQ(1U, statistics.num_connections);
+  EXPECT_EQ(kNumRequests - 1, statistics.num_reused_connections);
+  server.Stop();
+}
+
+
 TEST_F(T_Download, ValidateGeoReply) {
   vector<uint64_t> geo_order;
   EXPECT_FALSE(download_mgr.ValidateGeoReply("", geo_order.size(), &geo_order));
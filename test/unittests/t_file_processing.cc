@@ -10,6 +10,7 @@
 #include <string>
 #include <vector>
 
+#include "../../cvmfs/compression.h"
 #include "../../cvmfs/file_processing/char_buffer.h"
 #include "../../cvmfs/file_processing/file_processor.h"
 #include "../../cvmfs/upload_spooler_result.h"
@@ -68,11 +69,14 @@ class FP_MockUploader : public AbstractMockUploader<FP_MockUploader> {
   struct Result {
     Result(MockStreamHandle     *handle,
            const shash::Any     &computed_content_hash,
-           const shash::Suffix   hash_suffix) :
+           const shash::Suffix   hash_suffix,
+           const bool            keep_data) :
       computed_content_hash(computed_content_hash),
       hash_suffix(hash_suffix)
     {
       RecomputeContentHash(handle->data, handle->nbytes);
+      if (keep_data)
+        data.assign(reinterpret_cast<char *>(handle->data), handle->nbytes);
 
       EXPECT_EQ(recomputed_content_hash, computed_content_hash)
         << "returned content hash differs from recomputed content hash";
@@ -100,12 +104,14 @@ class FP_MockUploader : public AbstractMockUploader<FP_MockUploader> {
     shash::Any     computed_content_hash;
     shash::Any     recomputed_content_hash;
     shash::Suffix  hash_suffix;
+    std::string    data;  ///< the uploaded object, only if keep_data is set
   };
   typedef std::vector<Result> Results;
 
  public:
   explicit FP_MockUploader(const upload::SpoolerDefinition &spooler_definition)
     : AbstractMockUploader<FP_MockUploader>(spooler_definition)
+    , keep_data(false)
   {}
 
   const Results& results() const { return results_; }
@@ -136,7 +142,8 @@ class FP_MockUploader : public AbstractMockUploader<FP_MockUploader> {
     assert(local_handle != NULL);
 
     // summarize the results produced by the FileProcessor
-    results_.push_back(Result(local_handle, content_hash, hash_suffix));
+    results_.push_back(Result(local_handle, content_hash, hash_suffix,
+                              keep_data));
 
     // remove the stream handle and fire callback
     const CallbackTN *callback = local_handle->commit_callback;
@@ -144,6 +151,9 @@ class FP_MockUploader : public AbstractMockUploader<FP_MockUploader> {
     Respond(callback, upload::UploaderResults(0));
   }
 
+ public:
+  bool keep_data;
+
  protected:
   Results results_;
 };
@@ -358,6 +368,51 @@ class T_FileProcessing : public FileSandbox {
     CheckHashes(results, reference_hash_strings);
   }
 
+  /**
+   * Processes the big file with the given compression algorithm and checks
+   * that the uploaded chunks and the bulk chunk decompress to the file
+   */
+  void TestCompression(const zlib::Algorithms algorithm) {
+    upload::SpoolerDefinition spooler_definition = MockSpoolerDefinition();
+    spooler_definition.compression_algorithm = algorithm;
+    upload::FileProcessor processor(uploader_, spooler_definition);
+    uploader_->keep_data = true;
+
+    processor.Process(GetBigFile(), true);
+    processor.WaitForProcessing();
+
+    std::string content;
+    FILE *f = fopen(GetBigFile().c_str(), "r");
+    ASSERT_TRUE(f != NULL);
+    char buf[4096];
+    size_t nbytes;
+    while ((nbytes = fread(buf, 1, sizeof(buf), f)) > 0)
+      content.append(buf, nbytes);
+    fclose(f);
+
+    const FP_MockUploader::Results &results = uploader_->results();
+    ASSERT_EQ(GetBigFileChunkHashes().size() + 1, results.size());
+    size_t chunked_size = 0;
+    for (unsigned i = 0; i < results.size(); ++i) {
+      const std::string &data = results[i].data;
+      EXPECT_EQ(algorithm, zlib::DetectAlgorithm(data.data(), data.length()));
+      void *decompressed;
+      uint64_t decompressed_size;
+      ASSERT_TRUE(zlib::DecompressMem2Mem(data.data(), data.length(),
+                                          &decompressed, &decompressed_size));
+      const std::string plain(static_cast<char *>(decompressed),
+                              decompressed_size);
+      free(decompressed);
+      if (results[i].hash_suffix == shash::kSuffixPartial) {
+        EXPECT_NE(std::string::npos, content.find(plain));
+        chunked_size += plain.length();
+      } else {
+        EXPECT_EQ(content, plain);
+      }
+    }
+    EXPECT_EQ(content.length(), chunked_size);
+  }
+
   void CheckHash(const FP_MockUploader::Results &results,
                  const ExpectedHashString    &expected_hash) const {
     ExpectedHashStrings expected_hashes;
@@ -603,3 +658,68 @@ TEST_F(T_FileProcessing, ProcessingCallbackForBigFile) {
   EXPECT_EQ(GetBigFile(),          CallbackTest::result_local_path);
   EXPECT_EQ(number_of_chunks,      CallbackTest::result_chunk_list.size());
 }
+
+
+TEST_F(T_FileProcessing, ProcessFilesAboveBulkChunkThreshold) {
+  upload::SpoolerDefinition spooler_definition = MockSpoolerDefinition();
+  spooler_definition.bulk_chunk_threshold = 1024 * 1024;
+  upload::FileProcessor processor(uploader_, spooler_definition);
+
+  // the small file stays below the threshold, the big file gets chunked
+  processor.Process(GetSmallFile(), true);
+  processor.Process(GetBigFile(), true);
+  processor.WaitForProcessing();
+
+  ExpectedHashStrings hs = GetBigFileChunkHashes();
+  hs.push_back(GetSmallFileBulkHash());
+  CheckHashes(uploader_->results(), hs);
+}
+
+
+TEST_F(T_FileProcessing, ProcessingCallbackForBigFileWithoutBulkChunk) {
+  upload::SpoolerDefinition spooler_definition = MockSpoolerDefinition();
+  spooler_definition.bulk_chunk_threshold = 1024 * 1024;
+  upload::FileProcessor processor(uploader_, spooler_definition);
+  processor.RegisterListener(&CallbackTest::CallbackFn);
+
+  processor.Process(GetBigFile(), true);
+  processor.WaitForProcessing();
+
+  const size_t number_of_chunks = GetBigFileChunkHashes().size();
+  EXPECT_TRUE(CallbackTest::result_content_hash.IsNull());
+  EXPECT_EQ(GetBigFile(),          CallbackTest::result_local_path);
+  EXPECT_EQ(number_of_chunks,      CallbackTest::result_chunk_list.size());
+}
+
+
+TEST_F(T_FileProcessing, ProcessFilesWithMemoryLimit) {
+  // far below what the pipeline would like to keep in flight
+  upload::SpoolerDefinition spooler_definition = MockSpoolerDefinition();
+  spooler_definition.processing_memory_limit = 2 * 1024 * 1024;
+  upload::FileProcessor processor(uploader_, spooler_definition);
+
+  processor.Process(GetSmallFile(), true);
+  processor.Process(GetEmptyFile(), true);
+  processor.Process(GetBigFile(), true);
+  processor.Process(GetBigFile(), false);
+  processor.WaitForProcessing();
+
+  ExpectedHashStrings hs = GetBigFileChunkHashes();
+  hs.push_back(GetBigFileBulkHash());
+  hs.push_back(GetBigFileBulkHash());
+  hs.push_back(GetSmallFileBulkHash());
+  hs.push_back(GetEmptyFileBulkHash());
+  CheckHashes(uploader_->results(), hs);
+}
+
+
+TEST_F(T_FileProcessing, ProcessBigFileWithZlib) {
+  TestCompression(zlib::kZlibDefault);
+}
+
+
+TEST_F(T_FileProcessing, ProcessBigFileWithZstd) {
+  if (!zlib::IsAlgorithmSupported(zlib::kZstd))
+    return;
+  TestCompression(zlib::kZstd);
+}
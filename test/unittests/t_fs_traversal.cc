@@ -13,6 +13,7 @@
 #include <unistd.h>
 
 #include <string>
+#include <vector>
 
 #include "../../cvmfs/fs_traversal.h"
 
@@ -528,6 +529,12 @@ class SteeringTraversalDelegate : public BaseTraversalDelegate {
     }
   }
 
+  bool IgnoreNothing(const std::string &parent_dir,
+                     const std::string &filename)
+  {
+    return false;
+  }
+
 
   void Check() const {
     std::set<std::string> fully_ignored_pathes;
@@ -573,3 +580,129 @@ TEST_F(T_FsTraversal, SteeredTraversal) {
   delegate.Check();
 }
 
+
+
+//
+// # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # #
+//
+
+
+TEST_F(T_FsTraversal, ParallelTraversal) {
+  BaseTraversalDelegate delegate(reference_);
+  FileSystemTraversal<BaseTraversalDelegate> traverse(&delegate,
+                                                       testbed_path_,
+                                                       true);
+  RegisterDelegate(delegate, &traverse);
+  traverse.set_num_threads(4);
+
+  traverse.Recurse(testbed_path_);
+  delegate.Check();
+}
+
+
+TEST_F(T_FsTraversal, ParallelSteeredTraversal) {
+  SteeringTraversalDelegate delegate(reference_);
+  FileSystemTraversal<SteeringTraversalDelegate> traverse(&delegate,
+                                                          testbed_path_,
+                                                          true);
+  RegisterDelegate(delegate, &traverse);
+  traverse.fn_ignore_file = &SteeringTraversalDelegate::IgnoreNothing;
+  traverse.set_num_threads(4);
+
+  traverse.Recurse(testbed_path_);
+  delegate.Check();
+}
+
+
+//
+// # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # #
+//
+
+
+/**
+ * Records the sequence of callbacks
+ */
+class RecordingTraversalDelegate {
+ public:
+  void EnterDir(const std::string &relative_path,
+                const std::string &dir_name) {
+    Record("enter", relative_path, dir_name);
+  }
+  void LeaveDir(const std::string &relative_path,
+                const std::string &dir_name) {
+    Record("leave", relative_path, dir_name);
+  }
+  void File(const std::string &relative_path, const std::string &file_name) {
+    Record("file", relative_path, file_name);
+  }
+  void Symlink(const std::string &relative_path,
+               const std::string &link_name) {
+    Record("symlink", relative_path, link_name);
+  }
+  bool DirPrefix(const std::string &relative_path,
+                 const std::string &dir_name) {
+    Record("prefix", relative_path, dir_name);
+    return dir_name != "c";
+  }
+  void DirPostfix(const std::string &relative_path,
+                  const std::string &dir_name) {
+    Record("postfix", relative_path, dir_name);
+  }
+  // Called concurrently by the scanner threads
+  bool Ignore(const std::string &relative_path, const std::string &name) {
+    return name == "b";
+  }
+
+  std::vector<std::string> events;
+
+ private:
+  void Record(const std::string &what, const std::string &relative_path,
+              const std::string &name) {
+    events.push_back(what + " " + relative_path + " " + name);
+  }
+};
+
+// The callbacks of the parallel traversal arrive in the same order as in the
+// serial traversal
+TEST_F(T_FsTraversal, ParallelTraversalOrder) {
+  RecordingTraversalDelegate serial;
+  FileSystemTraversal<RecordingTraversalDelegate> traverse_serial(
+    &serial, testbed_path_, true);
+  RegisterDelegate(serial, &traverse_serial);
+  traverse_serial.Recurse(testbed_path_);
+  EXPECT_FALSE(serial.events.empty());
+
+  for (unsigned num_threads = 1; num_threads <= 8; num_threads *= 2) {
+    RecordingTraversalDelegate parallel;
+    FileSystemTraversal<RecordingTraversalDelegate> traverse_parallel(
+      &parallel, testbed_path_, true);
+    RegisterDelegate(parallel, &traverse_parallel);
+    traverse_parallel.set_num_threads(num_threads);
+    traverse_parallel.Recurse(testbed_path_);
+    EXPECT_EQ(serial.events, parallel.events) << num_threads << " threads";
+  }
+}
+
+
+TEST_F(T_FsTraversal, ParallelTraversalIgnore) {
+  RecordingTraversalDelegate serial;
+  FileSystemTraversal<RecordingTraversalDelegate> traverse_serial(
+    &serial, testbed_path_, true);
+  RegisterDelegate(serial, &traverse_serial);
+  traverse_serial.fn_ignore_file = &RecordingTraversalDelegate::Ignore;
+  traverse_serial.Recurse(testbed_path_);
+  EXPECT_FALSE(serial.events.empty());
+  for (unsigned i = 0; i < serial.events.size(); ++i)
+    EXPECT_NE(" b", serial.events[i].substr(serial.events[i].length() - 2));
+
+  for (unsigned num_threads = 1; num_threads <= 8; num_threads *= 2) {
+    RecordingTraversalDelegate parallel;
+    FileSystemTraversal<RecordingTraversalDelegate> traverse_parallel(
+      &parallel, testbed_path_, true);
+    RegisterDelegate(parallel, &traverse_parallel);
+    traverse_parallel.fn_ignore_file = &RecordingTraversalDelegate::Ignore;
+    traverse_parallel.set_num_threads(num_threads);
+    traverse_parallel.Recurse(testbed_path_);
+    EXPECT_EQ(serial.events, parallel.events) << num_threads << " threads";
+  }
+}
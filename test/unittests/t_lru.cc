@@ -308,6 +308,32 @@ TEST(T_LruCache, FillCompletely) {
 }
 
 
+TEST(T_LruCache, PopOldest) {
+  LruCache<int, std::string> cache(cache_size, -1, hasher_int);
+  int         k;
+  std::string v;
+  EXPECT_FALSE(cache.PopOldest(&k, &v));
+
+  cache.Insert(1, "eins");
+  cache.Insert(2, "zwei");
+  cache.Insert(3, "drei");
+  EXPECT_TRUE(cache.Lookup(1, &v));
+
+  EXPECT_TRUE(cache.PopOldest(&k, &v));
+  EXPECT_EQ(2, k);
+  EXPECT_EQ("zwei", v);
+  EXPECT_FALSE(cache.Lookup(2, &v));
+  EXPECT_TRUE(cache.PopOldest(&k, &v));
+  EXPECT_EQ(3, k);
+  EXPECT_EQ("drei", v);
+  EXPECT_TRUE(cache.PopOldest(&k, &v));
+  EXPECT_EQ(1, k);
+  EXPECT_EQ("eins", v);
+  EXPECT_FALSE(cache.PopOldest(&k, &v));
+  EXPECT_TRUE(cache.IsEmpty());
+}
+
+
 TEST(T_LruCache, LeastRecentlyUsedReplacementSlow) {
   LruCache<int, std::string> cache(cache_size, -1, hasher_int);
   EXPECT_TRUE(cache.IsEmpty());
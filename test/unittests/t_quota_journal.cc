@@ -0,0 +1,266 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../../cvmfs/hash.h"
+#include "../../cvmfs/quota_journal.h"
+#include "../../cvmfs/util.h"
+
+using namespace std;  // NOLINT
+
+class T_QuotaJournal : public ::testing::Test {
+ protected:
+  static const uint8_t kRegular = 0;
+  static const uint8_t kCatalog = 1;
+
+  virtual void SetUp() {
+    path_ = CreateTempPath("./cvmfs_ut_quota_journal", 0600);
+    ASSERT_FALSE(path_.empty());
+    journal_ = quota::JournalIndex::Open(path_);
+    ASSERT_TRUE(journal_ != NULL);
+  }
+
+  virtual void TearDown() {
+    delete journal_;
+    unlink(path_.c_str());
+    unlink((path_ + ".tmp").c_str());
+  }
+
+  void Reopen() {
+    delete journal_;
+    journal_ = quota::JournalIndex::Open(path_);
+    ASSERT_TRUE(journal_ != NULL);
+  }
+
+  // Uniformly distributed like real content hashes
+  static shash::Any MakeId(const unsigned i) {
+    shash::Any id(shash::kSha1);
+    const string content = StringifyInt(i);
+    shash::HashMem(reinterpret_cast<const unsigned char *>(content.data()),
+                   content.length(), &id);
+    return id;
+  }
+
+  quota::JournalIndex *journal_;
+  string path_;
+};
+
+
+TEST_F(T_QuotaJournal, InsertTouchRemove) {
+  EXPECT_EQ(0U, journal_->size());
+  journal_->Insert(MakeId(1), 100, 1, "/a", kRegular, false);
+  journal_->Insert(MakeId(2), 200, 2, "/b", kRegular, false);
+  journal_->Insert(MakeId(3), 300, 3, "/c", kCatalog, true);
+  EXPECT_EQ(3U, journal_->size());
+  EXPECT_EQ(600U, journal_->total_size());
+  EXPECT_EQ(3U, journal_->max_seq());
+
+  quota::JournalIndex::Entry entry;
+  EXPECT_TRUE(journal_->Lookup(MakeId(2), &entry));
+  EXPECT_EQ(200U, entry.size);
+  EXPECT_EQ(2, entry.seq);
+  EXPECT_FALSE(journal_->Contains(MakeId(4)));
+  EXPECT_FALSE(journal_->Touch(MakeId(4), 4));
+
+  // Replace
+  journal_->Insert(MakeId(2), 250, 4, "/b", kRegular, false);
+  EXPECT_EQ(3U, journal_->size());
+  EXPECT_EQ(650U, journal_->total_size());
+
+  EXPECT_TRUE(journal_->Touch(MakeId(1), 5));
+  EXPECT_TRUE(journal_->Remove(MakeId(3)));
+  EXPECT_FALSE(journal_->Remove(MakeId(3)));
+  EXPECT_EQ(2U, journal_->size());
+  EXPECT_EQ(350U, journal_->total_size());
+  EXPECT_TRUE(journal_->Commit());
+
+  vector<string> paths;
+  journal_->ListByType(kRegular, &paths);
+  ASSERT_EQ(2U, paths.size());
+  EXPECT_EQ("/b", paths[0]);
+  EXPECT_EQ("/a", paths[1]);
+}
+
+
+TEST_F(T_QuotaJournal, Evict) {
+  for (unsigned i = 0; i < 10; ++i)
+    journal_->Insert(MakeId(i), 10, i, "/" + StringifyInt(i), kRegular, false);
+  // Volatile entries go first
+  journal_->Insert(MakeId(10), 10, 10 | quota::JournalIndex::kVolatileFlag,
+                   "/volatile", kRegular, false);
+  EXPECT_TRUE(journal_->Touch(MakeId(0), 11));
+
+  map<shash::Any, uint64_t> keep;
+  keep[MakeId(2)] = 10;
+  vector<shash::Any> evicted;
+  EXPECT_EQ(40U, journal_->Evict(35, keep, &evicted));
+  ASSERT_EQ(4U, evicted.size());
+  EXPECT_EQ(MakeId(10), evicted[0]);
+  EXPECT_EQ(MakeId(1), evicted[1]);
+  EXPECT_EQ(MakeId(3), evicted[2]);
+  EXPECT_EQ(MakeId(4), evicted[3]);
+  EXPECT_TRUE(journal_->Contains(MakeId(2)));
+  EXPECT_TRUE(journal_->Contains(MakeId(0)));
+  EXPECT_EQ(70U, journal_->total_size());
+
+  evicted.clear();
+  EXPECT_EQ(70U, journal_->Evict(1000, map<shash::Any, uint64_t>(), &evicted));
+  EXPECT_EQ(7U, evicted.size());
+  EXPECT_EQ(MakeId(0), evicted[6]);
+  EXPECT_EQ(0U, journal_->size());
+}
+
+
+TEST_F(T_QuotaJournal, SharedSeq) {
+  // Like a rebuild that gives all entries the same sequence number
+  for (unsigned i = 0; i < 10; ++i)
+    journal_->Insert(MakeId(i), 10, 1, "/" + StringifyInt(i), kRegular, false);
+  EXPECT_EQ(10U, journal_->size());
+  EXPECT_TRUE(journal_->Touch(MakeId(0), 2));
+  EXPECT_TRUE(journal_->Remove(MakeId(1)));
+  EXPECT_TRUE(journal_->Checkpoint());
+
+  Reopen();
+  vector<string> paths;
+  journal_->ListByType(kRegular, &paths);
+  EXPECT_EQ(9U, paths.size());
+  vector<shash::Any> evicted;
+  EXPECT_EQ(90U, journal_->Evict(1000, map<shash::Any, uint64_t>(), &evicted));
+  ASSERT_EQ(9U, evicted.size());
+  EXPECT_EQ(MakeId(0), evicted[8]);
+  EXPECT_EQ(0U, journal_->size());
+  EXPECT_EQ(0U, journal_->total_size());
+}
+
+
+TEST_F(T_QuotaJournal, Replay) {
+  journal_->Insert(MakeId(1), 100, 1, "/a", kRegular, false);
+  journal_->Insert(MakeId(2), 200, 2 | quota::JournalIndex::kVolatileFlag,
+                   "/b", kRegular, false);
+  journal_->Insert(MakeId(3), 300, 3, "/c", kCatalog, true);
+  journal_->Insert(MakeId(4), 400, 4, "/d", kRegular, false);
+  EXPECT_TRUE(journal_->Touch(MakeId(1), 5));
+  EXPECT_TRUE(journal_->Touch(MakeId(2), 6));
+  EXPECT_TRUE(journal_->Remove(MakeId(4)));
+  EXPECT_TRUE(journal_->Commit());
+  vector<string> pinned;
+  journal_->ListPinned(&pinned);
+  EXPECT_EQ(1U, pinned.size());
+
+  Reopen();
+  EXPECT_EQ(3U, journal_->size());
+  EXPECT_EQ(600U, journal_->total_size());
+  EXPECT_EQ(6U, journal_->max_seq());
+  quota::JournalIndex::Entry entry;
+  EXPECT_TRUE(journal_->Lookup(MakeId(2), &entry));
+  EXPECT_EQ(static_cast<int64_t>(6 | quota::JournalIndex::kVolatileFlag),
+            entry.seq);
+  EXPECT_TRUE(journal_->Lookup(MakeId(3), &entry));
+  EXPECT_EQ(1U, entry.type);
+  // Pinning is not persistent
+  EXPECT_FALSE(entry.pinned);
+  pinned.clear();
+  journal_->ListPinned(&pinned);
+  EXPECT_TRUE(pinned.empty());
+
+  vector<string> catalogs;
+  journal_->ListByType(kCatalog, &catalogs);
+  ASSERT_EQ(1U, catalogs.size());
+  EXPECT_EQ("/c", catalogs[0]);
+}
+
+
+TEST_F(T_QuotaJournal, TornRecord) {
+  journal_->Insert(MakeId(1), 100, 1, "/a", kRegular, false);
+  journal_->Insert(MakeId(2), 200, 2, "/b", kRegular, false);
+  EXPECT_TRUE(journal_->Commit());
+  delete journal_;
+  journal_ = NULL;
+  const int64_t size = GetFileSize(path_);
+
+  // Crash in the middle of writing the second record
+  EXPECT_EQ(0, truncate(path_.c_str(), size - 1));
+  Reopen();
+  EXPECT_EQ(1U, journal_->size());
+  EXPECT_TRUE(journal_->Contains(MakeId(1)));
+  journal_->Insert(MakeId(3), 300, 3, "/c", kRegular, false);
+  EXPECT_TRUE(journal_->Commit());
+
+  // Garbage at the end
+  Reopen();
+  FILE *f = fopen(path_.c_str(), "a");
+  ASSERT_TRUE(f != NULL);
+  for (unsigned i = 0; i < 200; ++i)
+    fputc('x', f);
+  fclose(f);
+  Reopen();
+  EXPECT_EQ(2U, journal_->size());
+  EXPECT_EQ(400U, journal_->total_size());
+
+  // Unknown format
+  delete journal_;
+  journal_ = NULL;
+  f = fopen(path_.c_str(), "w");
+  ASSERT_TRUE(f != NULL);
+  fputs("no journal", f);
+  fclose(f);
+  Reopen();
+  EXPECT_EQ(0U, journal_->size());
+}
+
+
+TEST_F(T_QuotaJournal, Compaction) {
+  const unsigned kNumEntries = 1000;
+  for (unsigned i = 0; i < kNumEntries; ++i) {
+    journal_->Insert(MakeId(i), 1, i, "/" + StringifyInt(i),
+                     (i % 2) ? kCatalog : kRegular, false);
+  }
+  uint64_t seq = kNumEntries;
+  // Enough touches to trigger compaction
+  for (unsigned round = 0; round < 100; ++round) {
+    for (unsigned i = 0; i < kNumEntries; ++i)
+      EXPECT_TRUE(journal_->Touch(MakeId(i), seq++));
+    EXPECT_TRUE(journal_->Commit());
+  }
+  EXPECT_LT(journal_->num_records(), 100U * kNumEntries);
+  EXPECT_EQ(kNumEntries, journal_->size());
+
+  Reopen();
+  EXPECT_EQ(kNumEntries, journal_->size());
+  EXPECT_EQ(seq - 1, journal_->max_seq());
+  vector<string> paths;
+  journal_->ListByType(kCatalog, &paths);
+  ASSERT_EQ(kNumEntries / 2, paths.size());
+  for (unsigned i = 0; i < paths.size(); ++i)
+    EXPECT_EQ("/" + StringifyInt(2 * i + 1), paths[i]);
+}
+
+
+TEST_F(T_QuotaJournal, CleanupSlow) {
+  const unsigned kNumEntries = 500000;
+  const unsigned kNumEvict = 10000;
+  for (unsigned i = 0; i < kNumEntries; ++i)
+    journal_->Insert(MakeId(i), 1, i, "/some/file/path", kRegular, false);
+  EXPECT_TRUE(journal_->Commit());
+
+  Reopen();
+  EXPECT_EQ(kNumEntries, journal_->size());
+
+  vector<shash::Any> evicted;
+  EXPECT_EQ(kNumEvict, journal_->Evict(kNumEvict, map<shash::Any, uint64_t>(),
+                                       &evicted));
+  EXPECT_EQ(kNumEvict, evicted.size());
+  EXPECT_TRUE(journal_->Commit());
+  Reopen();
+  EXPECT_EQ(kNumEntries - kNumEvict, journal_->size());
+}
@@ -4,7 +4,13 @@
 
 #include <gtest/gtest.h>
 
+#include <alloca.h>
+
+#include <algorithm>
+#include <vector>
+
 #include "../../cvmfs/hash.h"
+#include "../../cvmfs/hash_accel.h"
 #include "../../cvmfs/prng.h"
 
 
@@ -640,3 +646,146 @@ TEST(T_Shash, GreaterThan) {
   EXPECT_EQ(rmd160("980b67db08d3b02d87de6ac05bad34e725fe00f5", 'D'),
             rmd160("980b67db08d3b02d87de6ac05bad34e725fe00f5", 'A'));
 }
+
+
+namespace {
+
+std::vector<unsigned char> RandomBuffer(const unsigned size, Prng *prng) {
+  std::vector<unsigned char> buffer(size + 1);
+  for (unsigned i = 0; i < size; ++i)
+    buffer[i] = prng->Next(256);
+  return buffer;
+}
+
+// Hashes with OpenSSL only
+shash::Any ReferenceHash(const shash::Algorithms algorithm,
+                         const std::vector<unsigned char> &buffer,
+                         const unsigned size)
+{
+  const unsigned features = shash::accel::GetCpuFeatures();
+  shash::accel::SetCpuFeatures(0);
+  shash::Any result(algorithm);
+  shash::HashMem(&buffer[0], size, &result);
+  shash::accel::SetCpuFeatures(features);
+  return result;
+}
+
+// The detected feature set and the fallbacks that are left by masking
+std::vector<unsigned> FeatureSets() {
+  const unsigned detected = shash::accel::DetectCpuFeatures();
+  std::vector<unsigned> result;
+  result.push_back(0);
+  const unsigned candidates[] = {shash::accel::kCpuSse2,
+                                 shash::accel::kCpuAvx2,
+                                 shash::accel::kCpuSha, detected};
+  for (unsigned i = 0; i < 4; ++i) {
+    if ((candidates[i] & detected) == candidates[i])
+      result.push_back(candidates[i]);
+  }
+  return result;
+}
+
+}  // anonymous namespace
+
+
+TEST(T_Shash, Sha1Accelerated) {
+  const std::vector<unsigned> feature_sets = FeatureSets();
+  Prng prng;
+  prng.InitSeed(42);
+  const unsigned sizes[] = {0, 1, 55, 56, 63, 64, 65, 127, 128, 1000, 100000};
+  for (unsigned f = 0; f < feature_sets.size(); ++f) {
+    shash::accel::SetCpuFeatures(feature_sets[f]);
+    EXPECT_EQ(feature_sets[f], shash::accel::GetCpuFeatures());
+
+    shash::Any abc(shash::kSha1);
+    shash::HashMem(reinterpret_cast<const unsigned char *>("abc"), 3, &abc);
+    EXPECT_EQ("a9993e364706816aba3e25717850c26c9cd0d89d", abc.ToString());
+
+    for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+      const std::vector<unsigned char> buffer = RandomBuffer(sizes[i], &prng);
+      const shash::Any expected = ReferenceHash(shash::kSha1, buffer, sizes[i]);
+
+      // Piecewise updates cross the block boundaries at random
+      shash::ContextPtr context(shash::kSha1);
+      context.buffer = alloca(context.size);
+      shash::Init(context);
+      unsigned pos = 0;
+      while (pos < sizes[i]) {
+        const unsigned nbytes = std::min(sizes[i] - pos, prng.Next(200));
+        shash::Update(&buffer[pos], nbytes, context);
+        pos += nbytes;
+      }
+      shash::Any result(shash::kSha1);
+      shash::Final(context, &result);
+      EXPECT_EQ(expected, result) << "features: " <<
+        shash::accel::DescribeCpuFeatures(feature_sets[f]) <<
+        ", size: " << sizes[i];
+    }
+  }
+  shash::accel::SetCpuFeatures(shash::accel::DetectCpuFeatures());
+}
+
+
+TEST(T_Shash, UpdateMulti) {
+  const std::vector<unsigned> feature_sets = FeatureSets();
+  const unsigned kNumStreams = 13;
+  const shash::Algorithms algorithms[] =
+    {shash::kSha1, shash::kSha1, shash::kMd5, shash::kSha1, shash::kRmd160};
+  Prng prng;
+  prng.InitSeed(1337);
+
+  std::vector<std::vector<unsigned char> > buffers;
+  std::vector<shash::Any> expected;
+  for (unsigned i = 0; i < kNumStreams; ++i) {
+    const unsigned size = (i == 0) ? 0 : prng.Next(20000);
+    buffers.push_back(RandomBuffer(size, &prng));
+    expected.push_back(ReferenceHash(algorithms[i % 5], buffers[i], size));
+  }
+
+  for (unsigned f = 0; f < feature_sets.size(); ++f) {
+    shash::accel::SetCpuFeatures(feature_sets[f]);
+
+    std::vector<shash::Any> results;
+    std::vector<const unsigned char *> ptrs;
+    std::vector<unsigned> sizes;
+    for (unsigned i = 0; i < kNumStreams; ++i) {
+      results.push_back(shash::Any(algorithms[i % 5]));
+      ptrs.push_back(&buffers[i][0]);
+      sizes.push_back(buffers[i].size() - 1);
+    }
+    shash::HashMemMulti(&ptrs[0], &sizes[0], kNumStreams, &results[0]);
+    for (unsigned i = 0; i < kNumStreams; ++i)
+      EXPECT_EQ(expected[i], results[i]) << "stream " << i;
+
+    // Several rounds of updates of different size
+    std::vector<shash::ContextPtr> contexts;
+    std::vector<std::vector<unsigned char> > storage(kNumStreams);
+    for (unsigned i = 0; i < kNumStreams; ++i) {
+      contexts.push_back(shash::ContextPtr(algorithms[i % 5]));
+      storage[i].resize(contexts[i].size);
+      contexts[i].buffer = &storage[i][0];
+      shash::Init(contexts[i]);
+      sizes[i] = 0;
+    }
+    std::vector<unsigned> positions(kNumStreams, 0);
+    bool done = false;
+    while (!done) {
+      done = true;
+      for (unsigned i = 0; i < kNumStreams; ++i) {
+        positions[i] += sizes[i];
+        const unsigned left = buffers[i].size() - 1 - positions[i];
+        sizes[i] = std::min(left, prng.Next(5000));
+        ptrs[i] = &buffers[i][positions[i]];
+        done = done && (left == 0);
+      }
+      shash::UpdateMulti(&ptrs[0], &sizes[0], &contexts[0], kNumStreams);
+    }
+    for (unsigned i = 0; i < kNumStreams; ++i) {
+      shash::Any result(algorithms[i % 5]);
+      shash::Final(contexts[i], &result);
+      EXPECT_EQ(expected[i], result) << "stream " << i << ", features: " <<
+        shash::accel::DescribeCpuFeatures(feature_sets[f]);
+    }
+  }
+  shash::accel::SetCpuFeatures(shash::accel::DetectCpuFeatures());
+}
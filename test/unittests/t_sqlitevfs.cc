@@ -0,0 +1,170 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <string>
+
+#include "../../cvmfs/duplex_sqlite3.h"
+#include "../../cvmfs/hash.h"
+#include "../../cvmfs/sqlitevfs.h"
+#include "../../cvmfs/statistics.h"
+#include "../../cvmfs/util.h"
+
+using namespace std;  // NOLINT
+
+class T_SqliteVfs : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    ASSERT_TRUE(sqlite::RegisterVfsRdOnly(&statistics_, sqlite::kVfsOptNone));
+    path_ = CreateTempPath("./cvmfs_ut_sqlitevfs", 0600);
+    ASSERT_FALSE(path_.empty());
+  }
+
+  virtual void TearDown() {
+    EXPECT_TRUE(sqlite::UnregisterVfsRdOnly());
+    unlink(path_.c_str());
+  }
+
+  static void PathMd5(const unsigned i, uint64_t *md5path_1,
+                      uint64_t *md5path_2)
+  {
+    shash::Md5(shash::AsciiPtr("/some/path/" + StringifyInt(i)))
+      .ToIntPair(md5path_1, md5path_2);
+  }
+
+  // Table with the primary key and row size of a file catalog
+  void CreateCatalog(const unsigned num_rows) {
+    sqlite3 *db;
+    ASSERT_EQ(SQLITE_OK, sqlite3_open(path_.c_str(), &db));
+    ASSERT_EQ(SQLITE_OK, sqlite3_exec(db,
+      "CREATE TABLE catalog (md5path_1 INTEGER, md5path_2 INTEGER, "
+      "parent_1 INTEGER, parent_2 INTEGER, hash BLOB, size INTEGER, "
+      "mode INTEGER, mtime INTEGER, flags INTEGER, name TEXT, symlink TEXT, "
+      "CONSTRAINT pk_catalog PRIMARY KEY (md5path_1, md5path_2)); BEGIN;",
+      NULL, NULL, NULL));
+    sqlite3_stmt *stmt;
+    ASSERT_EQ(SQLITE_OK, sqlite3_prepare_v2(db,
+      "INSERT INTO catalog VALUES (:md5_1, :md5_2, 0, 0, :hash, :size, "
+      "33188, 1400000000, 4, :name, '');", -1, &stmt, NULL));
+    for (unsigned i = 0; i < num_rows; ++i) {
+      uint64_t md5path_1, md5path_2;
+      PathMd5(i, &md5path_1, &md5path_2);
+      const string name = "file" + StringifyInt(i);
+      shash::Any hash(shash::kSha1);
+      shash::HashMem(reinterpret_cast<const unsigned char *>(name.data()),
+                     name.length(), &hash);
+      sqlite3_bind_int64(stmt, 1, md5path_1);
+      sqlite3_bind_int64(stmt, 2, md5path_2);
+      sqlite3_bind_blob(stmt, 3, hash.digest, hash.GetDigestSize(),
+                        SQLITE_STATIC);
+      sqlite3_bind_int64(stmt, 4, i);
+      sqlite3_bind_text(stmt, 5, name.data(), name.length(), SQLITE_STATIC);
+      ASSERT_EQ(SQLITE_DONE, sqlite3_step(stmt));
+      sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    ASSERT_EQ(SQLITE_OK, sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL));
+    ASSERT_EQ(SQLITE_OK, sqlite3_close(db));
+  }
+
+  sqlite3 *OpenReadOnly(const uint64_t mmap_size) {
+    sqlite3 *db;
+    int retval = sqlite3_open_v2(path_.c_str(), &db, SQLITE_OPEN_READONLY,
+                                 "cvmfs-readonly");
+    assert(retval == SQLITE_OK);
+    const string pragma = "PRAGMA mmap_size=" + StringifyInt(mmap_size) + ";";
+    retval = sqlite3_exec(db, pragma.c_str(), NULL, NULL, NULL);
+    assert(retval == SQLITE_OK);
+    return db;
+  }
+
+  // Returns the number of found rows
+  unsigned Lookup(sqlite3 *db, const unsigned num_rows,
+                  const unsigned num_lookups)
+  {
+    sqlite3_stmt *stmt;
+    int retval = sqlite3_prepare_v2(db,
+      "SELECT hash, size, name FROM catalog "
+      "WHERE (md5path_1 = :md5_1) AND (md5path_2 = :md5_2);", -1, &stmt, NULL);
+    assert(retval == SQLITE_OK);
+    unsigned num_found = 0;
+    for (unsigned i = 0; i < num_lookups; ++i) {
+      // Stride through the table with a step that is coprime to num_rows
+      const unsigned row = (static_cast<uint64_t>(i) * 7919) % num_rows;
+      uint64_t md5path_1, md5path_2;
+      PathMd5(row, &md5path_1, &md5path_2);
+      sqlite3_bind_int64(stmt, 1, md5path_1);
+      sqlite3_bind_int64(stmt, 2, md5path_2);
+      if ((sqlite3_step(stmt) == SQLITE_ROW) &&
+          (static_cast<unsigned>(sqlite3_column_int64(stmt, 1)) == row))
+      {
+        num_found++;
+      }
+      sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    return num_found;
+  }
+
+  int64_t Counter(const string &name) {
+    return statistics_.Lookup(name)->Get();
+  }
+
+  perf::Statistics statistics_;
+  string path_;
+};
+
+
+TEST_F(T_SqliteVfs, ReadWithoutMmap) {
+  const unsigned kNumRows = 2000;
+  CreateCatalog(kNumRows);
+  sqlite3 *db = OpenReadOnly(0);
+  EXPECT_EQ(kNumRows, Lookup(db, kNumRows, kNumRows));
+  EXPECT_GT(Counter("sqlite.n_read"), 0);
+  EXPECT_EQ(0, Counter("sqlite.n_fetch"));
+  EXPECT_EQ(0, Counter("sqlite.sz_mmap"));
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+}
+
+
+TEST_F(T_SqliteVfs, Mmap) {
+  const unsigned kNumRows = 2000;
+  CreateCatalog(kNumRows);
+  const int64_t file_size = GetFileSize(path_);
+
+  sqlite3 *db = OpenReadOnly(64 * 1024 * 1024);
+  EXPECT_EQ(kNumRows, Lookup(db, kNumRows, kNumRows));
+  EXPECT_GT(Counter("sqlite.n_fetch"), 0);
+  EXPECT_EQ(file_size, Counter("sqlite.sz_mmap"));
+  const int64_t num_reads = Counter("sqlite.n_read");
+  EXPECT_EQ(kNumRows, Lookup(db, kNumRows, kNumRows));
+  EXPECT_EQ(num_reads, Counter("sqlite.n_read"));
+
+  // Disabling drops the mapping
+  EXPECT_EQ(SQLITE_OK,
+            sqlite3_exec(db, "PRAGMA mmap_size=0;", NULL, NULL, NULL));
+  EXPECT_EQ(kNumRows, Lookup(db, kNumRows, kNumRows));
+  EXPECT_EQ(0, Counter("sqlite.sz_mmap"));
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+}
+
+
+TEST_F(T_SqliteVfs, PartialMmap) {
+  const unsigned kNumRows = 2000;
+  CreateCatalog(kNumRows);
+  const int64_t file_size = GetFileSize(path_);
+  ASSERT_GT(file_size, 16 * 1024);
+
+  // Pages beyond the mapping are read
+  sqlite3 *db = OpenReadOnly(16 * 1024);
+  EXPECT_EQ(kNumRows, Lookup(db, kNumRows, kNumRows));
+  EXPECT_GT(Counter("sqlite.n_fetch"), 0);
+  EXPECT_GT(Counter("sqlite.n_read"), 0);
+  EXPECT_EQ(16 * 1024, Counter("sqlite.sz_mmap"));
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(db));
+  EXPECT_EQ(0, Counter("sqlite.sz_mmap"));
+}
@@ -5,8 +5,15 @@
 #include <gtest/gtest.h>
 
 #include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
 #include <unistd.h>
 
+#include <vector>
+
+#include "../../cvmfs/prng.h"
+#include "../../cvmfs/util.h"
 #include "../../cvmfs/util_concurrency.h"
 
 
@@ -398,3 +405,356 @@ TEST(T_UtilConcurrency, MultiThreadedFifoChannel) {
                                          g_insert_cycles * g_cpu_burn_cycles;
   EXPECT_EQ(expected_checksum, checksum);
 }
+
+
+TEST(T_UtilConcurrency, SingleThreadedMpscRing) {
+  MpscRing<int> ring(8);
+  EXPECT_EQ(8U, ring.capacity());
+  int value;
+  EXPECT_FALSE(ring.TryDequeue(&value));
+
+  // Several rounds to wrap around the slots
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < 8; ++i)
+      EXPECT_TRUE(ring.TryEnqueue(round * 10 + i));
+    EXPECT_FALSE(ring.TryEnqueue(-1));
+    for (int i = 0; i < 8; ++i) {
+      EXPECT_TRUE(ring.TryDequeue(&value));
+      EXPECT_EQ(round * 10 + i, value);
+    }
+    EXPECT_FALSE(ring.TryDequeue(&value));
+  }
+
+  EXPECT_TRUE(ring.TryEnqueue(1));
+  EXPECT_TRUE(ring.TryEnqueue(2));
+  EXPECT_TRUE(ring.TryDequeue(&value));
+  EXPECT_EQ(1, value);
+  EXPECT_TRUE(ring.TryEnqueue(3));
+  EXPECT_TRUE(ring.TryDequeue(&value));
+  EXPECT_EQ(2, value);
+  EXPECT_TRUE(ring.TryDequeue(&value));
+  EXPECT_EQ(3, value);
+}
+
+
+const unsigned g_ring_producers = 8;
+const int      g_ring_items     = 200000;
+
+struct ring_producer_data {
+  MpscRing<int> *ring;
+  int            producer_id;
+  int            num_retries;
+};
+
+void* ring_producer(void *data) {
+  ring_producer_data *params = static_cast<ring_producer_data*>(data);
+  for (int i = 0; i < g_ring_items; ++i) {
+    // Items encode the producer in the lower bits
+    const int item = i * g_ring_producers + params->producer_id;
+    while (!params->ring->TryEnqueue(item)) {
+      ++params->num_retries;
+      sched_yield();
+    }
+  }
+  return data;
+}
+
+TEST(T_UtilConcurrency, MultiThreadedMpscRing) {
+  MpscRing<int> ring(1024);
+  pthread_t producer_threads[g_ring_producers];
+  ring_producer_data producer_data[g_ring_producers];
+
+  for (unsigned i = 0; i < g_ring_producers; ++i) {
+    producer_data[i].ring = &ring;
+    producer_data[i].producer_id = i;
+    producer_data[i].num_retries = 0;
+    const int retval = pthread_create(&producer_threads[i], NULL,
+                                      &ring_producer, &producer_data[i]);
+    ASSERT_EQ(0, retval);
+  }
+
+  // Items of every single producer arrive in order
+  int next_item[g_ring_producers];
+  for (unsigned i = 0; i < g_ring_producers; ++i)
+    next_item[i] = 0;
+  const int total_items = g_ring_items * g_ring_producers;
+  int value;
+  for (int num_items = 0; num_items < total_items; ) {
+    if (!ring.TryDequeue(&value)) {
+      sched_yield();
+      continue;
+    }
+    const unsigned producer_id = value % g_ring_producers;
+    ASSERT_EQ(next_item[producer_id], value / g_ring_producers);
+    ++next_item[producer_id];
+    ++num_items;
+  }
+
+  for (unsigned i = 0; i < g_ring_producers; ++i) {
+    const int retval = pthread_join(producer_threads[i], NULL);
+    ASSERT_EQ(0, retval);
+    EXPECT_EQ(g_ring_items, next_item[i]);
+  }
+  EXPECT_FALSE(ring.TryDequeue(&value));
+}
+
+
+//------------------------------------------------------------------------------
+
+
+struct RcuObject {
+  explicit RcuObject(const int v) : value(v), alive(true) { }
+  // Deleted objects are marked dead and their memory is kept until the end of
+  // the test, so that readers can detect a premature release
+  ~RcuObject() { alive = false; }
+  static void operator delete(void *p) { graveyard.push_back(p); }
+  static void FreeGraveyard() {
+    for (unsigned i = 0; i < graveyard.size(); ++i)
+      ::operator delete(graveyard[i]);
+    graveyard.clear();
+  }
+
+  int value;
+  volatile bool alive;
+  static std::vector<void *> graveyard;
+};
+std::vector<void *> RcuObject::graveyard;
+
+struct RcuReaderData {
+  RcuPtr<RcuObject> *rcu;
+  atomic_int32 *stop;
+  unsigned num_reads;
+  unsigned num_dead;
+};
+
+static void *RcuReader(void *data) {
+  RcuReaderData *reader_data = reinterpret_cast<RcuReaderData *>(data);
+  while (atomic_read32(reader_data->stop) == 0) {
+    unsigned ticket;
+    RcuObject *object = reader_data->rcu->Acquire(&ticket);
+    sched_yield();
+    if (!object->alive)
+      reader_data->num_dead++;
+    reader_data->rcu->Release(ticket);
+    reader_data->num_reads++;
+  }
+  return NULL;
+}
+
+TEST(T_UtilConcurrency, RcuPtr) {
+  RcuPtr<RcuObject> rcu(new RcuObject(0));
+  unsigned ticket;
+  EXPECT_EQ(0, rcu.Acquire(&ticket)->value);
+  rcu.Release(ticket);
+
+  const unsigned kNumReaders = 4;
+  atomic_int32 stop;
+  atomic_init32(&stop);
+  pthread_t threads[kNumReaders];
+  RcuReaderData reader_data[kNumReaders];
+  for (unsigned i = 0; i < kNumReaders; ++i) {
+    reader_data[i].rcu = &rcu;
+    reader_data[i].stop = &stop;
+    reader_data[i].num_reads = 0;
+    reader_data[i].num_dead = 0;
+    ASSERT_EQ(0, pthread_create(&threads[i], NULL, RcuReader,
+                                &reader_data[i]));
+  }
+
+  for (int i = 1; i <= 1000; ++i) {
+    RcuObject *previous = rcu.Publish(new RcuObject(i));
+    EXPECT_EQ(i - 1, previous->value);
+    delete previous;
+  }
+  atomic_write32(&stop, 1);
+  for (unsigned i = 0; i < kNumReaders; ++i) {
+    pthread_join(threads[i], NULL);
+    EXPECT_EQ(0U, reader_data[i].num_dead);
+  }
+
+  EXPECT_EQ(1000, rcu.Peek()->value);
+  delete rcu.Peek();
+  RcuObject::FreeGraveyard();
+}
+
+
+TEST(T_UtilConcurrency, RcuPtrReplace) {
+  RcuPtr<RcuObject> rcu(new RcuObject(0));
+  // Without readers, the previous object is freed right away
+  rcu.Replace(new RcuObject(1));
+  EXPECT_EQ(0U, rcu.NumRetired());
+
+  // A reader holds back the object it uses and everything replaced after it
+  unsigned ticket;
+  RcuObject *object = rcu.Acquire(&ticket);
+  rcu.Replace(new RcuObject(2));
+  rcu.Replace(new RcuObject(3));
+  EXPECT_TRUE(object->alive);
+  EXPECT_EQ(2U, rcu.NumRetired());
+  rcu.Release(ticket);
+  rcu.Replace(new RcuObject(4));
+  EXPECT_EQ(0U, rcu.NumRetired());
+
+  const unsigned kNumReaders = 4;
+  atomic_int32 stop;
+  atomic_init32(&stop);
+  pthread_t threads[kNumReaders];
+  RcuReaderData reader_data[kNumReaders];
+  for (unsigned i = 0; i < kNumReaders; ++i) {
+    reader_data[i].rcu = &rcu;
+    reader_data[i].stop = &stop;
+    reader_data[i].num_reads = 0;
+    reader_data[i].num_dead = 0;
+    ASSERT_EQ(0, pthread_create(&threads[i], NULL, RcuReader,
+                                &reader_data[i]));
+  }
+  for (int i = 5; i <= 1000; ++i) {
+    rcu.Replace(new RcuObject(i));
+    sched_yield();
+  }
+  atomic_write32(&stop, 1);
+  for (unsigned i = 0; i < kNumReaders; ++i) {
+    pthread_join(threads[i], NULL);
+    EXPECT_EQ(0U, reader_data[i].num_dead);
+  }
+
+  rcu.Drain();
+  EXPECT_EQ(0U, rcu.NumRetired());
+  EXPECT_EQ(1000U, RcuObject::graveyard.size());
+  EXPECT_EQ(1000, rcu.Peek()->value);
+  delete rcu.Peek();
+  RcuObject::FreeGraveyard();
+}
+
+
+/**
+ * Nodes of a random tree: node i > 0 has a parent with a smaller index
+ */
+struct SchedulerTree {
+  explicit SchedulerTree(const unsigned num_nodes) :
+    nodes(num_nodes), parents(num_nodes, -1), children(num_nodes),
+    done(num_nodes)
+  {
+    Prng prng;
+    prng.InitSeed(42);
+    for (unsigned i = 0; i < num_nodes; ++i) {
+      nodes[i] = i;
+      atomic_init32(&done[i]);
+      if (i > 0) {
+        parents[i] = prng.Next(i);
+        children[parents[i]].push_back(i);
+      }
+    }
+  }
+
+  int *parent(const unsigned i) {
+    return (parents[i] < 0) ? NULL : &nodes[parents[i]];
+  }
+
+  bool ChildrenDone(const int node) {
+    for (unsigned i = 0; i < children[node].size(); ++i) {
+      if (atomic_read32(&done[children[node][i]]) == 0)
+        return false;
+    }
+    return true;
+  }
+
+  std::vector<int> nodes;
+  std::vector<int> parents;
+  std::vector<std::vector<int> > children;
+  std::vector<atomic_int32> done;
+};
+
+
+TEST(T_UtilConcurrency, SingleThreadedBottomUpScheduler) {
+  // 0 -> {1, 2}, 1 -> {3, 4}, 3 -> {5}
+  int nodes[6] = {0, 1, 2, 3, 4, 5};
+  const int parents[6] = {-1, 0, 0, 1, 1, 3};
+  BottomUpScheduler<int> scheduler;
+  // Children before and after their parents
+  scheduler.Add(&nodes[5], &nodes[3]);
+  scheduler.Add(&nodes[3], &nodes[1]);
+  scheduler.Add(&nodes[0], NULL);
+  scheduler.Add(&nodes[1], &nodes[0]);
+  scheduler.Add(&nodes[2], &nodes[0]);
+  scheduler.Add(&nodes[4], &nodes[1]);
+  EXPECT_EQ(3U, scheduler.Start());
+
+  bool done[6] = {false, false, false, false, false, false};
+  std::vector<int> order;
+  int *node;
+  while ((node = scheduler.Next()) != NULL) {
+    for (unsigned i = 0; i < 6; ++i) {
+      if (parents[i] == *node)
+        EXPECT_TRUE(done[i]) << "node " << *node << " before child " << i;
+    }
+    EXPECT_FALSE(done[*node]);
+    done[*node] = true;
+    order.push_back(*node);
+    scheduler.Done(node);
+  }
+  ASSERT_EQ(6U, order.size());
+  EXPECT_EQ(0, order.back());
+  EXPECT_EQ(NULL, scheduler.Next());
+}
+
+
+struct scheduler_worker_data {
+  BottomUpScheduler<int> *scheduler;
+  SchedulerTree *tree;
+  unsigned num_processed;
+  unsigned num_violations;
+};
+
+void *scheduler_worker(void *data) {
+  scheduler_worker_data *params = static_cast<scheduler_worker_data *>(data);
+  int *node;
+  while ((node = params->scheduler->Next()) != NULL) {
+    if (!params->tree->ChildrenDone(*node))
+      ++params->num_violations;
+    // Give other threads the chance to run into a parent too early
+    if (*node % 7 == 0)
+      sched_yield();
+    atomic_inc32(&params->tree->done[*node]);
+    ++params->num_processed;
+    params->scheduler->Done(node);
+  }
+  return data;
+}
+
+TEST(T_UtilConcurrency, MultiThreadedBottomUpScheduler) {
+  const unsigned kNumNodes = 5000;
+  const unsigned kNumThreads = 8;
+  SchedulerTree tree(kNumNodes);
+  BottomUpScheduler<int> scheduler;
+  for (unsigned i = 0; i < kNumNodes; ++i)
+    scheduler.Add(&tree.nodes[i], tree.parent(i));
+  unsigned num_leafs = 0;
+  for (unsigned i = 0; i < kNumNodes; ++i)
+    num_leafs += tree.children[i].empty() ? 1 : 0;
+  EXPECT_EQ(num_leafs, scheduler.Start());
+
+  pthread_t threads[kNumThreads];
+  scheduler_worker_data worker_data[kNumThreads];
+  for (unsigned i = 0; i < kNumThreads; ++i) {
+    worker_data[i].scheduler = &scheduler;
+    worker_data[i].tree = &tree;
+    worker_data[i].num_processed = 0;
+    worker_data[i].num_violations = 0;
+    const int retval = pthread_create(&threads[i], NULL, &scheduler_worker,
+                                      &worker_data[i]);
+    ASSERT_EQ(0, retval);
+  }
+
+  unsigned num_processed = 0;
+  for (unsigned i = 0; i < kNumThreads; ++i) {
+    const int retval = pthread_join(threads[i], NULL);
+    ASSERT_EQ(0, retval);
+    num_processed += worker_data[i].num_processed;
+    EXPECT_EQ(0U, worker_data[i].num_violations);
+  }
+  EXPECT_EQ(kNumNodes, num_processed);
+  for (unsigned i = 0; i < kNumNodes; ++i)
+    EXPECT_EQ(1, atomic_read32(&tree.done[i])) << "node " << i;
+  EXPECT_EQ(NULL, scheduler.Next());
+}